@@ -0,0 +1,81 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <atomic>
+#include <mutex>
+#include <cstddef>
+#include <cstdint>
+#include "constants.h"
+
+namespace lsm
+{
+
+    // Bump allocator for memory that lives and dies together.
+    //
+    // Memory is carved out of large blocks with a compare-and-swap on the block's
+    // offset, so many threads can allocate at once without locking. Nothing is freed
+    // individually; destroying or resetting the arena releases everything at once.
+    class Arena
+    {
+    public:
+        explicit Arena(size_t block_size = constants::ARENA_BLOCK_SIZE);
+        ~Arena();
+
+        // Deleted copy/move constructors and assignment operators
+        Arena(const Arena &) = delete;
+        Arena &operator=(const Arena &) = delete;
+        Arena(Arena &&) = delete;
+        Arena &operator=(Arena &&) = delete;
+
+        // Allocate aligned memory; safe to call from many threads at once
+        void *allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+
+        // Release all allocations, keeping one block for reuse; must not run concurrently with allocate
+        void reset();
+
+        // Get the bytes handed out so far, including alignment padding
+        size_t allocated_bytes() const;
+
+        // Get the bytes reserved from the system for blocks
+        size_t memory_usage() const;
+
+    private:
+        // Header of a block; the block's data follows it
+        struct Block
+        {
+            Block *next;
+            size_t size;
+            std::atomic<size_t> used;
+
+            char *data();
+        };
+
+        // Allocate a block with room for `size` bytes of data
+        Block *new_block(size_t size);
+
+        // Try to carve an allocation out of a block; returns nullptr if it does not fit
+        void *try_allocate(Block *block, size_t bytes, size_t alignment);
+
+        // Start a new block when the current one is exhausted
+        void *allocate_slow(size_t bytes, size_t alignment);
+
+        // Size of regular blocks
+        size_t block_size;
+
+        // Block that allocations are currently carved from
+        std::atomic<Block *> current;
+
+        // All blocks, newest first
+        Block *blocks;
+
+        // Serializes adding blocks
+        std::mutex block_mutex;
+
+        // Statistics
+        std::atomic<size_t> allocated{0};
+        std::atomic<size_t> reserved{0};
+    };
+
+} // namespace lsm
+
+#endif // ARENA_H
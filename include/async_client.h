@@ -0,0 +1,183 @@
+#ifndef ASYNC_CLIENT_H
+#define ASYNC_CLIENT_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <future>
+#include <optional>
+#include <functional>
+#include <exception>
+#include <unordered_map>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+#include "protocol.h"
+#include "constants.h"
+
+namespace lsm
+{
+
+    // Tuning of an AsyncClient
+    struct AsyncClientOptions
+    {
+        // Binary protocol connections opened to the server
+        size_t connections = constants::ASYNC_CLIENT_CONNECTIONS;
+
+        // Most keys coalesced into one MGET
+        size_t max_batch_keys = constants::ASYNC_CLIENT_MAX_BATCH_KEYS;
+
+        // Most coalesced lookups in flight at once; further gets queue up behind them
+        size_t max_batches_in_flight = constants::ASYNC_CLIENT_MAX_BATCHES_IN_FLIGHT;
+
+        // Send puts and deletes with the sync flag, so they complete only once the server
+        // has synced them to its write-ahead log
+        bool sync_writes = false;
+    };
+
+    // Thread-safe, asynchronous client over a pool of binary protocol connections.
+    //
+    // Requests are spread over the connections round-robin and pipelined: each is sent
+    // as soon as it is made and completes when the server's response with its ID
+    // arrives. Every call has a future and a callback form; callbacks run on the
+    // receiving thread of a connection and must not block.
+    //
+    // Concurrent gets are coalesced. A get is sent right away while fewer than
+    // max_batches_in_flight lookups are outstanding; otherwise it waits, and when a
+    // lookup completes all waiting gets (up to max_batch_keys) go out as one MGET. Light
+    // load sees plain GET latency and heavy load gets batches sized to the backlog,
+    // without a timer.
+    //
+    // Each connection decodes responses from one reusable receive buffer into one
+    // reusable response, so replies are not allocated per frame.
+    class AsyncClient
+    {
+    public:
+        using Pairs = std::vector<std::pair<int64_t, int64_t>>;
+
+        // Completion callbacks; `error` is set if the request failed
+        using GetCallback = std::function<void(std::exception_ptr error, std::optional<int64_t> value)>;
+        using WriteCallback = std::function<void(std::exception_ptr error)>;
+        using RangeCallback = std::function<void(std::exception_ptr error, Pairs pairs)>;
+
+        AsyncClient(const std::string &host = constants::DEFAULT_HOST, int port = constants::DEFAULT_PORT,
+                    const AsyncClientOptions &options = {});
+        ~AsyncClient();
+
+        // Deleted copy/move constructors and assignment operators
+        AsyncClient(const AsyncClient &) = delete;
+        AsyncClient &operator=(const AsyncClient &) = delete;
+        AsyncClient(AsyncClient &&) = delete;
+        AsyncClient &operator=(AsyncClient &&) = delete;
+
+        // Open the connections and switch them to the binary protocol; throws on failure
+        void connect();
+
+        // Close every connection; requests still in flight fail
+        void disconnect();
+
+        // Check if any connection is open
+        bool is_connected() const;
+
+        // Look a key up; nullopt if it is absent or deleted
+        std::future<std::optional<int64_t>> get(int64_t key);
+        void get(int64_t key, GetCallback callback);
+
+        // Insert or update a key
+        std::future<void> put(int64_t key, int64_t value);
+        void put(int64_t key, int64_t value, WriteCallback callback);
+
+        // Delete a key
+        std::future<void> remove(int64_t key);
+        void remove(int64_t key, WriteCallback callback);
+
+        // Get every pair in [start_key, end_key)
+        std::future<Pairs> range(int64_t start_key, int64_t end_key);
+        void range(int64_t start_key, int64_t end_key, RangeCallback callback);
+
+        // Number of GET and MGET requests sent for gets so far
+        size_t get_lookup_request_count() const;
+
+    private:
+        // Called with the final response to a request, or with an error and an empty response
+        using Completion = std::function<void(std::exception_ptr error, protocol::Response &response)>;
+
+        // One binary protocol connection and its receiving thread
+        struct Connection
+        {
+            int fd = -1;
+            std::atomic<bool> open{false};
+            std::thread receiver;
+
+            // Write side; frames are encoded into send_buffer, which is kept between sends
+            std::mutex send_mutex;
+            std::string send_buffer;
+            uint64_t next_request_id = 1;
+
+            // Requests waiting for their responses
+            std::mutex pending_mutex;
+            std::unordered_map<uint64_t, Completion> pending;
+
+            // Read side, touched only by the receiver: bytes [receive_begin, receive_end)
+            // of receive_buffer are undecoded
+            std::vector<char> receive_buffer;
+            size_t receive_begin = 0;
+            size_t receive_end = 0;
+            protocol::Response response;
+
+            // Pairs of streamed range responses whose final frame has not arrived yet
+            std::unordered_map<uint64_t, Pairs> partial_pairs;
+        };
+
+        // A get waiting to be sent
+        struct QueuedGet
+        {
+            int64_t key;
+            GetCallback callback;
+        };
+
+        // Open one connection and negotiate the binary protocol
+        void open_connection(Connection &connection);
+
+        // Receive and dispatch responses until the connection closes
+        void receive_responses(Connection &connection);
+
+        // Complete the requests whose frames are in the receive buffer
+        void dispatch_responses(Connection &connection);
+
+        // Fail every pending request of a connection and mark it closed
+        void fail_connection(Connection &connection, const std::string &reason);
+
+        // Send a request on the next open connection; the completion runs exactly once
+        void submit(protocol::Request &request, Completion completion);
+
+        // Take up to max_batch_keys queued gets; batch_mutex held
+        std::vector<QueuedGet> take_batch();
+
+        // Send a batch of gets as one GET or MGET
+        void send_batch(std::vector<QueuedGet> batch);
+
+        // Account for a finished lookup and send the next batch if gets are waiting
+        void finish_batch();
+
+        std::string host;
+        int port;
+        AsyncClientOptions options;
+
+        std::vector<std::unique_ptr<Connection>> connections;
+        std::atomic<size_t> next_connection{0};
+
+        // Coalescing of gets
+        std::mutex batch_mutex;
+        std::deque<QueuedGet> queued_gets;
+        size_t batches_in_flight = 0;
+        std::atomic<size_t> lookup_requests{0};
+    };
+
+} // namespace lsm
+
+#endif // ASYNC_CLIENT_H
@@ -0,0 +1,136 @@
+#ifndef BLOCK_CACHE_H
+#define BLOCK_CACHE_H
+
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include "lsm_tree.h"
+
+namespace lsm
+{
+
+    // Sharded LRU cache of run pages, keyed by (file, page).
+    //
+    // Each shard has its own lock and an equal slice of the capacity, so lookups from
+    // different threads rarely contend. A capacity of zero disables caching.
+    class BlockCache
+    {
+    public:
+        // Decoded pairs of one page: the words of every pair (Traits::RECORD_WORDS each,
+        // the key first; see BlockCodec::decode) and its type
+        struct Block
+        {
+            std::vector<int64_t> words;
+            std::vector<EntryType> types;
+
+            // Number of pairs
+            size_t size() const
+            {
+                return types.size();
+            }
+
+            // Key of the pair at a position
+            template <typename Traits = DefaultTraits>
+            int64_t key(size_t i) const
+            {
+                return words[i * Traits::RECORD_WORDS];
+            }
+
+            // Pair at a position
+            template <typename Traits = DefaultTraits>
+            BasicKeyValuePair<Traits> pair(size_t i) const
+            {
+                const int64_t *record = &words[i * Traits::RECORD_WORDS];
+                return BasicKeyValuePair<Traits>(Traits::key_traits::from_words(record),
+                                                 Traits::value_traits::from_words(record + 1), types[i]);
+            }
+        };
+        using BlockHandle = std::shared_ptr<const Block>;
+
+        // Get the process-wide cache shared by all runs
+        static BlockCache &get_instance();
+
+        BlockCache(size_t capacity_bytes, size_t num_shards);
+
+        // Deleted copy/move constructors and assignment operators
+        BlockCache(const BlockCache &) = delete;
+        BlockCache &operator=(const BlockCache &) = delete;
+        BlockCache(BlockCache &&) = delete;
+        BlockCache &operator=(BlockCache &&) = delete;
+
+        // Look up a page; returns nullptr on a miss
+        BlockHandle lookup(uint64_t file_id, uint64_t page);
+
+        // Insert a page, evicting least recently used pages of the shard if needed
+        void insert(uint64_t file_id, uint64_t page, BlockHandle block);
+
+        // Change the total capacity; shrinking evicts immediately
+        void set_capacity(size_t capacity_bytes);
+
+        // Get the total capacity in bytes
+        size_t capacity() const;
+
+        // Get the bytes currently cached
+        size_t usage() const;
+
+        // Hit/miss statistics
+        size_t get_hit_count() const;
+        size_t get_miss_count() const;
+        void reset_stats();
+
+        // Allocate an ID that identifies a run file in the cache for the life of the process
+        static uint64_t next_file_id();
+
+    private:
+        struct Key
+        {
+            uint64_t file_id;
+            uint64_t page;
+
+            bool operator==(const Key &other) const
+            {
+                return file_id == other.file_id && page == other.page;
+            }
+        };
+
+        struct KeyHash
+        {
+            size_t operator()(const Key &key) const;
+        };
+
+        struct Entry
+        {
+            Key key;
+            BlockHandle block;
+            size_t charge;
+        };
+
+        struct Shard
+        {
+            std::mutex mutex;
+            std::list<Entry> lru; // Most recently used at the front
+            std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index;
+            size_t usage = 0;
+            size_t capacity = 0;
+
+            // Drop least recently used entries until usage fits the capacity
+            void evict();
+        };
+
+        Shard &shard_for(const Key &key);
+
+        std::vector<std::unique_ptr<Shard>> shards;
+        std::atomic<size_t> total_capacity;
+
+        std::atomic<size_t> hit_count{0};
+        std::atomic<size_t> miss_count{0};
+    };
+
+} // namespace lsm
+
+#endif // BLOCK_CACHE_H
@@ -0,0 +1,90 @@
+#ifndef BLOCK_CODEC_H
+#define BLOCK_CODEC_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "lsm_tree.h"
+
+namespace lsm
+{
+
+    // Encoding of one block of a run file.
+    //
+    // A block holds up to RUN_BLOCK_PAIRS pairs as a sequence of 64-bit words:
+    //
+    //   [u32 checksum | u15 count | u1 has deletions | u8 key bits | u8 value bits]
+    //   [first key]
+    //   [value base]
+    //   [key column]      count - 1 gaps between consecutive keys, minus one, bit-packed
+    //   [value column]    count values minus the smallest value, bit-packed
+    //   [deletion column] one bit per pair, set for deletions; only if has deletions
+    //   [padding word]
+    //
+    // Each column uses the fewest bits that fit its largest entry, so dense keys take
+    // no key bits at all. The checksum covers every word of the block. The padding word
+    // lets the decoder always read two adjacent words without bounds checks. Deletions
+    // are stored with a value of zero.
+    //
+    // Keys are widened to 64 bits, so every integer key type shares the key columns.
+    // Values that are not integers (FixedBytes) are stored as they are, VALUE_BYTES each,
+    // in place of the bit-packed column; their value base and value bits are zero.
+    //
+    // A key-only block leaves out the value base and value column (value bits is zero)
+    // and stores just the keys of the same pairs, for work that never looks at values.
+    // It is the same for every traits.
+    class BlockCodecBase
+    {
+    public:
+        // Number of words in the key-only block that starts with this header word
+        static size_t key_block_words(uint64_t header);
+
+        // Decode a key-only block and append its keys to out.
+        // Throws if the block is truncated or fails its checksum.
+        static void decode_keys(const uint64_t *words, size_t word_count, std::vector<int64_t> &out);
+
+        // Checksum of a sequence of words
+        static uint32_t checksum(const uint64_t *words, size_t word_count);
+
+    protected:
+        // Number of header words before the key column
+        static constexpr size_t HEADER_WORDS = 3;
+        static constexpr size_t KEY_HEADER_WORDS = 2;
+
+        // Number of words holding count entries of the given bit width
+        static size_t packed_words(size_t count, unsigned width);
+
+        // Append count entries of the given bit width to out
+        static void pack(const uint64_t *values, size_t count, unsigned width, std::vector<uint64_t> &out);
+
+        // Read count entries of the given bit width; column must be followed by another word
+        static void unpack(const uint64_t *column, size_t count, unsigned width, uint64_t *out);
+    };
+
+    // Block encoding of the pairs of Traits
+    template <typename Traits>
+    class BasicBlockCodec : public BlockCodecBase
+    {
+    public:
+        using Pair = BasicKeyValuePair<Traits>;
+
+        static_assert(Traits::INTEGER_KEYS, "blocks delta-code keys as 64-bit integers");
+
+        // Append the encoding of count pairs (values and deletions) to out
+        static void encode(const Pair *pairs, size_t count, std::vector<uint64_t> &out);
+
+        // Decode a block, appending the Traits::RECORD_WORDS words of each pair (its key,
+        // then its value) to out and its type to types. Throws if the block is truncated
+        // or fails its checksum.
+        static void decode(const uint64_t *words, size_t word_count, std::vector<int64_t> &out,
+                           std::vector<EntryType> &types);
+
+        // Append the key-only encoding of count pairs to out
+        static void encode_keys(const Pair *pairs, size_t count, std::vector<uint64_t> &out);
+    };
+
+    using BlockCodec = BasicBlockCodec<DefaultTraits>;
+
+} // namespace lsm
+
+#endif // BLOCK_CODEC_H
@@ -4,31 +4,66 @@
 #include <vector>
 #include <cstdint>
 #include <string>
+#include <memory>
+#include <iosfwd>
 #include <functional>
 #include <cmath>
+#include <algorithm>
+#include "constants.h"
+#include "key_value_traits.h"
+#include "mapped_file.h"
 
 namespace lsm
 {
 
-    // BloomFilter implementation with variable FPR (False Positive Rate)
+    // Cache-line blocked BloomFilter with variable FPR (False Positive Rate).
+    //
+    // Each key is hashed once; the hash picks one 512-bit block and all probe bits are
+    // set within that block, so a lookup touches a single cache line. The filter is
+    // sized so that the blocked layout still meets the requested FPR.
+    //
+    // A filter loaded from a file maps it rather than reading it, so only the blocks that
+    // lookups touch are ever read from disk. Such a filter is read-only.
     class BloomFilter
     {
     public:
         // Construct a bloom filter with specified false positive rate and expected number of elements
         BloomFilter(double false_positive_rate, size_t expected_elements);
 
-        // Load a bloom filter from file
+        // Load a bloom filter from file; files of the current version are mapped. The
+        // checksum of the blocks is verified, so a torn file is rejected.
         BloomFilter(const std::string &filename);
 
-        // Insert a key into the bloom filter
+        // Use a filter written with write() at an offset of a mapped file, in place. The
+        // checksum is not verified, so no block is read until a lookup needs it.
+        BloomFilter(std::shared_ptr<const MappedFile> file, size_t offset, size_t size, const std::string &name);
+
+        // Deleted copy/move constructors and assignment operators; blocks may point into the
+        // filter's own storage
+        BloomFilter(const BloomFilter &) = delete;
+        BloomFilter &operator=(const BloomFilter &) = delete;
+        BloomFilter(BloomFilter &&) = delete;
+        BloomFilter &operator=(BloomFilter &&) = delete;
+
+        // Read a bloom filter written with write() from a stream; name is used in errors
+        BloomFilter(std::istream &in, const std::string &name);
+
+        // Insert a key into the bloom filter; throws for a mapped filter
         void insert(int64_t key);
 
         // Check if a key might be in the set
         bool might_contain(int64_t key) const;
 
+        // Insert or check a key by its hash, for keys of other traits (Traits::hash)
+        void insert_hash(uint64_t hash);
+        bool might_contain_hash(uint64_t hash) const;
+
         // Save the bloom filter to a file
         void save(const std::string &filename) const;
 
+        // Write the bloom filter to a stream, in the file format
+        void write(std::ostream &out) const;
+
         // Get the number of bits in the filter
         size_t bit_count() const;
 
@@ -39,8 +74,28 @@ namespace lsm
         size_t hash_function_count() const;
 
     private:
-        // The bit array
-        std::vector<bool> bits;
+        // One cache line worth of filter bits
+        struct alignas(64) Block
+        {
+            uint64_t words[constants::BLOOM_BLOCK_BITS / 64];
+        };
+
+        // On-disk header, followed by the raw blocks
+        struct FileHeader
+        {
+            uint64_t magic;
+            uint32_t version;
+            uint32_t num_hash_functions;
+            double fpr;
+            uint64_t expected_num_elements;
+            uint64_t num_blocks;
+        };
+
+        // The bit array: either owned_blocks or the blocks of a mapped file
+        const Block *blocks = nullptr;
+        size_t num_blocks = 0;
+        std::vector<Block> owned_blocks;
+        std::shared_ptr<const MappedFile> mapping;
 
         // Number of hash functions
         size_t num_hash_functions;
@@ -54,11 +109,28 @@ namespace lsm
         // Calculate optimal number of bits and hash functions
         void calculate_parameters();
 
-        // Generate hash for a key and a specific hash function index
-        size_t hash(int64_t key, size_t hash_index) const;
+        // Read the header and blocks from a stream
+        void read(std::istream &in, const std::string &name);
+
+        // Use the filter at an offset of a mapped file, copying the blocks out if they are
+        // not aligned in it; optionally verify the checksum of the blocks
+        void map_section(std::shared_ptr<const MappedFile> file, size_t offset, size_t size, const std::string &name,
+                         bool verify);
+
+        // Checksum of the blocks, stored after the header
+        uint64_t blocks_checksum() const;
+
+        // Check a header and take the filter parameters from it
+        void apply_header(const FileHeader &header, const std::string &name);
 
-        // FNV-1a hash function
-        size_t fnv1a_hash(int64_t key) const;
+        // Point the bit array at owned_blocks
+        void use_owned_blocks();
+
+        // Pick the block for a key's hash
+        size_t block_index(uint64_t hash) const;
+
+        // Build the probe mask of a key's hash within its block
+        void probe_mask(uint64_t hash, Block &mask) const;
     };
 
     // Calculate the optimal number of bits for a bloom filter
@@ -82,6 +154,47 @@ namespace lsm
         return std::pow(1.0 - std::exp(-static_cast<double>(k * n) / static_cast<double>(m)), static_cast<double>(k));
     }
 
+    // Calculate the FPR of a blocked filter. Keys per block follow a Poisson distribution
+    // with mean B*n/m, and a block holding i keys behaves like a B-bit classic filter:
+    // p = sum_i Poisson(i) * (1 - (1 - 1/B)^(k*i))^k
+    inline double expected_blocked_fpr(size_t m, size_t n, size_t k)
+    {
+        const double block_bits = static_cast<double>(constants::BLOOM_BLOCK_BITS);
+        double lambda = block_bits * static_cast<double>(n) / static_cast<double>(m);
+        size_t max_i = static_cast<size_t>(lambda + 10.0 * std::sqrt(lambda) + 10.0);
+
+        double fpr = 0.0;
+        for (size_t i = 0; i <= max_i; ++i)
+        {
+            double log_poisson = -lambda + static_cast<double>(i) * std::log(lambda) - std::lgamma(static_cast<double>(i) + 1.0);
+            double block_fpr = std::pow(1.0 - std::pow(1.0 - 1.0 / block_bits, static_cast<double>(k * i)), static_cast<double>(k));
+            fpr += std::exp(log_poisson) * block_fpr;
+        }
+        return fpr;
+    }
+
+    // Calculate the number of bits a blocked filter needs to reach FPR p.
+    // Starts from the classic optimum and grows by ~2% until the blocked FPR meets the target.
+    // Returns 0 when p >= 1 (no filter needed).
+    inline size_t blocked_optimal_bits(size_t n, double p)
+    {
+        if (n == 0 || p >= 1.0)
+        {
+            return 0;
+        }
+
+        const size_t block_bits = constants::BLOOM_BLOCK_BITS;
+        size_t m = std::max(optimal_bits(n, p), block_bits);
+        m = (m + block_bits - 1) / block_bits * block_bits;
+
+        while (expected_blocked_fpr(m, n, std::max<size_t>(1, optimal_hash_functions(m, n))) > p)
+        {
+            size_t grown = m + std::max(m / 50, block_bits);
+            m = (grown + block_bits - 1) / block_bits * block_bits;
+        }
+        return m;
+    }
+
 } // namespace lsm
 
-#endif // BLOOM_FILTER_H
\ No newline at end of file
+#endif // BLOOM_FILTER_H
@@ -8,6 +8,11 @@
 #include <mutex>
 #include <condition_variable>
 #include <queue>
+#include <future>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "protocol.h"
 
 namespace lsm
 {
@@ -24,8 +29,8 @@ namespace lsm
         Client(Client &&) = delete;
         Client &operator=(Client &&) = delete;
 
-        // Connect to the server
-        bool connect();
+        // Connect to the server, optionally switching to the binary protocol
+        bool connect(bool binary_protocol = false);
 
         // Disconnect from the server
         void disconnect();
@@ -33,6 +38,16 @@ namespace lsm
         // Send a command to the server and return the response
         std::string send_command(const std::string &command);
 
+        // Send a binary request without waiting for its response (binary protocol only)
+        std::future<protocol::Response> send_request_async(protocol::Request request);
+
+        // Send a batch of binary requests in one write; the futures complete as responses
+        // arrive, in whatever order the server answers (binary protocol only)
+        std::vector<std::future<protocol::Response>> send_batch_async(std::vector<protocol::Request> requests);
+
+        // Check if the connection uses the binary protocol
+        bool is_binary() const;
+
         // Check if connected to server
         bool is_connected() const;
 
@@ -43,6 +58,18 @@ namespace lsm
         // Thread for receiving responses from the server
         void receive_responses();
 
+        // Switch an open connection to the binary protocol
+        bool negotiate_binary_protocol();
+
+        // Register requests as pending, assigning their IDs, and send them in one write
+        std::vector<std::future<protocol::Response>> submit_requests(std::vector<protocol::Request> &requests);
+
+        // Complete pending binary requests from the frames in receive_buffer
+        void dispatch_responses();
+
+        // Fail every pending binary request
+        void fail_pending_requests(const std::string &reason);
+
         std::string host;
         int port;
         int client_socket;
@@ -58,6 +85,17 @@ namespace lsm
         std::queue<std::string> response_queue;
         std::mutex queue_mutex;
         std::condition_variable queue_condition;
+
+        // Binary protocol state
+        std::atomic<bool> binary_mode;
+        std::atomic<uint64_t> next_request_id{1};
+        std::unordered_map<uint64_t, std::promise<protocol::Response>> pending_requests;
+        std::mutex pending_mutex;
+        std::mutex send_mutex;
+        std::string receive_buffer;
+
+        // Pairs of streamed range responses whose final frame has not arrived yet
+        std::unordered_map<uint64_t, std::vector<std::pair<int64_t, int64_t>>> partial_pairs;
     };
 
 } // namespace lsm
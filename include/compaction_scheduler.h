@@ -0,0 +1,88 @@
+#ifndef COMPACTION_SCHEDULER_H
+#define COMPACTION_SCHEDULER_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <utility>
+#include <cstddef>
+
+namespace lsm
+{
+
+    // Background scheduler for flush and compaction jobs.
+    //
+    // Every job reserves an inclusive range of levels when it is dispatched. Jobs whose
+    // level ranges are disjoint touch disjoint sets of runs and run concurrently; jobs that
+    // overlap are dispatched in submission order, one at a time.
+    class CompactionScheduler
+    {
+    public:
+        // Inclusive [first, last] range of levels a job reads from or writes to
+        using LevelRange = std::pair<int, int>;
+
+        // Computes the level range of a job right before it is dispatched
+        using ReserveFunction = std::function<LevelRange()>;
+
+        // The job body, given the range that was reserved for it
+        using JobFunction = std::function<void(LevelRange)>;
+
+        explicit CompactionScheduler(size_t num_threads);
+        ~CompactionScheduler();
+
+        // Deleted copy/move constructors and assignment operators
+        CompactionScheduler(const CompactionScheduler &) = delete;
+        CompactionScheduler &operator=(const CompactionScheduler &) = delete;
+        CompactionScheduler(CompactionScheduler &&) = delete;
+        CompactionScheduler &operator=(CompactionScheduler &&) = delete;
+
+        // Queue a job. A non-negative key collapses the job into an already queued
+        // (not yet running) job with the same key. Returns false if the job was collapsed.
+        bool submit(int key, ReserveFunction reserve, JobFunction job);
+
+        // Block until the queue is empty and no job is running
+        void wait_idle();
+
+        // Number of queued plus running jobs
+        size_t pending_jobs() const;
+
+        // Run every worker thread on one CPU core (modulo the core count). Returns false
+        // if any thread could not be pinned.
+        bool pin_to_core(size_t core);
+
+        // Finish all queued jobs and join the worker threads
+        void stop();
+
+    private:
+        struct Job
+        {
+            int key;
+            ReserveFunction reserve;
+            JobFunction run;
+        };
+
+        // Worker thread function
+        void worker_thread();
+
+        // Check whether a range overlaps a range held by a running job
+        bool is_reserved(const LevelRange &range) const;
+
+        std::vector<std::thread> workers;
+        std::deque<Job> jobs;
+
+        // Level ranges held by running jobs
+        std::vector<LevelRange> active_ranges;
+
+        // Synchronization
+        mutable std::mutex scheduler_mutex;
+        std::condition_variable work_condition;
+        std::condition_variable idle_condition;
+        bool stopping;
+    };
+
+} // namespace lsm
+
+#endif // COMPACTION_SCHEDULER_H
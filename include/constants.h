@@ -20,26 +20,159 @@ namespace lsm
         constexpr size_t DEFAULT_BUFFER_SIZE_BYTES = 4 * 1024 * 1024; // 4MB
         inline std::atomic<size_t> BUFFER_SIZE_BYTES = DEFAULT_BUFFER_SIZE_BYTES;
 
-        constexpr size_t SIZE_RATIO = 4;
+        // Size ratio between adjacent levels; change it with LSMTree::set_size_ratio
+        constexpr size_t DEFAULT_SIZE_RATIO = 4;
+        inline std::atomic<size_t> SIZE_RATIO = DEFAULT_SIZE_RATIO;
         constexpr int INITIAL_MAX_LEVEL = 6;
 
-        // Compaction parameters
-        constexpr int TIERING_THRESHOLD = 4;       // Level 1: Trigger after 4 runs
-        constexpr int LAZY_LEVELING_THRESHOLD = 3; // Levels 2-4: Trigger after 3 runs
+        // Compaction parameters; change them with LSMTree::set_compaction_thresholds
+        inline std::atomic<size_t> TIERING_THRESHOLD = 4;       // Level 1: Trigger after 4 runs
+        inline std::atomic<size_t> LAZY_LEVELING_THRESHOLD = 3; // Levels 2-4: Trigger after 3 runs
+
+        // LEVELING levels are split into runs of about TARGET_RUN_BYTES (uncompressed) with
+        // disjoint key ranges. A level over its capacity moves one run at a time into the
+        // next, rewriting only the runs there that it overlaps.
+        inline std::atomic<size_t> TARGET_RUN_BYTES = 2 * DEFAULT_BUFFER_SIZE_BYTES;
+
+        // Self-tuning: every AUTO_TUNING_INTERVAL_FLUSHES flushes, pick each level's strategy
+        // and bloom filter FPR from the reads and writes seen since the last pass
+        inline std::atomic<bool> AUTO_TUNING_ENABLED = false;
+        constexpr size_t AUTO_TUNING_INTERVAL_FLUSHES = 8;
+        constexpr size_t AUTO_TUNING_MIN_OPERATIONS = 1000; // Fewer operations leave the tuning as it is
 
         // Compaction control flag
         inline std::atomic<bool> COMPACTION_ENABLED = true;
 
+        // Background flush/compaction threads
+        constexpr size_t BACKGROUND_THREAD_COUNT = 2;
+
+        // Write backpressure: immutable buffers waiting to be flushed before puts are
+        // slowed down, and before puts block until a flush completes
+        inline std::atomic<size_t> WRITE_SLOWDOWN_THRESHOLD = 4;
+        inline std::atomic<size_t> WRITE_STOP_THRESHOLD = 8;
+        constexpr int WRITE_SLOWDOWN_DELAY_US = 1000; // Delay per put while slowed down
+
         // File and directory paths
         inline const std::string DATA_DIRECTORY = "data";
         inline const std::string RUN_FILENAME_PREFIX = "run_";
+        inline const std::string WAL_FILENAME_PREFIX = "wal_";
+
+        // Manifest ("LSMMANIF"): the runs of every level with their counts and key bounds,
+        // replaced atomically whenever the set of runs changes, so startup needs no directory
+        // scan and opens run files only when they are first read
+        inline const std::string MANIFEST_FILENAME = "MANIFEST";
+        constexpr uint64_t MANIFEST_FILE_MAGIC = 0x46494E414D4D534CULL;
+        constexpr uint32_t MANIFEST_FILE_VERSION = 1;
+
+        // Write-ahead log: asynchronous writes are made durable at least this often
+        constexpr int WAL_SYNC_INTERVAL_MS = 10;
+
+        // On-disk format tag for write-ahead log segments ("LSMWAL02"); records carry their
+        // entry type. Segments of the first format ("LSMWAL01") are still replayed.
+        constexpr uint64_t WAL_FILE_MAGIC = 0x32304C41574D534CULL;
+        constexpr uint64_t WAL_FILE_LEGACY_MAGIC = 0x31304C41574D534CULL;
 
         // Bloom filter and fence pointer settings
         constexpr double TOTAL_FPR = 1.0;  // Expected total false positives
         constexpr size_t PAGE_SIZE = 4096; // 4KB pages for fence pointers
 
+        // On-disk format tag for fence pointer files ("LSMFENCE"). Version 3 stores the
+        // in-memory layout so the file can be mapped; version 2 files (page keys) are read in.
+        constexpr uint64_t FENCE_FILE_MAGIC = 0x45434E45464D534CULL;
+        constexpr uint32_t FENCE_FILE_VERSION = 3;
+        constexpr uint32_t FENCE_FILE_PAGE_KEYS_VERSION = 2;
+
+        // Run data files are a sequence of compressed blocks, one per fence pointer page,
+        // followed by a block offset index and a footer ("LSMRUN01"). Version 2 and later blocks mark
+        // deletions with a flag; version 1 files (INT64_MIN values) are still readable.
+        constexpr size_t RUN_BLOCK_PAIRS = PAGE_SIZE / (2 * sizeof(int64_t));
+        constexpr uint64_t RUN_FILE_MAGIC = 0x31304E55524D534CULL;
+        // Version 3 files also hold the bloom filter, fence pointers, range filter, range
+        // tombstones and key-only blocks in sections after the index, each starting on a
+        // cache line; version 2 files keep their metadata in sidecars.
+        constexpr uint32_t RUN_FILE_VERSION = 3;
+        constexpr uint32_t RUN_FILE_SIDECAR_VERSION = 2;
+        constexpr uint32_t RUN_FILE_LEGACY_TOMBSTONE_VERSION = 1;
+        constexpr size_t RUN_FILE_SECTION_ALIGNMENT = 64;
+
+        // Run files are written RUN_WRITE_BUFFER_BYTES at a time from a buffer aligned for
+        // O_DIRECT, which RUN_WRITE_DIRECT_IO turns on. Compaction and bulk load output is
+        // dropped from the page cache once synced if RUN_WRITE_DROP_CACHE is set, and
+        // compactions write at most COMPACTION_WRITE_BYTES_PER_SECOND (0: no limit).
+        constexpr size_t RUN_WRITE_BUFFER_BYTES = 1024 * 1024; // 1MB
+        constexpr size_t RUN_WRITE_ALIGNMENT = 4096;
+        inline std::atomic<bool> RUN_WRITE_DIRECT_IO = false;
+        inline std::atomic<bool> RUN_WRITE_DROP_CACHE = true;
+        inline std::atomic<size_t> COMPACTION_WRITE_BYTES_PER_SECOND = 0;
+        constexpr int RATE_LIMITER_BURST_MS = 100;
+
+        // On-disk format tag for the range tombstone sidecar of a run ("LSMTOMB1")
+        constexpr uint64_t TOMBSTONE_FILE_MAGIC = 0x31424D4F544D534CULL;
+        constexpr uint32_t TOMBSTONE_FILE_VERSION = 1;
+
+        // Range filter sidecar of a run (".range", "LSMRANGE"): the run's key span and a bloom
+        // filter over key >> RANGE_FILTER_PREFIX_BITS, so range queries skip runs they miss.
+        // Set the prefix width with LSMTree::set_range_filter_prefix_bits; 0 keeps the span only.
+        constexpr uint64_t RANGE_FILTER_FILE_MAGIC = 0x45474E41524D534CULL;
+        constexpr uint32_t RANGE_FILTER_FILE_VERSION = 1;
+        inline std::atomic<size_t> RANGE_FILTER_PREFIX_BITS = 8;
+        constexpr double RANGE_FILTER_FPR = 0.01;
+        constexpr size_t RANGE_FILTER_MAX_PROBES = 16;        // Wider queries use the span only
+        constexpr size_t RANGE_FILTER_MAX_PREFIXES = 1 << 20; // Runs with more prefixes keep the span only
+
+        // Shared block cache for run pages
+        inline std::atomic<size_t> BLOCK_CACHE_SIZE_BYTES = 64 * 1024 * 1024; // 64MB
+        constexpr size_t BLOCK_CACHE_SHARDS = 16;
+
+        // Row cache of point lookup results, per tree (each shard of a sharded tree has
+        // its own); 0 entries disables it. W-TinyLFU: ROW_CACHE_WINDOW_PERCENT of the
+        // entries form the admission window, ROW_CACHE_PROTECTED_PERCENT of the rest the
+        // protected segment, and access counts halve every RESET_MULTIPLIER * capacity accesses.
+        inline std::atomic<size_t> ROW_CACHE_ENTRIES = 0;
+        constexpr size_t ROW_CACHE_SHARDS = 16;
+        constexpr size_t ROW_CACHE_WINDOW_PERCENT = 1;
+        constexpr size_t ROW_CACHE_PROTECTED_PERCENT = 80;
+        constexpr size_t ROW_CACHE_SKETCH_RESET_MULTIPLIER = 10;
+
+        // Parallel point lookups (LSMTree::set_parallel_lookup); the flag is the default
+        // for new trees, each tree keeps its own. Lookups with fewer candidate runs than
+        // PARALLEL_LOOKUP_MIN_RUNS are not worth a hand-off
+        inline std::atomic<bool> PARALLEL_LOOKUP_ENABLED = false;
+        constexpr size_t PARALLEL_LOOKUP_THREADS = 8;
+        constexpr size_t PARALLEL_LOOKUP_MIN_RUNS = 2;
+
+        // Sharding (ShardedLSMTree): number of independent shards the server's tree is split
+        // into, and whether each shard's background threads are pinned to their own core
+        inline std::atomic<size_t> SHARD_COUNT = 1;
+        inline std::atomic<bool> PIN_THREADS = false;
+
+        // Per-run read/write buffer used by streaming compaction
+        constexpr size_t MERGE_BUFFER_SIZE = 1024 * 1024; // 1MB
+
+        // Bulk loads sort their input in chunks of this many pairs, one chunk per thread at a time
+        constexpr size_t BULK_LOAD_CHUNK_PAIRS = 4 * 1024 * 1024; // 64MB
+
+        // Range results are merged and sent to clients in chunks of this many pairs
+        constexpr size_t RANGE_CHUNK_PAIRS = 4096;
+
+        // Per-operation debug logging, compiled in only with -DLSM_DEBUG_LOGGING (make DEBUG_LOG=1)
+#ifdef LSM_DEBUG_LOGGING
+        constexpr bool DEBUG_LOGGING = true;
+#else
+        constexpr bool DEBUG_LOGGING = false;
+#endif
+
+        // Metrics: counters and histograms are split into METRICS_SHARDS shards; latency
+        // buckets cover up to 2^METRICS_MAX_LATENCY_BITS ns with METRICS_SUB_BUCKETS per power of two
+        constexpr size_t METRICS_SHARDS = 8;
+        constexpr size_t METRICS_SUB_BUCKET_BITS = 4;
+        constexpr size_t METRICS_SUB_BUCKETS = size_t(1) << METRICS_SUB_BUCKET_BITS;
+        constexpr size_t METRICS_MAX_LATENCY_BITS = 40;
+        constexpr size_t METRICS_MAX_LEVELS = 16; // Deeper levels are counted with the last one
+
         // Skip list
         constexpr int MAX_SKIP_LIST_HEIGHT = 32;
+        constexpr size_t ARENA_BLOCK_SIZE = 1024 * 1024; // 1MB blocks for memtable nodes
 
         //======================================================================
         // Network & Server Settings
@@ -47,10 +180,23 @@ namespace lsm
 
         constexpr int DEFAULT_PORT = 9090;
         constexpr const char *DEFAULT_HOST = "127.0.0.1";
-        constexpr int MAX_CLIENTS = 64;
-        constexpr int CONNECTION_QUEUE_SIZE = 10;
+        constexpr int CONNECTION_QUEUE_SIZE = 512;
+
+        // Event loop threads reading and writing client connections
+        constexpr size_t IO_THREAD_COUNT = 2;
+        constexpr int EVENT_LOOP_MAX_EVENTS = 256; // Events handled per wait
+        constexpr int EVENT_LOOP_TIMEOUT_MS = 1000;
         constexpr int BUFFER_SIZE = 4096;
 
+        // Binary protocol
+        constexpr size_t PROTOCOL_MAX_FRAME_SIZE = 64 * 1024 * 1024; // Larger frames close the connection
+        constexpr size_t PROTOCOL_READ_BUFFER_SIZE = 64 * 1024;      // Bytes read per recv when pipelining
+
+        // Async client
+        constexpr size_t ASYNC_CLIENT_CONNECTIONS = 4;           // Connections in the pool
+        constexpr size_t ASYNC_CLIENT_MAX_BATCH_KEYS = 256;      // Keys coalesced into one MGET
+        constexpr size_t ASYNC_CLIENT_MAX_BATCHES_IN_FLIGHT = 8; // Lookups outstanding before gets queue up
+
         // Number of threads
         inline int default_thread_count()
         {
@@ -69,16 +215,39 @@ namespace lsm
         constexpr char CMD_LOAD = 'l';
         constexpr char CMD_STATS = 's';
         constexpr char CMD_HELP = 'h';
+        constexpr const char *CMD_MULTI_GET = "mg";
+        constexpr const char *CMD_MULTI_PUT = "mp";
+        constexpr const char *CMD_DELETE_RANGE = "dr";
         constexpr const char *CMD_EXIT = "q";
+        constexpr const char *CMD_BINARY = "b"; // Switch the connection to the binary protocol
+        constexpr const char *BINARY_PROTOCOL_READY = "Binary protocol enabled";
         constexpr const char *CMD_DELIMITER = "\r\n";
 
         //======================================================================
         // Bloom Filter Constants
         //======================================================================
 
-        // Hash function constants
-        constexpr uint64_t FNV_PRIME = 1099511628211ULL;
-        constexpr uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+        // Hash mixer constants (splitmix64 finalizer)
+        constexpr uint64_t HASH_MIX_MULTIPLIER_1 = 0xBF58476D1CE4E5B9ULL;
+        constexpr uint64_t HASH_MIX_MULTIPLIER_2 = 0x94D049BB133111EBULL;
+        constexpr uint64_t HASH_GOLDEN_RATIO = 0x9E3779B97F4A7C15ULL;
+
+        // Filters are split into cache-line sized blocks; every probe of a key hits one block
+        constexpr size_t BLOOM_BLOCK_BITS = 512;
+
+        // On-disk format tag for blocked bloom filters ("LSMBLOOM"). Version 4 pads the
+        // header to a whole block so the file can be mapped and keeps a checksum of the
+        // blocks in the padding; version 3 has no checksum and version 2 files are read in.
+        constexpr uint64_t BLOOM_FILE_MAGIC = 0x4D4F4F4C424D534CULL;
+        constexpr uint32_t BLOOM_FILE_VERSION = 4;
+        constexpr uint32_t BLOOM_FILE_UNCHECKED_VERSION = 3;
+        constexpr uint32_t BLOOM_FILE_UNPADDED_VERSION = 2;
+
+        // Background filter rebuilds: a run's filter is rebuilt once its target FPR is at
+        // least this many bits per key away from the one it was built for
+        constexpr double FILTER_REBUILD_MIN_BITS_CHANGE = 1.0;
+        constexpr size_t FILTER_REBUILD_THREADS = 2;
+        inline std::atomic<size_t> FILTER_REBUILD_KEYS_PER_SECOND = 16 * 1024 * 1024; // Per thread; 0 is unthrottled
 
         //======================================================================
         // Menu Text
@@ -93,8 +262,11 @@ p [key] [value]     - Put a key-value pair into the tree
 g [key]             - Get the value associated with a key
 r [start] [end]     - Range query for keys from start (inclusive) to end (exclusive)
 d [key]             - Delete a key-value pair
+dr [start] [end]    - Delete every key from start (inclusive) to end (exclusive)
+mg [key] [key] ...  - Get the values of several keys at once
+mp [key] [value] .. - Put several key-value pairs at once
 l "[filepath]"      - Load key-value pairs from a binary file
-s                   - Print statistics about the tree
+s [json]            - Print statistics about the tree (json: machine-readable metrics)
 h                   - Show this help message
 q                   - Disconnect from the server
 )";
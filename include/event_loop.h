@@ -0,0 +1,60 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <vector>
+#include <cstddef>
+
+namespace lsm
+{
+
+    // Readiness notification over epoll (Linux) or kqueue (BSD/macOS).
+    //
+    // Descriptors are level-triggered and always watched for reads; write interest is
+    // switched on only while a connection has output queued. wake() interrupts a wait
+    // from any thread.
+    class EventLoop
+    {
+    public:
+        struct Event
+        {
+            int fd;
+            bool readable;
+            bool writable;
+            bool error; // Hang-up or socket error
+        };
+
+        EventLoop();
+        ~EventLoop();
+
+        // Deleted copy/move constructors and assignment operators
+        EventLoop(const EventLoop &) = delete;
+        EventLoop &operator=(const EventLoop &) = delete;
+        EventLoop(EventLoop &&) = delete;
+        EventLoop &operator=(EventLoop &&) = delete;
+
+        // Start watching a descriptor for reads
+        void add(int fd);
+
+        // Turn write interest on or off for a watched descriptor
+        void set_writable(int fd, bool enabled);
+
+        // Stop watching a descriptor
+        void remove(int fd);
+
+        // Wait up to timeout_ms for events; returns the number stored in `events`
+        size_t wait(std::vector<Event> &events, int timeout_ms);
+
+        // Interrupt a wait in progress
+        void wake();
+
+    private:
+        // epoll or kqueue descriptor
+        int poll_fd;
+
+        // Self-pipe used by wake()
+        int wake_pipe[2];
+    };
+
+} // namespace lsm
+
+#endif // EVENT_LOOP_H
@@ -3,23 +3,42 @@
 
 #include <vector>
 #include <cstdint>
+#include <cstddef>
 #include <string>
-#include <fstream>
 #include <memory>
+#include <utility>
+#include <iosfwd>
+#include "mapped_file.h"
 
 namespace lsm
 {
 
-    // Fence pointer implementation for efficient range queries
+    // Fence pointers for efficient range queries
+    //
+    // Only the first key of every page is kept; a page's offset is its index times
+    // PAGE_SIZE, in the uncompressed run (each page is one block of the run file). Keys are stored in cache-line blocks of eight under a small
+    // top-level index holding the first key of each block, so a lookup is a branch-free
+    // search of the top level followed by one cache line of comparisons. Files hold the
+    // same layout and are mapped when loaded, so only the lines searched are read.
     class FencePointers
     {
     public:
-        // Create fence pointers for a run file with keys at the given offsets
-        FencePointers(const std::string &run_filename, const std::vector<std::pair<int64_t, size_t>> &key_offsets);
+        // Create fence pointers from the first key of every page, in page order
+        explicit FencePointers(const std::vector<int64_t> &page_keys);
 
-        // Load fence pointers from a file
+        // Load fence pointers from a file; files of the current version are mapped
         FencePointers(const std::string &fence_pointers_filename);
 
+        // Use fence pointers written with write() at an offset of a mapped file, in place
+        FencePointers(std::shared_ptr<const MappedFile> file, size_t offset, size_t size, const std::string &name);
+
+        // Deleted copy/move constructors and assignment operators; the index may point into
+        // the object's own storage
+        FencePointers(const FencePointers &) = delete;
+        FencePointers &operator=(const FencePointers &) = delete;
+        FencePointers(FencePointers &&) = delete;
+        FencePointers &operator=(FencePointers &&) = delete;
+
         // Find the offset in the data file where a key might be located
         // Returns the offset to start scanning from
         size_t find_offset(int64_t key) const;
@@ -31,29 +50,47 @@ namespace lsm
         // Save fence pointers to a file
         void save(const std::string &filename) const;
 
+        // Write fence pointers to a stream, in the format of save()
+        void write(std::ostream &out) const;
+
         // Get number of fence pointers
         size_t size() const;
 
+        // Get the memory used by the index in bytes
+        size_t memory_usage() const;
+
     private:
-        // Each fence pointer contains a key and its offset in the data file
-        struct FencePointer
-        {
-            int64_t key;
-            size_t offset;
+        static constexpr size_t KEYS_PER_BLOCK = 8;
 
-            FencePointer(int64_t k, size_t off) : key(k), offset(off) {}
+        // One cache line of page keys; the last block is padded with INT64_MAX
+        struct alignas(64) KeyBlock
+        {
+            int64_t keys[KEYS_PER_BLOCK];
         };
 
-        // Sorted array of fence pointers
-        std::vector<FencePointer> fence_pointers;
+        // Blocks and the first key of every block: either the owned vectors or the
+        // contents of a mapped file
+        const KeyBlock *blocks = nullptr;
+        const int64_t *block_keys = nullptr;
+        size_t num_blocks = 0;
+        std::vector<KeyBlock> owned_blocks;
+        std::vector<int64_t> owned_block_keys;
+        std::shared_ptr<const MappedFile> mapping;
+
+        // Number of pages
+        size_t num_pages = 0;
+
+        // Point the index at fence pointers of the current version in a mapped file; false
+        // for older formats
+        bool map_section(std::shared_ptr<const MappedFile> file, size_t offset, size_t size, const std::string &name);
 
-        // Reference to the run filename
-        std::string run_filename;
+        // Lay out sorted page keys in blocks
+        void build(const std::vector<int64_t> &page_keys);
 
-        // Binary search to find the fence pointer for a key
-        size_t binary_search(int64_t key) const;
+        // Find the last page whose first key is <= key (page 0 if there is none)
+        size_t find_page(int64_t key) const;
     };
 
 } // namespace lsm
 
-#endif // FENCE_POINTERS_H
\ No newline at end of file
+#endif // FENCE_POINTERS_H
@@ -0,0 +1,229 @@
+#ifndef KEY_VALUE_TRAITS_H
+#define KEY_VALUE_TRAITS_H
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include "constants.h"
+
+namespace lsm
+{
+
+    // 64-bit mixer (splitmix64 finalizer); every input bit affects every output bit
+    inline uint64_t mix64(uint64_t x)
+    {
+        x ^= x >> 30;
+        x *= constants::HASH_MIX_MULTIPLIER_1;
+        x ^= x >> 27;
+        x *= constants::HASH_MIX_MULTIPLIER_2;
+        x ^= x >> 31;
+        return x;
+    }
+
+    // Opaque fixed-width value of N bytes, for values wider than a machine word
+    template <size_t N>
+    struct FixedBytes
+    {
+        std::array<uint8_t, N> bytes{};
+
+        bool operator==(const FixedBytes &other) const
+        {
+            return bytes == other.bytes;
+        }
+
+        bool operator!=(const FixedBytes &other) const
+        {
+            return bytes != other.bytes;
+        }
+    };
+
+    // How the engine compares, hashes, and stores one fixed-width field.
+    //
+    // Integral types order numerically and hash with mix64. FixedBytes order
+    // lexicographically by byte and hash their bytes eight at a time. Every field type
+    // is trivially copyable, so a record is copied and saved with memcpy. In memory, a
+    // decoded field takes WORDS 64-bit words: an integer is widened to one word, and
+    // bytes are copied into as many words as they fill, the last one zero-padded.
+    template <typename T, typename Enable = void>
+    struct FieldTraits;
+
+    template <typename T>
+    struct FieldTraits<T, std::enable_if_t<std::is_integral_v<T>>>
+    {
+        using type = T;
+
+        static constexpr size_t BYTES = sizeof(T);
+        static constexpr size_t WORDS = 1;
+
+        static constexpr T min()
+        {
+            return std::numeric_limits<T>::min();
+        }
+
+        static constexpr T max()
+        {
+            return std::numeric_limits<T>::max();
+        }
+
+        static constexpr bool less(T a, T b)
+        {
+            return a < b;
+        }
+
+        static uint64_t hash(T x)
+        {
+            return mix64(static_cast<uint64_t>(x));
+        }
+
+        static void to_words(T x, int64_t *words)
+        {
+            words[0] = static_cast<int64_t>(x);
+        }
+
+        static T from_words(const int64_t *words)
+        {
+            return static_cast<T>(words[0]);
+        }
+    };
+
+    template <size_t N>
+    struct FieldTraits<FixedBytes<N>>
+    {
+        using type = FixedBytes<N>;
+
+        static constexpr size_t BYTES = N;
+        static constexpr size_t WORDS = (N + sizeof(int64_t) - 1) / sizeof(int64_t);
+
+        static constexpr type min()
+        {
+            return type{};
+        }
+
+        static constexpr type max()
+        {
+            type x{};
+            for (auto &byte : x.bytes)
+            {
+                byte = 0xFF;
+            }
+            return x;
+        }
+
+        static bool less(const type &a, const type &b)
+        {
+            return std::memcmp(a.bytes.data(), b.bytes.data(), N) < 0;
+        }
+
+        static uint64_t hash(const type &x)
+        {
+            uint64_t h = N;
+            for (size_t i = 0; i < N; i += sizeof(uint64_t))
+            {
+                uint64_t word = 0;
+                std::memcpy(&word, x.bytes.data() + i, std::min(N - i, sizeof(uint64_t)));
+                h = mix64(h ^ word) + constants::HASH_GOLDEN_RATIO;
+            }
+            return h;
+        }
+
+        static void to_words(const type &x, int64_t *words)
+        {
+            words[WORDS - 1] = 0;
+            std::memcpy(words, x.bytes.data(), N);
+        }
+
+        static type from_words(const int64_t *words)
+        {
+            type x;
+            std::memcpy(x.bytes.data(), words, N);
+            return x;
+        }
+    };
+
+    // Key and value types of a tree, and everything the engine needs to know about them:
+    // record sizes, key order, key hash, and the sentinels that bound every key.
+    //
+    // Both types are fixed-width so the size of a record is a compile-time constant.
+    // Every member is static and constexpr or inline, so code written against the traits
+    // compiles to the same instructions as code written against the types directly.
+    //
+    // The skip list, block codec, runs and write-ahead log are templates over the traits.
+    // They keep their range tombstones, fence pointers and range filters in int64_t, so
+    // they take INTEGER_KEYS only; values may be any field type.
+    template <typename Key, typename Value>
+    struct KeyValueTraits
+    {
+        static_assert(std::is_trivially_copyable_v<Key> && std::is_trivially_copyable_v<Value>,
+                      "keys and values must be fixed-width");
+        static_assert(sizeof(Value) < (1u << 18), "values must be smaller than 256KB");
+
+        using key_type = Key;
+        using value_type = Value;
+        using key_traits = FieldTraits<Key>;
+        using value_traits = FieldTraits<Value>;
+
+        static constexpr size_t KEY_BYTES = key_traits::BYTES;
+        static constexpr size_t VALUE_BYTES = value_traits::BYTES;
+
+        // Bytes of one pair as stored in a run's data section
+        static constexpr size_t RECORD_BYTES = KEY_BYTES + VALUE_BYTES;
+
+        // Words of one decoded pair: its key, then its value (see FieldTraits)
+        static constexpr size_t VALUE_WORDS = value_traits::WORDS;
+        static constexpr size_t RECORD_WORDS = key_traits::WORDS + VALUE_WORDS;
+
+        // Keys that keep their order when widened to int64_t
+        static constexpr bool INTEGER_KEYS =
+            std::is_integral_v<Key> && (std::is_signed_v<Key> ? sizeof(Key) <= 8 : sizeof(Key) < 8);
+
+        // Values stored as a word and delta-coded in run blocks, rather than as raw bytes
+        static constexpr bool INTEGER_VALUES = std::is_integral_v<Value> && sizeof(Value) <= 8;
+
+        // Record layout written into run footers and log segment headers, so files of one
+        // layout are never read with another. Zero for int64_t keys and values, whose file
+        // formats predate the traits.
+        static constexpr uint32_t LAYOUT_ID =
+            std::is_same_v<Key, int64_t> && std::is_same_v<Value, int64_t>
+                ? 0
+                : static_cast<uint32_t>(VALUE_BYTES << 6 | INTEGER_VALUES << 5 | std::is_signed_v<Key> << 4 | KEY_BYTES);
+
+        static constexpr Key min_key()
+        {
+            return key_traits::min();
+        }
+
+        static constexpr Key max_key()
+        {
+            return key_traits::max();
+        }
+
+        static constexpr bool less(const Key &a, const Key &b)
+        {
+            return key_traits::less(a, b);
+        }
+
+        static constexpr bool equal(const Key &a, const Key &b)
+        {
+            return !less(a, b) && !less(b, a);
+        }
+
+        static uint64_t hash(const Key &key)
+        {
+            return key_traits::hash(key);
+        }
+    };
+
+    // The configuration the engine, its file formats, and its protocols are built for
+    using DefaultTraits = KeyValueTraits<int64_t, int64_t>;
+
+    // 32-bit keys with 32-byte values, for tables that would waste half of every int64_t
+    // key and pack their values into several pairs. The skip list, block codec, runs and
+    // write-ahead log are instantiated for it as well as for DefaultTraits.
+    using CompactKeyTraits = KeyValueTraits<int32_t, FixedBytes<32>>;
+
+} // namespace lsm
+
+#endif // KEY_VALUE_TRAITS_H
@@ -5,7 +5,8 @@
 #include <string>
 #include <sstream>
 #include <vector>
-#include "lsm_tree.h"
+#include <atomic>
+#include "sharded_lsm_tree.h"
 
 namespace lsm
 {
@@ -27,24 +28,17 @@ namespace lsm
         std::string process_command(const std::string &command);
 
         // Access the tree (needed for buffer size optimization)
-        LSMTree *get_tree() const { return tree.get(); }
+        ShardedLSMTree *get_tree() const { return tree.get(); }
 
         // Safely shutdown the LSM adapter and tree
         void shutdown();
 
-        // I/O tracking methods
-        void increment_read_io()
-        {
-            if (tree)
-                tree->increment_read_io();
-        }
-
-        void increment_write_io()
-        {
-            if (tree)
-                tree->increment_write_io();
-        }
+        // Durability of the writes of text commands, and of binary writes sent without the
+        // sync flag
+        void set_write_durability(Durability durability) { write_durability.store(durability); }
+        Durability get_write_durability() const { return write_durability.load(); }
 
+        // I/O tracking methods
         size_t get_read_io_count() const
         {
             return tree ? tree->get_read_io_count() : 0;
@@ -92,16 +86,23 @@ namespace lsm
         // Private constructor for singleton
         LSMAdapter();
 
-        // The LSM-tree instance
-        std::unique_ptr<LSMTree> tree;
+        // The LSM-tree instance, split into constants::SHARD_COUNT shards
+        std::unique_ptr<ShardedLSMTree> tree;
+
+        // Durability the server's writes get by default
+        std::atomic<Durability> write_durability{Durability::ASYNC};
 
         // Command handlers
         std::string handle_put(const std::vector<std::string> &tokens);
         std::string handle_get(const std::vector<std::string> &tokens);
+        std::string handle_multi_get(const std::vector<std::string> &tokens);
+        std::string handle_multi_put(const std::vector<std::string> &tokens);
         std::string handle_range(const std::vector<std::string> &tokens);
         std::string handle_delete(const std::vector<std::string> &tokens);
+        std::string handle_delete_range(const std::vector<std::string> &tokens);
         std::string handle_load(const std::string &command);
         std::string handle_stats();
+        std::string handle_stats_json();
         std::string handle_reset_stats();
 
         // Helper to parse tokens
@@ -6,19 +6,37 @@
 #include <memory>
 #include <unordered_map>
 #include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <deque>
 #include <atomic>
 #include <cstdint>
 #include <optional>
+#include <limits>
 #include <chrono>
+#include <thread>
+#include <functional>
 #include "constants.h"
+#include "key_value_traits.h"
+#include "compaction_scheduler.h"
+#include "thread_pool.h"
+#include "metrics.h"
 
 // Forward declarations
 namespace lsm
 {
-    class SkipList;
+    template <typename Traits>
+    class BasicSkipList;
+    template <typename Traits>
+    class BasicRun;
+    template <typename Traits>
+    class BasicWriteAheadLog;
+    using SkipList = BasicSkipList<DefaultTraits>;
+    using Run = BasicRun<DefaultTraits>;
+    using WriteAheadLog = BasicWriteAheadLog<DefaultTraits>;
     class BloomFilter;
-    class Run;
     class FencePointers;
+    class RowCache;
 }
 
 namespace lsm
@@ -29,44 +47,82 @@ namespace lsm
     {
         TIERING,       // Multiple runs per level, only compact when threshold reached
         LAZY_LEVELING, // Multiple runs allowed but compact in place
-        LEVELING       // Single run per level
+        LEVELING       // Single sorted run per level, split into runs with disjoint key ranges
     };
 
-    // Represents a key-value pair
-    struct KeyValuePair
+    // How far a write must get before the call returns
+    enum class Durability
     {
-        int64_t key;
-        int64_t value;
+        NONE,  // Buffer only; lost if the process dies before the buffer is flushed
+        ASYNC, // Logged; the background committer syncs it within WAL_SYNC_INTERVAL_MS
+        SYNC   // Logged and synced to disk before returning
+    };
 
-        KeyValuePair(int64_t k, int64_t v) : key(k), value(v) {}
+    // Kind of entry a key-value pair records
+    enum class EntryType : uint8_t
+    {
+        VALUE,         // The key holds the value
+        DELETION,      // The key was deleted; the value is unused
+        RANGE_DELETION // Every key in [key, value) was deleted; only seen on the write path
+    };
+
+    // Represents a key-value pair of a tree configured by Traits (see key_value_traits.h)
+    template <typename Traits>
+    struct BasicKeyValuePair
+    {
+        using key_type = typename Traits::key_type;
+        using value_type = typename Traits::value_type;
+
+        key_type key;
+        value_type value;
+        EntryType type;
+
+        BasicKeyValuePair(key_type k, value_type v, EntryType t = EntryType::VALUE) : key(k), value(v), type(t) {}
 
         // Compare operators for sorting
-        bool operator<(const KeyValuePair &other) const
+        bool operator<(const BasicKeyValuePair &other) const
         {
-            return key < other.key;
+            return Traits::less(key, other.key);
+        }
+
+        bool operator==(const BasicKeyValuePair &other) const
+        {
+            return Traits::equal(key, other.key);
         }
+    };
 
-        bool operator==(const KeyValuePair &other) const
+    // The pair the engine stores
+    using KeyValuePair = BasicKeyValuePair<DefaultTraits>;
+    static_assert(sizeof(KeyValuePair) == 3 * sizeof(int64_t), "KeyValuePair layout must not change");
+
+    // Key-value pair as stored in bulk load files
+    struct FilePair
+    {
+        int64_t key;
+        int64_t value;
+
+        bool operator<(const FilePair &other) const
         {
-            return key == other.key;
+            return key < other.key;
         }
     };
+    static_assert(sizeof(FilePair) == 2 * sizeof(int64_t), "load files hold raw pairs");
 
-    // Represents a level in the LSM-tree
+    // Represents a level in the LSM-tree. A level is never modified once it is part of a
+    // published Version; changes are made to a copy (see Version::edit_level).
     class Level
     {
     public:
         Level(int level_number, CompactionStrategy strategy);
-        ~Level();
 
         // Add a run to this level
-        void add_run(std::unique_ptr<Run> run);
+        void add_run(std::shared_ptr<Run> run);
 
         // Check if compaction is needed
         bool needs_compaction() const;
 
-        // Get all runs in this level
-        const std::vector<std::unique_ptr<Run>> &get_runs() const;
+        // Get all runs in this level, oldest first
+        const std::vector<std::shared_ptr<Run>> &get_runs() const;
 
         // Get the level number
         int get_level_number() const;
@@ -74,24 +130,73 @@ namespace lsm
         // Get the compaction strategy
         CompactionStrategy get_strategy() const;
 
+        // Change the compaction strategy
+        void set_strategy(CompactionStrategy new_strategy);
+
         // Get number of runs
         size_t run_count() const;
 
-        // Clear all runs (after compaction)
-        void clear_runs();
+        // Remove runs (after compaction)
+        void remove_runs(const std::vector<std::shared_ptr<Run>> &removed);
+
+        // Uncompressed size of all runs in bytes
+        size_t size_bytes() const;
+
+        // Bytes the level holds before it pushes data down: BUFFER_SIZE * SIZE_RATIO^level
+        size_t capacity_bytes() const;
+
+        // Check if the level keeps its runs' key ranges disjoint (LEVELING)
+        bool is_partitioned() const;
+
+        // Check if the key ranges of two runs overlap
+        bool has_overlapping_runs() const;
+
+        // Get the runs whose key ranges overlap [min_key, max_key]
+        std::vector<std::shared_ptr<Run>> get_overlapping_runs(int64_t min_key, int64_t max_key) const;
+
+        // Pick the run a partitioned level moves down next: the first one past the key
+        // where the last move ended, wrapping around at the end of the key space
+        std::shared_ptr<Run> pick_compaction_run() const;
+
+        // Record the largest key of the run moved down last
+        void set_compaction_cursor(int64_t key);
 
     private:
         int level_number;
         CompactionStrategy strategy;
-        std::vector<std::unique_ptr<Run>> runs;
-        mutable std::mutex level_mutex;
+        std::vector<std::shared_ptr<Run>> runs;
+
+        // Largest key of the run moved down last
+        int64_t compaction_cursor = DefaultTraits::min_key();
+    };
+
+    // Immutable snapshot of the tree: the buffers and the runs of every level.
+    //
+    // Readers pin the current version with one atomic load and read it without locks for
+    // as long as they hold it; every change publishes a new version. Levels are shared
+    // between versions until a change copies them, and a run that has been compacted
+    // away keeps its files until the last version holding it is released.
+    struct Version
+    {
+        // Buffer receiving writes
+        std::shared_ptr<SkipList> buffer;
+
+        // Buffers awaiting flush, oldest first
+        std::vector<std::shared_ptr<SkipList>> immutable_buffers;
+
+        // Levels, indexed by level number
+        std::vector<std::shared_ptr<const Level>> levels;
+
+        // Get a level for modification, copying it so that published versions are unaffected
+        Level &edit_level(size_t level);
     };
 
     // Main LSM-tree class
     class LSMTree
     {
     public:
-        LSMTree();
+        // Open (or create) the tree kept in a data directory
+        explicit LSMTree(const std::string &data_directory = constants::DATA_DIRECTORY);
         ~LSMTree();
 
         // Deleted copy/move constructors and assignment operators
@@ -101,10 +206,23 @@ namespace lsm
         LSMTree &operator=(LSMTree &&) = delete;
 
         // Primary operations
-        void put(int64_t key, int64_t value);
+        void put(int64_t key, int64_t value, Durability durability = Durability::ASYNC);
         std::optional<int64_t> get(int64_t key);
         std::vector<KeyValuePair> range(int64_t start_key, int64_t end_key);
-        bool remove(int64_t key);
+        bool remove(int64_t key, Durability durability = Durability::ASYNC);
+
+        // Delete every key in [start_key, end_key) with one range tombstone
+        void delete_range(int64_t start_key, int64_t end_key, Durability durability = Durability::ASYNC);
+
+        // Stream the live pairs in [start_key, end_key) in key order with the newest value
+        // of each key; tombstones are skipped. `consumer` gets chunks of at most chunk_pairs
+        // pairs and can return false to stop the scan.
+        void scan(int64_t start_key, int64_t end_key, size_t chunk_pairs,
+                  const std::function<bool(const std::vector<KeyValuePair> &)> &consumer);
+
+        // Multi-key operations; multi_get results follow the order of `keys`
+        std::vector<std::optional<int64_t>> multi_get(const std::vector<int64_t> &keys);
+        void multi_put(const std::vector<KeyValuePair> &pairs, Durability durability = Durability::ASYNC);
 
         // Batch operations
         void load_file(const std::string &filepath);
@@ -112,6 +230,10 @@ namespace lsm
         // Optimized bulk loading path
         void bulk_load_file(const std::string &filepath);
 
+        // Bulk load pairs in file order, where a later pair of a key wins; the pairs are
+        // sorted in place
+        void bulk_load_pairs(FilePair *pairs, size_t count);
+
         // Buffer size management for loading
         size_t get_buffer_size() const;
         void set_buffer_size(size_t new_size);
@@ -120,9 +242,68 @@ namespace lsm
         bool is_compaction_enabled() const;
         void set_compaction_enabled(bool enabled);
 
+        // Shared block cache capacity
+        size_t get_block_cache_size() const;
+        void set_block_cache_size(size_t bytes);
+
+        // Write bandwidth shared by all compactions of the process in bytes per second (0: no limit)
+        size_t get_compaction_write_rate() const;
+        void set_compaction_write_rate(size_t bytes_per_second);
+
+        // Row cache capacity in entries (0 disables it)
+        size_t get_row_cache_capacity() const;
+        void set_row_cache_capacity(size_t entries);
+
+        // Write backpressure thresholds (immutable buffers awaiting flush)
+        void set_write_stall_thresholds(size_t slowdown, size_t stop);
+
+        // Size ratio between adjacent levels; levels over their new capacity move down as
+        // they are compacted
+        size_t get_size_ratio() const;
+        void set_size_ratio(size_t ratio);
+
+        // Number of runs that triggers compaction of TIERING and LAZY_LEVELING levels
+        void set_compaction_thresholds(size_t tiering, size_t lazy_leveling);
+
+        // Compaction strategy of a disk level (1 up to the deepest level)
+        CompactionStrategy get_level_strategy(int level) const;
+        void set_level_strategy(int level, CompactionStrategy strategy);
+
+        // Choose each level's strategy and bloom filter FPR from the reads and writes seen
+        // since the last pass. Filters whose FPR moved are rebuilt in the background.
+        void tune();
+
+        // Run tune() every AUTO_TUNING_INTERVAL_FLUSHES flushes
+        bool is_auto_tuning_enabled() const;
+        void set_auto_tuning(bool enabled);
+
+        // Parallel point lookups: a key missing from the buffers is checked against the
+        // bloom filters of all runs first, and the runs that may hold it are probed
+        // concurrently. The newest run holding the key wins; probes of older runs that
+        // have not started by then are cancelled.
+        bool is_parallel_lookup_enabled() const;
+        void set_parallel_lookup(bool enabled);
+
+        // Width in bits of the key buckets in the range filters of new runs (0: key span
+        // only). Existing runs keep the width they were written with.
+        size_t get_range_filter_prefix_bits() const;
+        void set_range_filter_prefix_bits(size_t bits);
+
+        // Number of immutable buffers waiting to be flushed
+        size_t immutable_buffer_count() const;
+
+        // Block until all pending flushes and compactions have finished
+        void wait_for_background_work();
+
         // Management operations
         void compact();
+
+        // Rebuild, in the background, the bloom filters whose level FPR has moved
         void rebuild_filters();
+
+        // Block until requested filter rebuilds have finished
+        void wait_for_filter_rebuilds();
+
         void print_stats(std::ostream &out) const;
 
         // Get the total number of key-value pairs (logical count)
@@ -145,46 +326,160 @@ namespace lsm
         size_t get_write_count() const;
         void reset_timing_stats();
 
+        // Latency histograms and per-level filter statistics
+        const Metrics &get_metrics() const;
+
+        // Write the metrics, I/O counts and block cache statistics as one JSON object
+        void write_metrics_json(std::ostream &out) const;
+
+        // Directory holding the tree's runs and log
+        const std::string &get_data_directory() const;
+
+        // Run the compaction and filter rebuild threads on one CPU core (modulo the core
+        // count). Returns false if any thread could not be pinned.
+        bool pin_background_threads(size_t core);
+
     private:
-        // In-memory buffer (skip list)
-        std::unique_ptr<SkipList> buffer;
+        // Directory holding the runs and the write-ahead log
+        std::string data_directory;
+
+        // In-memory buffer (skip list) receiving writes; readers find it in the version
+        std::shared_ptr<SkipList> buffer;
 
-        // Levels of the LSM-tree
-        std::vector<std::unique_ptr<Level>> levels;
+        // Full buffers handed off for flushing, oldest first; counted for write stalls
+        std::deque<std::shared_ptr<SkipList>> immutable_buffers;
+
+        // Current version of the buffers and levels; always read with get_version()
+        std::shared_ptr<const Version> current_version;
 
         // Current max level (for FPR calculations)
         std::atomic<int> max_level;
 
+        // Next run ID; IDs are unique across levels and increase with run age
+        std::atomic<size_t> next_run_id{0};
+
+        // Set once the runs on disk are loaded; from then on every version whose levels
+        // change is saved to the manifest before it is published
+        std::atomic<bool> manifest_enabled{false};
+
         // For synchronization
-        mutable std::mutex tree_mutex;
+        mutable std::shared_mutex tree_mutex;   // Writers share, buffer hand-off is exclusive
+        mutable std::mutex buffer_mutex;       // Guards immutable_buffers
+        mutable std::mutex version_mutex;      // Serializes installs of new versions
+        mutable std::mutex filter_mutex;       // Guards the filter rebuild state below
+        std::condition_variable write_stall_condition;
 
-        // I/O operation counters
-        std::atomic<size_t> read_io_count{0};
-        std::atomic<size_t> write_io_count{0};
+        // Runs flushes and compactions off the client threads
+        std::unique_ptr<CompactionScheduler> scheduler;
 
-        // Operation timing metrics
-        std::atomic<size_t> read_count{0};
-        std::atomic<size_t> write_count{0};
-        std::atomic<double> total_read_time_ms{0.0};
-        std::atomic<double> total_write_time_ms{0.0};
+        // Log of the writes held in the buffers; a segment goes away once its buffer is flushed
+        std::unique_ptr<WriteAheadLog> wal;
+
+        // Rebuilds stale bloom filters from the runs' key sections
+        std::thread filter_thread;
+        std::condition_variable filter_condition;
+        bool filter_rebuild_requested = false;
+        bool filter_rebuild_running = false;
+        std::atomic<bool> filter_thread_stopping{false};
+
+        // Bloom filter FPR per level chosen by tune(); levels without one (or with zero)
+        // use the Monkey allocation
+        std::vector<double> tuned_fprs;
+
+        // Operation counts when tune() last ran, and flushes since then
+        size_t tuned_read_count = 0;
+        size_t tuned_write_count = 0;
+        std::atomic<size_t> flushes_since_tuning{0};
+        mutable std::mutex tuning_mutex; // Guards tuned_fprs and the tuned counts
+
+        // Page reads and writes of the tree's runs
+        IoCounters io_counters;
+
+        // Results of point lookups that missed the buffers, for hot keys
+        std::unique_ptr<RowCache> row_cache;
+
+        // Keys read and written, and the latency of every operation
+        ShardedCounter read_count;
+        ShardedCounter write_count;
+        Metrics metrics;
+
+        // Probes runs for parallel lookups; created the first time they are enabled
+        std::unique_ptr<ThreadPool> lookup_pool;
+        std::once_flag lookup_pool_once;
+        std::atomic<bool> parallel_lookup{false}; // Set only once lookup_pool exists
+
+        // Set while a bulk load installs its runs; holds this tree's compactions back
+        std::atomic<bool> bulk_loading{false};
+
+        // Pin the current version
+        std::shared_ptr<const Version> get_version() const;
+
+        // Publish a copy of the current version with `edit` applied
+        void install_version(const std::function<void(Version &)> &edit);
+
+        // Save the runs of a version as the manifest; caller holds version_mutex
+        void save_manifest(const Version &version);
+
+        // Look a key up in the disk levels of a version, one run after another or with
+        // the candidate runs probed concurrently
+        std::optional<int64_t> get_from_levels(const Version &version, int64_t key);
+        std::optional<int64_t> get_from_levels_parallel(const Version &version, int64_t key);
+
+        // Apply one put, deletion or range deletion to the buffer, logging and timing it
+        void write(const KeyValuePair &entry, Durability durability);
 
         // Internal methods
+        uint64_t write_to_buffer(const KeyValuePair *pairs, size_t count, Durability durability);
         void flush_buffer();
-        void perform_compaction(int level);
+        void schedule_flush();
+        void flush_immutable_buffer();
+        void schedule_compaction(int level);
+        void perform_compaction(int level, int max_target_level);
+        CompactionScheduler::LevelRange compaction_levels(int level) const;
+        void apply_write_backpressure();
         CompactionStrategy get_strategy_for_level(int level) const;
+
+        // Runs a level of the given strategy holds between compactions
+        static size_t resting_runs(CompactionStrategy strategy);
         double calculate_fpr_for_level(int level) const;
 
         // Get appropriate level for a new run based on size
         int get_target_level_for_size(size_t size_bytes) const;
 
+        // Number of pairs a bulk load places in each level (indexed by level)
+        std::vector<size_t> plan_bulk_load_levels(size_t total_pairs) const;
+
         // Check if we need more levels
         void check_and_extend_levels();
 
+        // Body of the filter rebuild thread
+        void filter_rebuild_loop();
+
+        // Rebuild every filter of the current version that is off its level's FPR
+        void rebuild_stale_filters();
+
         // Load state from disk at startup
         void load_state_from_disk();
 
+        // Open the runs listed in the manifest and remove run files it does not list.
+        // Returns false if there is no usable manifest.
+        bool load_runs_from_manifest();
+
+        // Open every run file of the data directory
+        void load_runs_from_directory();
+
         // Internal logging
         void log_debug(const std::string &message) const;
+
+        // Per-operation logging; the message is only built when DEBUG_LOGGING is compiled in
+        template <typename MessageFn>
+        void log_trace(MessageFn &&message) const
+        {
+            if constexpr (constants::DEBUG_LOGGING)
+            {
+                log_debug(message());
+            }
+        }
     };
 
 } // namespace lsm
@@ -0,0 +1,64 @@
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <string>
+#include <vector>
+#include <optional>
+#include <cstdint>
+#include <cstddef>
+
+namespace lsm
+{
+
+    // What the manifest records about one run
+    struct ManifestRun
+    {
+        int level;
+        size_t run_id;
+        size_t num_pairs;
+        size_t file_bytes;
+
+        // Smallest and largest key the run or its range tombstones touch
+        int64_t min_key;
+        int64_t max_key;
+
+        // FPR the run's bloom filter was built for (1.0 if it has none)
+        double bloom_fpr;
+    };
+
+    // The set of runs of a tree, saved as the MANIFEST file of its data directory.
+    //
+    // Runs are listed level by level, oldest first within a level. The file is replaced
+    // with a rename, so it always describes either the old or the new set of runs; run
+    // files on disk that it does not list are leftovers of unfinished flushes or
+    // compactions.
+    class Manifest
+    {
+    public:
+        Manifest() = default;
+        Manifest(std::vector<ManifestRun> runs, size_t next_run_id);
+
+        // Load the manifest of a data directory; nullopt if there is none. Throws if it is
+        // damaged.
+        static std::optional<Manifest> load(const std::string &directory);
+
+        // Replace the manifest of a data directory and make it durable
+        void save(const std::string &directory) const;
+
+        // Runs, level by level and oldest first
+        const std::vector<ManifestRun> &get_runs() const;
+
+        // Smallest run ID not yet used
+        size_t get_next_run_id() const;
+
+        // Get the manifest filename of a data directory
+        static std::string make_filename(const std::string &directory);
+
+    private:
+        std::vector<ManifestRun> runs;
+        size_t next_run_id = 0;
+    };
+
+} // namespace lsm
+
+#endif // MANIFEST_H
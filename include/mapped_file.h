@@ -0,0 +1,41 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <string>
+#include <cstddef>
+
+namespace lsm
+{
+
+    // Read-only memory mapping of a whole file.
+    //
+    // Pages are read from disk on first touch, so mapping a file costs no I/O up front.
+    // The file may be unlinked or replaced by a rename while mapped; the mapping keeps
+    // the old contents. It must not be truncated or rewritten in place.
+    class MappedFile
+    {
+    public:
+        // Map a file; throws if it cannot be opened or mapped
+        explicit MappedFile(const std::string &filename);
+        ~MappedFile();
+
+        // Deleted copy/move constructors and assignment operators
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+        MappedFile(MappedFile &&) = delete;
+        MappedFile &operator=(MappedFile &&) = delete;
+
+        // Start of the mapping (nullptr for an empty file)
+        const char *data() const;
+
+        // Size of the file in bytes
+        size_t size() const;
+
+    private:
+        void *mapping;
+        size_t bytes;
+    };
+
+} // namespace lsm
+
+#endif // MAPPED_FILE_H
@@ -0,0 +1,116 @@
+#ifndef MERGE_ITERATOR_H
+#define MERGE_ITERATOR_H
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include "lsm_tree.h"
+#include "range_tombstone.h"
+
+namespace lsm
+{
+
+    // Forward-only cursor over key-value pairs of Traits in ascending key order
+    template <typename Traits>
+    class BasicPairIterator
+    {
+    public:
+        using Pair = BasicKeyValuePair<Traits>;
+        using key_type = typename Traits::key_type;
+
+        virtual ~BasicPairIterator() = default;
+
+        // Check if the iterator points at a pair
+        virtual bool valid() const = 0;
+
+        // Get the current pair
+        virtual const Pair &current() const = 0;
+
+        // Advance to the next pair
+        virtual void next() = 0;
+
+        // Advance to the first pair with a key >= key; sources that can skip ahead
+        // without reading the pairs in between override this
+        virtual void seek(key_type key)
+        {
+            while (valid() && Traits::less(current().key, key))
+            {
+                next();
+            }
+        }
+
+        // Range tombstones of the source, which delete keys of older sources only
+        virtual const RangeTombstoneSet *range_tombstones() const
+        {
+            return nullptr;
+        }
+    };
+
+    using PairIterator = BasicPairIterator<DefaultTraits>;
+
+    // Heap-based k-way merge of sorted sources.
+    //
+    // Sources are given newest first. When several sources hold the same key only the
+    // newest entry is produced; deletions are either passed through or dropped. Keys
+    // covered by a range tombstone of a newer source are always dropped, and the older
+    // sources skip the whole tombstone with one seek.
+    class MergeIterator : public PairIterator
+    {
+    public:
+        MergeIterator(std::vector<std::unique_ptr<PairIterator>> sources, bool drop_tombstones);
+
+        bool valid() const override;
+        const KeyValuePair &current() const override;
+        void next() override;
+
+    private:
+        struct HeapEntry
+        {
+            int64_t key;
+            size_t source;
+        };
+
+        // Stretch of keys covered by range tombstones, and the newest source with a
+        // tombstone over it; keys of older sources in [start_key, end_key) are deleted
+        struct Fragment
+        {
+            int64_t start_key;
+            int64_t end_key;
+            size_t source;
+        };
+
+        // Orders the heap by key, then by source age (newest on top)
+        static bool heap_compare(const HeapEntry &a, const HeapEntry &b);
+
+        // Advance a source and push its next key onto the heap
+        void advance_source(size_t source);
+
+        // Move to the next key that should be produced
+        void advance();
+
+        // Split the sources' range tombstones into non-overlapping fragments
+        void build_fragments();
+
+        // If a newer source's tombstone covers the key of an older source, seek every
+        // source under the tombstone past it and return true
+        bool skip_covered(int64_t key, size_t source);
+
+        std::vector<std::unique_ptr<PairIterator>> sources;
+
+        // Min-heap of the current key of every live source
+        std::vector<HeapEntry> heap;
+
+        // Fragments in key order, and the first one that may still cover a key
+        std::vector<Fragment> fragments;
+        size_t next_fragment;
+
+        bool drop_tombstones;
+
+        KeyValuePair current_pair;
+        bool has_current;
+    };
+
+} // namespace lsm
+
+#endif // MERGE_ITERATOR_H
@@ -0,0 +1,171 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <ostream>
+#include <vector>
+#include "constants.h"
+
+namespace lsm
+{
+
+    // Counter split over cache-line sized shards. Each thread adds to its own shard, so a
+    // counter bumped on every operation never bounces a cache line between cores.
+    class ShardedCounter
+    {
+    public:
+        ShardedCounter();
+
+        // Add to the calling thread's shard
+        void add(uint64_t amount = 1);
+
+        // Sum of all shards
+        uint64_t value() const;
+
+        // Set every shard to zero
+        void reset();
+
+    private:
+        struct alignas(64) Shard
+        {
+            std::atomic<uint64_t> value;
+        };
+
+        std::array<Shard, constants::METRICS_SHARDS> shards;
+    };
+
+    // Pages a tree's runs read from and wrote to disk
+    struct IoCounters
+    {
+        ShardedCounter reads;
+        ShardedCounter writes;
+    };
+
+    // Latency histogram with log-linear (HDR style) buckets: every power of two of
+    // nanoseconds is split into METRICS_SUB_BUCKETS equal buckets, so a percentile is
+    // within one bucket, about 6%, of the true value at any scale. Sharded like
+    // ShardedCounter.
+    class LatencyHistogram
+    {
+    public:
+        // Totals of all shards at one point in time
+        struct Snapshot
+        {
+            uint64_t count = 0;
+            uint64_t sum_ns = 0;
+            uint64_t max_ns = 0;
+            std::vector<uint64_t> buckets;
+
+            // Mean latency in nanoseconds
+            double mean_ns() const;
+
+            // Latency in nanoseconds below which a fraction q of the samples fall
+            uint64_t percentile_ns(double q) const;
+        };
+
+        LatencyHistogram();
+
+        // Record one sample
+        void record(uint64_t nanoseconds);
+
+        // Sum the shards
+        Snapshot snapshot() const;
+
+        // Drop all samples
+        void reset();
+
+        // Number of buckets
+        static constexpr size_t BUCKET_COUNT = (constants::METRICS_MAX_LATENCY_BITS - constants::METRICS_SUB_BUCKET_BITS + 2) *
+                                               constants::METRICS_SUB_BUCKETS;
+
+    private:
+        struct alignas(64) Shard
+        {
+            std::array<std::atomic<uint64_t>, BUCKET_COUNT> buckets;
+            std::atomic<uint64_t> sum_ns;
+            std::atomic<uint64_t> max_ns;
+        };
+
+        std::array<Shard, constants::METRICS_SHARDS> shards;
+
+        // Bucket holding a latency
+        static size_t bucket_index(uint64_t nanoseconds);
+
+        // Smallest and largest latency held by a bucket
+        static uint64_t bucket_lower(size_t index);
+        static uint64_t bucket_upper(size_t index);
+    };
+
+    // Operation latencies and per-level lookup statistics of a tree
+    class Metrics
+    {
+    public:
+        // Timed operations
+        enum class Operation
+        {
+            PUT,
+            DELETE,
+            GET,
+            MULTI_GET,
+            MULTI_PUT,
+            RANGE,
+            DELETE_RANGE
+        };
+        static constexpr size_t OPERATION_COUNT = 7;
+
+        // Clock used for every latency
+        using Clock = std::chrono::steady_clock;
+
+        // Nanoseconds since start
+        static uint64_t elapsed_ns(Clock::time_point start);
+
+        // Name of an operation, as used in the stats output
+        static const char *operation_name(Operation operation);
+
+        // Record the latency of one operation
+        void record(Operation operation, uint64_t nanoseconds);
+
+        // Record a run probed after its bloom filter let the key through, and whether the
+        // key was there (a true positive) or not (a false positive)
+        void record_probe(int level, uint64_t nanoseconds, bool found);
+
+        // Record a run skipped because its bloom filter ruled the key out
+        void record_filter_negative(int level);
+
+        // Record a run a range query read, or skipped because its range filter ruled it out
+        void record_range_run(int level, bool scanned);
+
+        // Latency histogram of an operation
+        const LatencyHistogram &latency(Operation operation) const;
+
+        // Write the latency and filter statistics as indented text lines
+        void write_text(std::ostream &out) const;
+
+        // Write the latency and filter statistics as JSON members, without the enclosing braces
+        void write_json(std::ostream &out) const;
+
+        // Drop all samples and counts
+        void reset();
+
+    private:
+        std::array<LatencyHistogram, OPERATION_COUNT> operations;
+
+        // Indexed by level; deeper levels share the last slot
+        std::array<LatencyHistogram, constants::METRICS_MAX_LEVELS> probe_latency;
+        std::array<ShardedCounter, constants::METRICS_MAX_LEVELS> filter_negatives;
+        std::array<ShardedCounter, constants::METRICS_MAX_LEVELS> filter_true_positives;
+        std::array<ShardedCounter, constants::METRICS_MAX_LEVELS> filter_false_positives;
+        std::array<ShardedCounter, constants::METRICS_MAX_LEVELS> range_runs_scanned;
+        std::array<ShardedCounter, constants::METRICS_MAX_LEVELS> range_runs_skipped;
+
+        // Slot of a level
+        static size_t level_slot(int level);
+    };
+
+} // namespace lsm
+
+#endif // METRICS_H
@@ -0,0 +1,97 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+
+namespace lsm
+{
+    namespace protocol
+    {
+
+        // Binary wire protocol, enabled per connection with the CMD_BINARY text command.
+        //
+        // Every frame starts with a 4-byte length covering the rest of the frame. Integers
+        // are fixed-width little-endian.
+        //
+        //   request:  [u32 length][u64 request id][u8 opcode][payload]
+        //   response: [u32 length][u64 request id][u8 opcode][u8 status][payload]
+        //
+        // Request payloads:  PUT key value | GET key | DELETE key | RANGE start end | TEXT bytes
+        //                    MGET u32 count, count x key | MPUT u32 count, count x (key value)
+        //                    DELETE_RANGE start end
+        // Response payloads: GET value | RANGE/MGET u32 count, count x (key value) | TEXT bytes
+        //                    MGET answers only the keys that were found, in request order
+        //                    ERROR responses carry a message instead
+        //
+        // A large RANGE result arrives as PARTIAL frames, each with a chunk of pairs, followed
+        // by one final OK frame holding the last chunk.
+        //
+        // A PUT, DELETE, MPUT or DELETE_RANGE request with SYNC_FLAG set in its opcode byte is
+        // answered only once the write is synced to the write-ahead log; other writes get the
+        // server's default durability. Responses carry the plain opcode.
+        //
+        // Responses echo the request id, so a client may keep many requests in flight.
+
+        enum class Opcode : uint8_t
+        {
+            PUT = 1,
+            GET = 2,
+            DELETE = 3,
+            RANGE = 4,
+            TEXT = 5, // Any text command, answered with its text response
+            MGET = 6,
+            MPUT = 7,
+            DELETE_RANGE = 8
+        };
+
+        // Opcode bit asking for a synced write
+        constexpr uint8_t SYNC_FLAG = 0x80;
+
+        enum class Status : uint8_t
+        {
+            OK = 0,
+            NOT_FOUND = 1,
+            ERROR = 2,
+            PARTIAL = 3 // More frames follow for the same request
+        };
+
+        struct Request
+        {
+            uint64_t id = 0;
+            Opcode opcode = Opcode::TEXT;
+            int64_t key = 0;   // Key, or start key of a range
+            int64_t value = 0; // Value, or end key of a range
+            std::vector<int64_t> keys;                      // MGET keys
+            std::vector<std::pair<int64_t, int64_t>> pairs; // MPUT pairs
+            std::string text;
+            bool sync = false; // Write sent with SYNC_FLAG
+        };
+
+        struct Response
+        {
+            uint64_t id = 0;
+            Opcode opcode = Opcode::TEXT;
+            Status status = Status::OK;
+            int64_t value = 0;
+            std::vector<std::pair<int64_t, int64_t>> pairs;
+            std::string text; // Text response or error message
+        };
+
+        // Append the encoding of a request/response to a buffer
+        void encode_request(const Request &request, std::string &out);
+        void encode_response(const Response &response, std::string &out);
+
+        // Decode one frame from the front of a buffer. Returns the number of bytes consumed,
+        // or 0 if the buffer does not hold a complete frame yet. Throws on malformed frames.
+        // A response decoded into an existing one reuses its pair and text buffers.
+        size_t decode_request(const char *data, size_t size, Request &request);
+        size_t decode_response(const char *data, size_t size, Response &response);
+
+    } // namespace protocol
+} // namespace lsm
+
+#endif // PROTOCOL_H
@@ -0,0 +1,80 @@
+#ifndef RANGE_FILTER_H
+#define RANGE_FILTER_H
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <iosfwd>
+#include <cstdint>
+#include <cstddef>
+#include "bloom_filter.h"
+
+namespace lsm
+{
+
+    // Key span and prefix filter of one run, so range queries can rule the run out without
+    // reading it.
+    //
+    // Keys are grouped into buckets of 2^prefix_bits consecutive keys, and a bloom filter
+    // holds the bucket (key >> prefix_bits) of every key in the run. A query probes each
+    // bucket it touches and misses the run if none is in the filter; queries touching more
+    // than RANGE_FILTER_MAX_PROBES buckets, or runs without a prefix filter, are answered
+    // from the key span alone. Deletions count as keys, since they hide older values.
+    class RangeFilter
+    {
+    public:
+        // Start an empty filter; add the run's keys in ascending order, then call seal().
+        // A prefix_bits of 0 keeps the key span only.
+        explicit RangeFilter(size_t prefix_bits);
+
+        // Load a filter saved with save(). Throws if the file is missing or damaged.
+        explicit RangeFilter(const std::string &filename);
+
+        // Read a filter written with write() from a stream; name is used in errors
+        RangeFilter(std::istream &in, const std::string &name);
+
+        // Add the next key of the run; keys must be ascending
+        void add(int64_t key);
+
+        // Build the prefix filter from the keys added; no keys may be added afterwards
+        void seal();
+
+        // Save the filter to a file
+        void save(const std::string &filename) const;
+
+        // Write the filter to a stream, in the format of save()
+        void write(std::ostream &out) const;
+
+        // Check if the run may hold a key in [start_key, end_key)
+        bool may_overlap(int64_t start_key, int64_t end_key) const;
+
+        // Smallest and largest key of the run
+        int64_t get_min_key() const;
+        int64_t get_max_key() const;
+
+        // Check if the filter has a prefix filter besides the key span
+        bool has_prefix_filter() const;
+
+    private:
+        size_t prefix_bits;
+
+        // Key span; min_key > max_key until a key is added
+        int64_t min_key;
+        int64_t max_key;
+
+        // Distinct prefixes collected until seal(); dropped once there are too many
+        std::vector<int64_t> prefixes;
+        bool too_many_prefixes = false;
+
+        std::unique_ptr<BloomFilter> prefix_filter;
+
+        // Bucket of a key
+        int64_t prefix_of(int64_t key) const;
+
+        // Read the header and prefix filter from a stream
+        void read(std::istream &in, const std::string &name);
+    };
+
+} // namespace lsm
+
+#endif // RANGE_FILTER_H
@@ -0,0 +1,88 @@
+#ifndef RANGE_TOMBSTONE_H
+#define RANGE_TOMBSTONE_H
+
+#include <vector>
+#include <string>
+#include <iosfwd>
+#include <cstdint>
+#include <cstddef>
+
+namespace lsm
+{
+
+    // Deletion of every key in [start_key, end_key)
+    struct RangeTombstone
+    {
+        int64_t start_key;
+        int64_t end_key;
+
+        RangeTombstone(int64_t start, int64_t end) : start_key(start), end_key(end) {}
+
+        // Check if the tombstone deletes a key
+        bool covers(int64_t key) const
+        {
+            return start_key <= key && key < end_key;
+        }
+    };
+
+    // Range tombstones of one buffer or run, kept sorted and coalesced so that no two
+    // overlap or touch.
+    //
+    // A buffer's or run's tombstones delete the keys of older buffers and runs only;
+    // entries of the same buffer or run are newer than its tombstones, since a range
+    // deletion marks the keys already in the buffer as deleted when it is applied.
+    class RangeTombstoneSet
+    {
+    public:
+        RangeTombstoneSet() = default;
+
+        // Build a set from tombstones in any order; empty ranges are dropped
+        explicit RangeTombstoneSet(std::vector<RangeTombstone> tombstones);
+
+        // Load a set saved with save(). Throws if the file is missing or damaged, since
+        // a lost tombstone would bring deleted keys back.
+        static RangeTombstoneSet load(const std::string &filename);
+
+        // Read a set written with write() from a stream; name is used in errors
+        static RangeTombstoneSet read(std::istream &in, const std::string &name);
+
+        // Save the set to a file
+        void save(const std::string &filename) const;
+
+        // Write the set to a stream, in the format of save()
+        void write(std::ostream &out) const;
+
+        // Add a tombstone, merging it with the ones it overlaps or touches
+        void add(const RangeTombstone &tombstone);
+
+        // Add every tombstone of another set
+        void merge(const RangeTombstoneSet &other);
+
+        // The parts of the tombstones within [start_key, end_key)
+        RangeTombstoneSet clip(int64_t start_key, int64_t end_key) const;
+
+        // Check if a key is deleted by one of the tombstones
+        bool covers(int64_t key) const;
+
+        // Check if a tombstone deletes part of [start_key, end_key)
+        bool overlaps(int64_t start_key, int64_t end_key) const;
+
+        // Tombstones in key order
+        const std::vector<RangeTombstone> &get_tombstones() const;
+
+        // Number of tombstones
+        size_t size() const;
+
+        // Check if there are no tombstones
+        bool empty() const;
+
+    private:
+        std::vector<RangeTombstone> tombstones;
+
+        // Sort and coalesce the tombstones
+        void normalize();
+    };
+
+} // namespace lsm
+
+#endif // RANGE_TOMBSTONE_H
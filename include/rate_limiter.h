@@ -0,0 +1,52 @@
+#ifndef RATE_LIMITER_H
+#define RATE_LIMITER_H
+
+#include <chrono>
+#include <mutex>
+#include <atomic>
+#include <cstddef>
+
+namespace lsm
+{
+
+    // Limits the bytes per second callers may write, shared by all threads using it.
+    //
+    // Each request reserves its share of the bandwidth right after the previous one and
+    // sleeps until its turn comes; up to RATE_LIMITER_BURST_MS of unused bandwidth is
+    // carried over, so writes after a pause go out at once. A rate of zero means no limit.
+    class RateLimiter
+    {
+    public:
+        explicit RateLimiter(size_t bytes_per_second);
+
+        // Get the limiter shared by all compactions of the process
+        static RateLimiter &get_compaction_limiter();
+
+        // Deleted copy/move constructors and assignment operators
+        RateLimiter(const RateLimiter &) = delete;
+        RateLimiter &operator=(const RateLimiter &) = delete;
+        RateLimiter(RateLimiter &&) = delete;
+        RateLimiter &operator=(RateLimiter &&) = delete;
+
+        // Block until bytes may be written
+        void request(size_t bytes);
+
+        // Change the rate; takes effect from the next request
+        void set_rate(size_t bytes_per_second);
+
+        // Get the rate in bytes per second (0: unlimited)
+        size_t get_rate() const;
+
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        std::atomic<size_t> rate;
+
+        // When the bandwidth reserved so far runs out
+        std::mutex mutex;
+        Clock::time_point next_free;
+    };
+
+} // namespace lsm
+
+#endif // RATE_LIMITER_H
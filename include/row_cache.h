@@ -0,0 +1,161 @@
+#ifndef ROW_CACHE_H
+#define ROW_CACHE_H
+
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <optional>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+namespace lsm
+{
+
+    // Sharded cache of point lookup results (a value, or the key being absent) for keys
+    // that missed the buffers, so hot keys skip the level walk.
+    //
+    // Eviction is W-TinyLFU: new entries enter a small LRU window, and an entry leaving
+    // the window only displaces the least recently used entry of the main segment if a
+    // frequency sketch has seen its key more often. The main segment is a segmented LRU
+    // whose probation part holds entries hit once and whose protected part holds entries
+    // hit again, so a long scan of cold keys cannot flush the hot ones.
+    //
+    // Writes erase the keys they touch. A lookup takes a ticket before it reads the
+    // buffers and its result is only cached if no write to the key's shard happened
+    // since, so a result computed from an older version is never cached over a newer
+    // write. A capacity of zero disables caching.
+    class RowCache
+    {
+    public:
+        // Cached lookup result; nullopt if the key is absent or deleted
+        using Value = std::optional<int64_t>;
+
+        RowCache(size_t capacity_entries, size_t num_shards);
+
+        // Deleted copy/move constructors and assignment operators
+        RowCache(const RowCache &) = delete;
+        RowCache &operator=(const RowCache &) = delete;
+        RowCache(RowCache &&) = delete;
+        RowCache &operator=(RowCache &&) = delete;
+
+        // Get a ticket for a lookup about to read the tree
+        uint64_t ticket(int64_t key) const;
+
+        // Look a key up; returns nullopt on a miss
+        std::optional<Value> lookup(int64_t key);
+
+        // Cache the result of a lookup unless the key's shard was written since the ticket
+        void insert(int64_t key, Value value, uint64_t ticket);
+
+        // Drop a key that was written
+        void erase(int64_t key);
+
+        // Drop every entry, e.g. after a range deletion
+        void clear();
+
+        // Change the total capacity; this empties the cache
+        void set_capacity(size_t capacity_entries);
+
+        // Get the total capacity in entries
+        size_t capacity() const;
+
+        // Get the number of entries cached
+        size_t size() const;
+
+        // Hit/miss statistics
+        size_t get_hit_count() const;
+        size_t get_miss_count() const;
+        void reset_stats();
+
+    private:
+        // Approximate access counts of recently seen keys: a count-min sketch of 4-bit
+        // counters, halved every RESET_MULTIPLIER * capacity accesses so old popularity fades
+        class FrequencySketch
+        {
+        public:
+            // Size the sketch for a shard capacity
+            void resize(size_t capacity_entries);
+
+            // Count an access to a key
+            void increment(int64_t key);
+
+            // Estimated accesses to a key
+            uint8_t frequency(int64_t key) const;
+
+        private:
+            static constexpr size_t ROWS = 4;
+
+            std::vector<uint8_t> counters; // ROWS rows of `width` counters
+            size_t width = 0;
+            size_t additions = 0;
+            size_t reset_threshold = 0;
+
+            // Counter of a key in a row
+            size_t index(int64_t key, size_t row) const;
+        };
+
+        enum class Segment : uint8_t
+        {
+            WINDOW,
+            PROBATION,
+            PROTECTED
+        };
+
+        struct Entry
+        {
+            int64_t key;
+            Value value;
+            Segment segment;
+        };
+
+        using EntryList = std::list<Entry>;
+
+        struct Shard
+        {
+            std::mutex mutex;
+
+            // Most recently used at the front of each list
+            EntryList window;
+            EntryList probation;
+            EntryList protected_entries;
+            std::unordered_map<int64_t, EntryList::iterator> index;
+            FrequencySketch sketch;
+
+            size_t window_capacity = 0;
+            size_t main_capacity = 0;
+            size_t protected_capacity = 0;
+
+            // Bumped by every write to a key of the shard
+            std::atomic<uint64_t> generation{0};
+
+            size_t hits = 0;
+            size_t misses = 0;
+
+            // Set the segment sizes for a capacity and drop every entry
+            void reset(size_t capacity_entries);
+
+            // Move a hit entry towards the protected segment
+            void touch(EntryList::iterator entry);
+
+            // Let the least recently used window entry compete for a place in the main segment
+            void admit_from_window();
+
+            // Remove an entry from its list and the index
+            void remove(EntryList::iterator entry);
+
+            // The list holding a segment's entries
+            EntryList &list_for(Segment segment);
+        };
+
+        Shard &shard_for(int64_t key) const;
+
+        std::vector<std::unique_ptr<Shard>> shards;
+        std::atomic<size_t> total_capacity;
+    };
+
+} // namespace lsm
+
+#endif // ROW_CACHE_H
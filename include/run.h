@@ -6,46 +6,121 @@
 #include <memory>
 #include <optional>
 #include <fstream>
+#include <functional>
+#include <mutex>
+#include <atomic>
+#include <limits>
 #include <cstdint>
 
 #include "bloom_filter.h"
 #include "fence_pointers.h"
+#include "block_cache.h"
 #include "lsm_tree.h"
+#include "merge_iterator.h"
+#include "metrics.h"
+#include "range_tombstone.h"
+#include "range_filter.h"
+#include "manifest.h"
+#include "run_file_writer.h"
+#include "constants.h"
 
 namespace lsm
 {
 
-    // Represents a sorted run of key-value pairs
-    class Run
+    template <typename Traits>
+    class BasicRunIterator;
+    template <typename Traits>
+    class BasicRunRangeIterator;
+
+    // Represents a sorted run of key-value pairs.
+    //
+    // The data file holds one compressed block (see BlockCodec) per fence pointer page,
+    // an index of block offsets, the bloom filter, fence pointers, range filter, range
+    // tombstones and keys as sections starting on cache lines, a table of those sections
+    // and a footer recording the pair count. The sections are mapped and used in place.
+    //
+    // Version 2 files keep the metadata in sidecars (.bloom, .fence, .range and
+    // .tombstones) and are still readable, as are files written before blocks were
+    // introduced, which hold raw pairs; in those, and in version 1 block files, a value of
+    // INT64_MIN marks a deletion.
+    //
+    // The key section holds the blocks again without their values, so the bloom filter can
+    // be rebuilt without reading the data. A rebuilt filter is saved as a .bloom sidecar,
+    // which takes precedence over the filter section.
+    //
+    // A run opened from a manifest record reads none of its files until a lookup first
+    // needs them; lookups outside the recorded key bounds are answered without them.
+    //
+    // Runs are templates over the key/value traits. Keys are widened to int64_t for the
+    // fence pointers, range filter, range tombstones and bounds, and hashed with
+    // Traits::hash for the bloom filter. Runs of other traits record their layout in the
+    // footer version, and the older formats above exist for DefaultTraits only.
+    template <typename Traits>
+    class BasicRun
     {
     public:
-        // Create a new run from a vector of key-value pairs
-        Run(const std::vector<KeyValuePair> &data, int level, size_t run_id, double fpr);
+        using Pair = BasicKeyValuePair<Traits>;
+        using key_type = typename Traits::key_type;
 
-        // Load an existing run from disk
-        Run(const std::string &filename, int level, size_t run_id);
+        static_assert(Traits::INTEGER_KEYS, "run metadata holds keys as int64_t");
+
+        // Load an existing run from disk. Page reads are counted in io when it is given.
+        BasicRun(const std::string &filename, int level, size_t run_id, IoCounters *io = nullptr);
+
+        // Adopt a run whose data file and metadata were written by a RunBuilder
+        BasicRun(const std::string &filename, int level, size_t run_id, size_t num_pairs,
+                 std::unique_ptr<BloomFilter> bloom_filter, std::unique_ptr<FencePointers> fence_pointers,
+                 std::unique_ptr<RangeFilter> range_filter, RangeTombstoneSet range_tombstones,
+                 IoCounters *io = nullptr);
+
+        // Open a run listed in the manifest. Its files are read on first use.
+        BasicRun(const std::string &filename, const ManifestRun &record, IoCounters *io = nullptr);
 
         // Destructor
-        ~Run();
+        ~BasicRun();
+
+        // Get the entry for a key (a value or a deletion). The run's range tombstones are
+        // not consulted; they only delete keys of older runs.
+        std::optional<Pair> get(key_type key) const;
 
-        // Get the value associated with a key
-        std::optional<int64_t> get(int64_t key) const;
+        // Look up several keys, which must be sorted. Keys are checked against the bloom
+        // filter together and each fence page is read once for all keys on it.
+        // Returns (index into keys, entry) for every key found.
+        std::vector<std::pair<size_t, Pair>> multi_get(const std::vector<key_type> &keys) const;
+
+        // Range tombstones deleting keys of older runs
+        const RangeTombstoneSet &get_range_tombstones() const;
+
+        // Check if one of the run's range tombstones deletes a key of an older run
+        bool range_deleted(key_type key) const;
 
         // Get all key-value pairs in a range [start_key, end_key)
-        std::vector<KeyValuePair> range(int64_t start_key, int64_t end_key) const;
+        std::vector<Pair> range(key_type start_key, key_type end_key) const;
+
+        // Check if the run takes part in a range query over [start_key, end_key): it may hold
+        // a key there, or one of its range tombstones reaches into it. Answered from memory.
+        bool may_overlap(key_type start_key, key_type end_key) const;
+
+        // Smallest and largest key the run or its range tombstones touch, widened to int64_t;
+        // answered from memory
+        int64_t get_min_bound() const;
+        int64_t get_max_bound() const;
 
         // Check if this run has a bloom filter
         bool has_bloom_filter() const;
 
-        // Check if a key might be in this run using the bloom filter
-        bool might_contain(int64_t key) const;
+        // Check if a key might be in this run using the key bounds and bloom filter
+        bool might_contain(key_type key) const;
 
         // Get the number of key-value pairs in the run
         size_t size() const;
 
-        // Get the size of the run in bytes
+        // Get the uncompressed size of the run in bytes
         size_t size_bytes() const;
 
+        // Get the size of the data file in bytes
+        size_t size_on_disk() const;
+
         // Get the level of this run
         int get_level() const;
 
@@ -58,22 +133,39 @@ namespace lsm
         // Get the bloom filter bits per element
         size_t get_bloom_filter_bits_per_element() const;
 
-        // Rebuild the bloom filter with a new FPR
-        void rebuild_bloom_filter(double new_fpr);
+        // Get the FPR the bloom filter was built for (1.0 if there is none)
+        double get_bloom_filter_fpr() const;
 
-        // Save all components of the run to disk
-        void save() const;
+        // Rebuild the bloom filter with a new FPR from the key section, or from the data
+        // blocks when the run has no usable key section. Readers keep the old filter until
+        // the new one is swapped in.
+        void rebuild_bloom_filter(double new_fpr);
 
         // Delete all files associated with this run
         void delete_files_from_disk();
 
+        // Delete the run's files when the run is destroyed; used once it has been compacted away
+        void mark_obsolete();
+
+        // Check if the run has been compacted away
+        bool is_obsolete() const;
+
         // Get all key-value pairs from the run
-        std::vector<KeyValuePair> get_all_pairs() const;
+        std::vector<Pair> get_all_pairs() const;
 
         // Get a sample of key-value pairs (for display purposes)
-        std::vector<KeyValuePair> get_sample_pairs(size_t max_count) const;
+        std::vector<Pair> get_sample_pairs(size_t max_count) const;
+
+        // What the manifest records about this run
+        ManifestRun get_manifest_record() const;
+
+        // Generate the data filename for a run in a directory
+        static std::string make_filename(const std::string &directory, int level, size_t run_id);
 
     private:
+        friend class BasicRunIterator<Traits>;
+        friend class BasicRunRangeIterator<Traits>;
+
         // The level this run belongs to
         int level;
 
@@ -86,33 +178,294 @@ namespace lsm
         // Number of key-value pairs in the run
         size_t num_pairs;
 
-        // Size in bytes
+        // Uncompressed size in bytes
         size_t bytes;
 
-        // Bloom filter for faster lookups
-        std::unique_ptr<BloomFilter> bloom_filter;
+        // Size of the data file in bytes
+        size_t file_bytes = 0;
+
+        // File offset of every block followed by the offset of the block index;
+        // empty for a file of raw pairs
+        std::vector<uint64_t> block_offsets;
+
+        // Where a metadata section lies in the data file
+        struct Section
+        {
+            uint64_t offset = 0;
+            uint64_t bytes = 0;
+        };
+
+        // Set for files holding their metadata in sections rather than sidecars
+        bool has_sections = false;
+        Section bloom_section;
+        Section fence_section;
+        Section range_filter_section;
+        Section range_tombstones_section;
+        Section keys_section;
+
+        // Bloom filter for faster lookups; replaced atomically when rebuilt, so always
+        // read it through get_bloom_filter()
+        std::shared_ptr<const BloomFilter> bloom_filter;
 
         // Fence pointers for range queries
         std::unique_ptr<FencePointers> fence_pointers;
 
-        // Read a key-value pair from the file at the given offset
-        KeyValuePair read_pair_at(std::ifstream &file, size_t offset) const;
+        // Key span and prefix filter (nullptr for runs written without one)
+        std::unique_ptr<RangeFilter> range_filter;
+
+        // Range tombstones, loaded from the sidecar
+        RangeTombstoneSet range_tombstones;
+
+        // Set for files that mark deletions with INT64_MIN values rather than a type
+        bool legacy_tombstones = false;
+
+        // Smallest and largest key the run or its range tombstones touch
+        int64_t min_bound = DefaultTraits::min_key();
+        int64_t max_bound = DefaultTraits::max_key();
+
+        // FPR recorded in the manifest, reported until the bloom filter is loaded
+        double recorded_fpr = 1.0;
+
+        // Cleared for a run opened from the manifest until its files are read
+        mutable std::atomic<bool> metadata_loaded{true};
+        mutable std::once_flag metadata_once;
 
-        // Write the run to disk
-        void write_to_disk(const std::vector<KeyValuePair> &data) const;
+        // Set once the run has been compacted away
+        std::atomic<bool> obsolete{false};
 
-        // Create bloom filter and fence pointers
-        void create_metadata(const std::vector<KeyValuePair> &data, double fpr);
+        // Page I/O counters of the owning tree (nullptr if not counted)
+        IoCounters *io;
 
-        // Load metadata (bloom filter and fence pointers)
+        // Identifies this run's pages in the shared block cache
+        uint64_t cache_id = BlockCache::next_file_id();
+
+        // Read-only descriptor for the data file, opened on first read and kept open
+        mutable int data_fd = -1;
+        mutable std::once_flag data_fd_once;
+
+        // Get the current bloom filter (nullptr if there is none)
+        std::shared_ptr<const BloomFilter> get_bloom_filter() const;
+
+        // Get the data file descriptor, opening it if needed
+        int get_data_fd() const;
+
+        // Read bytes of the data file at an offset
+        void read_at(size_t offset, size_t length, void *dest) const;
+
+        // Get a page of the data file, decoded, through the block cache
+        BlockCache::BlockHandle read_page(size_t page) const;
+
+        // Number of pages (blocks) in the data file
+        size_t page_count() const;
+
+        // Key (widened) and pair at a position of a decoded page
+        static int64_t page_key(const BlockCache::Block &block, size_t i);
+        static Pair page_pair(const BlockCache::Block &block, size_t i);
+
+        // Position of the first pair >= key within a page
+        static size_t lower_bound_in_page(const BlockCache::Block &block, int64_t key);
+
+        // Turn INT64_MIN values of a legacy file into deletions
+        void convert_legacy_tombstones(const std::vector<int64_t> &words, std::vector<EntryType> &types) const;
+
+        // Read the footer, block index and section table; returns the pair count
+        size_t load_block_index();
+
+        // Read the block index and metadata of a run opened from the manifest, once
+        void ensure_metadata() const;
+
+        // Check if a key lies within the run's bounds
+        bool in_bounds(int64_t key) const;
+
+        // Set the bounds from the range filter and range tombstones
+        void set_bounds();
+
+        // Pass every key of the run, in order and in chunks, to visit. Returns false if the
+        // key section is missing or damaged, in which case the keys visited are incomplete.
+        bool scan_keys(const std::function<void(const int64_t *, size_t)> &visit) const;
+
+        // Load metadata (bloom filter, fence pointers, range filter and range tombstones)
         void load_metadata();
 
+        // Load the metadata from the sections of the data file
+        void load_sections();
+
         // Generate filenames for different components
         std::string get_data_filename() const;
         std::string get_bloom_filter_filename() const;
         std::string get_fence_pointers_filename() const;
+        std::string get_range_tombstones_filename() const;
+        std::string get_range_filter_filename() const;
     };
 
+    // Sequential, buffered reader over all pairs of a run
+    template <typename Traits>
+    class BasicRunIterator : public BasicPairIterator<Traits>
+    {
+    public:
+        using Pair = BasicKeyValuePair<Traits>;
+        using key_type = typename Traits::key_type;
+
+        explicit BasicRunIterator(const BasicRun<Traits> &run, size_t buffer_bytes = constants::MERGE_BUFFER_SIZE);
+
+        bool valid() const override;
+        const Pair &current() const override;
+        void next() override;
+
+        // Skips the blocks before the key's fence pointer page without reading them
+        void seek(key_type key) override;
+        const RangeTombstoneSet *range_tombstones() const override;
+
+    private:
+        const BasicRun<Traits> &run;
+        std::ifstream file;
+        std::string filename;
+
+        // Decoded words (Traits::RECORD_WORDS per pair) and the type of every pair
+        std::vector<int64_t> buffer;
+        std::vector<EntryType> types;
+        size_t buffered_pairs;
+        size_t position;
+
+        // Pairs not yet read from the file
+        size_t remaining_pairs;
+
+        // Compressed blocks read per refill, the next block to read and its raw words
+        size_t blocks_per_refill;
+        size_t next_block;
+        std::vector<uint64_t> encoded;
+
+        Pair current_pair;
+        bool has_current;
+
+        // Read the next chunk of pairs into the buffer
+        void refill();
+
+        // Read and decode the next group of compressed blocks into the buffer
+        void refill_blocks();
+    };
+
+    // Cursor over the pairs of a run in [start_key, end_key). Pages are read through
+    // the block cache, starting from the fence pointer of start_key.
+    template <typename Traits>
+    class BasicRunRangeIterator : public BasicPairIterator<Traits>
+    {
+    public:
+        using Pair = BasicKeyValuePair<Traits>;
+        using key_type = typename Traits::key_type;
+
+        BasicRunRangeIterator(const BasicRun<Traits> &run, key_type start_key, key_type end_key);
+
+        bool valid() const override;
+        const Pair &current() const override;
+        void next() override;
+
+        // Jumps to the key's fence pointer page without reading the pages before it
+        void seek(key_type key) override;
+        const RangeTombstoneSet *range_tombstones() const override;
+
+    private:
+        const BasicRun<Traits> &run;
+        key_type end_key;
+
+        // Page being read and the position of the next pair in it
+        BlockCache::BlockHandle block;
+        size_t page;
+        size_t position;
+
+        Pair current_pair;
+        bool has_current;
+
+        // Load the pair at the current position, reading the next page when needed
+        void load();
+    };
+
+    // Writes a run incrementally from pairs supplied in ascending key order.
+    // Memory use is the write buffer plus the bloom filter and key-only blocks, which are a
+    // fraction of the run. The whole run is one file, written through a throttled
+    // RunFileWriter and synced once, when it is complete.
+    template <typename Traits>
+    class BasicRunBuilder
+    {
+    public:
+        using Pair = BasicKeyValuePair<Traits>;
+        using key_type = typename Traits::key_type;
+        using value_type = typename Traits::value_type;
+
+        // expected_pairs is an upper bound used to size the bloom filter
+        BasicRunBuilder(const std::string &directory, int level, size_t run_id, double fpr, size_t expected_pairs,
+                        IoCounters *io = nullptr, const RunWriteOptions &options = RunWriteOptions(),
+                        size_t buffer_bytes = constants::MERGE_BUFFER_SIZE);
+
+        // Removes the partial data file unless finish() was called
+        ~BasicRunBuilder();
+
+        // Deleted copy/move constructors and assignment operators
+        BasicRunBuilder(const BasicRunBuilder &) = delete;
+        BasicRunBuilder &operator=(const BasicRunBuilder &) = delete;
+        BasicRunBuilder(BasicRunBuilder &&) = delete;
+        BasicRunBuilder &operator=(BasicRunBuilder &&) = delete;
+
+        // Append a value or a deletion; keys must be strictly ascending
+        void add(key_type key, const value_type &value, EntryType type = EntryType::VALUE);
+
+        // Give the run range tombstones, which delete keys of older runs
+        void add_range_tombstones(const RangeTombstoneSet &tombstones);
+
+        // Number of pairs added so far
+        size_t size() const;
+
+        // Write the remaining data and the metadata sections, sync the file and return the
+        // run (nullptr if no pairs or range tombstones were added)
+        std::unique_ptr<BasicRun<Traits>> finish();
+
+    private:
+        int level;
+        size_t run_id;
+        std::string filename;
+        RunFileWriter file;
+
+        // Key-only blocks of every sealed block, written as a section by finish(); like the
+        // bloom filter they are held until then, a fraction of the size of the data
+        std::vector<uint64_t> keys_blocks;
+
+        // Pairs of the block being filled
+        std::vector<Pair> block;
+
+        // Encoded blocks not yet written
+        std::vector<uint64_t> buffer;
+        size_t buffer_capacity_words;
+
+        // File offset of every block started so far
+        std::vector<uint64_t> block_offsets;
+        uint64_t file_offset;
+
+        size_t num_pairs;
+        bool finished;
+        IoCounters *io;
+
+        std::unique_ptr<BloomFilter> bloom_filter;
+        std::unique_ptr<RangeFilter> range_filter;
+
+        // First key of every page, for the fence pointers
+        std::vector<int64_t> page_keys;
+
+        RangeTombstoneSet range_tombstones;
+
+        // Encode the pairs of the current block into the buffer
+        void seal_block();
+
+        // Write the pending encoded blocks to the data file
+        void flush();
+
+        // Append a metadata section, starting on a cache line; returns its offset and size
+        std::pair<uint64_t, uint64_t> append_section(const std::string &bytes);
+    };
+
+    using RunIterator = BasicRunIterator<DefaultTraits>;
+    using RunRangeIterator = BasicRunRangeIterator<DefaultTraits>;
+    using RunBuilder = BasicRunBuilder<DefaultTraits>;
+
 } // namespace lsm
 
 #endif // RUN_H
\ No newline at end of file
@@ -0,0 +1,84 @@
+#ifndef RUN_FILE_WRITER_H
+#define RUN_FILE_WRITER_H
+
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+#include "rate_limiter.h"
+
+namespace lsm
+{
+
+    // How a run file is written
+    struct RunWriteOptions
+    {
+        // Drop the file's pages from the page cache once it is synced, so a large
+        // compaction does not push out the pages readers are using
+        bool drop_cache = false;
+
+        // Throttles the writes (nullptr: no limit)
+        RateLimiter *rate_limiter = nullptr;
+    };
+
+    // Writes a new file sequentially through one large aligned buffer.
+    //
+    // Data is written RUN_WRITE_BUFFER_BYTES at a time, with O_DIRECT when
+    // RUN_WRITE_DIRECT_IO is set and the file system supports it, so the page cache is
+    // bypassed altogether. finish() writes the remainder and syncs the file once.
+    class RunFileWriter
+    {
+    public:
+        // Create (or truncate) a file; throws if it cannot be created
+        RunFileWriter(const std::string &filename, const RunWriteOptions &options = RunWriteOptions());
+
+        // Closes the file without syncing it unless finish() was called
+        ~RunFileWriter();
+
+        // Deleted copy/move constructors and assignment operators
+        RunFileWriter(const RunFileWriter &) = delete;
+        RunFileWriter &operator=(const RunFileWriter &) = delete;
+        RunFileWriter(RunFileWriter &&) = delete;
+        RunFileWriter &operator=(RunFileWriter &&) = delete;
+
+        // Append bytes to the file
+        void append(const void *data, size_t size);
+
+        // Append zero bytes up to the next multiple of alignment
+        void pad_to(size_t alignment);
+
+        // Bytes appended so far
+        uint64_t offset() const;
+
+        // Write what is buffered, sync the file and close it; throws on failure
+        void finish();
+
+    private:
+        struct FreeDeleter
+        {
+            void operator()(char *p) const
+            {
+                std::free(p);
+            }
+        };
+
+        std::string filename;
+        RunWriteOptions options;
+        int fd;
+        bool direct;
+
+        // Aligned staging buffer and the bytes in it
+        std::unique_ptr<char, FreeDeleter> buffer;
+        size_t buffered;
+
+        // Bytes written to the file so far
+        uint64_t written;
+
+        // Write the first size bytes of the buffer at the end of the file
+        void write_buffer(size_t size);
+    };
+
+} // namespace lsm
+
+#endif // RUN_FILE_WRITER_H
@@ -5,17 +5,30 @@
 #include <unordered_map>
 #include <atomic>
 #include <vector>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include <functional>
 #include <sys/socket.h>
 #include <netinet/in.h>
 
 #include "thread_pool.h"
+#include "event_loop.h"
+#include "protocol.h"
 #include "constants.h"
 
 namespace lsm
 {
 
+    class ShardedLSMTree;
+
+    // Event-driven server.
+    //
+    // A few I/O threads each run an event loop over their share of the connections and
+    // do all reads and parsing. Parsed commands run on the worker pool, which appends
+    // responses to the connection's output buffer; writes are non-blocking and the
+    // owning I/O thread finishes any that would block.
     class Server
     {
     public:
@@ -35,11 +48,98 @@ namespace lsm
         void stop();
 
     private:
-        // Handle new client connections
-        void handle_connections();
+        struct IOThread;
+
+        // State of one client connection
+        struct Connection
+        {
+            int fd;
+            IOThread *owner;
+
+            // Read side, touched only by the owning I/O thread
+            std::string input;
+            bool binary = false;
+
+            // Shared with the workers
+            std::mutex mutex;
+            std::string output;
+            bool write_pending = false;     // Owner will finish writing output
+            bool close_after_write = false; // Client asked to disconnect
+            bool closed = false;
+
+            // Text commands run one at a time so their responses stay in order
+            std::deque<std::string> text_commands;
+            bool text_worker_active = false;
+
+            // Binary batches also run one at a time, so requests apply in the order they
+            // were sent; they start once the text commands before the switch are done
+            std::deque<std::vector<protocol::Request>> binary_batches;
+            bool binary_worker_active = false;
+        };
+
+        // An I/O thread and the connections it owns
+        struct IOThread
+        {
+            std::unique_ptr<EventLoop> loop;
+            std::thread thread;
+            std::unordered_map<int, std::shared_ptr<Connection>> connections;
+
+            // Hand-offs from other threads, guarded by mutex
+            std::mutex mutex;
+            std::vector<std::shared_ptr<Connection>> incoming;
+            std::vector<std::shared_ptr<Connection>> write_requests;
+        };
+
+        // Event loop of an I/O thread
+        void run_io_thread(IOThread &io);
+
+        // Accept all pending connections and spread them over the I/O threads
+        void accept_connections();
+
+        // Read from a connection and dispatch what was parsed
+        void handle_readable(IOThread &io, const std::shared_ptr<Connection> &connection);
+
+        // Continue writing queued output
+        void handle_writable(IOThread &io, const std::shared_ptr<Connection> &connection);
 
-        // Handle client communication
-        void handle_client(int client_socket);
+        // Close a connection owned by an I/O thread
+        void close_connection(IOThread &io, const std::shared_ptr<Connection> &connection);
+
+        // Split buffered input into text commands; stops at a switch to binary
+        void parse_text_commands(const std::shared_ptr<Connection> &connection);
+
+        // Decode buffered binary requests and hand them to a worker
+        bool parse_binary_requests(const std::shared_ptr<Connection> &connection);
+
+        // Worker loop running a connection's text commands in order
+        void run_text_commands(const std::shared_ptr<Connection> &connection);
+
+        // Worker loop running a connection's binary batches in order
+        void run_binary_requests(const std::shared_ptr<Connection> &connection);
+
+        // Start the binary worker of a connection if batches wait and no worker runs;
+        // connection mutex held. Returns true if the caller must submit the worker.
+        bool claim_binary_worker(Connection &connection);
+
+        // Append output for a connection and write as much as possible without blocking
+        void queue_output(const std::shared_ptr<Connection> &connection, const std::string &data);
+
+        // Write buffered output until done or the socket would block; connection mutex held
+        bool flush_output(Connection &connection);
+
+        // Ask the owning I/O thread to finish writing a connection's output
+        void request_write(const std::shared_ptr<Connection> &connection);
+
+        // Turn a text command's result into the response sent on the wire
+        std::string format_text_response(const std::string &command, std::string response) const;
+
+        // Stream the results of a text range command; false if it is not a valid range command
+        bool stream_text_range(const std::shared_ptr<Connection> &connection, const std::string &command);
+
+        // Process a binary request and append the encoded response to `out`. Range results
+        // are streamed: `out` is sent to the connection whenever a chunk of pairs is ready.
+        void process_binary_request(ShardedLSMTree &tree, const std::shared_ptr<Connection> &connection,
+                                    const protocol::Request &request, std::string &out);
 
         // Process a command from a client
         std::string process_command(const std::string &command);
@@ -51,14 +151,11 @@ namespace lsm
         // Thread pool for handling client requests
         std::unique_ptr<ThreadPool> thread_pool;
 
-        // Thread for accepting new connections
-        std::unique_ptr<std::thread> connection_thread;
-
-        // Active client connections
-        std::unordered_map<int, std::unique_ptr<std::thread>> clients;
-        std::mutex clients_mutex;
+        // I/O threads; the first one also accepts connections
+        std::vector<std::unique_ptr<IOThread>> io_threads;
+        std::atomic<size_t> next_io_thread{0};
     };
 
 } // namespace lsm
 
-#endif // SERVER_H
\ No newline at end of file
+#endif // SERVER_H
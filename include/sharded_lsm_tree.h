@@ -0,0 +1,124 @@
+#ifndef SHARDED_LSM_TREE_H
+#define SHARDED_LSM_TREE_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <optional>
+#include <functional>
+#include <ostream>
+#include <cstdint>
+#include "lsm_tree.h"
+#include "constants.h"
+
+namespace lsm
+{
+
+    // A set of independent LSM-tree shards, each with its own data subdirectory,
+    // buffers, write-ahead log and compaction, so writes to different shards never
+    // share a lock.
+    //
+    // Keys are hash-partitioned. Point operations go to the one shard owning the key;
+    // range operations fan out to every shard and merge the results, which never
+    // overlap. With a single shard the tree lives in the data directory itself, as an
+    // unsharded tree does. The shard count is recorded in the data directory and must
+    // not change between runs.
+    class ShardedLSMTree
+    {
+    public:
+        // Open (or create) shard_count shards in a data directory. With pin_threads, the
+        // background threads of shard i run on core i (modulo the core count).
+        explicit ShardedLSMTree(size_t shard_count, const std::string &data_directory = constants::DATA_DIRECTORY,
+                                bool pin_threads = false);
+
+        // Deleted copy/move constructors and assignment operators
+        ShardedLSMTree(const ShardedLSMTree &) = delete;
+        ShardedLSMTree &operator=(const ShardedLSMTree &) = delete;
+        ShardedLSMTree(ShardedLSMTree &&) = delete;
+        ShardedLSMTree &operator=(ShardedLSMTree &&) = delete;
+
+        // Number of shards
+        size_t shard_count() const;
+
+        // Get a shard
+        LSMTree &shard(size_t index) const;
+
+        // Index of the shard owning a key
+        size_t shard_for_key(int64_t key) const;
+
+        // Run fn on every shard, in order
+        void for_each_shard(const std::function<void(LSMTree &)> &fn) const;
+
+        // Primary operations, as on LSMTree
+        void put(int64_t key, int64_t value, Durability durability = Durability::ASYNC);
+        std::optional<int64_t> get(int64_t key);
+        std::vector<KeyValuePair> range(int64_t start_key, int64_t end_key);
+        bool remove(int64_t key, Durability durability = Durability::ASYNC);
+        void delete_range(int64_t start_key, int64_t end_key, Durability durability = Durability::ASYNC);
+
+        // Stream the live pairs in [start_key, end_key) in key order, merged over the
+        // shards; see LSMTree::scan
+        void scan(int64_t start_key, int64_t end_key, size_t chunk_pairs,
+                  const std::function<bool(const std::vector<KeyValuePair> &)> &consumer);
+
+        // Multi-key operations, split by shard; multi_get results follow the order of `keys`
+        std::vector<std::optional<int64_t>> multi_get(const std::vector<int64_t> &keys);
+        void multi_put(const std::vector<KeyValuePair> &pairs, Durability durability = Durability::ASYNC);
+
+        // Load a file of pairs through the write path
+        void load_file(const std::string &filepath);
+
+        // Bulk load a file; with several shards it is split by shard first and the
+        // shards load their parts concurrently
+        void bulk_load_file(const std::string &filepath);
+
+        // Compact every shard
+        void compact();
+
+        // Block until the flushes and compactions of every shard have finished
+        void wait_for_background_work();
+
+        // Total number of key-value pairs (logical count)
+        size_t size() const;
+
+        // Tree statistics of every shard
+        void print_stats(std::ostream &out) const;
+
+        // Latency and filter statistics of every shard as text lines
+        void write_metrics_text(std::ostream &out) const;
+
+        // Metrics as one JSON object; several shards are reported one by one under "shards"
+        void write_metrics_json(std::ostream &out) const;
+
+        // Settings applied to every shard
+        void set_size_ratio(size_t ratio);
+        void set_auto_tuning(bool enabled);
+        void set_parallel_lookup(bool enabled);
+
+        // Row cache capacity in entries, split evenly between the shards
+        void set_row_cache_capacity(size_t entries);
+
+        // Statistics summed (or averaged) over the shards
+        size_t get_read_io_count() const;
+        size_t get_write_io_count() const;
+        void reset_io_stats();
+        double get_avg_read_time_ms() const;
+        double get_avg_write_time_ms() const;
+        size_t get_read_count() const;
+        size_t get_write_count() const;
+        void reset_timing_stats();
+
+    private:
+        std::string data_directory;
+        std::vector<std::unique_ptr<LSMTree>> shards;
+
+        // Directory of a shard in a tree of shard_count shards
+        std::string shard_directory(size_t index, size_t shard_count) const;
+
+        // Check the shard count recorded in the data directory, recording it if there is none
+        void check_layout(size_t shard_count) const;
+    };
+
+} // namespace lsm
+
+#endif // SHARDED_LSM_TREE_H
@@ -3,66 +3,176 @@
 
 #include <cstdint>
 #include <memory>
-#include <random>
 #include <vector>
 #include <optional>
+#include <atomic>
 #include <mutex>
+#include <new>
+#include <type_traits>
 #include "lsm_tree.h"
+#include "range_tombstone.h"
+#include "merge_iterator.h"
+#include "arena.h"
 #include "constants.h"
 
 namespace lsm
 {
 
+    // Value of a skip list node, which writers replace while readers load it. Integers
+    // are kept in a lock-free atomic in the node.
+    template <typename Value, typename Enable = void>
+    class SkipListValue
+    {
+    public:
+        SkipListValue(Arena &, Value value) : value(value) {}
+
+        Value load() const
+        {
+            return value.load(std::memory_order_acquire);
+        }
+
+        void store(Arena &, Value new_value)
+        {
+            value.store(new_value, std::memory_order_release);
+        }
+
+    private:
+        std::atomic<Value> value;
+    };
+
+    // Wider values are copied into the arena and the node points at the copy, so a reader
+    // never sees half of an update. Replaced copies stay in the arena and count in its size.
+    template <typename Value>
+    class SkipListValue<Value, std::enable_if_t<!std::is_integral_v<Value>>>
+    {
+    public:
+        SkipListValue(Arena &arena, const Value &value) : value(copy(arena, value)) {}
+
+        Value load() const
+        {
+            return *value.load(std::memory_order_acquire);
+        }
+
+        void store(Arena &arena, const Value &new_value)
+        {
+            value.store(copy(arena, new_value), std::memory_order_release);
+        }
+
+    private:
+        std::atomic<const Value *> value;
+
+        static const Value *copy(Arena &arena, const Value &value)
+        {
+            return new (arena.allocate(sizeof(Value), alignof(Value))) Value(value);
+        }
+    };
+
     // Node in the skip list
-    class SkipListNode
+    //
+    // The tower of next pointers is stored inline after the node, so a node is a
+    // single arena allocation sized for its height. Nodes are created with create()
+    // and are never freed individually; they go away with their arena.
+    template <typename Traits>
+    class BasicSkipListNode
     {
     public:
-        SkipListNode(int64_t key, int64_t value, int height);
+        using Pair = BasicKeyValuePair<Traits>;
+        using key_type = typename Traits::key_type;
+        using value_type = typename Traits::value_type;
 
-        // Special constructor for sentinel nodes
-        explicit SkipListNode(int height);
+        // Allocate a node with room for `height` next pointers from an arena
+        static BasicSkipListNode *create(Arena &arena, key_type key, const value_type &value, EntryType type,
+                                         int height);
 
-        int64_t get_key() const;
-        int64_t get_value() const;
-        void set_value(int64_t new_value);
+        // Allocate a sentinel node from an arena
+        static BasicSkipListNode *create_sentinel(Arena &arena, int height);
+
+        // Get the number of bytes occupied by a node of the given height
+        static size_t allocation_size(int height);
+
+        key_type get_key() const;
+        value_type get_value() const;
+
+        // Load the node's entry (a value or a deletion); a deletion reads as value zero
+        Pair get_entry() const;
+
+        // Store a value or mark the node deleted. The value is stored before the type, so
+        // a reader that sees VALUE also sees the value that goes with it. Wide values are
+        // copied into the list's arena.
+        void set_entry(Arena &arena, const value_type &new_value, EntryType new_type);
 
         // Get the next node at a specific level
-        SkipListNode *next(int level) const;
+        BasicSkipListNode *next(int level) const;
 
         // Set the next node at a specific level
-        void set_next(int level, SkipListNode *node);
+        void set_next(int level, BasicSkipListNode *node);
+
+        // Link `node` after this one at a level if the next node is still `expected`
+        bool cas_next(int level, BasicSkipListNode *expected, BasicSkipListNode *node);
 
         // Get the height of this node
         int get_height() const;
 
     private:
-        int64_t key;
-        int64_t value;
+        BasicSkipListNode(Arena &arena, key_type key, const value_type &value, EntryType type, int height);
+
+        key_type key;
+        SkipListValue<value_type> value;
         int height;
-        std::vector<SkipListNode *> next_nodes;
+        std::atomic<EntryType> type;
+
+        // First slot of the tower; the remaining height - 1 slots follow the node
+        std::atomic<BasicSkipListNode *> next_nodes[1];
     };
 
-    // Skip list implementation for the buffer
-    class SkipList
+    template <typename Traits>
+    class BasicSkipListIterator;
+
+    // Lock-free skip list implementation for the buffer, over the pairs of Traits
+    //
+    // Writers link new nodes bottom-up with compare-and-swap and update existing keys
+    // in place, so any number of threads may insert concurrently. Readers never block
+    // or retry. Nodes are never unlinked; they live in an arena that is freed at once
+    // when the list is destroyed or cleared.
+    template <typename Traits>
+    class BasicSkipList
     {
     public:
-        SkipList();
-        ~SkipList();
+        using Pair = BasicKeyValuePair<Traits>;
+        using Node = BasicSkipListNode<Traits>;
+        using key_type = typename Traits::key_type;
+        using value_type = typename Traits::value_type;
+
+        static_assert(Traits::INTEGER_KEYS, "range tombstones hold keys as int64_t");
+
+        BasicSkipList();
+        ~BasicSkipList();
 
         // Deleted copy/move constructors and assignment operators
-        SkipList(const SkipList &) = delete;
-        SkipList &operator=(const SkipList &) = delete;
-        SkipList(SkipList &&) = delete;
-        SkipList &operator=(SkipList &&) = delete;
+        BasicSkipList(const BasicSkipList &) = delete;
+        BasicSkipList &operator=(const BasicSkipList &) = delete;
+        BasicSkipList(BasicSkipList &&) = delete;
+        BasicSkipList &operator=(BasicSkipList &&) = delete;
+
+        // Insert or update a key-value pair, or mark the key deleted
+        void insert(key_type key, const value_type &value, EntryType type = EntryType::VALUE);
 
-        // Insert or update a key-value pair
-        void insert(int64_t key, int64_t value);
+        // Delete every key in [start_key, end_key): keys already in the list are marked
+        // deleted and the range is kept as a tombstone for the older buffers and runs.
+        // A deletion is also stored at start_key, so the list is never left empty.
+        void delete_range(key_type start_key, key_type end_key);
 
-        // Get the value for a key
-        std::optional<int64_t> get(int64_t key) const;
+        // Get the entry for a key (a value or a deletion)
+        std::optional<Pair> get(key_type key) const;
+
+        // Range tombstones applied to the list so far
+        std::shared_ptr<const RangeTombstoneSet> get_range_tombstones() const;
+
+        // Check if a range tombstone of the list deletes a key of older sources
+        bool range_deleted(key_type key) const;
 
         // Get all key-value pairs in a range [start_key, end_key)
-        std::vector<KeyValuePair> range(int64_t start_key, int64_t end_key) const;
+        std::vector<Pair> range(key_type start_key, key_type end_key) const;
 
         // Check if the buffer is full
         bool is_full() const;
@@ -73,39 +183,80 @@ namespace lsm
         // Get the number of elements in the skip list
         size_t element_count() const;
 
-        // Empty the skip list
+        // Empty the skip list; must not run concurrently with any other operation
         void clear();
 
         // Get all key-value pairs in sorted order
-        std::vector<KeyValuePair> get_all_sorted() const;
+        std::vector<Pair> get_all_sorted() const;
 
     private:
-        // Head and tail sentinel nodes
-        std::unique_ptr<SkipListNode> head;
-        std::unique_ptr<SkipListNode> tail;
+        friend class BasicSkipListIterator<Traits>;
+
+        // Memory for all nodes; also tracks the exact size of the list
+        Arena arena;
 
-        // Current size in bytes
-        size_t current_size;
+        // Head sentinel node; a null next pointer marks the end of a level
+        Node *head;
 
         // Number of elements
-        size_t num_elements;
+        std::atomic<size_t> num_elements;
 
-        // For synchronization
-        mutable std::mutex skip_list_mutex;
+        // Height of the tallest node, where searches start
+        std::atomic<int> max_height;
 
-        // Random number generator for levels
-        std::mt19937 rng;
+        // Range tombstones; replaced as a whole on every range deletion, so readers
+        // take a snapshot with one atomic load
+        std::shared_ptr<const RangeTombstoneSet> range_tombstones;
+        std::atomic<bool> has_range_tombstones{false}; // Lets lookups skip the snapshot
+        std::mutex range_tombstone_mutex;            // Serializes range deletions
 
         // Determine the height for a new node
         int random_height();
 
-        // Find the nodes that would precede a key at each level
-        void find_predecessors(int64_t key, std::vector<SkipListNode *> &predecessors) const;
+        // Find the first node >= key, starting from the tallest level in use
+        Node *find_greater_or_equal(key_type key) const;
 
-        // Estimate the size of a key-value pair in bytes
-        size_t estimate_pair_size(int64_t key, int64_t value, int height) const;
+        // Find the nodes that would precede and follow a key at each level
+        void find_predecessors(key_type key, Node **predecessors, Node **successors) const;
     };
 
+    // Cursor over the pairs of a skip list in [start_key, end_key). It may be used
+    // while writers insert and keeps the list alive until it is destroyed.
+    template <typename Traits>
+    class BasicSkipListIterator : public BasicPairIterator<Traits>
+    {
+    public:
+        using Pair = BasicKeyValuePair<Traits>;
+        using key_type = typename Traits::key_type;
+
+        BasicSkipListIterator(std::shared_ptr<const BasicSkipList<Traits>> list, key_type start_key,
+                              key_type end_key);
+
+        bool valid() const override;
+        const Pair &current() const override;
+        void next() override;
+        void seek(key_type key) override;
+        const RangeTombstoneSet *range_tombstones() const override;
+
+    private:
+        std::shared_ptr<const BasicSkipList<Traits>> list;
+        const BasicSkipListNode<Traits> *node;
+        key_type end_key;
+
+        // Tombstones of the list when the iterator was created
+        std::shared_ptr<const RangeTombstoneSet> tombstones;
+
+        Pair current_pair;
+        bool has_current;
+
+        // Load the pair at `node`, or mark the iterator exhausted
+        void load();
+    };
+
+    using SkipListNode = BasicSkipListNode<DefaultTraits>;
+    using SkipList = BasicSkipList<DefaultTraits>;
+    using SkipListIterator = BasicSkipListIterator<DefaultTraits>;
+
 } // namespace lsm
 
-#endif // SKIP_LIST_H
\ No newline at end of file
+#endif // SKIP_LIST_H
@@ -1,22 +1,49 @@
 #ifndef THREAD_POOL_H
 #define THREAD_POOL_H
 
+#include <array>
+#include <cstdint>
+#include <deque>
 #include <vector>
-#include <queue>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
 #include <functional>
 #include <future>
+#include <memory>
 #include <atomic>
+#include <stdexcept>
+#include "work_stealing_deque.h"
 
 namespace lsm
 {
 
+    // Restrict a thread to one CPU core (modulo the number of cores). Returns false where
+    // thread affinity is not supported or the call fails.
+    bool pin_thread_to_core(std::thread &thread, size_t core);
+
+    // Work-stealing thread pool.
+    //
+    // Every worker owns a Chase-Lev deque per priority, which tasks submitted from that
+    // worker go to without locking, and an inbox per priority for tasks submitted from
+    // other threads. A worker runs its own tasks first and steals from the other workers
+    // when it runs out. Foreground tasks are always taken ahead of background ones.
     class ThreadPool
     {
     public:
-        explicit ThreadPool(size_t num_threads);
+        // Priority classes; foreground work (client requests) runs ahead of background work
+        enum class Priority
+        {
+            FOREGROUND,
+            BACKGROUND
+        };
+        static constexpr size_t PRIORITY_COUNT = 2;
+
+        // Affinity of a task that may start on any worker
+        static constexpr size_t NO_AFFINITY = SIZE_MAX;
+
+        // With pin_workers, worker i runs on core i only
+        explicit ThreadPool(size_t num_threads, bool pin_workers = false);
         ~ThreadPool();
 
         // Deleted copy/move constructors and assignment operators
@@ -25,20 +52,63 @@ namespace lsm
         ThreadPool(ThreadPool &&) = delete;
         ThreadPool &operator=(ThreadPool &&) = delete;
 
-        // Add a task to the thread pool
+        // Add a task to the thread pool and get a future for its result
         template <class F, class... Args>
         auto enqueue(F &&f, Args &&...args) -> std::future<typename std::invoke_result<F, Args...>::type>;
 
+        // Add a fire-and-forget task. With an affinity the task is queued on that worker
+        // (modulo the pool size), which runs it unless another worker goes idle and steals
+        // it first. Exceptions thrown by the task are logged and dropped. Tasks submitted
+        // by running tasks while the pool is stopping still run before it joins.
+        template <class F>
+        void submit(F &&f, Priority priority = Priority::FOREGROUND, size_t affinity = NO_AFFINITY);
+
+        // Number of worker threads
+        size_t size() const;
+
     private:
+        using Task = WorkStealingDeque::Task;
+
+        // Queues of one worker
+        struct Worker
+        {
+            // Tasks submitted by the worker itself
+            std::array<WorkStealingDeque, PRIORITY_COUNT> local;
+
+            // Tasks submitted from other threads, oldest first
+            std::mutex inbox_mutex;
+            std::array<std::deque<Task *>, PRIORITY_COUNT> inbox;
+        };
+
+        // Check whether the calling thread is one of this pool's workers
+        bool on_worker_thread() const;
+
+        // Queue a task, taking ownership of it
+        void schedule(Task *task, Priority priority, size_t affinity);
+
+        // Find a task of a priority, looking at the worker's own queues first. Returns
+        // nullptr if there is none.
+        Task *take(size_t index, size_t priority);
+
+        // Take the oldest task of a priority from a worker's inbox
+        Task *take_from_inbox(Worker &worker, size_t priority);
+
         // Worker thread function
-        void worker_thread();
+        void worker_thread(size_t index);
 
+        std::vector<std::unique_ptr<Worker>> queues;
         std::vector<std::thread> workers;
-        std::queue<std::function<void()>> tasks;
 
-        // Synchronization
-        std::mutex queue_mutex;
+        // Queued tasks per priority
+        std::array<std::atomic<size_t>, PRIORITY_COUNT> pending;
+
+        // Spreads tasks without affinity submitted from outside the pool over the workers
+        std::atomic<size_t> next_worker;
+
+        // Idle workers sleep here until a task is queued
+        std::mutex sleep_mutex;
         std::condition_variable condition;
+        std::atomic<size_t> sleeping;
         std::atomic<bool> stop;
     };
 
@@ -54,24 +124,23 @@ namespace lsm
             std::bind(std::forward<F>(f), std::forward<Args>(args)...));
 
         std::future<return_type> result = task->get_future();
+        submit([task]()
+               { (*task)(); });
+        return result;
+    }
 
+    template <class F>
+    void ThreadPool::submit(F &&f, Priority priority, size_t affinity)
+    {
+        // Don't allow submitting after stopping the pool, except from tasks still draining
+        if (stop && !on_worker_thread())
         {
-            std::unique_lock<std::mutex> lock(queue_mutex);
-
-            // Don't allow enqueueing after stopping the pool
-            if (stop)
-            {
-                throw std::runtime_error("enqueue on stopped ThreadPool");
-            }
-
-            tasks.emplace([task]()
-                          { (*task)(); });
+            throw std::runtime_error("submit on stopped ThreadPool");
         }
 
-        condition.notify_one();
-        return result;
+        schedule(new Task(std::forward<F>(f)), priority, affinity);
     }
 
 } // namespace lsm
 
-#endif // THREAD_POOL_H
\ No newline at end of file
+#endif // THREAD_POOL_H
@@ -0,0 +1,133 @@
+#ifndef WAL_H
+#define WAL_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+#include <optional>
+#include <cstdint>
+#include <cstddef>
+#include "lsm_tree.h"
+
+namespace lsm
+{
+
+    // Append-only write-ahead log for the memtables.
+    //
+    // The log is a sequence of segment files, one per memtable: the active segment
+    // receives new writes, and roll() seals it when its memtable is handed off. A sealed
+    // segment is deleted once its memtable is safely in a run. Segments are released in
+    // the order they were sealed, matching the order in which memtables are flushed.
+    //
+    // Appends only copy records into a pending buffer. Writers that need durability wait
+    // for a group commit: one of them writes the whole buffer and calls fdatasync on
+    // behalf of everyone waiting, so concurrent writers share a single sync. A background
+    // thread commits asynchronous writes every WAL_SYNC_INTERVAL_MS.
+    //
+    // A failed commit fails the log for good: the segment is cut back to its last synced
+    // record, and every later append and wait throws, so no writer is told that records
+    // which never reached the disk are durable. Sealing still works, so the memtables
+    // holding earlier writes can be flushed.
+    //
+    // Records hold the key and value of Traits as they are, so their size is fixed by the
+    // traits. Segments of other record layouts start with a different magic; they are
+    // never replayed and never deleted, only skipped with a warning.
+    template <typename Traits>
+    class BasicWriteAheadLog
+    {
+    public:
+        using Pair = BasicKeyValuePair<Traits>;
+
+        // Segments live in `directory`; nothing is written until recover() is called
+        explicit BasicWriteAheadLog(const std::string &directory);
+
+        // Commits pending records; an empty active segment is removed
+        ~BasicWriteAheadLog();
+
+        // Deleted copy/move constructors and assignment operators
+        BasicWriteAheadLog(const BasicWriteAheadLog &) = delete;
+        BasicWriteAheadLog &operator=(const BasicWriteAheadLog &) = delete;
+        BasicWriteAheadLog(BasicWriteAheadLog &&) = delete;
+        BasicWriteAheadLog &operator=(BasicWriteAheadLog &&) = delete;
+
+        // Read the segments left on disk, oldest first, and open a new active segment.
+        // Every non-empty segment returned stays sealed until release_oldest() is called
+        // for it; its entries (puts, deletions and range deletions) are in write order, so
+        // later entries win.
+        std::vector<std::vector<Pair>> recover();
+
+        // Queue records for the active segment and run `apply` before any later append, so
+        // the memtable sees writes in log order. Returns the log position after the records.
+        // Throws, without running `apply`, once the log has failed.
+        uint64_t append(const Pair *pairs, size_t count, const std::function<void()> &apply);
+
+        // Block until everything up to a log position is on stable storage; throws if the
+        // log failed first
+        void wait_durable(uint64_t position);
+
+        // Commit and seal the active segment and start a new one
+        void roll();
+
+        // Delete the oldest sealed segment
+        void release_oldest();
+
+    private:
+        std::string directory;
+
+        std::mutex mutex;
+        std::condition_variable commit_condition;
+
+        // Records not yet written to the active segment
+        std::string pending;
+
+        // Log positions (bytes of records ever appended) appended and made durable
+        uint64_t appended_position;
+        uint64_t durable_position;
+
+        // A group commit is writing and syncing outside the lock
+        bool commit_in_progress;
+
+        // Error of the commit that failed the log; empty while it works
+        std::string failure;
+
+        // Active segment
+        int fd;
+        uint64_t segment_number;
+        bool segment_has_records;
+
+        // Bytes of the active segment written and synced by successful commits
+        uint64_t segment_synced_size;
+
+        // Sealed segments awaiting release, oldest first
+        std::deque<std::string> sealed_segments;
+
+        // Background committer for asynchronous writes
+        std::thread committer;
+        bool stopping;
+
+        // Commit everything up to `position`, leading a group commit if none is running
+        void commit(std::unique_lock<std::mutex> &lock, uint64_t position);
+
+        // Background loop committing asynchronous writes
+        void run_committer();
+
+        // Create a segment file and make it the active segment
+        void open_segment(uint64_t number);
+
+        // Path of a segment file
+        std::string segment_filename(uint64_t number) const;
+
+        // Read the records of a segment, stopping at the first torn or corrupt one; nullopt
+        // if it starts with the magic of another record layout
+        static std::optional<std::vector<Pair>> read_segment(const std::string &filename);
+    };
+
+    using WriteAheadLog = BasicWriteAheadLog<DefaultTraits>;
+
+} // namespace lsm
+
+#endif // WAL_H
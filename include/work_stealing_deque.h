@@ -0,0 +1,75 @@
+#ifndef WORK_STEALING_DEQUE_H
+#define WORK_STEALING_DEQUE_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace lsm
+{
+
+    // Chase-Lev work-stealing deque of tasks (Lê et al., "Correct and Efficient
+    // Work-Stealing for Weak Memory Models", 2013).
+    //
+    // Only the owning thread may push() and pop(), which work on the bottom end without
+    // locking unless the deque holds a single task. Any thread may steal() from the top
+    // end. The ring buffer grows when full; replaced buffers are kept until the deque is
+    // destroyed, so a concurrent thief never reads freed memory.
+    class WorkStealingDeque
+    {
+    public:
+        using Task = std::function<void()>;
+
+        explicit WorkStealingDeque(size_t initial_capacity = 256);
+        ~WorkStealingDeque();
+
+        // Deleted copy/move constructors and assignment operators
+        WorkStealingDeque(const WorkStealingDeque &) = delete;
+        WorkStealingDeque &operator=(const WorkStealingDeque &) = delete;
+        WorkStealingDeque(WorkStealingDeque &&) = delete;
+        WorkStealingDeque &operator=(WorkStealingDeque &&) = delete;
+
+        // Add a task at the bottom; owner only
+        void push(Task *task);
+
+        // Take the most recently pushed task; owner only. Returns nullptr if empty.
+        Task *pop();
+
+        // Take the oldest task; any thread. Returns nullptr if empty or if another thread
+        // took the task first.
+        Task *steal();
+
+        // Approximate number of tasks
+        size_t size() const;
+
+    private:
+        // Ring buffer with a power-of-two capacity
+        struct Buffer
+        {
+            explicit Buffer(size_t capacity);
+
+            size_t capacity;
+            size_t mask;
+            std::unique_ptr<std::atomic<Task *>[]> slots;
+
+            Task *get(int64_t index) const;
+            void put(int64_t index, Task *task);
+        };
+
+        // Next slot thieves take from, and next slot the owner pushes to
+        alignas(64) std::atomic<int64_t> top;
+        alignas(64) std::atomic<int64_t> bottom;
+        std::atomic<Buffer *> buffer;
+
+        // Every buffer allocated, including replaced ones; owner only
+        std::vector<std::unique_ptr<Buffer>> buffers;
+
+        // Copy the live tasks into a buffer of twice the capacity
+        Buffer *grow(Buffer *old_buffer, int64_t top_index, int64_t bottom_index);
+    };
+
+} // namespace lsm
+
+#endif // WORK_STEALING_DEQUE_H
@@ -0,0 +1,140 @@
+#include "../include/arena.h"
+
+#include <new>
+
+namespace lsm
+{
+
+    char *Arena::Block::data()
+    {
+        return reinterpret_cast<char *>(this + 1);
+    }
+
+    Arena::Arena(size_t block_size)
+        : block_size(block_size), blocks(nullptr)
+    {
+        Block *first = new_block(block_size);
+        blocks = first;
+        current.store(first);
+    }
+
+    Arena::~Arena()
+    {
+        Block *block = blocks;
+        while (block != nullptr)
+        {
+            Block *next = block->next;
+            block->~Block();
+            ::operator delete(block);
+            block = next;
+        }
+    }
+
+    void *Arena::allocate(size_t bytes, size_t alignment)
+    {
+        void *result = try_allocate(current.load(std::memory_order_acquire), bytes, alignment);
+        if (result != nullptr)
+        {
+            return result;
+        }
+        return allocate_slow(bytes, alignment);
+    }
+
+    void Arena::reset()
+    {
+        std::lock_guard<std::mutex> lock(block_mutex);
+
+        // Keep the current block and free all others
+        Block *keep = current.load();
+        Block *block = blocks;
+        while (block != nullptr)
+        {
+            Block *next = block->next;
+            if (block != keep)
+            {
+                reserved -= block->size;
+                block->~Block();
+                ::operator delete(block);
+            }
+            block = next;
+        }
+
+        keep->next = nullptr;
+        keep->used.store(0);
+        blocks = keep;
+        allocated.store(0);
+    }
+
+    size_t Arena::allocated_bytes() const
+    {
+        return allocated.load(std::memory_order_relaxed);
+    }
+
+    size_t Arena::memory_usage() const
+    {
+        return reserved.load(std::memory_order_relaxed);
+    }
+
+    Arena::Block *Arena::new_block(size_t size)
+    {
+        void *memory = ::operator new(sizeof(Block) + size);
+        Block *block = new (memory) Block{nullptr, size, {0}};
+        reserved += size;
+        return block;
+    }
+
+    void *Arena::try_allocate(Block *block, size_t bytes, size_t alignment)
+    {
+        uintptr_t base = reinterpret_cast<uintptr_t>(block->data());
+        size_t offset = block->used.load(std::memory_order_relaxed);
+
+        while (true)
+        {
+            // Align the absolute address, not just the offset
+            size_t start = ((base + offset + alignment - 1) & ~(uintptr_t(alignment) - 1)) - base;
+            if (start + bytes > block->size)
+            {
+                return nullptr;
+            }
+
+            if (block->used.compare_exchange_weak(offset, start + bytes, std::memory_order_relaxed))
+            {
+                allocated.fetch_add(start + bytes - offset, std::memory_order_relaxed);
+                return block->data() + start;
+            }
+        }
+    }
+
+    void *Arena::allocate_slow(size_t bytes, size_t alignment)
+    {
+        std::lock_guard<std::mutex> lock(block_mutex);
+
+        // Large allocations get a block of their own so the current block is not wasted
+        bool dedicated = bytes + alignment > block_size / 4;
+
+        if (!dedicated)
+        {
+            // Another thread may have started a new block while we waited
+            void *result = try_allocate(current.load(std::memory_order_acquire), bytes, alignment);
+            if (result != nullptr)
+            {
+                return result;
+            }
+        }
+
+        Block *block = new_block(dedicated ? bytes + alignment : block_size);
+        void *result = try_allocate(block, bytes, alignment);
+
+        block->next = blocks;
+        blocks = block;
+
+        // Publish the block only after our allocation is carved out of it
+        if (!dedicated)
+        {
+            current.store(block, std::memory_order_release);
+        }
+
+        return result;
+    }
+
+}
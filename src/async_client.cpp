@@ -0,0 +1,601 @@
+#include "../include/async_client.h"
+#include "../include/constants.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+
+namespace lsm
+{
+
+    namespace
+    {
+        // Error for a response with status ERROR
+        std::exception_ptr response_error(const protocol::Response &response)
+        {
+            return std::make_exception_ptr(std::runtime_error("Server error: " + response.text));
+        }
+
+        // Send a whole buffer, retrying short writes
+        bool send_fully(int fd, const char *data, size_t size)
+        {
+            while (size > 0)
+            {
+                ssize_t sent = ::send(fd, data, size, MSG_NOSIGNAL);
+                if (sent < 0)
+                {
+                    if (errno == EINTR)
+                    {
+                        continue;
+                    }
+                    return false;
+                }
+                data += sent;
+                size -= static_cast<size_t>(sent);
+            }
+            return true;
+        }
+    }
+
+    AsyncClient::AsyncClient(const std::string &host, int port, const AsyncClientOptions &options)
+        : host(host), port(port), options(options)
+    {
+        this->options.connections = std::max<size_t>(this->options.connections, 1);
+        this->options.max_batch_keys = std::max<size_t>(this->options.max_batch_keys, 1);
+        this->options.max_batches_in_flight = std::max<size_t>(this->options.max_batches_in_flight, 1);
+    }
+
+    AsyncClient::~AsyncClient()
+    {
+        disconnect();
+    }
+
+    void AsyncClient::connect()
+    {
+        if (!connections.empty())
+        {
+            return;
+        }
+
+        try
+        {
+            for (size_t i = 0; i < options.connections; ++i)
+            {
+                connections.push_back(std::make_unique<Connection>());
+                open_connection(*connections.back());
+            }
+        }
+        catch (...)
+        {
+            disconnect();
+            throw;
+        }
+
+        for (auto &connection : connections)
+        {
+            Connection *raw = connection.get();
+            connection->receiver = std::thread([this, raw]()
+                                               { receive_responses(*raw); });
+        }
+    }
+
+    void AsyncClient::open_connection(Connection &connection)
+    {
+        struct addrinfo hints;
+        std::memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+
+        struct addrinfo *address = nullptr;
+        if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &address) != 0 || !address)
+        {
+            throw std::runtime_error("Failed to resolve hostname: " + host);
+        }
+
+        connection.fd = socket(address->ai_family, address->ai_socktype | SOCK_CLOEXEC, address->ai_protocol);
+        if (connection.fd < 0 || ::connect(connection.fd, address->ai_addr, address->ai_addrlen) < 0)
+        {
+            std::string error = std::strerror(errno);
+            freeaddrinfo(address);
+            throw std::runtime_error("Connection to " + host + ":" + std::to_string(port) + " failed: " + error);
+        }
+        freeaddrinfo(address);
+
+        // Requests are small and latency bound
+        int no_delay = 1;
+        setsockopt(connection.fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+
+        std::string upgrade = std::string(constants::CMD_BINARY) + constants::CMD_DELIMITER;
+        if (!send_fully(connection.fd, upgrade.data(), upgrade.size()))
+        {
+            throw std::runtime_error("Failed to request the binary protocol: " + std::string(std::strerror(errno)));
+        }
+
+        // Skip the welcome line up to the acknowledgment; binary frames follow it
+        connection.receive_buffer.resize(constants::PROTOCOL_READ_BUFFER_SIZE);
+        std::string reply;
+        while (true)
+        {
+            size_t delimiter_pos = reply.find(constants::CMD_DELIMITER);
+            if (delimiter_pos != std::string::npos)
+            {
+                std::string line = reply.substr(0, delimiter_pos);
+                reply.erase(0, delimiter_pos + std::strlen(constants::CMD_DELIMITER));
+                if (line == constants::BINARY_PROTOCOL_READY)
+                {
+                    break;
+                }
+                continue;
+            }
+
+            ssize_t bytes_read = recv(connection.fd, connection.receive_buffer.data(),
+                                      connection.receive_buffer.size(), 0);
+            if (bytes_read < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (bytes_read <= 0)
+            {
+                throw std::runtime_error("Server did not accept the binary protocol");
+            }
+            reply.append(connection.receive_buffer.data(), static_cast<size_t>(bytes_read));
+        }
+
+        if (reply.size() > connection.receive_buffer.size())
+        {
+            connection.receive_buffer.resize(reply.size());
+        }
+        std::memcpy(connection.receive_buffer.data(), reply.data(), reply.size());
+        connection.receive_begin = 0;
+        connection.receive_end = reply.size();
+        connection.open.store(true);
+    }
+
+    void AsyncClient::disconnect()
+    {
+        // Wake the receivers; each fails what is still pending on its connection
+        for (auto &connection : connections)
+        {
+            if (connection->fd >= 0)
+            {
+                shutdown(connection->fd, SHUT_RDWR);
+            }
+        }
+
+        for (auto &connection : connections)
+        {
+            if (connection->receiver.joinable())
+            {
+                connection->receiver.join();
+            }
+            fail_connection(*connection, "Connection closed");
+            if (connection->fd >= 0)
+            {
+                close(connection->fd);
+                connection->fd = -1;
+            }
+        }
+        connections.clear();
+
+        // Gets that never went out
+        std::deque<QueuedGet> orphaned;
+        {
+            std::lock_guard<std::mutex> lock(batch_mutex);
+            orphaned.swap(queued_gets);
+            batches_in_flight = 0;
+        }
+        auto error = std::make_exception_ptr(std::runtime_error("Not connected to server"));
+        for (auto &get : orphaned)
+        {
+            get.callback(error, std::nullopt);
+        }
+    }
+
+    bool AsyncClient::is_connected() const
+    {
+        return std::any_of(connections.begin(), connections.end(), [](const auto &connection)
+                           { return connection->open.load(); });
+    }
+
+    void AsyncClient::receive_responses(Connection &connection)
+    {
+        while (connection.open.load())
+        {
+            // Make room at the end of the buffer: slide undecoded bytes to the front, or
+            // grow it if a single frame needs more space
+            auto &buffer = connection.receive_buffer;
+            if (connection.receive_end == buffer.size())
+            {
+                if (connection.receive_begin > 0)
+                {
+                    std::memmove(buffer.data(), buffer.data() + connection.receive_begin,
+                                 connection.receive_end - connection.receive_begin);
+                    connection.receive_end -= connection.receive_begin;
+                    connection.receive_begin = 0;
+                }
+                else
+                {
+                    buffer.resize(buffer.size() * 2);
+                }
+            }
+
+            ssize_t bytes_read = recv(connection.fd, buffer.data() + connection.receive_end,
+                                      buffer.size() - connection.receive_end, 0);
+            if (bytes_read < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (bytes_read <= 0)
+            {
+                break;
+            }
+
+            connection.receive_end += static_cast<size_t>(bytes_read);
+            dispatch_responses(connection);
+        }
+
+        fail_connection(connection, "Connection closed");
+    }
+
+    void AsyncClient::dispatch_responses(Connection &connection)
+    {
+        protocol::Response &response = connection.response;
+        try
+        {
+            while (size_t consumed = protocol::decode_response(connection.receive_buffer.data() + connection.receive_begin,
+                                                               connection.receive_end - connection.receive_begin,
+                                                               response))
+            {
+                connection.receive_begin += consumed;
+
+                // Collect streamed chunks until the final frame of the response
+                if (response.status == protocol::Status::PARTIAL)
+                {
+                    auto &pairs = connection.partial_pairs[response.id];
+                    pairs.insert(pairs.end(), response.pairs.begin(), response.pairs.end());
+                    continue;
+                }
+
+                auto partial = connection.partial_pairs.find(response.id);
+                if (partial != connection.partial_pairs.end())
+                {
+                    if (response.status == protocol::Status::OK)
+                    {
+                        partial->second.insert(partial->second.end(), response.pairs.begin(), response.pairs.end());
+                        response.pairs.swap(partial->second);
+                    }
+                    connection.partial_pairs.erase(partial);
+                }
+
+                Completion completion;
+                {
+                    std::lock_guard<std::mutex> lock(connection.pending_mutex);
+                    auto it = connection.pending.find(response.id);
+                    if (it == connection.pending.end())
+                    {
+                        continue;
+                    }
+                    completion = std::move(it->second);
+                    connection.pending.erase(it);
+                }
+                completion(nullptr, response);
+            }
+        }
+        catch (const std::exception &e)
+        {
+            fail_connection(connection, std::string("Malformed response from server: ") + e.what());
+            shutdown(connection.fd, SHUT_RDWR);
+            return;
+        }
+
+        if (connection.receive_begin == connection.receive_end)
+        {
+            connection.receive_begin = 0;
+            connection.receive_end = 0;
+        }
+    }
+
+    void AsyncClient::fail_connection(Connection &connection, const std::string &reason)
+    {
+        connection.open.store(false);
+
+        std::unordered_map<uint64_t, Completion> failed;
+        {
+            std::lock_guard<std::mutex> lock(connection.pending_mutex);
+            failed.swap(connection.pending);
+        }
+
+        auto error = std::make_exception_ptr(std::runtime_error(reason));
+        protocol::Response empty;
+        for (auto &pending : failed)
+        {
+            pending.second(error, empty);
+        }
+    }
+
+    void AsyncClient::submit(protocol::Request &request, Completion completion)
+    {
+        // Try the connections round-robin, skipping closed ones
+        for (size_t attempt = 0; attempt < connections.size(); ++attempt)
+        {
+            Connection &connection = *connections[next_connection++ % connections.size()];
+            if (!connection.open.load())
+            {
+                continue;
+            }
+
+            std::lock_guard<std::mutex> send_lock(connection.send_mutex);
+            request.id = connection.next_request_id++;
+
+            // Register the request before sending so its response cannot arrive unclaimed
+            {
+                std::lock_guard<std::mutex> lock(connection.pending_mutex);
+                if (!connection.open.load())
+                {
+                    continue;
+                }
+                connection.pending.emplace(request.id, std::move(completion));
+            }
+
+            connection.send_buffer.clear();
+            protocol::encode_request(request, connection.send_buffer);
+            if (!send_fully(connection.fd, connection.send_buffer.data(), connection.send_buffer.size()))
+            {
+                // The receiver fails this request along with the rest of the connection
+                shutdown(connection.fd, SHUT_RDWR);
+            }
+            return;
+        }
+
+        protocol::Response empty;
+        completion(std::make_exception_ptr(std::runtime_error("Not connected to server")), empty);
+    }
+
+    std::future<std::optional<int64_t>> AsyncClient::get(int64_t key)
+    {
+        auto promise = std::make_shared<std::promise<std::optional<int64_t>>>();
+        auto future = promise->get_future();
+        get(key, [promise](std::exception_ptr error, std::optional<int64_t> value)
+            {
+                if (error)
+                {
+                    promise->set_exception(error);
+                }
+                else
+                {
+                    promise->set_value(value);
+                }
+            });
+        return future;
+    }
+
+    void AsyncClient::get(int64_t key, GetCallback callback)
+    {
+        std::vector<QueuedGet> batch;
+        {
+            std::lock_guard<std::mutex> lock(batch_mutex);
+            queued_gets.push_back(QueuedGet{key, std::move(callback)});
+            if (batches_in_flight >= options.max_batches_in_flight)
+            {
+                return;
+            }
+            batches_in_flight++;
+            batch = take_batch();
+        }
+        send_batch(std::move(batch));
+    }
+
+    std::vector<AsyncClient::QueuedGet> AsyncClient::take_batch()
+    {
+        size_t count = std::min(queued_gets.size(), options.max_batch_keys);
+        std::vector<QueuedGet> batch(std::make_move_iterator(queued_gets.begin()),
+                                     std::make_move_iterator(queued_gets.begin() + count));
+        queued_gets.erase(queued_gets.begin(), queued_gets.begin() + count);
+        return batch;
+    }
+
+    void AsyncClient::send_batch(std::vector<QueuedGet> batch)
+    {
+        lookup_requests++;
+
+        protocol::Request request;
+        if (batch.size() == 1)
+        {
+            request.opcode = protocol::Opcode::GET;
+            request.key = batch.front().key;
+        }
+        else
+        {
+            request.opcode = protocol::Opcode::MGET;
+            request.keys.reserve(batch.size());
+            for (const auto &get : batch)
+            {
+                request.keys.push_back(get.key);
+            }
+        }
+
+        auto gets = std::make_shared<std::vector<QueuedGet>>(std::move(batch));
+        submit(request, [this, gets](std::exception_ptr error, protocol::Response &response)
+               {
+                   if (!error && response.status == protocol::Status::ERROR)
+                   {
+                       error = response_error(response);
+                   }
+
+                   if (error)
+                   {
+                       for (auto &get : *gets)
+                       {
+                           get.callback(error, std::nullopt);
+                       }
+                   }
+                   else if (response.opcode == protocol::Opcode::GET)
+                   {
+                       std::optional<int64_t> value;
+                       if (response.status == protocol::Status::OK)
+                       {
+                           value = response.value;
+                       }
+                       gets->front().callback(nullptr, value);
+                   }
+                   else
+                   {
+                       // MGET answers the keys it found in request order, so one pass
+                       // matches them to the gets
+                       size_t next = 0;
+                       for (auto &get : *gets)
+                       {
+                           std::optional<int64_t> value;
+                           if (next < response.pairs.size() && response.pairs[next].first == get.key)
+                           {
+                               value = response.pairs[next++].second;
+                           }
+                           get.callback(nullptr, value);
+                       }
+                   }
+
+                   finish_batch();
+               });
+    }
+
+    void AsyncClient::finish_batch()
+    {
+        std::vector<QueuedGet> batch;
+        {
+            std::lock_guard<std::mutex> lock(batch_mutex);
+            if (batches_in_flight > 0)
+            {
+                batches_in_flight--;
+            }
+            if (queued_gets.empty())
+            {
+                return;
+            }
+            batches_in_flight++;
+            batch = take_batch();
+        }
+        send_batch(std::move(batch));
+    }
+
+    std::future<void> AsyncClient::put(int64_t key, int64_t value)
+    {
+        auto promise = std::make_shared<std::promise<void>>();
+        auto future = promise->get_future();
+        put(key, value, [promise](std::exception_ptr error)
+            {
+                if (error)
+                {
+                    promise->set_exception(error);
+                }
+                else
+                {
+                    promise->set_value();
+                }
+            });
+        return future;
+    }
+
+    void AsyncClient::put(int64_t key, int64_t value, WriteCallback callback)
+    {
+        protocol::Request request;
+        request.opcode = protocol::Opcode::PUT;
+        request.key = key;
+        request.value = value;
+        request.sync = options.sync_writes;
+        submit(request, [callback = std::move(callback)](std::exception_ptr error, protocol::Response &response)
+               {
+                   if (!error && response.status == protocol::Status::ERROR)
+                   {
+                       error = response_error(response);
+                   }
+                   callback(error);
+               });
+    }
+
+    std::future<void> AsyncClient::remove(int64_t key)
+    {
+        auto promise = std::make_shared<std::promise<void>>();
+        auto future = promise->get_future();
+        remove(key, [promise](std::exception_ptr error)
+               {
+                   if (error)
+                   {
+                       promise->set_exception(error);
+                   }
+                   else
+                   {
+                       promise->set_value();
+                   }
+               });
+        return future;
+    }
+
+    void AsyncClient::remove(int64_t key, WriteCallback callback)
+    {
+        protocol::Request request;
+        request.opcode = protocol::Opcode::DELETE;
+        request.key = key;
+        request.sync = options.sync_writes;
+        submit(request, [callback = std::move(callback)](std::exception_ptr error, protocol::Response &response)
+               {
+                   if (!error && response.status == protocol::Status::ERROR)
+                   {
+                       error = response_error(response);
+                   }
+                   callback(error);
+               });
+    }
+
+    std::future<AsyncClient::Pairs> AsyncClient::range(int64_t start_key, int64_t end_key)
+    {
+        auto promise = std::make_shared<std::promise<Pairs>>();
+        auto future = promise->get_future();
+        range(start_key, end_key, [promise](std::exception_ptr error, Pairs pairs)
+              {
+                  if (error)
+                  {
+                      promise->set_exception(error);
+                  }
+                  else
+                  {
+                      promise->set_value(std::move(pairs));
+                  }
+              });
+        return future;
+    }
+
+    void AsyncClient::range(int64_t start_key, int64_t end_key, RangeCallback callback)
+    {
+        protocol::Request request;
+        request.opcode = protocol::Opcode::RANGE;
+        request.key = start_key;
+        request.value = end_key;
+        submit(request, [callback = std::move(callback)](std::exception_ptr error, protocol::Response &response)
+               {
+                   if (!error && response.status == protocol::Status::ERROR)
+                   {
+                       error = response_error(response);
+                   }
+                   if (error)
+                   {
+                       callback(error, Pairs());
+                       return;
+                   }
+
+                   // The pairs are handed over; the connection's response grows a new buffer
+                   callback(nullptr, std::move(response.pairs));
+               });
+    }
+
+    size_t AsyncClient::get_lookup_request_count() const
+    {
+        return lookup_requests.load();
+    }
+
+}
@@ -0,0 +1,147 @@
+#include "../include/block_cache.h"
+#include "../include/constants.h"
+
+#include <algorithm>
+
+namespace lsm
+{
+
+    BlockCache &BlockCache::get_instance()
+    {
+        static BlockCache instance(constants::BLOCK_CACHE_SIZE_BYTES.load(), constants::BLOCK_CACHE_SHARDS);
+        return instance;
+    }
+
+    BlockCache::BlockCache(size_t capacity_bytes, size_t num_shards)
+        : total_capacity(0)
+    {
+        for (size_t i = 0; i < std::max<size_t>(num_shards, 1); ++i)
+        {
+            shards.push_back(std::make_unique<Shard>());
+        }
+        set_capacity(capacity_bytes);
+    }
+
+    size_t BlockCache::KeyHash::operator()(const Key &key) const
+    {
+        // Mix both words so consecutive pages of a file spread across shards
+        uint64_t h = key.file_id * 0x9E3779B97F4A7C15ULL ^ (key.page + 0x632BE59BD9B4E019ULL);
+        h ^= h >> 33;
+        h *= 0xFF51AFD7ED558CCDULL;
+        h ^= h >> 33;
+        return static_cast<size_t>(h);
+    }
+
+    BlockCache::Shard &BlockCache::shard_for(const Key &key)
+    {
+        return *shards[KeyHash()(key) % shards.size()];
+    }
+
+    BlockCache::BlockHandle BlockCache::lookup(uint64_t file_id, uint64_t page)
+    {
+        Key key{file_id, page};
+        Shard &shard = shard_for(key);
+
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.index.find(key);
+        if (it == shard.index.end())
+        {
+            miss_count++;
+            return nullptr;
+        }
+
+        // Move to the front of the LRU list
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        hit_count++;
+        return it->second->block;
+    }
+
+    void BlockCache::insert(uint64_t file_id, uint64_t page, BlockHandle block)
+    {
+        Key key{file_id, page};
+        Shard &shard = shard_for(key);
+        size_t charge = block->words.size() * sizeof(int64_t) + block->types.size() * sizeof(EntryType);
+
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (charge > shard.capacity)
+        {
+            return;
+        }
+
+        auto it = shard.index.find(key);
+        if (it != shard.index.end())
+        {
+            shard.usage -= it->second->charge;
+            shard.lru.erase(it->second);
+            shard.index.erase(it);
+        }
+
+        shard.lru.push_front(Entry{key, std::move(block), charge});
+        shard.index[key] = shard.lru.begin();
+        shard.usage += charge;
+
+        shard.evict();
+    }
+
+    void BlockCache::Shard::evict()
+    {
+        while (usage > capacity && !lru.empty())
+        {
+            usage -= lru.back().charge;
+            index.erase(lru.back().key);
+            lru.pop_back();
+        }
+    }
+
+    void BlockCache::set_capacity(size_t capacity_bytes)
+    {
+        total_capacity.store(capacity_bytes);
+
+        size_t per_shard = capacity_bytes / shards.size();
+        for (auto &shard : shards)
+        {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            shard->capacity = per_shard;
+            shard->evict();
+        }
+    }
+
+    size_t BlockCache::capacity() const
+    {
+        return total_capacity.load();
+    }
+
+    size_t BlockCache::usage() const
+    {
+        size_t total = 0;
+        for (const auto &shard : shards)
+        {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            total += shard->usage;
+        }
+        return total;
+    }
+
+    size_t BlockCache::get_hit_count() const
+    {
+        return hit_count.load();
+    }
+
+    size_t BlockCache::get_miss_count() const
+    {
+        return miss_count.load();
+    }
+
+    void BlockCache::reset_stats()
+    {
+        hit_count.store(0);
+        miss_count.store(0);
+    }
+
+    uint64_t BlockCache::next_file_id()
+    {
+        static std::atomic<uint64_t> counter{1};
+        return counter++;
+    }
+
+}
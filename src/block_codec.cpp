@@ -0,0 +1,376 @@
+#include "../include/block_codec.h"
+#include "../include/constants.h"
+#include <stdexcept>
+#include <algorithm>
+#include <array>
+#include <string>
+#include <cstring>
+
+namespace lsm
+{
+
+    namespace
+    {
+        // Header word layout
+        constexpr unsigned COUNT_SHIFT = 32;
+        constexpr uint64_t COUNT_MASK = 0x7FFF;
+        constexpr unsigned DELETIONS_SHIFT = 47;
+        constexpr unsigned KEY_BITS_SHIFT = 48;
+        constexpr unsigned VALUE_BITS_SHIFT = 56;
+        constexpr uint64_t CHECKSUM_MASK = 0xFFFFFFFFULL;
+
+        // Bits needed to represent a value
+        unsigned bit_width(uint64_t value)
+        {
+            return value == 0 ? 0 : 64 - static_cast<unsigned>(__builtin_clzll(value));
+        }
+
+        // Key widened to 64 bits, as the key column stores it
+        template <typename Key>
+        uint64_t key_bits_of(Key key)
+        {
+            return static_cast<uint64_t>(static_cast<int64_t>(key));
+        }
+
+        // Gaps between consecutive keys, minus one; returns the union of their bits
+        template <typename Traits>
+        uint64_t key_gaps(const BasicKeyValuePair<Traits> *pairs, size_t count, uint64_t *gaps)
+        {
+            // Ascending keys have gaps of at least one
+            uint64_t key_union = 0;
+            for (size_t i = 1; i < count; ++i)
+            {
+                gaps[i - 1] = key_bits_of(pairs[i].key) - key_bits_of(pairs[i - 1].key) - 1;
+                key_union |= gaps[i - 1];
+            }
+            return key_union;
+        }
+
+        // Checksum of a block, with the checksum field of its header treated as zero
+        uint32_t block_checksum(const uint64_t *words, size_t word_count)
+        {
+            uint64_t header = words[0] & ~CHECKSUM_MASK;
+            return BlockCodecBase::checksum(&header, 1) ^ BlockCodecBase::checksum(words + 1, word_count - 1);
+        }
+    }
+
+    template <typename Traits>
+    void BasicBlockCodec<Traits>::encode(const Pair *pairs, size_t count, std::vector<uint64_t> &out)
+    {
+        if (count == 0 || count > constants::RUN_BLOCK_PAIRS)
+        {
+            throw std::runtime_error("Invalid block size: " + std::to_string(count) + " pairs");
+        }
+
+        std::array<uint64_t, constants::RUN_BLOCK_PAIRS> gaps;
+        std::array<uint64_t, constants::RUN_BLOCK_PAIRS> values;
+
+        // Keys as gaps to the previous key
+        uint64_t key_union = key_gaps(pairs, count, gaps.data());
+
+        // Deletions are a bit each and store a value of zero
+        std::array<uint64_t, constants::RUN_BLOCK_PAIRS> deletions;
+        bool has_deletions = false;
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (pairs[i].type == EntryType::RANGE_DELETION)
+            {
+                throw std::runtime_error("Range deletions cannot be stored in a run block");
+            }
+            deletions[i] = pairs[i].type == EntryType::DELETION;
+            has_deletions = has_deletions || deletions[i];
+        }
+
+        auto stored_value = [&](size_t i)
+        {
+            return deletions[i] ? typename Traits::value_type{} : pairs[i].value;
+        };
+
+        // Values relative to the smallest value of the block
+        int64_t value_base = 0;
+        uint64_t value_union = 0;
+        if constexpr (Traits::INTEGER_VALUES)
+        {
+            value_base = stored_value(0);
+            for (size_t i = 1; i < count; ++i)
+            {
+                value_base = std::min<int64_t>(value_base, stored_value(i));
+            }
+            for (size_t i = 0; i < count; ++i)
+            {
+                values[i] = static_cast<uint64_t>(static_cast<int64_t>(stored_value(i))) -
+                            static_cast<uint64_t>(value_base);
+                value_union |= values[i];
+            }
+        }
+
+        unsigned key_bits = bit_width(key_union);
+        unsigned value_bits = bit_width(value_union);
+
+        size_t start = out.size();
+        out.push_back((static_cast<uint64_t>(count) << COUNT_SHIFT) |
+                      (static_cast<uint64_t>(has_deletions) << DELETIONS_SHIFT) |
+                      (static_cast<uint64_t>(key_bits) << KEY_BITS_SHIFT) |
+                      (static_cast<uint64_t>(value_bits) << VALUE_BITS_SHIFT));
+        out.push_back(key_bits_of(pairs[0].key));
+        out.push_back(static_cast<uint64_t>(value_base));
+        pack(gaps.data(), count - 1, key_bits, out);
+        if constexpr (Traits::INTEGER_VALUES)
+        {
+            pack(values.data(), count, value_bits, out);
+        }
+        else
+        {
+            size_t column = out.size();
+            out.resize(column + packed_words(count, Traits::VALUE_BYTES * 8), 0);
+            char *bytes = reinterpret_cast<char *>(out.data() + column);
+            for (size_t i = 0; i < count; ++i)
+            {
+                auto value = stored_value(i);
+                std::memcpy(bytes + i * Traits::VALUE_BYTES, &value, Traits::VALUE_BYTES);
+            }
+        }
+        if (has_deletions)
+        {
+            pack(deletions.data(), count, 1, out);
+        }
+        out.push_back(0);
+
+        out[start] |= block_checksum(out.data() + start, out.size() - start);
+    }
+
+    template <typename Traits>
+    void BasicBlockCodec<Traits>::decode(const uint64_t *words, size_t word_count, std::vector<int64_t> &out,
+                                         std::vector<EntryType> &types)
+    {
+        if (word_count < HEADER_WORDS + 1)
+        {
+            throw std::runtime_error("Truncated run block");
+        }
+
+        uint64_t header = words[0];
+        size_t count = (header >> COUNT_SHIFT) & COUNT_MASK;
+        unsigned key_bits = (header >> KEY_BITS_SHIFT) & 0xFF;
+        unsigned value_bits = (header >> VALUE_BITS_SHIFT) & 0xFF;
+
+        bool has_deletions = (header >> DELETIONS_SHIFT) & 1;
+
+        // Values that are not integers always take their full width
+        unsigned value_width = Traits::INTEGER_VALUES ? value_bits : Traits::VALUE_BYTES * 8;
+        size_t key_words = packed_words(count > 0 ? count - 1 : 0, key_bits);
+        size_t value_words = packed_words(count, value_width);
+        size_t deletion_words = has_deletions ? packed_words(count, 1) : 0;
+        if (count == 0 || count > constants::RUN_BLOCK_PAIRS || key_bits > 64 || value_bits > 64 ||
+            (!Traits::INTEGER_VALUES && value_bits != 0) ||
+            word_count != HEADER_WORDS + key_words + value_words + deletion_words + 1)
+        {
+            throw std::runtime_error("Malformed run block");
+        }
+
+        if (static_cast<uint32_t>(header & CHECKSUM_MASK) != block_checksum(words, word_count))
+        {
+            throw std::runtime_error("Run block failed its checksum");
+        }
+
+        constexpr size_t stride = Traits::RECORD_WORDS;
+        std::array<uint64_t, constants::RUN_BLOCK_PAIRS> gaps;
+        unpack(words + HEADER_WORDS, count - 1, key_bits, gaps.data());
+
+        size_t offset = out.size();
+        out.resize(offset + count * stride);
+        int64_t *pairs = out.data() + offset;
+
+        // Values are independent of each other
+        const uint64_t *value_column = words + HEADER_WORDS + key_words;
+        if constexpr (Traits::INTEGER_VALUES)
+        {
+            std::array<uint64_t, constants::RUN_BLOCK_PAIRS> values;
+            unpack(value_column, count, value_bits, values.data());
+            uint64_t value_base = words[2];
+            for (size_t i = 0; i < count; ++i)
+            {
+                pairs[i * stride + 1] = static_cast<int64_t>(values[i] + value_base);
+            }
+        }
+        else
+        {
+            const char *bytes = reinterpret_cast<const char *>(value_column);
+            for (size_t i = 0; i < count; ++i)
+            {
+                typename Traits::value_type value;
+                std::memcpy(&value, bytes + i * Traits::VALUE_BYTES, Traits::VALUE_BYTES);
+                Traits::value_traits::to_words(value, pairs + i * stride + 1);
+            }
+        }
+
+        // Keys are a running sum of the gaps
+        uint64_t key = words[1];
+        pairs[0] = static_cast<int64_t>(key);
+        for (size_t i = 1; i < count; ++i)
+        {
+            key += gaps[i - 1] + 1;
+            pairs[i * stride] = static_cast<int64_t>(key);
+        }
+
+        if (!has_deletions)
+        {
+            types.resize(types.size() + count, EntryType::VALUE);
+            return;
+        }
+
+        std::array<uint64_t, constants::RUN_BLOCK_PAIRS> deletions;
+        unpack(words + HEADER_WORDS + key_words + value_words, count, 1, deletions.data());
+        for (size_t i = 0; i < count; ++i)
+        {
+            types.push_back(deletions[i] ? EntryType::DELETION : EntryType::VALUE);
+        }
+    }
+
+    template <typename Traits>
+    void BasicBlockCodec<Traits>::encode_keys(const Pair *pairs, size_t count, std::vector<uint64_t> &out)
+    {
+        if (count == 0 || count > constants::RUN_BLOCK_PAIRS)
+        {
+            throw std::runtime_error("Invalid block size: " + std::to_string(count) + " pairs");
+        }
+
+        std::array<uint64_t, constants::RUN_BLOCK_PAIRS> gaps;
+        unsigned key_bits = bit_width(key_gaps(pairs, count, gaps.data()));
+
+        size_t start = out.size();
+        out.push_back((static_cast<uint64_t>(count) << COUNT_SHIFT) |
+                      (static_cast<uint64_t>(key_bits) << KEY_BITS_SHIFT));
+        out.push_back(key_bits_of(pairs[0].key));
+        pack(gaps.data(), count - 1, key_bits, out);
+        out.push_back(0);
+
+        out[start] |= block_checksum(out.data() + start, out.size() - start);
+    }
+
+    size_t BlockCodecBase::key_block_words(uint64_t header)
+    {
+        size_t count = (header >> COUNT_SHIFT) & COUNT_MASK;
+        unsigned key_bits = (header >> KEY_BITS_SHIFT) & 0xFF;
+        return KEY_HEADER_WORDS + packed_words(count > 0 ? count - 1 : 0, std::min(key_bits, 64u)) + 1;
+    }
+
+    void BlockCodecBase::decode_keys(const uint64_t *words, size_t word_count, std::vector<int64_t> &out)
+    {
+        if (word_count < KEY_HEADER_WORDS + 1)
+        {
+            throw std::runtime_error("Truncated key block");
+        }
+
+        uint64_t header = words[0];
+        size_t count = (header >> COUNT_SHIFT) & COUNT_MASK;
+        unsigned key_bits = (header >> KEY_BITS_SHIFT) & 0xFF;
+        unsigned value_bits = (header >> VALUE_BITS_SHIFT) & 0xFF;
+        if (count == 0 || count > constants::RUN_BLOCK_PAIRS || key_bits > 64 || value_bits != 0 ||
+            word_count != key_block_words(header))
+        {
+            throw std::runtime_error("Malformed key block");
+        }
+
+        if (static_cast<uint32_t>(header & CHECKSUM_MASK) != block_checksum(words, word_count))
+        {
+            throw std::runtime_error("Key block failed its checksum");
+        }
+
+        std::array<uint64_t, constants::RUN_BLOCK_PAIRS> gaps;
+        unpack(words + KEY_HEADER_WORDS, count - 1, key_bits, gaps.data());
+
+        size_t offset = out.size();
+        out.resize(offset + count);
+        int64_t *keys = out.data() + offset;
+
+        uint64_t key = words[1];
+        keys[0] = static_cast<int64_t>(key);
+        for (size_t i = 1; i < count; ++i)
+        {
+            key += gaps[i - 1] + 1;
+            keys[i] = static_cast<int64_t>(key);
+        }
+    }
+
+    uint32_t BlockCodecBase::checksum(const uint64_t *words, size_t word_count)
+    {
+        // Four independent lanes keep the multiplies from serializing
+        uint64_t lanes[4] = {constants::HASH_GOLDEN_RATIO, constants::HASH_MIX_MULTIPLIER_1,
+                             constants::HASH_MIX_MULTIPLIER_2, word_count};
+        size_t i = 0;
+        for (; i + 4 <= word_count; i += 4)
+        {
+            for (size_t lane = 0; lane < 4; ++lane)
+            {
+                lanes[lane] = (lanes[lane] ^ words[i + lane]) * constants::HASH_MIX_MULTIPLIER_1;
+                lanes[lane] ^= lanes[lane] >> 31;
+            }
+        }
+        for (; i < word_count; ++i)
+        {
+            lanes[0] = (lanes[0] ^ words[i]) * constants::HASH_MIX_MULTIPLIER_1;
+            lanes[0] ^= lanes[0] >> 31;
+        }
+
+        uint64_t hash = lanes[0];
+        for (size_t lane = 1; lane < 4; ++lane)
+        {
+            hash = (hash ^ lanes[lane]) * constants::HASH_MIX_MULTIPLIER_2;
+            hash ^= hash >> 29;
+        }
+        return static_cast<uint32_t>(hash ^ (hash >> 32));
+    }
+
+    size_t BlockCodecBase::packed_words(size_t count, unsigned width)
+    {
+        return (count * width + 63) / 64;
+    }
+
+    void BlockCodecBase::pack(const uint64_t *values, size_t count, unsigned width, std::vector<uint64_t> &out)
+    {
+        size_t base = out.size();
+        out.resize(base + packed_words(count, width), 0);
+        if (width == 0)
+        {
+            return;
+        }
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            size_t bit = i * width;
+            size_t word = base + bit / 64;
+            unsigned shift = bit % 64;
+            out[word] |= values[i] << shift;
+            if (shift + width > 64)
+            {
+                out[word + 1] |= values[i] >> (64 - shift);
+            }
+        }
+    }
+
+    void BlockCodecBase::unpack(const uint64_t *column, size_t count, unsigned width, uint64_t *out)
+    {
+        if (width == 0)
+        {
+            std::fill(out, out + count, 0);
+            return;
+        }
+
+        // Every entry is cut out of two adjacent words with no branches, so the loop
+        // has a fixed shape the compiler can vectorize
+        const uint64_t mask = width == 64 ? ~0ULL : (1ULL << width) - 1;
+        for (size_t i = 0; i < count; ++i)
+        {
+            size_t bit = i * width;
+            size_t word = bit / 64;
+            unsigned shift = bit % 64;
+            uint64_t low = column[word] >> shift;
+            uint64_t high = (column[word + 1] << 1) << (63 - shift);
+            out[i] = (low | high) & mask;
+        }
+    }
+
+    template class BasicBlockCodec<DefaultTraits>;
+    template class BasicBlockCodec<CompactKeyTraits>;
+
+}
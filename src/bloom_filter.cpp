@@ -1,13 +1,37 @@
 #include "../include/bloom_filter.h"
 #include "../include/constants.h"
+#include "../include/block_codec.h"
 #include <fstream>
 #include <stdexcept>
-#include <cassert>
+#include <algorithm>
 #include <cstring>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 namespace lsm
 {
 
+    namespace
+    {
+        constexpr size_t WORDS_PER_BLOCK = constants::BLOOM_BLOCK_BITS / 64;
+
+        // Bytes of padding after the header in the padded formats
+        constexpr size_t header_padding(size_t header_bytes)
+        {
+            return (constants::BLOOM_BLOCK_BITS / 8) - header_bytes;
+        }
+
+        // Check if a version pads its header to a whole block
+        bool is_padded(uint32_t version)
+        {
+            return version == constants::BLOOM_FILE_VERSION || version == constants::BLOOM_FILE_UNCHECKED_VERSION;
+        }
+    }
+
     BloomFilter::BloomFilter(double false_positive_rate, size_t expected_elements)
         : fpr(false_positive_rate), expected_num_elements(expected_elements)
     {
@@ -17,96 +41,141 @@ namespace lsm
 
     BloomFilter::BloomFilter(const std::string &filename)
     {
-        std::ifstream file(filename, std::ios::binary);
-        if (!file)
-        {
-            throw std::runtime_error("Failed to open bloom filter file: " + filename);
-        }
-
-        // Read metadata
-        file.read(reinterpret_cast<char *>(&fpr), sizeof(fpr));
-        file.read(reinterpret_cast<char *>(&expected_num_elements), sizeof(expected_num_elements));
-        file.read(reinterpret_cast<char *>(&num_hash_functions), sizeof(num_hash_functions));
-
-        size_t bit_count;
-        file.read(reinterpret_cast<char *>(&bit_count), sizeof(bit_count));
+        auto file = std::make_shared<const MappedFile>(filename);
+        map_section(file, 0, file->size(), filename, true);
+    }
 
-        // Resize the bit array
-        bits.resize(bit_count);
+    BloomFilter::BloomFilter(std::shared_ptr<const MappedFile> file, size_t offset, size_t size,
+                             const std::string &name)
+    {
+        map_section(std::move(file), offset, size, name, false);
+    }
 
-        // Read the bits
-        size_t byte_count = (bit_count + 7) / 8;
-        std::vector<uint8_t> buffer(byte_count, 0);
+    void BloomFilter::map_section(std::shared_ptr<const MappedFile> file, size_t offset, size_t size,
+                                  const std::string &name, bool verify)
+    {
+        FileHeader header{};
+        if (size < sizeof(header) || offset + size > file->size())
+        {
+            throw std::runtime_error("Unsupported bloom filter format in file: " + name);
+        }
+        const char *start = file->data() + offset;
+        std::memcpy(&header, start, sizeof(header));
+        apply_header(header, name);
 
-        file.read(reinterpret_cast<char *>(buffer.data()), byte_count);
+        // Old files have the blocks right after the header, unaligned; copy them out
+        size_t blocks_offset = is_padded(header.version) ? sizeof(Block) : sizeof(header);
+        if (size != blocks_offset + header.num_blocks * sizeof(Block))
+        {
+            throw std::runtime_error("Failed to read bloom filter data from file: " + name);
+        }
 
-        // Convert bytes to bits
-        for (size_t i = 0; i < bit_count; ++i)
+        if (is_padded(header.version) && offset % alignof(Block) == 0)
+        {
+            blocks = reinterpret_cast<const Block *>(start + blocks_offset);
+            num_blocks = header.num_blocks;
+            mapping = std::move(file);
+        }
+        else
         {
-            size_t byte_index = i / 8;
-            size_t bit_index = i % 8;
-            bits[i] = (buffer[byte_index] & (1 << bit_index)) != 0;
+            owned_blocks.resize(header.num_blocks);
+            std::memcpy(owned_blocks.data(), start + blocks_offset, header.num_blocks * sizeof(Block));
+            use_owned_blocks();
         }
 
-        if (!file)
+        if (verify && header.version == constants::BLOOM_FILE_VERSION)
         {
-            throw std::runtime_error("Failed to read bloom filter data from file: " + filename);
+            uint64_t checksum = 0;
+            std::memcpy(&checksum, start + sizeof(header), sizeof(checksum));
+            if (checksum != blocks_checksum())
+            {
+                throw std::runtime_error("Corrupt bloom filter in file: " + name);
+            }
         }
     }
 
+    BloomFilter::BloomFilter(std::istream &in, const std::string &name)
+    {
+        read(in, name);
+    }
+
     void BloomFilter::insert(int64_t key)
     {
-        for (size_t i = 0; i < num_hash_functions; ++i)
-        {
-            size_t index = hash(key, i);
-            bits[index] = true;
-        }
+        insert_hash(DefaultTraits::hash(key));
     }
 
     bool BloomFilter::might_contain(int64_t key) const
     {
-        for (size_t i = 0; i < num_hash_functions; ++i)
+        return might_contain_hash(DefaultTraits::hash(key));
+    }
+
+    void BloomFilter::insert_hash(uint64_t hash)
+    {
+        if (mapping)
         {
-            size_t index = hash(key, i);
-            if (!bits[index])
-            {
-                return false;
-            }
+            throw std::runtime_error("Cannot insert into a mapped bloom filter");
+        }
+        if (num_blocks == 0)
+        {
+            return;
+        }
+
+        Block mask;
+        probe_mask(hash, mask);
+
+        Block &block = owned_blocks[block_index(hash)];
+        for (size_t i = 0; i < WORDS_PER_BLOCK; ++i)
+        {
+            block.words[i] |= mask.words[i];
         }
-        return true;
     }
 
-    void BloomFilter::save(const std::string &filename) const
+    bool BloomFilter::might_contain_hash(uint64_t hash) const
     {
-        std::ofstream file(filename, std::ios::binary);
-        if (!file)
+        // An empty filter was sized for FPR 1.0 and rejects nothing
+        if (num_blocks == 0)
         {
-            throw std::runtime_error("Failed to create bloom filter file: " + filename);
+            return true;
         }
 
-        // Write metadata
-        file.write(reinterpret_cast<const char *>(&fpr), sizeof(fpr));
-        file.write(reinterpret_cast<const char *>(&expected_num_elements), sizeof(expected_num_elements));
-        file.write(reinterpret_cast<const char *>(&num_hash_functions), sizeof(num_hash_functions));
+        Block mask;
+        probe_mask(hash, mask);
 
-        size_t bit_count = bits.size();
-        file.write(reinterpret_cast<const char *>(&bit_count), sizeof(bit_count));
+        const Block &block = blocks[block_index(hash)];
 
-        // Write the bits
-        size_t byte_count = (bit_count + 7) / 8;
-        std::vector<uint8_t> buffer(byte_count, 0);
+        // All probe bits must be set: (block & mask) == mask
+#if defined(__AVX2__)
+        const __m256i *b = reinterpret_cast<const __m256i *>(block.words);
+        const __m256i *m = reinterpret_cast<const __m256i *>(mask.words);
+        return _mm256_testc_si256(_mm256_load_si256(b), _mm256_load_si256(m)) &&
+               _mm256_testc_si256(_mm256_load_si256(b + 1), _mm256_load_si256(m + 1));
+#elif defined(__ARM_NEON)
+        uint64x2_t missing = vdupq_n_u64(0);
+        for (size_t i = 0; i < WORDS_PER_BLOCK; i += 2)
+        {
+            uint64x2_t m = vld1q_u64(mask.words + i);
+            missing = vorrq_u64(missing, vbicq_u64(m, vld1q_u64(block.words + i)));
+        }
+        return (vgetq_lane_u64(missing, 0) | vgetq_lane_u64(missing, 1)) == 0;
+#else
+        uint64_t missing = 0;
+        for (size_t i = 0; i < WORDS_PER_BLOCK; ++i)
+        {
+            missing |= mask.words[i] & ~block.words[i];
+        }
+        return missing == 0;
+#endif
+    }
 
-        for (size_t i = 0; i < bit_count; ++i)
+    void BloomFilter::save(const std::string &filename) const
+    {
+        std::ofstream file(filename, std::ios::binary);
+        if (!file)
         {
-            if (bits[i])
-            {
-                size_t byte_index = i / 8;
-                size_t bit_index = i % 8;
-                buffer[byte_index] |= (1 << bit_index);
-            }
+            throw std::runtime_error("Failed to create bloom filter file: " + filename);
         }
 
-        file.write(reinterpret_cast<const char *>(buffer.data()), byte_count);
+        write(file);
 
         if (!file)
         {
@@ -114,9 +183,33 @@ namespace lsm
         }
     }
 
+    void BloomFilter::write(std::ostream &out) const
+    {
+        // Write metadata
+        FileHeader header;
+        std::memset(&header, 0, sizeof(header));
+        header.magic = constants::BLOOM_FILE_MAGIC;
+        header.version = constants::BLOOM_FILE_VERSION;
+        header.num_hash_functions = static_cast<uint32_t>(num_hash_functions);
+        header.fpr = fpr;
+        header.expected_num_elements = expected_num_elements;
+        header.num_blocks = num_blocks;
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+        // Pad the header to a whole block, so the blocks stay aligned when the file is mapped;
+        // the checksum of the blocks starts the padding
+        uint64_t checksum = blocks_checksum();
+        out.write(reinterpret_cast<const char *>(&checksum), sizeof(checksum));
+        const char padding[header_padding(sizeof(FileHeader) + sizeof(checksum))] = {};
+        out.write(padding, sizeof(padding));
+
+        // Write the blocks as they are laid out in memory
+        out.write(reinterpret_cast<const char *>(blocks), num_blocks * sizeof(Block));
+    }
+
     size_t BloomFilter::bit_count() const
     {
-        return bits.size();
+        return num_blocks * constants::BLOOM_BLOCK_BITS;
     }
 
     double BloomFilter::get_fpr() const
@@ -131,49 +224,110 @@ namespace lsm
 
     void BloomFilter::calculate_parameters()
     {
-        // Calculate optimal number of bits based on the formula: m = -n * ln(p) / (ln(2)^2)
-        size_t m = optimal_bits(expected_num_elements, fpr);
+        // Size the blocked filter so it still meets the target FPR
+        size_t m = blocked_optimal_bits(expected_num_elements, fpr);
 
         // Calculate optimal number of hash functions: k = (m/n) * ln(2)
-        num_hash_functions = optimal_hash_functions(m, expected_num_elements);
+        num_hash_functions = m > 0 ? optimal_hash_functions(m, expected_num_elements) : 0;
 
         // Ensure at least 1 hash function
         num_hash_functions = std::max(size_t(1), num_hash_functions);
 
-        // Resize the bit array
-        bits.resize(m, false);
+        // Allocate zeroed blocks
+        owned_blocks.assign(m / constants::BLOOM_BLOCK_BITS, Block{});
+        use_owned_blocks();
     }
 
-    size_t BloomFilter::hash(int64_t key, size_t hash_index) const
+    uint64_t BloomFilter::blocks_checksum() const
     {
-        // Use double hashing to generate multiple hash functions
-        // h_i(key) = (h1(key) + i * h2(key)) % m
+        return BlockCodec::checksum(reinterpret_cast<const uint64_t *>(blocks), num_blocks * WORDS_PER_BLOCK);
+    }
 
-        // First hash function: FNV-1a
-        uint64_t h1 = fnv1a_hash(key);
+    void BloomFilter::use_owned_blocks()
+    {
+        blocks = owned_blocks.data();
+        num_blocks = owned_blocks.size();
+    }
 
-        // Second hash function: modify h1 slightly
-        uint64_t h2 = fnv1a_hash(~key);
+    void BloomFilter::read(std::istream &in, const std::string &name)
+    {
+        // Read metadata
+        FileHeader header{};
+        in.read(reinterpret_cast<char *>(&header), sizeof(header));
+        if (!in)
+        {
+            throw std::runtime_error("Unsupported bloom filter format in file: " + name);
+        }
+        apply_header(header, name);
 
-        // Combine the two hashes
-        return (h1 + hash_index * h2) % bits.size();
+        uint64_t checksum = 0;
+        if (header.version == constants::BLOOM_FILE_VERSION)
+        {
+            in.read(reinterpret_cast<char *>(&checksum), sizeof(checksum));
+            in.ignore(static_cast<std::streamsize>(header_padding(sizeof(FileHeader) + sizeof(checksum))));
+        }
+        else if (header.version == constants::BLOOM_FILE_UNCHECKED_VERSION)
+        {
+            in.ignore(static_cast<std::streamsize>(header_padding(sizeof(FileHeader))));
+        }
+
+        // Read all blocks in one go
+        owned_blocks.resize(header.num_blocks);
+        in.read(reinterpret_cast<char *>(owned_blocks.data()), owned_blocks.size() * sizeof(Block));
+        use_owned_blocks();
+
+        if (!in)
+        {
+            throw std::runtime_error("Failed to read bloom filter data from file: " + name);
+        }
+        if (header.version == constants::BLOOM_FILE_VERSION && checksum != blocks_checksum())
+        {
+            throw std::runtime_error("Corrupt bloom filter in file: " + name);
+        }
     }
 
-    size_t BloomFilter::fnv1a_hash(int64_t key) const
+    void BloomFilter::apply_header(const FileHeader &header, const std::string &name)
     {
-        // Convert key to bytes
-        const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&key);
-        size_t len = sizeof(key);
-
-        uint64_t hash = constants::FNV_OFFSET_BASIS;
+        if (header.magic != constants::BLOOM_FILE_MAGIC)
+        {
+            throw std::runtime_error("Unsupported bloom filter format in file: " + name);
+        }
 
-        for (size_t i = 0; i < len; ++i)
+        if (!is_padded(header.version) && header.version != constants::BLOOM_FILE_UNPADDED_VERSION)
         {
-            hash ^= bytes[i];
-            hash *= constants::FNV_PRIME;
+            throw std::runtime_error("Unsupported bloom filter version " + std::to_string(header.version) +
+                                     " in file: " + name);
         }
 
-        return hash;
+        fpr = header.fpr;
+        expected_num_elements = header.expected_num_elements;
+        num_hash_functions = header.num_hash_functions;
+    }
+
+    size_t BloomFilter::block_index(uint64_t hash) const
+    {
+        // Map the hash onto [0, blocks) with a multiply instead of a modulo
+#if defined(__SIZEOF_INT128__)
+        return static_cast<size_t>((static_cast<unsigned __int128>(hash) * num_blocks) >> 64);
+#else
+        return static_cast<size_t>(hash % num_blocks);
+#endif
+    }
+
+    void BloomFilter::probe_mask(uint64_t hash, Block &mask) const
+    {
+        std::memset(mask.words, 0, sizeof(mask.words));
+
+        // The block index consumes the high bits of the hash, so derive the probes from a
+        // remix of it; each probe steps a 64-bit LCG and takes its top 9 bits
+        uint64_t state = mix64(hash + constants::HASH_GOLDEN_RATIO);
+
+        for (size_t i = 0; i < num_hash_functions; ++i)
+        {
+            uint64_t bit = state >> 55;
+            mask.words[bit >> 6] |= uint64_t(1) << (bit & 63);
+            state = state * constants::HASH_MIX_MULTIPLIER_2 + constants::HASH_GOLDEN_RATIO;
+        }
     }
 
-}
\ No newline at end of file
+}
@@ -24,7 +24,8 @@ namespace lsm
         : host(host),
           port(port),
           client_socket(-1),
-          connected(false)
+          connected(false),
+          binary_mode(false)
     {
     }
 
@@ -33,7 +34,7 @@ namespace lsm
         disconnect();
     }
 
-    bool Client::connect()
+    bool Client::connect(bool binary_protocol)
     {
         if (connected.load())
         {
@@ -111,6 +112,50 @@ namespace lsm
             std::cout << "Server: " << welcome_message << std::endl;
         }
 
+        if (binary_protocol && !negotiate_binary_protocol())
+        {
+            std::cerr << "Server did not accept the binary protocol" << std::endl;
+            disconnect();
+            return false;
+        }
+
+        return true;
+    }
+
+    bool Client::negotiate_binary_protocol()
+    {
+        std::string upgrade = std::string(constants::CMD_BINARY) + constants::CMD_DELIMITER;
+        if (send(client_socket, upgrade.c_str(), upgrade.length(), MSG_NOSIGNAL) < 0)
+        {
+            return false;
+        }
+
+        // Read the acknowledgment line; binary frames follow it
+        std::string reply;
+        char buffer[constants::BUFFER_SIZE];
+        size_t delimiter_pos;
+        while ((delimiter_pos = reply.find(constants::CMD_DELIMITER)) == std::string::npos)
+        {
+            ssize_t bytes_read = recv(client_socket, buffer, sizeof(buffer), 0);
+            if (bytes_read < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (bytes_read <= 0)
+            {
+                return false;
+            }
+            reply.append(buffer, bytes_read);
+        }
+
+        if (reply.substr(0, delimiter_pos) != constants::BINARY_PROTOCOL_READY)
+        {
+            return false;
+        }
+
+        receive_buffer = reply.substr(delimiter_pos + strlen(constants::CMD_DELIMITER));
+        binary_mode.store(true);
+        std::cout << "Using binary protocol" << std::endl;
         return true;
     }
 
@@ -156,6 +201,21 @@ namespace lsm
             throw std::runtime_error("Not connected to server");
         }
 
+        // Binary connections carry text commands in TEXT frames
+        if (binary_mode.load())
+        {
+            // Closing the socket ends a binary session
+            if (command == constants::CMD_EXIT)
+            {
+                return "";
+            }
+
+            protocol::Request request;
+            request.opcode = protocol::Opcode::TEXT;
+            request.text = command;
+            return send_request_async(std::move(request)).get().text;
+        }
+
         // Exit command doesn't get a response
         if (command == constants::CMD_EXIT)
         {
@@ -350,6 +410,138 @@ namespace lsm
         }
     }
 
+    std::future<protocol::Response> Client::send_request_async(protocol::Request request)
+    {
+        std::vector<protocol::Request> requests;
+        requests.push_back(std::move(request));
+        return std::move(submit_requests(requests).front());
+    }
+
+    std::vector<std::future<protocol::Response>> Client::send_batch_async(std::vector<protocol::Request> requests)
+    {
+        return submit_requests(requests);
+    }
+
+    std::vector<std::future<protocol::Response>> Client::submit_requests(std::vector<protocol::Request> &requests)
+    {
+        if (!connected.load())
+        {
+            throw std::runtime_error("Not connected to server");
+        }
+        if (!binary_mode.load())
+        {
+            throw std::runtime_error("Binary protocol is not enabled on this connection");
+        }
+
+        // Register the requests before sending so no response can arrive unclaimed
+        std::vector<std::future<protocol::Response>> futures;
+        futures.reserve(requests.size());
+        {
+            std::lock_guard<std::mutex> lock(pending_mutex);
+            for (auto &request : requests)
+            {
+                request.id = next_request_id++;
+                futures.push_back(pending_requests[request.id].get_future());
+            }
+        }
+
+        std::string frames;
+        for (const auto &request : requests)
+        {
+            protocol::encode_request(request, frames);
+        }
+
+        // Write the whole batch in one go
+        {
+            std::lock_guard<std::mutex> lock(send_mutex);
+            size_t bytes_sent = 0;
+            while (bytes_sent < frames.size())
+            {
+                ssize_t sent = send(client_socket, frames.data() + bytes_sent, frames.size() - bytes_sent, MSG_NOSIGNAL);
+                if (sent < 0)
+                {
+                    if (errno == EINTR)
+                    {
+                        continue;
+                    }
+                    std::string error = "Failed to send requests: " + std::string(strerror(errno));
+                    fail_pending_requests(error);
+                    throw std::runtime_error(error);
+                }
+                bytes_sent += sent;
+            }
+        }
+
+        return futures;
+    }
+
+    void Client::dispatch_responses()
+    {
+        size_t offset = 0;
+        try
+        {
+            protocol::Response response;
+            while (size_t consumed = protocol::decode_response(receive_buffer.data() + offset,
+                                                               receive_buffer.size() - offset, response))
+            {
+                offset += consumed;
+
+                // Collect streamed chunks until the final frame of the response
+                if (response.status == protocol::Status::PARTIAL)
+                {
+                    auto &pairs = partial_pairs[response.id];
+                    pairs.insert(pairs.end(), response.pairs.begin(), response.pairs.end());
+                    continue;
+                }
+
+                auto partial = partial_pairs.find(response.id);
+                if (partial != partial_pairs.end())
+                {
+                    if (response.status == protocol::Status::OK)
+                    {
+                        partial->second.insert(partial->second.end(), response.pairs.begin(), response.pairs.end());
+                        response.pairs = std::move(partial->second);
+                    }
+                    partial_pairs.erase(partial);
+                }
+
+                std::lock_guard<std::mutex> lock(pending_mutex);
+                auto it = pending_requests.find(response.id);
+                if (it == pending_requests.end())
+                {
+                    std::cerr << "Dropping response to unknown request " << response.id << std::endl;
+                    continue;
+                }
+                it->second.set_value(std::move(response));
+                pending_requests.erase(it);
+            }
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Malformed response from server: " << e.what() << std::endl;
+            receive_buffer.clear();
+            partial_pairs.clear();
+            fail_pending_requests(e.what());
+            return;
+        }
+        receive_buffer.erase(0, offset);
+    }
+
+    void Client::fail_pending_requests(const std::string &reason)
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex);
+        for (auto &pending : pending_requests)
+        {
+            pending.second.set_exception(std::make_exception_ptr(std::runtime_error(reason)));
+        }
+        pending_requests.clear();
+    }
+
+    bool Client::is_binary() const
+    {
+        return binary_mode.load();
+    }
+
     bool Client::is_connected() const
     {
         return connected.load();
@@ -386,6 +578,30 @@ namespace lsm
                 continue;
             }
 
+            // Binary connections deliver all responses through this thread
+            if (binary_mode.load() && FD_ISSET(client_socket, &readfds))
+            {
+                char read_buffer[constants::PROTOCOL_READ_BUFFER_SIZE];
+                ssize_t bytes_read = recv(client_socket, read_buffer, sizeof(read_buffer), 0);
+                if (bytes_read < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+                {
+                    continue;
+                }
+                if (bytes_read <= 0)
+                {
+                    if (connected.load())
+                    {
+                        std::cerr << "Server closed connection" << std::endl;
+                        connected.store(false);
+                    }
+                    break;
+                }
+
+                receive_buffer.append(read_buffer, bytes_read);
+                dispatch_responses();
+                continue;
+            }
+
             // Skip receiving data in this thread. The main send_command function handles responses
             // We keep this thread only to check if the connection is alive
             if (FD_ISSET(client_socket, &readfds) && connected.load())
@@ -413,6 +629,9 @@ namespace lsm
                 // Socket is still active, continue monitoring
             }
         }
+
+        // Nothing more will arrive for requests still in flight
+        fail_pending_requests("Connection closed");
     }
 
 }
\ No newline at end of file
@@ -0,0 +1,192 @@
+#include "../include/compaction_scheduler.h"
+#include "../include/thread_pool.h"
+
+#include <iostream>
+#include <exception>
+
+namespace lsm
+{
+
+    namespace
+    {
+        bool ranges_overlap(const CompactionScheduler::LevelRange &a, const CompactionScheduler::LevelRange &b)
+        {
+            return a.first <= b.second && b.first <= a.second;
+        }
+    }
+
+    CompactionScheduler::CompactionScheduler(size_t num_threads)
+        : stopping(false)
+    {
+        for (size_t i = 0; i < num_threads; ++i)
+        {
+            workers.emplace_back([this]
+                                 { this->worker_thread(); });
+        }
+    }
+
+    bool CompactionScheduler::pin_to_core(size_t core)
+    {
+        bool pinned = true;
+        for (auto &worker : workers)
+        {
+            pinned = pin_thread_to_core(worker, core) && pinned;
+        }
+        return pinned;
+    }
+
+    CompactionScheduler::~CompactionScheduler()
+    {
+        stop();
+    }
+
+    bool CompactionScheduler::submit(int key, ReserveFunction reserve, JobFunction job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(scheduler_mutex);
+
+            if (key >= 0)
+            {
+                for (const auto &queued : jobs)
+                {
+                    if (queued.key == key)
+                    {
+                        return false;
+                    }
+                }
+            }
+
+            jobs.push_back(Job{key, std::move(reserve), std::move(job)});
+        }
+
+        work_condition.notify_one();
+        return true;
+    }
+
+    void CompactionScheduler::wait_idle()
+    {
+        std::unique_lock<std::mutex> lock(scheduler_mutex);
+        idle_condition.wait(lock, [this]
+                            { return jobs.empty() && active_ranges.empty(); });
+    }
+
+    size_t CompactionScheduler::pending_jobs() const
+    {
+        std::lock_guard<std::mutex> lock(scheduler_mutex);
+        return jobs.size() + active_ranges.size();
+    }
+
+    void CompactionScheduler::stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(scheduler_mutex);
+            if (stopping)
+            {
+                return;
+            }
+            stopping = true;
+        }
+
+        work_condition.notify_all();
+
+        for (std::thread &worker : workers)
+        {
+            if (worker.joinable())
+            {
+                worker.join();
+            }
+        }
+    }
+
+    bool CompactionScheduler::is_reserved(const LevelRange &range) const
+    {
+        for (const auto &active : active_ranges)
+        {
+            if (ranges_overlap(active, range))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void CompactionScheduler::worker_thread()
+    {
+        std::unique_lock<std::mutex> lock(scheduler_mutex);
+
+        while (true)
+        {
+            if (stopping && jobs.empty())
+            {
+                return;
+            }
+
+            // Pick the oldest job whose levels are free. Ranges of jobs skipped on the way
+            // are treated as reserved so overlapping jobs keep their submission order.
+            auto selected = jobs.end();
+            LevelRange range{0, 0};
+            std::vector<LevelRange> skipped;
+
+            for (auto it = jobs.begin(); it != jobs.end(); ++it)
+            {
+                LevelRange candidate = it->reserve();
+                bool blocked = is_reserved(candidate);
+
+                for (const auto &earlier : skipped)
+                {
+                    blocked = blocked || ranges_overlap(earlier, candidate);
+                }
+
+                if (!blocked)
+                {
+                    selected = it;
+                    range = candidate;
+                    break;
+                }
+                skipped.push_back(candidate);
+            }
+
+            if (selected == jobs.end())
+            {
+                work_condition.wait(lock);
+                continue;
+            }
+
+            Job job = std::move(*selected);
+            jobs.erase(selected);
+            active_ranges.push_back(range);
+
+            lock.unlock();
+
+            try
+            {
+                job.run(range);
+            }
+            catch (const std::exception &e)
+            {
+                std::cerr << "Background job on levels " << range.first << "-" << range.second
+                          << " failed: " << e.what() << std::endl;
+            }
+
+            lock.lock();
+
+            for (auto it = active_ranges.begin(); it != active_ranges.end(); ++it)
+            {
+                if (*it == range)
+                {
+                    active_ranges.erase(it);
+                    break;
+                }
+            }
+
+            // Finishing a job can unblock queued jobs on other workers
+            work_condition.notify_all();
+
+            if (jobs.empty() && active_ranges.empty())
+            {
+                idle_condition.notify_all();
+            }
+        }
+    }
+
+}
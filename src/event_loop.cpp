@@ -0,0 +1,171 @@
+#include "../include/event_loop.h"
+#include "../include/constants.h"
+
+#include <stdexcept>
+#include <string>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#else
+#include <sys/types.h>
+#include <sys/event.h>
+#include <sys/time.h>
+#endif
+
+namespace lsm
+{
+
+    EventLoop::EventLoop()
+    {
+#if defined(__linux__)
+        poll_fd = epoll_create1(EPOLL_CLOEXEC);
+#else
+        poll_fd = kqueue();
+#endif
+        if (poll_fd < 0)
+        {
+            throw std::runtime_error("Failed to create event loop: " + std::string(strerror(errno)));
+        }
+
+        if (pipe(wake_pipe) < 0)
+        {
+            close(poll_fd);
+            throw std::runtime_error("Failed to create event loop wake pipe: " + std::string(strerror(errno)));
+        }
+
+        for (int fd : wake_pipe)
+        {
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+        }
+
+        add(wake_pipe[0]);
+    }
+
+    EventLoop::~EventLoop()
+    {
+        close(wake_pipe[0]);
+        close(wake_pipe[1]);
+        close(poll_fd);
+    }
+
+    void EventLoop::add(int fd)
+    {
+#if defined(__linux__)
+        struct epoll_event event;
+        std::memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN | EPOLLRDHUP;
+        event.data.fd = fd;
+        int result = epoll_ctl(poll_fd, EPOLL_CTL_ADD, fd, &event);
+#else
+        struct kevent change;
+        EV_SET(&change, fd, EVFILT_READ, EV_ADD, 0, 0, nullptr);
+        int result = kevent(poll_fd, &change, 1, nullptr, 0, nullptr);
+#endif
+        if (result < 0)
+        {
+            throw std::runtime_error("Failed to watch descriptor " + std::to_string(fd) + ": " + strerror(errno));
+        }
+    }
+
+    void EventLoop::set_writable(int fd, bool enabled)
+    {
+#if defined(__linux__)
+        struct epoll_event event;
+        std::memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN | EPOLLRDHUP;
+        if (enabled)
+        {
+            event.events |= EPOLLOUT;
+        }
+        event.data.fd = fd;
+        epoll_ctl(poll_fd, EPOLL_CTL_MOD, fd, &event);
+#else
+        struct kevent change;
+        EV_SET(&change, fd, EVFILT_WRITE, enabled ? EV_ADD : EV_DELETE, 0, 0, nullptr);
+        kevent(poll_fd, &change, 1, nullptr, 0, nullptr);
+#endif
+    }
+
+    void EventLoop::remove(int fd)
+    {
+#if defined(__linux__)
+        epoll_ctl(poll_fd, EPOLL_CTL_DEL, fd, nullptr);
+#else
+        struct kevent changes[2];
+        EV_SET(&changes[0], fd, EVFILT_READ, EV_DELETE, 0, 0, nullptr);
+        EV_SET(&changes[1], fd, EVFILT_WRITE, EV_DELETE, 0, 0, nullptr);
+        // Deleting a filter that was never added fails harmlessly
+        kevent(poll_fd, &changes[0], 1, nullptr, 0, nullptr);
+        kevent(poll_fd, &changes[1], 1, nullptr, 0, nullptr);
+#endif
+    }
+
+    size_t EventLoop::wait(std::vector<Event> &events, int timeout_ms)
+    {
+        events.clear();
+
+#if defined(__linux__)
+        struct epoll_event ready[constants::EVENT_LOOP_MAX_EVENTS];
+        int count = epoll_wait(poll_fd, ready, constants::EVENT_LOOP_MAX_EVENTS, timeout_ms);
+#else
+        struct kevent ready[constants::EVENT_LOOP_MAX_EVENTS];
+        struct timespec timeout;
+        timeout.tv_sec = timeout_ms / 1000;
+        timeout.tv_nsec = (timeout_ms % 1000) * 1000000L;
+        int count = kevent(poll_fd, nullptr, 0, ready, constants::EVENT_LOOP_MAX_EVENTS, &timeout);
+#endif
+
+        if (count < 0)
+        {
+            if (errno == EINTR)
+            {
+                return 0;
+            }
+            throw std::runtime_error("Event loop wait failed: " + std::string(strerror(errno)));
+        }
+
+        for (int i = 0; i < count; ++i)
+        {
+#if defined(__linux__)
+            int fd = ready[i].data.fd;
+            Event event{fd,
+                        (ready[i].events & EPOLLIN) != 0,
+                        (ready[i].events & EPOLLOUT) != 0,
+                        (ready[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) != 0};
+#else
+            int fd = static_cast<int>(ready[i].ident);
+            Event event{fd,
+                        ready[i].filter == EVFILT_READ,
+                        ready[i].filter == EVFILT_WRITE,
+                        (ready[i].flags & (EV_EOF | EV_ERROR)) != 0};
+#endif
+
+            // Drain wake-ups; they only exist to end the wait early
+            if (fd == wake_pipe[0])
+            {
+                char drain[64];
+                while (read(wake_pipe[0], drain, sizeof(drain)) > 0)
+                {
+                }
+                continue;
+            }
+
+            events.push_back(event);
+        }
+
+        return events.size();
+    }
+
+    void EventLoop::wake()
+    {
+        char byte = 1;
+        // A full pipe already guarantees a pending wake-up
+        ssize_t result = write(wake_pipe[1], &byte, 1);
+        (void)result;
+    }
+
+}
@@ -1,104 +1,203 @@
 #include "../include/fence_pointers.h"
 #include "../include/constants.h"
+#include "../include/key_value_traits.h"
 #include <fstream>
 #include <stdexcept>
 #include <algorithm>
+#include <limits>
+#include <cstring>
 
 namespace lsm
 {
 
-    FencePointers::FencePointers(const std::string &run_filename,
-                                 const std::vector<std::pair<int64_t, size_t>> &key_offsets)
-        : run_filename(run_filename)
+    namespace
     {
-
-        // Reserve space for fence pointers
-        fence_pointers.reserve(key_offsets.size());
-
-        // Create fence pointers based on the page size
-        size_t page_size = constants::PAGE_SIZE;
-        size_t current_page = 0;
-
-        for (const auto &[key, offset] : key_offsets)
+        // First bytes of a fence pointer file, padded to a cache line. The first key of every
+        // block follows, padded to a whole line, and then the blocks.
+        struct alignas(64) FenceFileHeader
         {
-            size_t page_number = offset / page_size;
-
-            if (page_number > current_page || fence_pointers.empty())
-            {
-                fence_pointers.emplace_back(key, offset);
-                current_page = page_number;
-            }
+            uint64_t magic;
+            uint32_t version;
+            uint32_t reserved;
+            uint64_t num_pages;
+            uint64_t num_blocks;
+        };
+
+        // Bytes taken by the first keys of a number of blocks, padded to a cache line
+        size_t block_keys_bytes(size_t num_blocks)
+        {
+            return (num_blocks * sizeof(int64_t) + 63) / 64 * 64;
         }
     }
 
+    FencePointers::FencePointers(const std::vector<int64_t> &page_keys)
+    {
+        build(page_keys);
+    }
+
     FencePointers::FencePointers(const std::string &fence_pointers_filename)
     {
+        // Files of the current version are mapped; older ones are read and rebuilt
+        auto mapped = std::make_shared<const MappedFile>(fence_pointers_filename);
+        if (map_section(mapped, 0, mapped->size(), fence_pointers_filename))
+        {
+            return;
+        }
+
         std::ifstream file(fence_pointers_filename, std::ios::binary);
         if (!file)
         {
             throw std::runtime_error("Failed to open fence pointers file: " + fence_pointers_filename);
         }
 
-        // Read run filename length and then the filename
-        size_t filename_length;
-        file.read(reinterpret_cast<char *>(&filename_length), sizeof(filename_length));
+        std::vector<int64_t> page_keys;
 
-        run_filename.resize(filename_length);
-        file.read(&run_filename[0], filename_length);
+        uint64_t magic = 0;
+        file.read(reinterpret_cast<char *>(&magic), sizeof(magic));
 
-        // Read number of fence pointers
-        size_t count;
-        file.read(reinterpret_cast<char *>(&count), sizeof(count));
+        if (magic == constants::FENCE_FILE_MAGIC)
+        {
+            uint32_t version = 0;
+            file.read(reinterpret_cast<char *>(&version), sizeof(version));
+            if (version != constants::FENCE_FILE_PAGE_KEYS_VERSION)
+            {
+                throw std::runtime_error("Unsupported fence pointers version " + std::to_string(version) +
+                                         " in " + fence_pointers_filename);
+            }
 
-        // Read all fence pointers
-        fence_pointers.reserve(count);
-        for (size_t i = 0; i < count; ++i)
+            uint64_t count = 0;
+            file.read(reinterpret_cast<char *>(&count), sizeof(count));
+
+            page_keys.resize(count);
+            file.read(reinterpret_cast<char *>(page_keys.data()), count * sizeof(int64_t));
+        }
+        else
         {
-            int64_t key;
-            size_t offset;
+            // Old format: run filename, then one {key, offset} pair per page in page order
+            size_t filename_length = magic;
+            file.seekg(static_cast<std::streamoff>(filename_length), std::ios::cur);
 
-            file.read(reinterpret_cast<char *>(&key), sizeof(key));
-            file.read(reinterpret_cast<char *>(&offset), sizeof(offset));
+            size_t count = 0;
+            file.read(reinterpret_cast<char *>(&count), sizeof(count));
 
-            fence_pointers.emplace_back(key, offset);
+            page_keys.reserve(count);
+            for (size_t i = 0; i < count && file; ++i)
+            {
+                int64_t key;
+                size_t offset;
+                file.read(reinterpret_cast<char *>(&key), sizeof(key));
+                file.read(reinterpret_cast<char *>(&offset), sizeof(offset));
+                page_keys.push_back(key);
+            }
         }
 
         if (!file)
         {
             throw std::runtime_error("Failed to read fence pointers from file: " + fence_pointers_filename);
         }
+
+        build(page_keys);
     }
 
-    size_t FencePointers::find_offset(int64_t key) const
+    FencePointers::FencePointers(std::shared_ptr<const MappedFile> file, size_t offset, size_t size,
+                                 const std::string &name)
+    {
+        if (!map_section(std::move(file), offset, size, name))
+        {
+            throw std::runtime_error("Unsupported fence pointers format in " + name);
+        }
+    }
+
+    bool FencePointers::map_section(std::shared_ptr<const MappedFile> file, size_t offset, size_t size,
+                                    const std::string &name)
+    {
+        FenceFileHeader header{};
+        if (size < sizeof(header) || offset + size > file->size())
+        {
+            return false;
+        }
+        const char *start = file->data() + offset;
+        std::memcpy(&header, start, sizeof(header));
+        if (header.magic != constants::FENCE_FILE_MAGIC || header.version != constants::FENCE_FILE_VERSION)
+        {
+            return false;
+        }
+
+        size_t keys_bytes = block_keys_bytes(header.num_blocks);
+        if (header.num_blocks != (header.num_pages + KEYS_PER_BLOCK - 1) / KEYS_PER_BLOCK ||
+            size != sizeof(header) + keys_bytes + header.num_blocks * sizeof(KeyBlock))
+        {
+            throw std::runtime_error("Failed to read fence pointers from file: " + name);
+        }
+
+        num_pages = header.num_pages;
+        const int64_t *keys = reinterpret_cast<const int64_t *>(start + sizeof(header));
+        const KeyBlock *mapped_blocks = reinterpret_cast<const KeyBlock *>(start + sizeof(header) + keys_bytes);
+        if (offset % alignof(KeyBlock) != 0)
+        {
+            // Misaligned blocks cannot be used in place; copy them out
+            owned_blocks.assign(header.num_blocks, KeyBlock{});
+            std::memcpy(owned_blocks.data(), mapped_blocks, header.num_blocks * sizeof(KeyBlock));
+            owned_block_keys.assign(keys, keys + header.num_blocks);
+            blocks = owned_blocks.data();
+            block_keys = owned_block_keys.data();
+        }
+        else
+        {
+            block_keys = keys;
+            blocks = mapped_blocks;
+            mapping = std::move(file);
+        }
+        num_blocks = header.num_blocks;
+        return true;
+    }
+
+    void FencePointers::build(const std::vector<int64_t> &page_keys)
     {
-        if (fence_pointers.empty())
+        num_pages = page_keys.size();
+
+        size_t block_count = (num_pages + KEYS_PER_BLOCK - 1) / KEYS_PER_BLOCK;
+        owned_blocks.resize(block_count);
+        owned_block_keys.resize(block_count);
+
+        for (size_t b = 0; b < block_count; ++b)
         {
-            return 0; 
+            for (size_t i = 0; i < KEYS_PER_BLOCK; ++i)
+            {
+                size_t page = b * KEYS_PER_BLOCK + i;
+                owned_blocks[b].keys[i] = page < num_pages ? page_keys[page] : DefaultTraits::max_key();
+            }
+            owned_block_keys[b] = owned_blocks[b].keys[0];
         }
 
-        // Binary search to find the appropriate fence pointer
-        size_t index = binary_search(key);
+        blocks = owned_blocks.data();
+        block_keys = owned_block_keys.data();
+        num_blocks = block_count;
+    }
 
-        // Return the offset of the fence pointer
-        return fence_pointers[index].offset;
+    size_t FencePointers::find_offset(int64_t key) const
+    {
+        if (num_pages == 0)
+        {
+            return 0;
+        }
+
+        return find_page(key) * constants::PAGE_SIZE;
     }
 
     std::pair<size_t, size_t> FencePointers::find_range_offsets(int64_t start_key, int64_t end_key) const
     {
-        if (fence_pointers.empty())
+        if (num_pages == 0)
         {
             return {0, 0};
         }
 
-        // Find the fence pointer for the start key
-        size_t start_index = binary_search(start_key);
-        size_t start_offset = fence_pointers[start_index].offset;
-
-        // Find the fence pointer for the end key
-        size_t end_index = binary_search(end_key);
+        size_t start_offset = find_page(start_key) * constants::PAGE_SIZE;
 
-        // If we're at the last fence pointer, read until the end of the file
-        size_t end_offset = (end_index == fence_pointers.size() - 1) ? std::numeric_limits<size_t>::max() : fence_pointers[end_index + 1].offset;
+        // If the end key falls in the last page, read until the end of the file
+        size_t end_page = find_page(end_key);
+        size_t end_offset = (end_page == num_pages - 1) ? std::numeric_limits<size_t>::max()
+                                                        : (end_page + 1) * constants::PAGE_SIZE;
 
         return {start_offset, end_offset};
     }
@@ -111,21 +210,7 @@ namespace lsm
             throw std::runtime_error("Failed to create fence pointers file: " + filename);
         }
 
-        // Write run filename length and then the filename
-        size_t filename_length = run_filename.length();
-        file.write(reinterpret_cast<const char *>(&filename_length), sizeof(filename_length));
-        file.write(run_filename.c_str(), filename_length);
-
-        // Write number of fence pointers
-        size_t count = fence_pointers.size();
-        file.write(reinterpret_cast<const char *>(&count), sizeof(count));
-
-        // Write all fence pointers
-        for (const auto &fp : fence_pointers)
-        {
-            file.write(reinterpret_cast<const char *>(&fp.key), sizeof(fp.key));
-            file.write(reinterpret_cast<const char *>(&fp.offset), sizeof(fp.offset));
-        }
+        write(file);
 
         if (!file)
         {
@@ -133,44 +218,55 @@ namespace lsm
         }
     }
 
+    void FencePointers::write(std::ostream &out) const
+    {
+        // Header, the first key of every block and the blocks, each padded to a cache line
+        FenceFileHeader header{};
+        header.magic = constants::FENCE_FILE_MAGIC;
+        header.version = constants::FENCE_FILE_VERSION;
+        header.num_pages = num_pages;
+        header.num_blocks = num_blocks;
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+        std::vector<int64_t> keys(block_keys_bytes(num_blocks) / sizeof(int64_t), DefaultTraits::max_key());
+        std::copy(block_keys, block_keys + num_blocks, keys.begin());
+        out.write(reinterpret_cast<const char *>(keys.data()), static_cast<std::streamsize>(keys.size() * sizeof(int64_t)));
+        out.write(reinterpret_cast<const char *>(blocks), static_cast<std::streamsize>(num_blocks * sizeof(KeyBlock)));
+    }
+
     size_t FencePointers::size() const
     {
-        return fence_pointers.size();
+        return num_pages;
     }
 
-    size_t FencePointers::binary_search(int64_t key) const
+    size_t FencePointers::memory_usage() const
     {
-        // If key is less than the first fence pointer, return the first one
-        if (key < fence_pointers.front().key)
-        {
-            return 0;
-        }
+        return num_blocks * sizeof(KeyBlock) + num_blocks * sizeof(int64_t);
+    }
 
-        // If key is greater than or equal to the last fence pointer, return the last one
-        if (key >= fence_pointers.back().key)
+    size_t FencePointers::find_page(int64_t key) const
+    {
+        // Last block whose first key is <= key; the loop compiles to conditional moves
+        const int64_t *base = block_keys;
+        size_t length = num_blocks;
+        while (length > 1)
         {
-            return fence_pointers.size() - 1;
+            size_t half = length / 2;
+            base = (base[half] <= key) ? base + half : base;
+            length -= half;
         }
+        size_t block = static_cast<size_t>(base - block_keys);
 
-        // Binary search to find the largest fence pointer with key <= search_key
-        size_t left = 0;
-        size_t right = fence_pointers.size() - 1;
-
-        while (left < right)
+        // Count the keys <= key within the block's cache line
+        size_t count = 0;
+        for (size_t i = 0; i < KEYS_PER_BLOCK; ++i)
         {
-            size_t mid = left + (right - left + 1) / 2;
-
-            if (fence_pointers[mid].key <= key)
-            {
-                left = mid;
-            }
-            else
-            {
-                right = mid - 1;
-            }
+            count += static_cast<size_t>(blocks[block].keys[i] <= key);
         }
 
-        return left;
+        // Keys below the first page map to page 0; padding keys can only match INT64_MAX
+        size_t page = block * KEYS_PER_BLOCK + count - (count > 0);
+        return std::min(page, num_pages - 1);
     }
 
-}
\ No newline at end of file
+}
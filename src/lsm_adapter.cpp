@@ -14,14 +14,18 @@ namespace lsm
     LSMAdapter &LSMAdapter::get_instance()
     {
         static LSMAdapter instance;
-        std::cout << "LSM Adapter instance accessed" << std::endl;
+        if constexpr (constants::DEBUG_LOGGING)
+        {
+            std::cout << "LSM Adapter instance accessed" << std::endl;
+        }
         return instance;
     }
 
     LSMAdapter::LSMAdapter()
     {
         // Create the LSM-tree
-        tree = std::make_unique<LSMTree>();
+        tree = std::make_unique<ShardedLSMTree>(constants::SHARD_COUNT.load(), constants::DATA_DIRECTORY,
+                                                constants::PIN_THREADS.load());
         std::cout << "LSM-Tree adapter initialized" << std::endl;
     }
 
@@ -63,23 +67,42 @@ namespace lsm
 
         case 'r':
         {
-            if (command.size() == 1 || command[1] == ' ')
+            auto tokens = tokenize(command);
+            if (tokens.size() == 1)
             {
                 // Single 'r' is reset stats
                 return handle_reset_stats();
             }
             else
             {
-                // "range" command would be longer and start with 'r'
-                auto tokens = tokenize(command);
+                // "r [start] [end]" is a range query
                 return handle_range(tokens);
             }
         }
 
+        case 'm':
+        {
+            // Multi-key commands: "mg" and "mp"
+            auto tokens = tokenize(command);
+            if (tokens[0] == constants::CMD_MULTI_GET)
+            {
+                return handle_multi_get(tokens);
+            }
+            if (tokens[0] == constants::CMD_MULTI_PUT)
+            {
+                return handle_multi_put(tokens);
+            }
+            return "Error: Unknown command";
+        }
+
         case 'd':
         {
-            // Delete command
+            // Delete command; "dr" deletes a range
             auto tokens = tokenize(command);
+            if (tokens[0] == constants::CMD_DELETE_RANGE)
+            {
+                return handle_delete_range(tokens);
+            }
             return handle_delete(tokens);
         }
 
@@ -91,11 +114,15 @@ namespace lsm
 
         case 's':
         {
-            // Stats command
+            // Stats command; "s json" is the machine-readable form
             auto tokens = tokenize(command);
+            if (tokens.size() == 2 && tokens[1] == "json")
+            {
+                return handle_stats_json();
+            }
             if (tokens.size() > 1)
             {
-                return "Error: Stats command takes no arguments";
+                return "Error: Usage: s [json]";
             }
             return handle_stats();
         }
@@ -117,7 +144,7 @@ namespace lsm
             int64_t key = std::stoll(tokens[1]);
             int64_t value = std::stoll(tokens[2]);
 
-            tree->put(key, value);
+            tree->put(key, value, write_durability.load());
             return "Put successful: " + tokens[1] + " -> " + tokens[2];
         }
         catch (const std::exception &e)
@@ -153,6 +180,67 @@ namespace lsm
         }
     }
 
+    std::string LSMAdapter::handle_multi_get(const std::vector<std::string> &tokens)
+    {
+        if (tokens.size() < 2)
+        {
+            return "Error: Multi-get command requires at least 1 key";
+        }
+
+        try
+        {
+            std::vector<int64_t> keys;
+            keys.reserve(tokens.size() - 1);
+            for (size_t i = 1; i < tokens.size(); ++i)
+            {
+                keys.push_back(std::stoll(tokens[i]));
+            }
+
+            auto results = tree->multi_get(keys);
+
+            // Same format as range results; missing keys are left out
+            std::stringstream ss;
+            for (size_t i = 0; i < keys.size(); ++i)
+            {
+                if (results[i])
+                {
+                    ss << keys[i] << ":" << *results[i] << " ";
+                }
+            }
+
+            return ss.str();
+        }
+        catch (const std::exception &e)
+        {
+            return std::string("Error parsing arguments: ") + e.what();
+        }
+    }
+
+    std::string LSMAdapter::handle_multi_put(const std::vector<std::string> &tokens)
+    {
+        if (tokens.size() < 3 || tokens.size() % 2 == 0)
+        {
+            return "Error: Multi-put command requires key-value pairs";
+        }
+
+        try
+        {
+            std::vector<KeyValuePair> pairs;
+            pairs.reserve(tokens.size() / 2);
+            for (size_t i = 1; i + 1 < tokens.size(); i += 2)
+            {
+                pairs.emplace_back(std::stoll(tokens[i]), std::stoll(tokens[i + 1]));
+            }
+
+            tree->multi_put(pairs, write_durability.load());
+            return "Put successful: " + std::to_string(pairs.size()) + " pairs";
+        }
+        catch (const std::exception &e)
+        {
+            return std::string("Error parsing arguments: ") + e.what();
+        }
+    }
+
     std::string LSMAdapter::handle_range(const std::vector<std::string> &tokens)
     {
         if (tokens.size() != 3)
@@ -202,7 +290,7 @@ namespace lsm
         {
             int64_t key = std::stoll(tokens[1]);
 
-            bool success = tree->remove(key);
+            bool success = tree->remove(key, write_durability.load());
             return success ? "Delete successful" : "Delete failed: Key not found";
         }
         catch (const std::exception &e)
@@ -211,6 +299,31 @@ namespace lsm
         }
     }
 
+    std::string LSMAdapter::handle_delete_range(const std::vector<std::string> &tokens)
+    {
+        if (tokens.size() != 3)
+        {
+            return "Error: Delete range command requires exactly 2 arguments";
+        }
+
+        try
+        {
+            int64_t start_key = std::stoll(tokens[1]);
+            int64_t end_key = std::stoll(tokens[2]);
+            if (start_key >= end_key)
+            {
+                return "Error: Delete range start must be less than end";
+            }
+
+            tree->delete_range(start_key, end_key, write_durability.load());
+            return "Delete range successful";
+        }
+        catch (const std::exception &e)
+        {
+            return std::string("Error parsing arguments: ") + e.what();
+        }
+    }
+
     std::string LSMAdapter::handle_load(const std::string &command)
     {
         // Extract filepath
@@ -295,6 +408,11 @@ namespace lsm
         ss << "  I/O per read operation: " << std::fixed << std::setprecision(2) << io_per_read << std::endl;
         ss << "  I/O per write operation: " << std::fixed << std::setprecision(2) << io_per_write << std::endl;
 
+        // Latency percentiles and per-level filter accuracy
+        ss << std::endl
+           << "===== Latency =====" << std::endl;
+        tree->write_metrics_text(ss);
+
         ss << "=========================" << std::endl
            << std::endl;
 
@@ -322,6 +440,13 @@ namespace lsm
         return stats;
     }
 
+    std::string LSMAdapter::handle_stats_json()
+    {
+        std::stringstream ss;
+        tree->write_metrics_json(ss);
+        return ss.str();
+    }
+
     std::string LSMAdapter::handle_reset_stats()
     {
         reset_io_stats();
@@ -3,23 +3,222 @@
 #include "../include/run.h"
 #include "../include/bloom_filter.h"
 #include "../include/fence_pointers.h"
+#include "../include/merge_iterator.h"
+#include "../include/block_cache.h"
+#include "../include/row_cache.h"
+#include "../include/rate_limiter.h"
+#include "../include/wal.h"
+#include "../include/manifest.h"
 #include "../include/constants.h"
 
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <iomanip>
+#include <ctime>
 #include <algorithm>
 #include <chrono>
 #include <filesystem>
 #include <cmath>
 #include <numeric>
 #include <map>
+#include <set>
+#include <thread>
+#include <cstring>
+#include <cerrno>
+#include <exception>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 namespace fs = std::filesystem;
 
 namespace lsm
 {
 
+    namespace
+    {
+        // Private, writable mapping of a file of key-value pairs. Changes stay in memory
+        // (copy-on-write), which lets a bulk load sort its input in place.
+        class MappedPairFile
+        {
+        public:
+            explicit MappedPairFile(const std::string &filepath) : fd(-1), mapping(nullptr), bytes(0)
+            {
+                fd = ::open(filepath.c_str(), O_RDONLY | O_CLOEXEC);
+                if (fd < 0)
+                {
+                    throw std::runtime_error("Failed to open file: " + filepath);
+                }
+
+                struct stat info;
+                if (::fstat(fd, &info) < 0)
+                {
+                    ::close(fd);
+                    throw std::runtime_error("Failed to stat file: " + filepath + ": " + std::strerror(errno));
+                }
+
+                // A trailing partial pair is ignored
+                bytes = static_cast<size_t>(info.st_size) / sizeof(FilePair) * sizeof(FilePair);
+                if (bytes == 0)
+                {
+                    return;
+                }
+
+                mapping = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+                if (mapping == MAP_FAILED)
+                {
+                    mapping = nullptr;
+                    ::close(fd);
+                    throw std::runtime_error("Failed to map file: " + filepath + ": " + std::strerror(errno));
+                }
+                ::madvise(mapping, bytes, MADV_WILLNEED);
+            }
+
+            ~MappedPairFile()
+            {
+                if (mapping)
+                {
+                    ::munmap(mapping, bytes);
+                }
+                if (fd >= 0)
+                {
+                    ::close(fd);
+                }
+            }
+
+            MappedPairFile(const MappedPairFile &) = delete;
+            MappedPairFile &operator=(const MappedPairFile &) = delete;
+
+            FilePair *pairs() const
+            {
+                return static_cast<FilePair *>(mapping);
+            }
+
+            size_t size() const
+            {
+                return bytes / sizeof(FilePair);
+            }
+
+        private:
+            int fd;
+            void *mapping;
+            size_t bytes;
+        };
+
+        // Cursor over a sorted array of load file pairs
+        class PairSpanIterator : public PairIterator
+        {
+        public:
+            PairSpanIterator(const FilePair *begin, const FilePair *end)
+                : position(begin), end(end), current_pair(0, 0)
+            {
+                load();
+            }
+
+            bool valid() const override
+            {
+                return position != end;
+            }
+
+            const KeyValuePair &current() const override
+            {
+                return current_pair;
+            }
+
+            void next() override
+            {
+                ++position;
+                load();
+            }
+
+        private:
+            const FilePair *position;
+            const FilePair *end;
+            KeyValuePair current_pair;
+
+            void load()
+            {
+                if (position != end)
+                {
+                    current_pair = KeyValuePair(position->key, position->value);
+                }
+            }
+        };
+
+        // Sort pairs by key and keep only the last (newest) pair of each key; returns the new end
+        FilePair *sort_and_deduplicate(FilePair *begin, FilePair *end)
+        {
+            std::stable_sort(begin, end);
+
+            FilePair *out = begin;
+            for (FilePair *it = begin; it != end; ++it)
+            {
+                if (it + 1 != end && (it + 1)->key == it->key)
+                {
+                    continue;
+                }
+                *out++ = *it;
+            }
+            return out;
+        }
+
+        // Value of an entry, or nothing if it is a deletion
+        std::optional<int64_t> entry_value(const KeyValuePair &entry)
+        {
+            if (entry.type != EntryType::VALUE)
+            {
+                return std::nullopt;
+            }
+            return entry.value;
+        }
+
+        // Apply a put, deletion or range deletion to a buffer
+        void apply_to_buffer(SkipList &buffer, const KeyValuePair &entry)
+        {
+            if (entry.type == EntryType::RANGE_DELETION)
+            {
+                buffer.delete_range(entry.key, entry.value);
+            }
+            else
+            {
+                buffer.insert(entry.key, entry.value, entry.type);
+            }
+        }
+
+        // State of a parallel point lookup, shared with the pool tasks probing its runs
+        struct ParallelLookup
+        {
+            // One candidate run, in newest-first order
+            struct Probe
+            {
+                Probe(std::shared_ptr<Run> run, int level, bool filtered)
+                    : run(std::move(run)), level(level), filtered(filtered) {}
+
+                std::shared_ptr<Run> run;
+                int level;
+                bool filtered;
+
+                // Set by whichever thread probes the run
+                std::atomic<bool> claimed{false};
+
+                // Outcome, guarded by mutex
+                bool done = false;
+                std::optional<KeyValuePair> result;
+                std::exception_ptr error;
+            };
+
+            std::deque<Probe> probes;
+
+            // Newest probe known to hold the key; probes of older runs are skipped
+            std::atomic<size_t> resolved{SIZE_MAX};
+
+            std::mutex mutex;
+            std::condition_variable condition;
+        };
+    }
+
     // Level implementation
 
     Level::Level(int level_number, CompactionStrategy strategy)
@@ -27,37 +226,30 @@ namespace lsm
     {
     }
 
-    Level::~Level()
-    {
-    }
-
-    void Level::add_run(std::unique_ptr<Run> run)
+    void Level::add_run(std::shared_ptr<Run> run)
     {
-        std::lock_guard<std::mutex> lock(level_mutex);
         runs.push_back(std::move(run));
     }
 
     bool Level::needs_compaction() const
     {
-        std::lock_guard<std::mutex> lock(level_mutex);
-
         switch (strategy)
         {
         case CompactionStrategy::TIERING:
-            return runs.size() >= constants::TIERING_THRESHOLD;
+            return runs.size() >= constants::TIERING_THRESHOLD.load();
 
         case CompactionStrategy::LAZY_LEVELING:
-            return runs.size() >= constants::LAZY_LEVELING_THRESHOLD;
+            return runs.size() >= constants::LAZY_LEVELING_THRESHOLD.load();
 
         case CompactionStrategy::LEVELING:
-            return runs.size() > 1;
+            return has_overlapping_runs() || size_bytes() > capacity_bytes();
 
         default:
             return false;
         }
     }
 
-    const std::vector<std::unique_ptr<Run>> &Level::get_runs() const
+    const std::vector<std::shared_ptr<Run>> &Level::get_runs() const
     {
         return runs;
     }
@@ -72,270 +264,748 @@ namespace lsm
         return strategy;
     }
 
+    void Level::set_strategy(CompactionStrategy new_strategy)
+    {
+        strategy = new_strategy;
+    }
+
     size_t Level::run_count() const
     {
-        std::lock_guard<std::mutex> lock(level_mutex);
         return runs.size();
     }
 
-    void Level::clear_runs()
+    void Level::remove_runs(const std::vector<std::shared_ptr<Run>> &removed)
     {
-        std::lock_guard<std::mutex> lock(level_mutex);
+        runs.erase(std::remove_if(runs.begin(), runs.end(),
+                                  [&removed](const std::shared_ptr<Run> &run)
+                                  { return std::find(removed.begin(), removed.end(), run) != removed.end(); }),
+                   runs.end());
+    }
 
-        // First delete all physical files associated with these runs
-        for (auto &run : runs)
+    size_t Level::size_bytes() const
+    {
+        size_t total = 0;
+        for (const auto &run : runs)
         {
-            run->delete_files_from_disk();
+            total += run->size_bytes();
         }
+        return total;
+    }
 
-        // Then clear the runs from memory
-        runs.clear();
+    size_t Level::capacity_bytes() const
+    {
+        double capacity = static_cast<double>(constants::BUFFER_SIZE_BYTES.load()) *
+                          std::pow(static_cast<double>(constants::SIZE_RATIO.load()), level_number);
+        return capacity >= static_cast<double>(SIZE_MAX) ? SIZE_MAX : static_cast<size_t>(capacity);
     }
 
-    // LSMTree implementation
+    bool Level::is_partitioned() const
+    {
+        return strategy == CompactionStrategy::LEVELING;
+    }
 
-    LSMTree::LSMTree() : max_level(constants::INITIAL_MAX_LEVEL)
+    bool Level::has_overlapping_runs() const
     {
-        // Create data directory if it doesn't exist
-        if (!fs::exists(constants::DATA_DIRECTORY))
+        std::vector<std::pair<int64_t, int64_t>> bounds;
+        bounds.reserve(runs.size());
+        for (const auto &run : runs)
         {
-            fs::create_directory(constants::DATA_DIRECTORY);
+            bounds.emplace_back(run->get_min_bound(), run->get_max_bound());
         }
+        std::sort(bounds.begin(), bounds.end());
 
-        // Initialize the buffer
-        buffer = std::make_unique<SkipList>();
-
-        // Initialize levels
-        for (int i = 0; i <= max_level; ++i)
+        for (size_t i = 1; i < bounds.size(); ++i)
         {
-            CompactionStrategy strategy;
+            if (bounds[i].first <= bounds[i - 1].second)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
 
-            if (i == 1)
+    std::vector<std::shared_ptr<Run>> Level::get_overlapping_runs(int64_t min_key, int64_t max_key) const
+    {
+        std::vector<std::shared_ptr<Run>> overlapping;
+        for (const auto &run : runs)
+        {
+            if (run->get_min_bound() <= max_key && run->get_max_bound() >= min_key)
             {
-                strategy = CompactionStrategy::TIERING;
+                overlapping.push_back(run);
             }
-            else if (i >= 2 && i <= 4)
+        }
+        return overlapping;
+    }
+
+    std::shared_ptr<Run> Level::pick_compaction_run() const
+    {
+        std::shared_ptr<Run> next;
+        std::shared_ptr<Run> first;
+        for (const auto &run : runs)
+        {
+            if (!first || run->get_min_bound() < first->get_min_bound())
             {
-                strategy = CompactionStrategy::LAZY_LEVELING;
+                first = run;
             }
-            else
+            if (run->get_min_bound() > compaction_cursor &&
+                (!next || run->get_min_bound() < next->get_min_bound()))
             {
-                strategy = CompactionStrategy::LEVELING;
+                next = run;
             }
+        }
+        return next ? next : first;
+    }
+
+    void Level::set_compaction_cursor(int64_t key)
+    {
+        compaction_cursor = key;
+    }
+
+    // Version implementation
+
+    Level &Version::edit_level(size_t level)
+    {
+        auto copy = std::make_shared<Level>(*levels[level]);
+        Level &edited = *copy;
+        levels[level] = std::move(copy);
+        return edited;
+    }
+
+    // LSMTree implementation
 
-            levels.push_back(std::make_unique<Level>(i, strategy));
+    LSMTree::LSMTree(const std::string &data_directory)
+        : data_directory(data_directory), max_level(constants::INITIAL_MAX_LEVEL)
+    {
+        // Create data directory if it doesn't exist
+        if (!fs::exists(data_directory))
+        {
+            fs::create_directories(data_directory);
+        }
+
+        // Initialize the buffer
+        buffer = std::make_shared<SkipList>();
+        row_cache = std::make_unique<RowCache>(constants::ROW_CACHE_ENTRIES.load(), constants::ROW_CACHE_SHARDS);
+
+        // Initialize levels
+        auto version = std::make_shared<Version>();
+        version->buffer = buffer;
+        for (int i = 0; i <= max_level; ++i)
+        {
+            version->levels.push_back(std::make_shared<Level>(i, get_strategy_for_level(i)));
         }
+        current_version = std::move(version);
+
+        // Start the background flush/compaction threads
+        scheduler = std::make_unique<CompactionScheduler>(constants::BACKGROUND_THREAD_COUNT);
+
+        // Log segments are replayed while loading state below
+        wal = std::make_unique<WriteAheadLog>(data_directory);
 
         // Load existing state from disk if any
         load_state_from_disk();
 
+        // Filters left stale by an interrupted rebuild are caught up in the background
+        filter_thread = std::thread(&LSMTree::filter_rebuild_loop, this);
+        rebuild_filters();
+
+        // Parallel lookups may have been switched on before the tree was created
+        if (constants::PARALLEL_LOOKUP_ENABLED.load())
+        {
+            set_parallel_lookup(true);
+        }
+
         log_debug("LSM-Tree initialized with " + std::to_string(max_level) + " levels");
     }
 
     LSMTree::~LSMTree()
     {
         // Flush any remaining data in the buffer to disk
-        if (buffer && buffer->element_count() > 0)
         {
-            log_debug("Flushing buffer during shutdown to prevent data loss");
-            flush_buffer();
+            std::unique_lock<std::shared_mutex> lock(tree_mutex);
+            if (buffer && buffer->element_count() > 0)
+            {
+                log_debug("Flushing buffer during shutdown to prevent data loss");
+                flush_buffer();
+            }
+        }
+
+        // Lookup probes still running hold runs of the levels
+        parallel_lookup.store(false);
+        lookup_pool.reset();
+
+        // Let queued flushes and compactions finish before the levels go away
+        scheduler->wait_idle();
+        scheduler->stop();
+
+        // An unfinished filter rebuild is finished on the next start
+        {
+            std::lock_guard<std::mutex> lock(filter_mutex);
+            filter_thread_stopping = true;
+        }
+        filter_condition.notify_all();
+        if (filter_thread.joinable())
+        {
+            filter_thread.join();
         }
     }
 
-    void LSMTree::put(int64_t key, int64_t value)
+    void LSMTree::put(int64_t key, int64_t value, Durability durability)
+    {
+        log_trace([&]
+                  { return "PUT operation: Inserting key=" + std::to_string(key) + ", value=" + std::to_string(value); });
+        write(KeyValuePair(key, value), durability);
+    }
+
+    void LSMTree::write(const KeyValuePair &entry, Durability durability)
     {
-        auto start_time = std::chrono::high_resolution_clock::now();
+        auto start_time = Metrics::Clock::now();
 
-        std::lock_guard<std::mutex> lock(tree_mutex);
+        // Slow down or block while too many buffers are waiting to be flushed
+        apply_write_backpressure();
 
-        log_debug("PUT operation: Inserting key=" + std::to_string(key) +
-                  ", value=" + std::to_string(value));
+        // Writers insert concurrently; the shared lock only keeps the buffer from being
+        // handed off under them
+        bool buffer_full;
+        uint64_t log_position;
+        {
+            std::shared_lock<std::shared_mutex> lock(tree_mutex);
+
+            // Insert/update in buffer
+            log_position = write_to_buffer(&entry, 1, durability);
+            log_trace([&]
+                      { return "PUT: Inserted into buffer. Buffer now has " +
+                               std::to_string(buffer->element_count()) + " elements (" +
+                               std::to_string(buffer->size_bytes()) + " bytes)"; });
 
-        // Insert/update in buffer
-        buffer->insert(key, value);
-        log_debug("PUT: Inserted into buffer. Buffer now has " +
-                  std::to_string(buffer->element_count()) + " elements (" +
-                  std::to_string(buffer->size_bytes()) + " bytes)");
+            buffer_full = buffer->is_full();
+        }
 
         // Check if buffer is full and needs to be flushed
-        if (buffer->is_full())
+        if (buffer_full)
         {
-            log_debug("PUT: Buffer is full (>= " +
-                      std::to_string(constants::BUFFER_SIZE_BYTES.load()) + " bytes), flushing to disk");
-            flush_buffer();
+            std::unique_lock<std::shared_mutex> lock(tree_mutex);
+
+            // Another writer may have handed the full buffer off already
+            if (buffer->is_full())
+            {
+                log_debug("PUT: Buffer is full (>= " +
+                          std::to_string(constants::BUFFER_SIZE_BYTES.load()) + " bytes), handing off for flush");
+                flush_buffer();
+            }
         }
-        else
+
+        // Wait outside the tree lock so other writers can join the same group commit
+        if (durability == Durability::SYNC)
         {
-            log_debug("PUT: Buffer not full yet, remaining capacity: " +
-                      std::to_string(constants::BUFFER_SIZE_BYTES.load() - buffer->size_bytes()) + " bytes");
+            wal->wait_durable(log_position);
         }
 
         // Track write timing
-        auto end_time = std::chrono::high_resolution_clock::now();
-        double elapsed_ms = std::chrono::duration<double, std::milli>(end_time - start_time).count();
-
-        // Update write metrics
-        write_count++;
-        total_write_time_ms.store(total_write_time_ms.load() + elapsed_ms);
+        write_count.add();
+        Metrics::Operation operation = entry.type == EntryType::VALUE      ? Metrics::Operation::PUT
+                                       : entry.type == EntryType::DELETION ? Metrics::Operation::DELETE
+                                                                           : Metrics::Operation::DELETE_RANGE;
+        metrics.record(operation, Metrics::elapsed_ns(start_time));
     }
 
     std::optional<int64_t> LSMTree::get(int64_t key)
     {
-        auto start_time = std::chrono::high_resolution_clock::now();
+        auto start_time = Metrics::Clock::now();
 
-        log_debug("GET operation: Searching for key=" + std::to_string(key));
+        log_trace([&]
+                  { return "GET operation: Searching for key=" + std::to_string(key); });
 
-        // First check the buffer
-        auto buffer_result = buffer->get(key);
-        if (buffer_result.has_value())
+        // Every outcome counts as one read
+        auto finish = [&](std::optional<int64_t> result)
         {
-            log_debug("GET: Found key in buffer, value=" + std::to_string(*buffer_result));
-
-            // Track read timing for buffer hit
-            auto end_time = std::chrono::high_resolution_clock::now();
-            double elapsed_ms = std::chrono::duration<double, std::milli>(end_time - start_time).count();
+            read_count.add();
+            metrics.record(Metrics::Operation::GET, Metrics::elapsed_ns(start_time));
+            return result;
+        };
+
+        // Taken before the buffers are read, so a write racing with this lookup keeps its
+        // result out of the row cache
+        uint64_t cache_ticket = row_cache->ticket(key);
+
+        // Pin the current version; flushes and compactions leave it intact
+        auto version = get_version();
+
+        // First check the active buffer, then the immutable ones, newest first. A buffer's
+        // own entry is newer than its range tombstones, which only hide older sources.
+        // Returns the result of the lookup if the buffer decides it.
+        auto check_buffer = [&](const SkipList &memtable) -> std::optional<std::optional<int64_t>>
+        {
+            if (auto entry = memtable.get(key))
+            {
+                log_trace([&]
+                          { return "GET: Found key in buffer, value=" + std::to_string(entry->value); });
+                return entry_value(*entry);
+            }
+            if (memtable.range_deleted(key))
+            {
+                return std::optional<int64_t>();
+            }
+            return std::nullopt;
+        };
 
-            // Update read metrics
-            read_count++;
-            total_read_time_ms.store(total_read_time_ms.load() + elapsed_ms);
+        if (auto result = check_buffer(*version->buffer))
+        {
+            return finish(*result);
+        }
+        for (auto it = version->immutable_buffers.rbegin(); it != version->immutable_buffers.rend(); ++it)
+        {
+            if (auto result = check_buffer(**it))
+            {
+                return finish(*result);
+            }
+        }
+        log_trace([]
+                  { return std::string("GET: Key not found in buffer, checking disk levels"); });
 
-            return buffer_result;
+        // Flushes and compactions move keys between runs without changing their values, so
+        // a cached result stays valid until the key is written
+        if (auto cached = row_cache->lookup(key))
+        {
+            return finish(*cached);
         }
-        log_debug("GET: Key not found in buffer, checking disk levels");
 
+        auto result = is_parallel_lookup_enabled() ? get_from_levels_parallel(*version, key)
+                                                   : get_from_levels(*version, key);
+        row_cache->insert(key, result, cache_ticket);
+        return finish(result);
+    }
+
+    std::optional<int64_t> LSMTree::get_from_levels(const Version &version, int64_t key)
+    {
         // Check each level, starting from the most recent
-        for (const auto &level : levels)
+        for (const auto &level : version.levels)
         {
             int level_num = level->get_level_number();
-            log_debug("GET: Checking level " + std::to_string(level_num) +
-                      " (strategy: " + get_strategy_name(level->get_strategy()) +
-                      ", runs: " + std::to_string(level->run_count()) + ")");
+            log_trace([&]
+                      { return "GET: Checking level " + std::to_string(level_num) +
+                               " (strategy: " + get_strategy_name(level->get_strategy()) +
+                               ", runs: " + std::to_string(level->run_count()) + ")"; });
 
             // Check runs in reverse order (newest first)
             const auto &runs = level->get_runs();
             int run_idx = 0;
             for (auto it = runs.rbegin(); it != runs.rend(); ++it, ++run_idx)
             {
-                log_debug("GET: Checking run " + std::to_string(run_idx) +
-                          " in level " + std::to_string(level_num));
-
                 // Check bloom filter first, if available
-                if ((*it)->has_bloom_filter() && !(*it)->might_contain(key))
+                bool filtered = (*it)->has_bloom_filter();
+                if (filtered && !(*it)->might_contain(key))
                 {
-                    log_debug("GET: Bloom filter indicates key is not in run " +
-                              std::to_string(run_idx) + " of level " + std::to_string(level_num));
-                    continue;
+                    metrics.record_filter_negative(level_num);
+                    log_trace([&]
+                              { return "GET: Bloom filter indicates key is not in run " +
+                                       std::to_string(run_idx) + " of level " + std::to_string(level_num); });
                 }
-
-                auto result = (*it)->get(key);
-                if (result.has_value())
+                else
                 {
-                    log_debug("GET: Found key in run " + std::to_string(run_idx) +
-                              " of level " + std::to_string(level_num) +
-                              ", value=" + std::to_string(*result));
-
-                    // Track read timing for disk hit
-                    auto end_time = std::chrono::high_resolution_clock::now();
-                    double elapsed_ms = std::chrono::duration<double, std::milli>(end_time - start_time).count();
+                    auto probe_start = Metrics::Clock::now();
+                    auto result = (*it)->get(key);
+                    if (filtered)
+                    {
+                        metrics.record_probe(level_num, Metrics::elapsed_ns(probe_start), result.has_value());
+                    }
 
-                    // Update read metrics
-                    read_count++;
-                    total_read_time_ms.store(total_read_time_ms.load() + elapsed_ms);
+                    if (result.has_value())
+                    {
+                        log_trace([&]
+                                  { return "GET: Found key in run " + std::to_string(run_idx) +
+                                           " of level " + std::to_string(level_num) +
+                                           ", value=" + std::to_string(result->value); });
+                        return entry_value(*result);
+                    }
+                }
 
-                    return result;
+                // Older runs are hidden under the run's range tombstones
+                if ((*it)->range_deleted(key))
+                {
+                    log_trace([&]
+                              { return "GET: Key deleted by a range tombstone in level " + std::to_string(level_num); });
+                    return std::nullopt;
                 }
-                log_debug("GET: Key not found in run " + std::to_string(run_idx) +
-                          " of level " + std::to_string(level_num));
             }
         }
 
-        log_debug("GET: Key not found in any level");
-
-        // Track read timing for miss
-        auto end_time = std::chrono::high_resolution_clock::now();
-        double elapsed_ms = std::chrono::duration<double, std::milli>(end_time - start_time).count();
-
-        // Update read metrics (even for misses)
-        read_count++;
-        total_read_time_ms.store(total_read_time_ms.load() + elapsed_ms);
-
-        // Key not found
+        log_trace([]
+                  { return std::string("GET: Key not found in any level"); });
         return std::nullopt;
     }
 
-    std::vector<KeyValuePair> LSMTree::range(int64_t start_key, int64_t end_key)
+    std::optional<int64_t> LSMTree::get_from_levels_parallel(const Version &version, int64_t key)
     {
-        if (start_key >= end_key)
+        auto lookup = std::make_shared<ParallelLookup>();
+
+        // Every run whose bloom filter lets the key through, newest first, down to the
+        // first run with a range tombstone over the key
+        bool range_deleted = false;
+        for (size_t i = 0; i < version.levels.size() && !range_deleted; ++i)
+        {
+            int level_num = version.levels[i]->get_level_number();
+            const auto &runs = version.levels[i]->get_runs();
+            for (auto it = runs.rbegin(); it != runs.rend() && !range_deleted; ++it)
+            {
+                range_deleted = (*it)->range_deleted(key);
+                bool filtered = (*it)->has_bloom_filter();
+                if (filtered && !(*it)->might_contain(key))
+                {
+                    metrics.record_filter_negative(level_num);
+                    continue;
+                }
+                lookup->probes.emplace_back(*it, level_num, filtered);
+            }
+        }
+
+        size_t count = lookup->probes.size();
+        log_trace([&]
+                  { return "GET: Probing " + std::to_string(count) + " candidate runs in parallel"; });
+        if (count == 0)
         {
-            return {};
+            return std::nullopt;
         }
 
-        // Results from all levels (buffer and disk)
-        std::vector<KeyValuePair> results;
+        // Probe one run unless it was claimed already or a newer run has the key
+        auto probe = [this, key](ParallelLookup &lookup, size_t index)
+        {
+            auto &candidate = lookup.probes[index];
+            if (candidate.claimed.exchange(true))
+            {
+                return;
+            }
+
+            std::optional<KeyValuePair> result;
+            std::exception_ptr error;
+            if (index < lookup.resolved.load())
+            {
+                try
+                {
+                    auto probe_start = Metrics::Clock::now();
+                    result = candidate.run->get(key);
+                    if (candidate.filtered)
+                    {
+                        metrics.record_probe(candidate.level, Metrics::elapsed_ns(probe_start), result.has_value());
+                    }
+                }
+                catch (...)
+                {
+                    error = std::current_exception();
+                }
+
+                if (result.has_value())
+                {
+                    size_t resolved = lookup.resolved.load();
+                    while (index < resolved && !lookup.resolved.compare_exchange_weak(resolved, index))
+                    {
+                    }
+                }
+            }
 
-        // Get results from buffer
-        auto buffer_results = buffer->range(start_key, end_key);
-        results.insert(results.end(), buffer_results.begin(), buffer_results.end());
+            {
+                std::lock_guard<std::mutex> lock(lookup.mutex);
+                candidate.result = result;
+                candidate.error = error;
+                candidate.done = true;
+            }
+            lookup.condition.notify_all();
+        };
 
-        // Get results from each level
-        for (const auto &level : levels)
+        // Older runs go to the pool; this thread works from the newest run down and only
+        // waits for a run a worker is still reading
+        if (count >= constants::PARALLEL_LOOKUP_MIN_RUNS)
         {
-            const auto &runs = level->get_runs();
-            for (auto it = runs.rbegin(); it != runs.rend(); ++it)
+            for (size_t i = 1; i < count; ++i)
             {
-                auto run_results = (*it)->range(start_key, end_key);
-                results.insert(results.end(), run_results.begin(), run_results.end());
+                lookup_pool->submit([lookup, probe, i]
+                                    { probe(*lookup, i); });
             }
         }
 
-        // Deduplicate results (keep only the newest value for each key)
-        if (!results.empty())
+        for (size_t i = 0; i < count; ++i)
         {
-            // Sort by key
-            std::sort(results.begin(), results.end(),
-                      [](const KeyValuePair &a, const KeyValuePair &b)
-                      {
-                          return a.key < b.key;
-                      });
+            probe(*lookup, i);
 
-            // Deduplicate
-            auto last = std::unique(results.begin(), results.end(),
-                                    [](const KeyValuePair &a, const KeyValuePair &b)
-                                    {
-                                        return a.key == b.key;
-                                    });
-            results.erase(last, results.end());
+            auto &candidate = lookup->probes[i];
+            std::unique_lock<std::mutex> lock(lookup->mutex);
+            lookup->condition.wait(lock, [&candidate]
+                                   { return candidate.done; });
+            if (candidate.error)
+            {
+                std::rethrow_exception(candidate.error);
+            }
+            if (candidate.result.has_value())
+            {
+                log_trace([&]
+                          { return "GET: Found key in level " + std::to_string(candidate.level) +
+                                   ", value=" + std::to_string(candidate.result->value); });
+                return entry_value(*candidate.result);
+            }
         }
 
-        return results;
+        log_trace([]
+                  { return std::string("GET: Key not found in any level"); });
+        return std::nullopt;
     }
 
-    bool LSMTree::remove(int64_t key)
+    std::vector<KeyValuePair> LSMTree::range(int64_t start_key, int64_t end_key)
     {
-        // In this implementation, removing is the same as putting with a special "tombstone" value
-        // For this example, we'll use INT64_MIN as the tombstone value
-        put(key, INT64_MIN);
-        return true;
+        std::vector<KeyValuePair> results;
+        scan(start_key, end_key, constants::RANGE_CHUNK_PAIRS,
+             [&results](const std::vector<KeyValuePair> &chunk)
+             {
+                 results.insert(results.end(), chunk.begin(), chunk.end());
+                 return true;
+             });
+        return results;
     }
 
-    void LSMTree::load_file(const std::string &filepath)
+    void LSMTree::scan(int64_t start_key, int64_t end_key, size_t chunk_pairs,
+                       const std::function<bool(const std::vector<KeyValuePair> &)> &consumer)
     {
-        std::ifstream file(filepath, std::ios::binary);
-        if (!file)
+        if (start_key >= end_key)
         {
-            throw std::runtime_error("Failed to open file: " + filepath);
+            return;
         }
 
-        // Read key-value pairs in chunks to avoid loading the entire file into memory at once
-        const size_t CHUNK_SIZE = 1000;
-        std::vector<KeyValuePair> pairs;
-        pairs.reserve(CHUNK_SIZE);
+        auto start_time = Metrics::Clock::now();
 
-        int64_t key, value;
-        size_t total_pairs = 0;
+        // Sources go newest first so the merge keeps the newest value of every key
+        std::vector<std::unique_ptr<PairIterator>> sources;
 
-        while (file.read(reinterpret_cast<char *>(&key), sizeof(key)) &&
-               file.read(reinterpret_cast<char *>(&value), sizeof(value)))
+        // Pin the current version; its runs stay on disk until the scan lets go of it
+        auto version = get_version();
+
+        // The active and immutable buffers, newest first
+        sources.push_back(std::make_unique<SkipListIterator>(version->buffer, start_key, end_key));
+        for (auto it = version->immutable_buffers.rbegin(); it != version->immutable_buffers.rend(); ++it)
+        {
+            sources.push_back(std::make_unique<SkipListIterator>(*it, start_key, end_key));
+        }
+
+        // Then every level top-down, and within a level the newest run first
+        for (const auto &level : version->levels)
+        {
+            const auto &runs = level->get_runs();
+            for (auto it = runs.rbegin(); it != runs.rend(); ++it)
+            {
+                // Runs ruled out by their range filter are never opened
+                bool overlaps = (*it)->may_overlap(start_key, end_key);
+                metrics.record_range_run(level->get_level_number(), overlaps);
+                if (overlaps)
+                {
+                    sources.push_back(std::make_unique<RunRangeIterator>(**it, start_key, end_key));
+                }
+            }
+        }
+
+        MergeIterator merged(std::move(sources), true);
+
+        std::vector<KeyValuePair> chunk;
+        chunk.reserve(std::max<size_t>(chunk_pairs, 1));
+        for (; merged.valid(); merged.next())
+        {
+            chunk.push_back(merged.current());
+            if (chunk.size() >= chunk_pairs)
+            {
+                if (!consumer(chunk))
+                {
+                    metrics.record(Metrics::Operation::RANGE, Metrics::elapsed_ns(start_time));
+                    return;
+                }
+                chunk.clear();
+            }
+        }
+
+        if (!chunk.empty())
+        {
+            consumer(chunk);
+        }
+        metrics.record(Metrics::Operation::RANGE, Metrics::elapsed_ns(start_time));
+    }
+
+    bool LSMTree::remove(int64_t key, Durability durability)
+    {
+        log_trace([&]
+                  { return "DELETE operation: key=" + std::to_string(key); });
+        write(KeyValuePair(key, 0, EntryType::DELETION), durability);
+        return true;
+    }
+
+    void LSMTree::delete_range(int64_t start_key, int64_t end_key, Durability durability)
+    {
+        if (start_key >= end_key)
+        {
+            return;
+        }
+
+        log_trace([&]
+                  { return "DELETE RANGE operation: [" + std::to_string(start_key) + ", " +
+                           std::to_string(end_key) + ")"; });
+        write(KeyValuePair(start_key, end_key, EntryType::RANGE_DELETION), durability);
+    }
+
+    std::vector<std::optional<int64_t>> LSMTree::multi_get(const std::vector<int64_t> &keys)
+    {
+        auto start_time = Metrics::Clock::now();
+
+        // Sort the batch once; every run is then probed with keys in order
+        std::vector<int64_t> sorted_keys(keys);
+        std::sort(sorted_keys.begin(), sorted_keys.end());
+        sorted_keys.erase(std::unique(sorted_keys.begin(), sorted_keys.end()), sorted_keys.end());
+
+        std::vector<std::optional<int64_t>> sorted_results(sorted_keys.size());
+        std::vector<bool> resolved(sorted_keys.size(), false);
+        size_t unresolved = sorted_keys.size();
+
+        // Pin the current version; flushes and compactions leave it intact
+        auto version = get_version();
+
+        // The active and immutable buffers, newest first
+        std::vector<std::shared_ptr<SkipList>> memtables;
+        memtables.reserve(version->immutable_buffers.size() + 1);
+        memtables.push_back(version->buffer);
+        memtables.insert(memtables.end(), version->immutable_buffers.rbegin(), version->immutable_buffers.rend());
+
+        for (const auto &memtable : memtables)
+        {
+            for (size_t i = 0; i < sorted_keys.size() && unresolved > 0; ++i)
+            {
+                if (resolved[i])
+                {
+                    continue;
+                }
+
+                auto entry = memtable->get(sorted_keys[i]);
+                if (entry.has_value() || memtable->range_deleted(sorted_keys[i]))
+                {
+                    resolved[i] = true;
+                    unresolved--;
+                    sorted_results[i] = entry.has_value() ? entry_value(*entry) : std::nullopt;
+                }
+            }
+        }
+
+        // Then the levels of the same version
+        {
+            std::vector<int64_t> pending_keys;
+            std::vector<size_t> pending_index;
+            for (const auto &level : version->levels)
+            {
+                // Check runs in reverse order (newest first)
+                const auto &runs = level->get_runs();
+                for (auto it = runs.rbegin(); it != runs.rend() && unresolved > 0; ++it)
+                {
+                    pending_keys.clear();
+                    pending_index.clear();
+                    for (size_t i = 0; i < sorted_keys.size(); ++i)
+                    {
+                        if (!resolved[i])
+                        {
+                            pending_keys.push_back(sorted_keys[i]);
+                            pending_index.push_back(i);
+                        }
+                    }
+
+                    for (const auto &hit : (*it)->multi_get(pending_keys))
+                    {
+                        size_t i = pending_index[hit.first];
+                        resolved[i] = true;
+                        unresolved--;
+                        sorted_results[i] = entry_value(hit.second);
+                    }
+
+                    // Keys under the run's range tombstones are deleted in older runs
+                    for (size_t j = 0; j < pending_keys.size(); ++j)
+                    {
+                        size_t i = pending_index[j];
+                        if (!resolved[i] && (*it)->range_deleted(pending_keys[j]))
+                        {
+                            resolved[i] = true;
+                            unresolved--;
+                        }
+                    }
+                }
+            }
+        }
+
+        // Return results in the caller's order
+        std::vector<std::optional<int64_t>> results;
+        results.reserve(keys.size());
+        for (int64_t key : keys)
+        {
+            size_t i = std::lower_bound(sorted_keys.begin(), sorted_keys.end(), key) - sorted_keys.begin();
+            results.push_back(sorted_results[i]);
+        }
+
+        // Track read timing, counting every key as a read
+        read_count.add(keys.size());
+        metrics.record(Metrics::Operation::MULTI_GET, Metrics::elapsed_ns(start_time));
+
+        return results;
+    }
+
+    void LSMTree::multi_put(const std::vector<KeyValuePair> &pairs, Durability durability)
+    {
+        if (pairs.empty())
+        {
+            return;
+        }
+
+        auto start_time = Metrics::Clock::now();
+
+        // Slow down or block while too many buffers are waiting to be flushed
+        apply_write_backpressure();
+
+        // Apply the whole batch under one acquisition of the shared lock
+        bool buffer_full;
+        uint64_t log_position;
+        {
+            std::shared_lock<std::shared_mutex> lock(tree_mutex);
+            log_position = write_to_buffer(pairs.data(), pairs.size(), durability);
+            buffer_full = buffer->is_full();
+        }
+
+        if (buffer_full)
+        {
+            std::unique_lock<std::shared_mutex> lock(tree_mutex);
+
+            // Another writer may have handed the full buffer off already
+            if (buffer->is_full())
+            {
+                log_debug("MPUT: Buffer is full, handing off for flush");
+                flush_buffer();
+            }
+        }
+
+        if (durability == Durability::SYNC)
+        {
+            wal->wait_durable(log_position);
+        }
+
+        // Track write timing, counting every pair as a write
+        write_count.add(pairs.size());
+        metrics.record(Metrics::Operation::MULTI_PUT, Metrics::elapsed_ns(start_time));
+    }
+
+    void LSMTree::load_file(const std::string &filepath)
+    {
+        std::ifstream file(filepath, std::ios::binary);
+        if (!file)
+        {
+            throw std::runtime_error("Failed to open file: " + filepath);
+        }
+
+        // Read key-value pairs in chunks to avoid loading the entire file into memory at once
+        const size_t CHUNK_SIZE = 1000;
+        std::vector<KeyValuePair> pairs;
+        pairs.reserve(CHUNK_SIZE);
+
+        int64_t key, value;
+        size_t total_pairs = 0;
+
+        while (file.read(reinterpret_cast<char *>(&key), sizeof(key)) &&
+               file.read(reinterpret_cast<char *>(&value), sizeof(value)))
         {
             pairs.emplace_back(key, value);
             total_pairs++;
@@ -362,48 +1032,198 @@ namespace lsm
 
     void LSMTree::compact()
     {
-        std::lock_guard<std::mutex> lock(tree_mutex);
+        // Queue every level that is over its threshold and wait for the cascade to settle
+        size_t level_count = get_version()->levels.size();
 
-        // Check each level for compaction
-        for (size_t i = 0; i < levels.size(); ++i)
+        for (size_t i = 1; i < level_count; ++i)
         {
-            if (levels[i]->needs_compaction())
+            schedule_compaction(static_cast<int>(i));
+        }
+
+        scheduler->wait_idle();
+    }
+
+    void LSMTree::rebuild_filters()
+    {
+        {
+            std::lock_guard<std::mutex> lock(filter_mutex);
+            filter_rebuild_requested = true;
+        }
+        filter_condition.notify_all();
+    }
+
+    void LSMTree::wait_for_filter_rebuilds()
+    {
+        std::unique_lock<std::mutex> lock(filter_mutex);
+        filter_condition.wait(lock, [this]
+                              { return (!filter_rebuild_requested && !filter_rebuild_running) ||
+                                       filter_thread_stopping; });
+    }
+
+    void LSMTree::filter_rebuild_loop()
+    {
+        std::unique_lock<std::mutex> lock(filter_mutex);
+        while (true)
+        {
+            filter_condition.wait(lock, [this]
+                                  { return filter_rebuild_requested || filter_thread_stopping; });
+            if (filter_thread_stopping)
             {
-                perform_compaction(i);
+                return;
             }
+
+            // Requests made during a pass start another one, against the newer version
+            filter_rebuild_requested = false;
+            filter_rebuild_running = true;
+            lock.unlock();
+
+            rebuild_stale_filters();
+
+            lock.lock();
+            filter_rebuild_running = false;
+            filter_condition.notify_all();
         }
     }
 
-    void LSMTree::rebuild_filters()
+    void LSMTree::rebuild_stale_filters()
     {
-        std::lock_guard<std::mutex> lock(tree_mutex);
+        // A filter is stale once its level's FPR differs from the one it was built for by
+        // FILTER_REBUILD_MIN_BITS_CHANGE bits per key or more
+        const double ln2_squared = std::log(2.0) * std::log(2.0);
+        auto version = get_version();
+        std::vector<std::pair<std::shared_ptr<Run>, double>> stale;
+        for (size_t i = 1; i < version->levels.size(); ++i)
+        {
+            double fpr = calculate_fpr_for_level(static_cast<int>(i));
+            for (const auto &run : version->levels[i]->get_runs())
+            {
+                double current_fpr = run->get_bloom_filter_fpr();
+                if (std::abs(std::log(fpr) - std::log(current_fpr)) >= constants::FILTER_REBUILD_MIN_BITS_CHANGE * ln2_squared)
+                {
+                    stale.emplace_back(run, fpr);
+                }
+            }
+        }
 
-        for (size_t i = 0; i < levels.size(); ++i)
+        if (stale.empty())
         {
-            double fpr = calculate_fpr_for_level(i);
-            log_debug("Rebuilding Bloom filters for level " + std::to_string(i) +
-                      " with FPR: " + std::to_string(fpr));
+            return;
+        }
 
-            const auto &runs = levels[i]->get_runs();
-            for (const auto &run : runs)
+        log_debug("Rebuilding " + std::to_string(stale.size()) + " stale Bloom filters");
+
+        // Runs are rebuilt in parallel; each worker paces itself to the rebuild rate
+        std::atomic<size_t> next_run{0};
+        auto rebuild = [&]()
+        {
+            for (size_t i = next_run++; i < stale.size() && !filter_thread_stopping; i = next_run++)
             {
-                run->rebuild_bloom_filter(fpr);
+                const auto &[run, fpr] = stale[i];
+                if (run->is_obsolete())
+                {
+                    continue;
+                }
+
+                auto start_time = std::chrono::steady_clock::now();
+                try
+                {
+                    run->rebuild_bloom_filter(fpr);
+                }
+                catch (const std::exception &e)
+                {
+                    std::cerr << "Failed to rebuild Bloom filter of " << run->get_filename() << ": " << e.what() << std::endl;
+                    continue;
+                }
+
+                size_t keys_per_second = constants::FILTER_REBUILD_KEYS_PER_SECOND.load();
+                if (keys_per_second > 0)
+                {
+                    auto budget = std::chrono::duration<double>(static_cast<double>(run->size()) / keys_per_second);
+                    auto done = start_time + std::chrono::duration_cast<std::chrono::steady_clock::duration>(budget);
+                    while (!filter_thread_stopping && std::chrono::steady_clock::now() < done)
+                    {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                    }
+                }
             }
+        };
+
+        std::vector<std::thread> workers;
+        size_t worker_count = std::min(constants::FILTER_REBUILD_THREADS, stale.size());
+        for (size_t i = 1; i < worker_count; ++i)
+        {
+            workers.emplace_back(rebuild);
         }
+        rebuild();
+        for (auto &worker : workers)
+        {
+            worker.join();
+        }
+
+        // The manifest records each filter's FPR, which decides what is stale at the next start
+        try
+        {
+            std::lock_guard<std::mutex> lock(version_mutex);
+            save_manifest(*current_version);
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Failed to save manifest: " << e.what() << std::endl;
+        }
+
+        log_debug("Finished rebuilding Bloom filters");
     }
 
     void LSMTree::print_stats(std::ostream &out) const
     {
         size_t total_pairs = size();
 
+        // Pin one version so every figure below describes the same tree
+        auto version = get_version();
+        const auto &levels = version->levels;
+
+        // The active and immutable buffers, newest first
+        std::vector<std::shared_ptr<SkipList>> memtables;
+        memtables.push_back(version->buffer);
+        memtables.insert(memtables.end(), version->immutable_buffers.rbegin(), version->immutable_buffers.rend());
+
         out << "Logical Pairs: " << total_pairs << "\n";
 
         // I/O Statistics
-        out << "Read I/Os: " << read_io_count.load() << "\n";
-        out << "Write I/Os: " << write_io_count.load() << "\n";
+        out << "Read I/Os: " << io_counters.reads.value() << "\n";
+        out << "Write I/Os: " << io_counters.writes.value() << "\n";
+
+        // Block cache statistics
+        const BlockCache &cache = BlockCache::get_instance();
+        size_t cache_hits = cache.get_hit_count();
+        size_t cache_misses = cache.get_miss_count();
+        double hit_rate = (cache_hits + cache_misses) > 0
+                              ? static_cast<double>(cache_hits) / (cache_hits + cache_misses)
+                              : 0.0;
+        out << "Block Cache Hits: " << cache_hits << "\n";
+        out << "Block Cache Misses: " << cache_misses << "\n";
+        out << "Block Cache Hit Rate: " << hit_rate << "\n";
+        out << "Block Cache Usage: " << cache.usage() << "/" << cache.capacity() << " bytes\n";
+
+        // Row cache statistics
+        size_t row_hits = row_cache->get_hit_count();
+        size_t row_misses = row_cache->get_miss_count();
+        double row_hit_rate = (row_hits + row_misses) > 0
+                                  ? static_cast<double>(row_hits) / (row_hits + row_misses)
+                                  : 0.0;
+        out << "Row Cache Hits: " << row_hits << "\n";
+        out << "Row Cache Misses: " << row_misses << "\n";
+        out << "Row Cache Hit Rate: " << row_hit_rate << "\n";
+        out << "Row Cache Usage: " << row_cache->size() << "/" << row_cache->capacity() << " entries\n";
 
         // Count keys in each level
-        out << "LVL0: " << buffer->element_count();
+        size_t buffer_count = 0;
+        for (const auto &memtable : memtables)
+        {
+            buffer_count += memtable->element_count();
+        }
+
+        out << "LVL0: " << buffer_count;
         for (size_t i = 1; i < levels.size(); ++i)
         {
             size_t level_count = 0;
@@ -417,6 +1237,15 @@ namespace lsm
         }
         out << "\n";
 
+        // Shape of the tree
+        out << "Size Ratio: " << get_size_ratio()
+            << (is_auto_tuning_enabled() ? " (auto tuning)" : "") << ", Strategies:";
+        for (size_t i = 1; i < levels.size(); ++i)
+        {
+            out << " L" << i << "=" << get_strategy_name(levels[i]->get_strategy());
+        }
+        out << "\n";
+
         // Calculate Bloom filter bits for each level
         for (size_t i = 1; i < levels.size(); ++i)
         { // Skip level 0 (buffer)
@@ -432,10 +1261,11 @@ namespace lsm
                 }
                 avg_keys_per_run /= runs.size();
 
-                size_t bits = optimal_bits(avg_keys_per_run, fpr);
+                size_t bits = blocked_optimal_bits(avg_keys_per_run, fpr);
+                size_t hash_functions = bits > 0 ? optimal_hash_functions(bits, avg_keys_per_run) : 0;
                 out << "Level " << i << " Bloom filter: FPR=" << fpr
-                    << ", Bits per element=" << (bits / avg_keys_per_run)
-                    << ", Hash functions=" << optimal_hash_functions(bits, avg_keys_per_run) << "\n";
+                    << ", Bits per element=" << (avg_keys_per_run > 0 ? bits / avg_keys_per_run : 0)
+                    << ", Hash functions=" << hash_functions << "\n";
             }
         }
 
@@ -446,13 +1276,13 @@ namespace lsm
         const size_t MAX_KEYS_TO_DISPLAY = 10;
 
         // Buffer keys (limited to MAX_KEYS_TO_DISPLAY)
-        auto buffer_pairs = buffer->get_all_sorted();
+        auto buffer_pairs = memtables.front()->get_all_sorted();
         size_t buffer_display_count = 0;
 
         out << "Buffer (Level 0): ";
         for (const auto &pair : buffer_pairs)
         {
-            if (pair.value != INT64_MIN) // Skip tombstones
+            if (pair.type == EntryType::VALUE) // Skip deletions
             {
                 out << pair.key << ":" << pair.value << " ";
                 buffer_display_count++;
@@ -483,7 +1313,7 @@ namespace lsm
 
                     for (const auto &pair : pairs)
                     {
-                        if (pair.value != INT64_MIN) // Skip tombstones
+                        if (pair.type == EntryType::VALUE) // Skip deletions
                         {
                             out << pair.key << ":" << pair.value << " ";
                             displayed++;
@@ -512,9 +1342,15 @@ namespace lsm
     size_t LSMTree::size() const
     {
         // Count logical key-value pairs (excluding deleted/tombstones)
-        size_t count = buffer->element_count();
+        auto version = get_version();
+
+        size_t count = version->buffer->element_count();
+        for (const auto &memtable : version->immutable_buffers)
+        {
+            count += memtable->element_count();
+        }
 
-        for (const auto &level : levels)
+        for (const auto &level : version->levels)
         {
             const auto &runs = level->get_runs();
             for (const auto &run : runs)
@@ -526,290 +1362,496 @@ namespace lsm
         return count;
     }
 
+    std::shared_ptr<const Version> LSMTree::get_version() const
+    {
+        return std::atomic_load(&current_version);
+    }
+
+    void LSMTree::install_version(const std::function<void(Version &)> &edit)
+    {
+        // The replaced version is released outside the lock; dropping it may delete the
+        // files of runs that were compacted away
+        std::shared_ptr<const Version> previous;
+        {
+            std::lock_guard<std::mutex> lock(version_mutex);
+            previous = current_version;
+
+            auto version = std::make_shared<Version>(*previous);
+            edit(*version);
+
+            // The manifest must list the new runs before the old ones can go
+            if (manifest_enabled.load() && version->levels != previous->levels)
+            {
+                save_manifest(*version);
+            }
+            std::atomic_store(&current_version, std::shared_ptr<const Version>(std::move(version)));
+        }
+    }
+
+    void LSMTree::save_manifest(const Version &version)
+    {
+        std::vector<ManifestRun> runs;
+        for (const auto &level : version.levels)
+        {
+            for (const auto &run : level->get_runs())
+            {
+                runs.push_back(run->get_manifest_record());
+            }
+        }
+        Manifest(std::move(runs), next_run_id.load()).save(data_directory);
+    }
+
+    uint64_t LSMTree::write_to_buffer(const KeyValuePair *pairs, size_t count, Durability durability)
+    {
+        // Caller holds tree_mutex shared, so the buffer stays the one the log segment belongs to
+        auto apply = [this, pairs, count]
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                apply_to_buffer(*buffer, pairs[i]);
+            }
+        };
+
+        uint64_t log_position = 0;
+        if (durability == Durability::NONE)
+        {
+            apply();
+        }
+        else
+        {
+            log_position = wal->append(pairs, count, apply);
+        }
+
+        // Once the buffer has the writes, cached results of the keys are stale
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (pairs[i].type == EntryType::RANGE_DELETION)
+            {
+                row_cache->clear();
+            }
+            else
+            {
+                row_cache->erase(pairs[i].key);
+            }
+        }
+        return log_position;
+    }
+
     void LSMTree::flush_buffer()
     {
+        // Caller holds tree_mutex exclusively, so no writer can touch the buffer meanwhile
         if (buffer->element_count() == 0)
         {
             log_debug("Flush called on empty buffer, nothing to do");
             return;
         }
 
-        log_debug("Flushing buffer with " + std::to_string(buffer->element_count()) +
-                  " elements (" + std::to_string(buffer->size_bytes()) + " bytes)");
+        log_debug("Handing off buffer with " + std::to_string(buffer->element_count()) +
+                  " elements (" + std::to_string(buffer->size_bytes()) + " bytes) for flushing");
 
-        // Get all pairs from the buffer
-        auto pairs = buffer->get_all_sorted();
+        // Swap in a fresh buffer and publish it before any writer can reach it; readers
+        // keep seeing the old one until its run is installed
+        std::shared_ptr<SkipList> memtable = std::move(buffer);
+        buffer = std::make_shared<SkipList>();
+        install_version([this, &memtable](Version &version)
+                        {
+                            version.buffer = buffer;
+                            version.immutable_buffers.push_back(memtable);
+                        });
+        {
+            std::lock_guard<std::mutex> lock(buffer_mutex);
+            immutable_buffers.push_back(std::move(memtable));
+        }
 
-        // Create a new run in level 1
+        // Seal the buffer's log segment; new writes go to a fresh one
+        wal->roll();
+
+        schedule_flush();
+    }
+
+    void LSMTree::schedule_flush()
+    {
+        // Flushes all reserve level 1, so they are written in hand-off order
+        scheduler->submit(
+            -1,
+            []
+            { return CompactionScheduler::LevelRange{1, 1}; },
+            [this](CompactionScheduler::LevelRange)
+            { flush_immutable_buffer(); });
+    }
+
+    void LSMTree::flush_immutable_buffer()
+    {
+        std::shared_ptr<SkipList> memtable;
+        {
+            std::lock_guard<std::mutex> lock(buffer_mutex);
+            if (immutable_buffers.empty())
+            {
+                return;
+            }
+            memtable = immutable_buffers.front();
+        }
+
+        log_debug("Flushing buffer with " + std::to_string(memtable->element_count()) +
+                  " elements (" + std::to_string(memtable->size_bytes()) + " bytes)");
+
+        // Write the buffer's pairs to a new run in level 1. Flushed data is read again soon,
+        // so it stays in the page cache.
+        auto pairs = memtable->get_all_sorted();
         int level = 1;
-        size_t run_id = levels[level]->run_count();
-        double fpr = calculate_fpr_for_level(level);
+        RunBuilder builder(data_directory, level, next_run_id++, calculate_fpr_for_level(level), pairs.size(),
+                           &io_counters);
+        for (const auto &pair : pairs)
+        {
+            builder.add(pair.key, pair.value, pair.type);
+        }
+        builder.add_range_tombstones(*memtable->get_range_tombstones());
+        std::shared_ptr<Run> run = builder.finish();
 
-        auto run = std::make_unique<Run>(pairs, level, run_id, fpr);
-        levels[level]->add_run(std::move(run));
+        // Swap the buffer for its run in one version, so readers see exactly one of them
+        install_version([&](Version &version)
+                        {
+                            if (run)
+                            {
+                                version.edit_level(level).add_run(run);
+                            }
+                            auto &memtables = version.immutable_buffers;
+                            memtables.erase(std::remove(memtables.begin(), memtables.end(), memtable), memtables.end());
+                        });
 
-        // Clear the buffer
-        buffer->clear();
+        // Stop counting it against the write stall thresholds
+        {
+            std::lock_guard<std::mutex> lock(buffer_mutex);
+            immutable_buffers.pop_front();
+        }
+        write_stall_condition.notify_all();
+
+        // The run now holds everything the buffer's log segment did
+        wal->release_oldest();
 
         // Check if level 1 needs compaction after the flush
-        if (constants::COMPACTION_ENABLED.load() && levels[level]->needs_compaction())
+        schedule_compaction(level);
+
+        // Retune every few flushes when self-tuning is on
+        if (constants::AUTO_TUNING_ENABLED.load() &&
+            ++flushes_since_tuning >= constants::AUTO_TUNING_INTERVAL_FLUSHES)
         {
-            log_debug("Level " + std::to_string(level) + " needs compaction after buffer flush");
-            perform_compaction(level);
+            flushes_since_tuning = 0;
+            tune();
         }
     }
 
-    void LSMTree::perform_compaction(int level)
+    void LSMTree::schedule_compaction(int level)
     {
-        // Skip compaction if disabled
-        if (!constants::COMPACTION_ENABLED.load())
+        if (!constants::COMPACTION_ENABLED.load() || bulk_loading.load())
+        {
+            return;
+        }
+
+        auto version = get_version();
+        if (level < 1 || static_cast<size_t>(level) >= version->levels.size() ||
+            !version->levels[level]->needs_compaction())
         {
-            log_debug("Compaction is disabled, skipping compaction of level " + std::to_string(level));
             return;
         }
 
-        log_debug("Performing compaction on level " + std::to_string(level));
+        log_debug("Level " + std::to_string(level) + " needs compaction, scheduling background job");
 
-        // Get the compaction strategy for this level
-        CompactionStrategy strategy = levels[level]->get_strategy();
+        scheduler->submit(
+            level,
+            [this, level]
+            { return compaction_levels(level); },
+            [this, level](CompactionScheduler::LevelRange range)
+            { perform_compaction(level, range.second); });
+    }
 
-        // Collect all key-value pairs from the runs in this level
-        std::vector<KeyValuePair> all_pairs;
-        const auto &runs = levels[level]->get_runs();
+    CompactionScheduler::LevelRange LSMTree::compaction_levels(int level) const
+    {
+        auto version = get_version();
+        const auto &levels = version->levels;
 
-        for (const auto &run : runs)
+        if (static_cast<size_t>(level) >= levels.size())
         {
-            auto pairs = run->get_all_pairs();
-            all_pairs.insert(all_pairs.end(), pairs.begin(), pairs.end());
+            return {level, level};
         }
 
-        if (all_pairs.empty())
+        // A tiered deepest level has nowhere to push its runs, so it merges them in place;
+        // a partitioned level moves one run into the next
+        const Level &source = *levels[level];
+        if (source.get_strategy() == CompactionStrategy::TIERING ||
+            (source.is_partitioned() && !source.has_overlapping_runs()))
         {
-            log_debug("No data to compact in level " + std::to_string(level));
-            return;
+            return {level, std::min<int>(level + 1, static_cast<int>(levels.size()) - 1)};
+        }
+
+        // A partitioned level whose runs overlap is merged in place
+        if (source.is_partitioned())
+        {
+            return {level, level};
         }
 
-        // Sort by key (most recent values will come last if duplicates exist)
-        std::sort(all_pairs.begin(), all_pairs.end());
+        // The merged data is never larger than its inputs, so their total size bounds the target level
+        size_t total_bytes = 0;
+        for (const auto &run : levels[level]->get_runs())
+        {
+            total_bytes += run->size_bytes();
+        }
 
-        // Deduplicate keeping only the most recent value for each key
-        // Since we might have read the pairs from multiple runs, there could be duplicates
-        // We want to keep only the newest value (which should be the last one after sorting)
-        std::vector<KeyValuePair> deduplicated;
-        deduplicated.reserve(all_pairs.size());
+        return {level, std::max(level, get_target_level_for_size(total_bytes))};
+    }
 
-        int64_t current_key = all_pairs[0].key;
-        int64_t current_value = all_pairs[0].value;
+    void LSMTree::apply_write_backpressure()
+    {
+        std::unique_lock<std::mutex> lock(buffer_mutex);
 
-        // Take the last value for each key (most recent from newest run)
-        for (size_t i = 1; i < all_pairs.size(); ++i)
+        size_t stop_threshold = constants::WRITE_STOP_THRESHOLD.load();
+        if (immutable_buffers.size() >= stop_threshold)
         {
-            if (all_pairs[i].key == current_key)
-            {
-                // Found a duplicate, update to newer value
-                current_value = all_pairs[i].value;
-            }
-            else
-            {
-                // Found a new key, store the previous one if not a tombstone
-                if (current_value != INT64_MIN)
-                {
-                    deduplicated.emplace_back(current_key, current_value);
-                }
-                // Start tracking the new key
-                current_key = all_pairs[i].key;
-                current_value = all_pairs[i].value;
-            }
+            log_debug("PUT: " + std::to_string(immutable_buffers.size()) +
+                      " buffers awaiting flush, stalling writes");
+            write_stall_condition.wait(lock, [this]
+                                       { return immutable_buffers.size() < constants::WRITE_STOP_THRESHOLD.load(); });
+            return;
         }
 
-        // Add the last key if not a tombstone
-        if (current_value != INT64_MIN)
+        if (immutable_buffers.size() >= constants::WRITE_SLOWDOWN_THRESHOLD.load())
         {
-            deduplicated.emplace_back(current_key, current_value);
+            lock.unlock();
+            std::this_thread::sleep_for(std::chrono::microseconds(constants::WRITE_SLOWDOWN_DELAY_US));
         }
+    }
 
-        // Replace all_pairs with properly deduplicated data
-        all_pairs = std::move(deduplicated);
+    void LSMTree::perform_compaction(int level, int max_target_level)
+    {
+        // Skip compaction if disabled or a bulk load is installing runs
+        if (!constants::COMPACTION_ENABLED.load() || bulk_loading.load())
+        {
+            log_debug("Compaction is disabled, skipping compaction of level " + std::to_string(level));
+            return;
+        }
 
-        // Calculate the total size of merged data
-        size_t total_size = all_pairs.size() * (sizeof(int64_t) * 2);
+        // The scheduler has reserved this level, so no other job changes its runs until we
+        // install the result
+        auto version = get_version();
+        const auto &levels = version->levels;
+        if (!levels[level]->needs_compaction())
+        {
+            return;
+        }
 
-        log_debug("Compacted " + std::to_string(runs.size()) + " runs into " +
-                  std::to_string(all_pairs.size()) + " key-value pairs (" +
-                  std::to_string(total_size) + " bytes)");
+        const Level &source = *levels[level];
+        CompactionStrategy strategy = source.get_strategy();
+        std::vector<std::shared_ptr<Run>> runs;
+        int target_level;
 
-        // Strategy-specific handling
-        switch (strategy)
+        if (source.is_partitioned() && !source.has_overlapping_runs())
         {
-        case CompactionStrategy::TIERING:
-            // In TIERING, only move to next level when threshold is reached
+            // A partitioned level over its capacity moves one run at a time into the next
+            // level, taking them in key order so every part of the key space moves in turn
+            if (max_target_level <= level)
             {
-                int next_level = level + 1;
-
-                if (runs.size() >= constants::TIERING_THRESHOLD)
-                {
-                    size_t run_id = levels[next_level]->run_count();
-                    double fpr = calculate_fpr_for_level(next_level);
-
-                    // Create a new run in the next level
-                    if (!all_pairs.empty())
-                    {
-                        auto new_run = std::make_unique<Run>(all_pairs, next_level, run_id, fpr);
-                        levels[next_level]->add_run(std::move(new_run));
-                        log_debug("TIERING: Moved data from level " + std::to_string(level) +
-                                  " to level " + std::to_string(next_level) +
-                                  " after reaching threshold of " + std::to_string(constants::TIERING_THRESHOLD) + " runs");
-
-                        // Clear this level only after successful compaction
-                        levels[level]->clear_runs();
-                        log_debug("TIERING: Cleared runs from level " + std::to_string(level) +
-                                  " after successful compaction");
-
-                        // Check if the next level needs compaction
-                        if (levels[next_level]->needs_compaction())
-                        {
-                            log_debug("TIERING: Level " + std::to_string(next_level) +
-                                      " needs compaction after receiving data from level " +
-                                      std::to_string(level));
-                            perform_compaction(next_level);
-                        }
-                    }
-                    else
-                    {
-                        // All data was tombstones, just clear the runs
-                        levels[level]->clear_runs();
-                        log_debug("TIERING: Cleared runs from level " + std::to_string(level) +
-                                  " (all data was tombstones)");
-                    }
-                }
-                else
-                {
-                    log_debug("TIERING: Not enough runs for compaction in level " +
-                              std::to_string(level) + ". Current: " + std::to_string(runs.size()) +
-                              ", Threshold: " + std::to_string(constants::TIERING_THRESHOLD));
-                }
-
-                // Check if we need to extend levels (when adding to highest level)
-                if (next_level == max_level && levels[next_level]->run_count() > 0)
-                {
-                    check_and_extend_levels();
-                }
+                // The deepest level; add one below and come back
+                check_and_extend_levels();
+                schedule_compaction(level);
+                return;
             }
-            break;
+            runs.push_back(source.pick_compaction_run());
+            target_level = level + 1;
+        }
+        else
+        {
+            runs = source.get_runs();
 
-        case CompactionStrategy::LAZY_LEVELING:
-            // In LAZY_LEVELING, compact in place OR move to next level if too large
+            // Strategy-specific choice of where the merged run goes. The output is
+            // streamed, so its level is chosen from the input size, which bounds the
+            // merged size.
+            size_t runs_bytes = 0;
+            for (const auto &run : runs)
             {
-                // Check if the run is too large for this level
-                int target_level = get_target_level_for_size(total_size);
-
-                if (target_level > level && !all_pairs.empty())
-                {
-                    // The compacted data is too large, move it to a deeper level
-                    size_t run_id = levels[target_level]->run_count();
-                    double fpr = calculate_fpr_for_level(target_level);
-
-                    auto new_run = std::make_unique<Run>(all_pairs, target_level, run_id, fpr);
-                    levels[target_level]->add_run(std::move(new_run));
+                runs_bytes += run->size_bytes();
+            }
 
-                    log_debug("Lazy leveling: Moved data from level " + std::to_string(level) +
-                              " to level " + std::to_string(target_level) +
-                              " due to size considerations");
+            switch (strategy)
+            {
+            case CompactionStrategy::TIERING:
+                // In TIERING, move to the next level once the threshold is reached
+                target_level = level + 1;
+                break;
+
+            case CompactionStrategy::LAZY_LEVELING:
+            case CompactionStrategy::LEVELING:
+            default:
+                // Compact in place unless the merged data is too large for this level. A
+                // partitioned level whose runs overlap is always merged in place.
+                target_level = source.is_partitioned() ? level : std::max(level, get_target_level_for_size(runs_bytes));
+                break;
+            }
 
-                    // Clear existing runs in this level
-                    levels[level]->clear_runs();
+            // Never write outside the levels the scheduler reserved for us
+            target_level = std::min(target_level, max_target_level);
+        }
 
-                    // Check if the target level needs compaction
-                    if (levels[target_level]->needs_compaction())
-                    {
-                        perform_compaction(target_level);
-                    }
-                }
-                else if (!all_pairs.empty())
-                {
-                    // Compact in place (default LAZY_LEVELING behavior)
-                    // Clear existing runs
-                    levels[level]->clear_runs();
+        // Key span the inputs and their range tombstones touch
+        int64_t min_key = DefaultTraits::max_key();
+        int64_t max_key = DefaultTraits::min_key();
+        for (const auto &run : runs)
+        {
+            min_key = std::min(min_key, run->get_min_bound());
+            max_key = std::max(max_key, run->get_max_bound());
+        }
 
-                    // Create a new single run
-                    size_t run_id = 0;
-                    double fpr = calculate_fpr_for_level(level);
+        // A partitioned target keeps its runs' key ranges disjoint, so data moving into it is
+        // merged with the runs there that it overlaps, and only those
+        const Level &target = *levels[target_level];
+        bool partitioned_target = target.is_partitioned();
+        std::vector<std::shared_ptr<Run>> target_runs;
+        if (partitioned_target && target_level != level)
+        {
+            target_runs = target.get_overlapping_runs(min_key, max_key);
+        }
 
-                    auto new_run = std::make_unique<Run>(all_pairs, level, run_id, fpr);
-                    levels[level]->add_run(std::move(new_run));
+        // Deletions and range tombstones can only be dropped once no older data lies below
+        // the inputs. Runs that miss the inputs' span cannot hold such data, so only the
+        // overlapping runs below this level that are not merged here keep them.
+        bool drop_tombstones = true;
+        for (size_t i = level + 1; i < levels.size() && drop_tombstones; ++i)
+        {
+            for (const auto &run : levels[i]->get_overlapping_runs(min_key, max_key))
+            {
+                drop_tombstones = drop_tombstones &&
+                                  std::find(target_runs.begin(), target_runs.end(), run) != target_runs.end();
+            }
+        }
 
-                    log_debug("Lazy leveling: Compacted runs in place at level " +
-                              std::to_string(level));
-                }
-                else
-                {
-                    // All data was tombstones, just clear the runs
-                    levels[level]->clear_runs();
-                }
+        log_debug("Performing compaction on level " + std::to_string(level) + " into level " +
+                  std::to_string(target_level) + " with " + std::to_string(target_runs.size()) +
+                  " overlapping runs");
 
-                // If this is the highest level, check if we need to extend
-                if (level == max_level && levels[level]->run_count() > 0)
+        // Open a buffered reader per run, newest first, so the merge keeps the newest value;
+        // the target's runs are older than any of this level's
+        std::vector<std::unique_ptr<PairIterator>> sources;
+        size_t input_pairs = 0;
+        RangeTombstoneSet input_tombstones;
+        for (const auto *inputs : {&runs, &target_runs})
+        {
+            for (auto it = inputs->rbegin(); it != inputs->rend(); ++it)
+            {
+                sources.push_back(std::make_unique<RunIterator>(**it));
+                input_pairs += (*it)->size();
+                if (!drop_tombstones)
                 {
-                    check_and_extend_levels();
+                    input_tombstones.merge((*it)->get_range_tombstones());
                 }
             }
-            break;
+        }
 
-        case CompactionStrategy::LEVELING:
-            // Move down if too large, otherwise compact in place
+        // Merge the runs straight into the new runs; readers keep using the old runs meanwhile.
+        // A partitioned target gets runs of TARGET_RUN_BYTES, cut between keys; each takes
+        // the tombstones between its cut points, which keeps the runs' bounds disjoint.
+        MergeIterator merged(std::move(sources), drop_tombstones);
+        size_t pairs_per_run = partitioned_target
+                                   ? std::max<size_t>(constants::TARGET_RUN_BYTES.load() / DefaultTraits::RECORD_BYTES, 1)
+                                   : SIZE_MAX;
+        std::vector<std::shared_ptr<Run>> new_runs;
+        size_t output_pairs = 0;
+        int64_t lower_cut = DefaultTraits::min_key();
+        while (true)
+        {
+            RunBuilder builder(data_directory, target_level, next_run_id++, calculate_fpr_for_level(target_level),
+                               std::min(pairs_per_run, input_pairs - std::min(output_pairs, input_pairs)),
+                               &io_counters,
+                               RunWriteOptions{constants::RUN_WRITE_DROP_CACHE.load(), &RateLimiter::get_compaction_limiter()});
+
+            for (; merged.valid() && builder.size() < pairs_per_run; merged.next())
             {
-                // Estimate total size
-                int target_level = get_target_level_for_size(total_size);
+                const KeyValuePair &pair = merged.current();
+                builder.add(pair.key, pair.value, pair.type);
+            }
 
-                if (target_level > level && !all_pairs.empty())
-                {
-                    // Move to a deeper level
-                    size_t run_id = levels[target_level]->run_count();
-                    double fpr = calculate_fpr_for_level(target_level);
+            // Keys the inputs' range tombstones cover are gone from the merged runs already,
+            // but the tombstones still hide older data in the levels below
+            int64_t upper_cut = merged.valid() ? merged.current().key : DefaultTraits::max_key();
+            builder.add_range_tombstones(input_tombstones.clip(lower_cut, upper_cut));
+            output_pairs += builder.size();
 
-                    auto new_run = std::make_unique<Run>(all_pairs, target_level, run_id, fpr);
-                    levels[target_level]->add_run(std::move(new_run));
+            if (auto run = builder.finish())
+            {
+                new_runs.push_back(std::move(run));
+            }
+            if (!merged.valid())
+            {
+                break;
+            }
+            lower_cut = upper_cut;
+        }
 
-                    log_debug("Leveling: Moved data from level " + std::to_string(level) +
-                              " to level " + std::to_string(target_level) +
-                              " due to size considerations");
+        log_debug("Compacted " + std::to_string(runs.size() + target_runs.size()) + " runs with " +
+                  std::to_string(input_pairs) + " pairs into " + std::to_string(new_runs.size()) + " runs with " +
+                  std::to_string(output_pairs) + " key-value pairs");
 
-                    // Clear existing runs in this level
-                    levels[level]->clear_runs();
+        // Replace the inputs with the merged runs in one version, only after they are on disk
+        bool source_needs_compaction = false;
+        bool target_needs_compaction = false;
+        bool target_has_runs = false;
+        install_version([&](Version &next)
+                        {
+                            Level &edited_source = next.edit_level(level);
+                            edited_source.remove_runs(runs);
+                            if (target_level != level)
+                            {
+                                edited_source.set_compaction_cursor(runs.back()->get_max_bound());
+                            }
 
-                    // Check if the target level needs compaction
-                    if (levels[target_level]->needs_compaction())
-                    {
-                        perform_compaction(target_level);
-                    }
-                }
-                else if (!all_pairs.empty())
-                {
-                    // Compact in place
-                    levels[level]->clear_runs();
+                            Level &edited_target = next.edit_level(target_level);
+                            edited_target.remove_runs(target_runs);
+                            for (const auto &run : new_runs)
+                            {
+                                edited_target.add_run(run);
+                            }
+                            source_needs_compaction = next.levels[level]->needs_compaction();
+                            target_needs_compaction = next.levels[target_level]->needs_compaction();
+                            target_has_runs = next.levels[target_level]->run_count() > 0;
+                        });
 
-                    size_t run_id = 0;
-                    double fpr = calculate_fpr_for_level(level);
+        // Their files go once the last reader still holding an older version is done
+        for (const auto *inputs : {&runs, &target_runs})
+        {
+            for (const auto &run : *inputs)
+            {
+                run->mark_obsolete();
+            }
+        }
 
-                    auto new_run = std::make_unique<Run>(all_pairs, level, run_id, fpr);
-                    levels[level]->add_run(std::move(new_run));
+        if (target_level != level)
+        {
+            log_debug(get_strategy_name(strategy) + ": Moved data from level " + std::to_string(level) +
+                      " to level " + std::to_string(target_level));
+        }
+        else
+        {
+            log_debug(get_strategy_name(strategy) + ": Compacted runs in place at level " +
+                      std::to_string(level));
 
-                    log_debug("Leveling: Compacted runs in place at level " +
-                              std::to_string(level));
-                }
-                else
-                {
-                    // All data was tombstones, just clear the runs
-                    levels[level]->clear_runs();
-                }
+            // Merging in place leaves one run, except in a partitioned level, which may now
+            // have to move runs down
+            target_needs_compaction = target_needs_compaction && partitioned_target;
+        }
 
-                // If this is the highest level, check if we need to extend
-                if (level == max_level && levels[level]->run_count() > 0)
-                {
-                    check_and_extend_levels();
-                }
-            }
-            break;
+        // Check if we need to extend levels (when adding to highest level)
+        if (target_level == max_level && target_has_runs)
+        {
+            check_and_extend_levels();
+        }
+
+        // Cascade into the target level once our reservation is released, and keep moving
+        // runs out of a partitioned level until it is back within its capacity
+        if (target_needs_compaction)
+        {
+            schedule_compaction(target_level);
+        }
+        if (source_needs_compaction && target_level != level)
+        {
+            schedule_compaction(level);
         }
 
         log_debug("Compaction on level " + std::to_string(level) + " completed");
@@ -839,10 +1881,19 @@ namespace lsm
             return 1.0;
         }
 
+        // An FPR chosen by tune() takes precedence
+        {
+            std::lock_guard<std::mutex> lock(tuning_mutex);
+            if (static_cast<size_t>(level) < tuned_fprs.size() && tuned_fprs[level] > 0.0)
+            {
+                return tuned_fprs[level];
+            }
+        }
+
         // Calculate FPR based on the Monkey formula
         // FPR_i = r / T^(L-i)
         double r = constants::TOTAL_FPR;
-        double T = static_cast<double>(constants::SIZE_RATIO);
+        double T = static_cast<double>(constants::SIZE_RATIO.load());
         int L = max_level.load();
 
         double fpr = r / std::pow(T, L - level);
@@ -856,60 +1907,196 @@ namespace lsm
         // Calculate which level this size belongs to
         // Level capacity = BUFFER_SIZE * SIZE_RATIO^(level-1)
         double buffer_size = static_cast<double>(constants::BUFFER_SIZE_BYTES.load());
-        double size_ratio = static_cast<double>(constants::SIZE_RATIO);
+        double size_ratio = static_cast<double>(constants::SIZE_RATIO.load());
 
         // Start at level 1
         int level = 1;
         double level_capacity = buffer_size * size_ratio;
 
-        while (level < max_level && size_bytes > level_capacity)
+        while (level < max_level && size_bytes > level_capacity)
+        {
+            level++;
+            level_capacity *= size_ratio;
+        }
+
+        return level;
+    }
+
+    void LSMTree::check_and_extend_levels()
+    {
+        // If the deepest level has runs, we might need to extend
+        bool extended = false;
+        install_version([&](Version &version)
+                        {
+                            if (version.levels.empty() || version.levels.back()->run_count() == 0)
+                            {
+                                return;
+                            }
+
+                            log_debug("Adding a new level to the LSM-tree");
+
+                            // Add a new level with LEVELING strategy
+                            int new_level = max_level.load() + 1;
+                            version.levels.push_back(std::make_shared<Level>(new_level, CompactionStrategy::LEVELING));
+
+                            // Update max level
+                            max_level.store(new_level);
+                            extended = true;
+                        });
+
+        // Every level's FPR moved; rebuild the bloom filters in the background
+        if (extended)
+        {
+            rebuild_filters();
+        }
+    }
+
+    void LSMTree::load_state_from_disk()
+    {
+        log_debug("Loading LSM-tree state from disk");
+
+        // Check if data directory exists
+        if (!fs::exists(data_directory))
+        {
+            log_debug("Data directory doesn't exist, nothing to load");
+            manifest_enabled.store(true);
+            return;
+        }
+
+        // Directories written before the manifest, or with a damaged one, are scanned
+        if (!load_runs_from_manifest())
+        {
+            load_runs_from_directory();
+        }
+
+        // Record the runs found, so the next start can skip the scan
+        {
+            std::lock_guard<std::mutex> lock(version_mutex);
+            manifest_enabled.store(true);
+            save_manifest(*current_version);
+        }
+
+        // Rebuild the buffers whose log segments were never flushed; they are newer than
+        // every run, and are flushed in log order like any handed-off buffer
+        for (const auto &pairs : wal->recover())
+        {
+            auto memtable = std::make_shared<SkipList>();
+            for (const auto &pair : pairs)
+            {
+                apply_to_buffer(*memtable, pair);
+            }
+
+            log_debug("Recovered " + std::to_string(memtable->element_count()) + " keys from the write-ahead log");
+            install_version([&memtable](Version &version)
+                            { version.immutable_buffers.push_back(memtable); });
+            {
+                std::lock_guard<std::mutex> lock(buffer_mutex);
+                immutable_buffers.push_back(std::move(memtable));
+            }
+            schedule_flush();
+        }
+
+        // After loading, queue compactions for any levels over their threshold
+        size_t level_count = get_version()->levels.size();
+        for (size_t i = 1; i < level_count; ++i)
+        {
+            schedule_compaction(static_cast<int>(i));
+        }
+
+        log_debug("Finished loading LSM-tree state from disk");
+    }
+
+    bool LSMTree::load_runs_from_manifest()
+    {
+        std::optional<Manifest> manifest;
+        try
+        {
+            manifest = Manifest::load(data_directory);
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Warning: Ignoring manifest: " << e.what() << std::endl;
+            return false;
+        }
+        if (!manifest)
+        {
+            return false;
+        }
+
+        // Runs are opened from their records; their files are read on first use
+        std::vector<std::vector<std::shared_ptr<Run>>> level_runs;
+        std::set<std::string> listed;
+        size_t next_id = manifest->get_next_run_id();
+        for (const auto &record : manifest->get_runs())
         {
-            level++;
-            level_capacity *= size_ratio;
+            std::string filename = Run::make_filename(data_directory, record.level, record.run_id);
+            listed.insert(fs::path(filename).filename().string());
+            next_id = std::max(next_id, record.run_id + 1);
+
+            size_t level_number = static_cast<size_t>(record.level);
+            if (level_number >= level_runs.size())
+            {
+                level_runs.resize(level_number + 1);
+            }
+            level_runs[level_number].push_back(std::make_shared<Run>(filename, record, &io_counters));
         }
+        next_run_id.store(std::max(next_run_id.load(), next_id));
 
-        return level;
-    }
+        install_version([&](Version &version)
+                        {
+                            while (level_runs.size() > version.levels.size())
+                            {
+                                CompactionStrategy strategy = get_strategy_for_level(version.levels.size());
+                                version.levels.push_back(std::make_shared<Level>(version.levels.size(), strategy));
+                            }
 
-    void LSMTree::check_and_extend_levels()
-    {
-        // Check if we need to add more levels
-        int current_max_level = max_level.load();
+                            for (size_t level_number = 0; level_number < level_runs.size(); ++level_number)
+                            {
+                                if (level_runs[level_number].empty())
+                                {
+                                    continue;
+                                }
+                                Level &target = version.edit_level(level_number);
+                                for (const auto &run : level_runs[level_number])
+                                {
+                                    target.add_run(run);
+                                }
+                            }
+                        });
 
-        // If the deepest level has runs, we might need to extend
-        if (!levels.empty() && levels.back()->run_count() > 0)
+        // Run files the manifest does not list were left by a flush or compaction that
+        // never finished, or by runs compacted away before their files were deleted.
+        // Sidecars are named after their data file.
+        size_t removed = 0;
+        for (const auto &entry : fs::directory_iterator(data_directory))
         {
-            log_debug("Adding a new level to the LSM-tree");
-
-            int new_level = current_max_level + 1;
-
-            // Add a new level with LEVELING strategy
-            levels.push_back(std::make_unique<Level>(new_level, CompactionStrategy::LEVELING));
-
-            // Update max level
-            max_level.store(new_level);
+            std::string filename = entry.path().filename().string();
+            size_t data_suffix = filename.find(".data");
+            if (filename.find(constants::RUN_FILENAME_PREFIX) != 0 || data_suffix == std::string::npos)
+            {
+                continue;
+            }
 
-            // Recalculate FPRs and rebuild bloom filters
-            rebuild_filters();
+            if (listed.count(filename.substr(0, data_suffix + 5)) == 0)
+            {
+                std::error_code ec;
+                fs::remove(entry.path(), ec);
+                ++removed;
+            }
         }
+
+        log_debug("Opened " + std::to_string(manifest->get_runs().size()) + " runs from the manifest" +
+                  (removed > 0 ? ", removed " + std::to_string(removed) + " unlisted run files" : ""));
+        return true;
     }
 
-    void LSMTree::load_state_from_disk()
+    void LSMTree::load_runs_from_directory()
     {
-        log_debug("Loading LSM-tree state from disk");
-
-        // Check if data directory exists
-        if (!fs::exists(constants::DATA_DIRECTORY))
-        {
-            log_debug("Data directory doesn't exist, nothing to load");
-            return;
-        }
-
         // Map to collect runs by level
         std::map<int, std::vector<std::pair<size_t, std::string>>> level_runs;
 
         // Scan for run files
-        for (const auto &entry : fs::directory_iterator(constants::DATA_DIRECTORY))
+        for (const auto &entry : fs::directory_iterator(data_directory))
         {
             std::string filename = entry.path().filename().string();
 
@@ -937,13 +2124,6 @@ namespace lsm
         // Load runs into the tree
         for (const auto &[level, runs] : level_runs)
         {
-            // Make sure we have enough levels
-            while (static_cast<size_t>(level) >= levels.size())
-            {
-                CompactionStrategy strategy = get_strategy_for_level(levels.size());
-                levels.push_back(std::make_unique<Level>(levels.size(), strategy));
-            }
-
             // Sort runs by ID to load them in order
             auto sorted_runs = runs;
             std::sort(sorted_runs.begin(), sorted_runs.end(),
@@ -951,12 +2131,15 @@ namespace lsm
                       { return a.first < b.first; });
 
             // Load each run
+            std::vector<std::shared_ptr<Run>> loaded;
             for (const auto &[id, filename] : sorted_runs)
             {
+                // New runs must not reuse an ID that is already on disk
+                next_run_id.store(std::max(next_run_id.load(), id + 1));
+
                 try
                 {
-                    auto run = std::make_unique<Run>(filename, level, id);
-                    levels[level]->add_run(std::move(run));
+                    loaded.push_back(std::make_shared<Run>(filename, level, id, &io_counters));
                     log_debug("Loaded run " + std::to_string(id) + " from level " + std::to_string(level));
                 }
                 catch (const std::exception &e)
@@ -964,19 +2147,24 @@ namespace lsm
                     log_debug("Failed to load run: " + std::string(e.what()));
                 }
             }
-        }
 
-        // After loading, check if any levels need compaction
-        for (size_t i = 1; i < levels.size(); ++i)
-        {
-            if (levels[i]->needs_compaction())
-            {
-                log_debug("Level " + std::to_string(i) + " needs compaction after loading state");
-                perform_compaction(i);
-            }
+            size_t level_number = static_cast<size_t>(level);
+            install_version([&](Version &version)
+                            {
+                                // Make sure we have enough levels
+                                while (level_number >= version.levels.size())
+                                {
+                                    CompactionStrategy strategy = get_strategy_for_level(version.levels.size());
+                                    version.levels.push_back(std::make_shared<Level>(version.levels.size(), strategy));
+                                }
+
+                                Level &target = version.edit_level(level_number);
+                                for (const auto &run : loaded)
+                                {
+                                    target.add_run(run);
+                                }
+                            });
         }
-
-        log_debug("Finished loading LSM-tree state from disk");
     }
 
     void LSMTree::log_debug(const std::string &message) const
@@ -992,21 +2180,16 @@ namespace lsm
             return;
         }
 
-        // Regular operational logs get timestamps
+        // Regular operational logs get timestamps, formatted like ctime; localtime_r keeps
+        // background threads from sharing ctime's static buffer
         auto now = std::chrono::system_clock::now();
         auto time = std::chrono::system_clock::to_time_t(now);
+        std::tm local_time{};
+        localtime_r(&time, &local_time);
 
         std::stringstream ss;
-        ss << "[" << std::ctime(&time) << "] " << message;
-
-        // Remove newline from ctime output
-        std::string log_message = ss.str();
-        if (!log_message.empty() && log_message[log_message.size() - 1] == '\n')
-        {
-            log_message.erase(log_message.size() - 1);
-        }
-
-        std::cout << log_message << std::endl;
+        ss << "[" << std::put_time(&local_time, "%a %b %e %H:%M:%S %Y") << "] " << message << "\n";
+        std::cout << ss.str() << std::flush;
     }
 
     // Helper method to convert CompactionStrategy enum to string for logging
@@ -1026,6 +2209,21 @@ namespace lsm
     }
 
     // Buffer size management
+    const std::string &LSMTree::get_data_directory() const
+    {
+        return data_directory;
+    }
+
+    bool LSMTree::pin_background_threads(size_t core)
+    {
+        bool pinned = scheduler->pin_to_core(core);
+        if (filter_thread.joinable())
+        {
+            pinned = pin_thread_to_core(filter_thread, core) && pinned;
+        }
+        return pinned;
+    }
+
     size_t LSMTree::get_buffer_size() const
     {
         return constants::BUFFER_SIZE_BYTES.load();
@@ -1050,254 +2248,489 @@ namespace lsm
         constants::COMPACTION_ENABLED.store(enabled);
     }
 
-    // Optimized bulk loading
-    void LSMTree::bulk_load_file(const std::string &filepath)
+    // Block cache management
+    size_t LSMTree::get_block_cache_size() const
     {
-        // Remember original settings to restore later
-        size_t original_buffer_size = get_buffer_size();
-        bool original_compaction_state = is_compaction_enabled();
+        return BlockCache::get_instance().capacity();
+    }
 
-        // Create a unique_lock instead of lock_guard so we can manually unlock it
-        std::unique_lock<std::mutex> lock(tree_mutex);
+    void LSMTree::set_block_cache_size(size_t bytes)
+    {
+        log_debug("Changing block cache size from " + std::to_string(get_block_cache_size()) +
+                  " to " + std::to_string(bytes) + " bytes");
+        constants::BLOCK_CACHE_SIZE_BYTES.store(bytes);
+        BlockCache::get_instance().set_capacity(bytes);
+    }
 
-        try
+    size_t LSMTree::get_compaction_write_rate() const
+    {
+        return RateLimiter::get_compaction_limiter().get_rate();
+    }
+
+    void LSMTree::set_compaction_write_rate(size_t bytes_per_second)
+    {
+        log_debug("Changing compaction write rate from " + std::to_string(get_compaction_write_rate()) +
+                  " to " + std::to_string(bytes_per_second) + " bytes/s");
+        constants::COMPACTION_WRITE_BYTES_PER_SECOND.store(bytes_per_second);
+        RateLimiter::get_compaction_limiter().set_rate(bytes_per_second);
+    }
+
+    size_t LSMTree::get_row_cache_capacity() const
+    {
+        return row_cache->capacity();
+    }
+
+    void LSMTree::set_row_cache_capacity(size_t entries)
+    {
+        log_debug("Changing row cache capacity from " + std::to_string(get_row_cache_capacity()) +
+                  " to " + std::to_string(entries) + " entries");
+        row_cache->set_capacity(entries);
+    }
+
+    // Write backpressure
+    void LSMTree::set_write_stall_thresholds(size_t slowdown, size_t stop)
+    {
+        log_debug("Write stall thresholds: slowdown at " + std::to_string(slowdown) +
+                  ", stop at " + std::to_string(stop) + " immutable buffers");
+        constants::WRITE_SLOWDOWN_THRESHOLD.store(slowdown);
+        constants::WRITE_STOP_THRESHOLD.store(std::max<size_t>(stop, 1));
+        write_stall_condition.notify_all();
+    }
+
+    // Level shape
+    size_t LSMTree::get_size_ratio() const
+    {
+        return constants::SIZE_RATIO.load();
+    }
+
+    void LSMTree::set_size_ratio(size_t ratio)
+    {
+        if (ratio < 2)
         {
-            log_debug("Starting bulk load from file: " + filepath);
+            throw std::runtime_error("Size ratio must be at least 2, got " + std::to_string(ratio));
+        }
 
-            // 1. Optimize settings for loading
-            set_buffer_size(100 * 1024 * 1024); // 100MB buffer
-            set_compaction_enabled(false);      // Disable compaction during load
+        log_debug("Changing size ratio from " + std::to_string(get_size_ratio()) + " to " + std::to_string(ratio));
+        constants::SIZE_RATIO.store(ratio);
 
-            // 2. Open the input file
-            std::ifstream file(filepath, std::ios::binary);
-            if (!file)
-            {
-                throw std::runtime_error("Failed to open file: " + filepath);
-            }
+        // Level capacities and Monkey FPRs follow the new ratio from the next flush or
+        // compaction on; let any level that is already due start now
+        for (size_t i = 1; i < get_version()->levels.size(); ++i)
+        {
+            schedule_compaction(static_cast<int>(i));
+        }
+    }
+
+    void LSMTree::set_compaction_thresholds(size_t tiering, size_t lazy_leveling)
+    {
+        log_debug("Compaction thresholds: TIERING at " + std::to_string(tiering) +
+                  " runs, LAZY_LEVELING at " + std::to_string(lazy_leveling) + " runs");
+
+        // A threshold of one run would compact a level into itself forever
+        constants::TIERING_THRESHOLD.store(std::max<size_t>(tiering, 2));
+        constants::LAZY_LEVELING_THRESHOLD.store(std::max<size_t>(lazy_leveling, 2));
+
+        for (size_t i = 1; i < get_version()->levels.size(); ++i)
+        {
+            schedule_compaction(static_cast<int>(i));
+        }
+    }
+
+    CompactionStrategy LSMTree::get_level_strategy(int level) const
+    {
+        auto version = get_version();
+        if (level < 1 || static_cast<size_t>(level) >= version->levels.size())
+        {
+            throw std::runtime_error("No disk level " + std::to_string(level));
+        }
+        return version->levels[level]->get_strategy();
+    }
+
+    void LSMTree::set_level_strategy(int level, CompactionStrategy strategy)
+    {
+        bool changed = false;
+        install_version([&](Version &version)
+                        {
+                            if (level < 1 || static_cast<size_t>(level) >= version.levels.size())
+                            {
+                                throw std::runtime_error("No disk level " + std::to_string(level));
+                            }
+                            if (version.levels[level]->get_strategy() != strategy)
+                            {
+                                version.edit_level(level).set_strategy(strategy);
+                                changed = true;
+                            }
+                        });
+
+        if (changed)
+        {
+            log_debug("Level " + std::to_string(level) + " now uses " + get_strategy_name(strategy));
+
+            // The runs already there are compacted under the new strategy when it calls for it
+            schedule_compaction(level);
+        }
+    }
+
+    size_t LSMTree::resting_runs(CompactionStrategy strategy)
+    {
+        switch (strategy)
+        {
+        case CompactionStrategy::TIERING:
+            return constants::TIERING_THRESHOLD.load() - 1;
+
+        case CompactionStrategy::LAZY_LEVELING:
+            return constants::LAZY_LEVELING_THRESHOLD.load() - 1;
+
+        case CompactionStrategy::LEVELING:
+        default:
+            return 1;
+        }
+    }
 
-            // 3. First pass: count pairs and calculate total size
-            std::ifstream count_file(filepath, std::ios::binary);
-            size_t total_pairs = 0;
-            int64_t key, value;
-            while (count_file.read(reinterpret_cast<char *>(&key), sizeof(key)) &&
-                   count_file.read(reinterpret_cast<char *>(&value), sizeof(value)))
+    // Self-tuning
+    void LSMTree::tune()
+    {
+        // Operations since the last pass
+        size_t reads;
+        size_t writes;
+        {
+            std::lock_guard<std::mutex> lock(tuning_mutex);
+            size_t total_reads = read_count.value();
+            size_t total_writes = write_count.value();
+
+            // Counters reset since the last pass count from zero
+            reads = total_reads >= tuned_read_count ? total_reads - tuned_read_count : total_reads;
+            writes = total_writes >= tuned_write_count ? total_writes - tuned_write_count : total_writes;
+            if (reads + writes < constants::AUTO_TUNING_MIN_OPERATIONS)
             {
-                total_pairs++;
+                return;
             }
 
-            log_debug("Bulk loading " + std::to_string(total_pairs) + " pairs from file");
-            size_t data_size_bytes = total_pairs * sizeof(KeyValuePair);
+            tuned_read_count = total_reads;
+            tuned_write_count = total_writes;
+        }
 
-            // 4. Load data in large chunks directly into memory
-            // We can now pre-allocate memory for all pairs
-            std::vector<KeyValuePair> all_pairs;
-            all_pairs.reserve(total_pairs);
+        double read_fraction = static_cast<double>(reads) / static_cast<double>(reads + writes);
+        double write_fraction = 1.0 - read_fraction;
+        double size_ratio = static_cast<double>(get_size_ratio());
 
-            // Reset file position
-            file.clear();
-            file.seekg(0);
+        auto version = get_version();
+        size_t level_count = version->levels.size();
 
-            // Read all pairs
-            while (file.read(reinterpret_cast<char *>(&key), sizeof(key)) &&
-                   file.read(reinterpret_cast<char *>(&value), sizeof(value)))
+        // Cost per operation of a level holding K runs between compactions (Dostoevsky):
+        // a lookup probes K filters and reads a page for each false positive, while an
+        // entry is rewritten about T / (K + 1) times on its way through the level, one
+        // page write per RUN_BLOCK_PAIRS entries
+        auto level_cost = [&](CompactionStrategy strategy, double fpr)
+        {
+            double runs = static_cast<double>(resting_runs(strategy));
+            return read_fraction * runs * fpr +
+                   write_fraction * size_ratio / (runs + 1.0) / static_cast<double>(constants::RUN_BLOCK_PAIRS);
+        };
+
+        std::vector<CompactionStrategy> strategies(level_count, CompactionStrategy::LEVELING);
+        std::vector<double> entries(level_count, 0.0);
+        std::vector<double> current_fprs(level_count, 1.0);
+        for (size_t i = 1; i < level_count; ++i)
+        {
+            for (const auto &run : version->levels[i]->get_runs())
             {
-                all_pairs.emplace_back(key, value);
+                entries[i] += static_cast<double>(run->size());
             }
 
-            // 5. Sort all pairs
-            log_debug("Sorting " + std::to_string(all_pairs.size()) + " pairs");
-            std::sort(all_pairs.begin(), all_pairs.end());
-
-            // 6. Deduplicate to keep only the latest value for each key
-            if (all_pairs.size() > 1)
+            current_fprs[i] = calculate_fpr_for_level(static_cast<int>(i));
+            strategies[i] = version->levels[i]->get_strategy();
+            for (CompactionStrategy candidate : {CompactionStrategy::TIERING, CompactionStrategy::LAZY_LEVELING,
+                                                 CompactionStrategy::LEVELING})
             {
-                std::vector<KeyValuePair> deduplicated;
-                deduplicated.reserve(all_pairs.size());
+                if (level_cost(candidate, current_fprs[i]) < level_cost(strategies[i], current_fprs[i]))
+                {
+                    strategies[i] = candidate;
+                }
+            }
+        }
+
+        // Filter memory for an FPR p is -ln(p) / ln(2)^2 bits per entry. With the memory the
+        // filters use now held fixed, the expected false positives per lookup, the sum of
+        // K_i * p_i, are lowest when p_i is proportional to n_i / K_i (Monkey).
+        const double ln2_squared = std::log(2.0) * std::log(2.0);
+        auto bits_per_entry = [ln2_squared](double fpr)
+        {
+            return fpr >= 1.0 ? 0.0 : -std::log(fpr) / ln2_squared;
+        };
 
-                int64_t current_key = all_pairs[0].key;
-                int64_t current_value = all_pairs[0].value;
+        double budget = 0.0;
+        for (size_t i = 1; i < level_count; ++i)
+        {
+            budget += entries[i] * bits_per_entry(current_fprs[i]);
+        }
 
-                for (size_t i = 1; i < all_pairs.size(); ++i)
+        std::vector<double> fprs(level_count, 0.0);
+        if (budget > 0.0)
+        {
+            auto allocate = [&](double scale, std::vector<double> *out)
+            {
+                double bits = 0.0;
+                for (size_t i = 1; i < level_count; ++i)
                 {
-                    if (all_pairs[i].key == current_key)
+                    if (entries[i] > 0.0)
                     {
-                        // Found a duplicate, update to newer value
-                        current_value = all_pairs[i].value;
-                    }
-                    else
-                    {
-                        // Found a new key, store the previous one if not a tombstone
-                        if (current_value != INT64_MIN)
+                        double fpr = std::min(1.0, scale * entries[i] / static_cast<double>(resting_runs(strategies[i])));
+                        bits += entries[i] * bits_per_entry(fpr);
+                        if (out)
                         {
-                            deduplicated.emplace_back(current_key, current_value);
+                            (*out)[i] = fpr;
                         }
-                        // Start tracking the new key
-                        current_key = all_pairs[i].key;
-                        current_value = all_pairs[i].value;
                     }
                 }
+                return bits;
+            };
 
-                // Add the last key if not a tombstone
-                if (current_value != INT64_MIN)
+            // Memory falls as the scale grows; search for the scale that fits the budget
+            double low = 1e-30;
+            double high = 1e3;
+            for (int step = 0; step < 100; ++step)
+            {
+                double mid = std::sqrt(low * high);
+                if (allocate(mid, nullptr) > budget)
                 {
-                    deduplicated.emplace_back(current_key, current_value);
+                    low = mid;
+                }
+                else
+                {
+                    high = mid;
                 }
-
-                // Replace with deduplicated data
-                all_pairs = std::move(deduplicated);
             }
+            allocate(high, &fprs);
+        }
 
-            // 7. Distribute data across levels working backwards
-            size_t data_size_mb = data_size_bytes / (1024 * 1024); // Convert to MB for easier logging
-            double default_buffer_mb = constants::DEFAULT_BUFFER_SIZE_BYTES / (1024.0 * 1024.0);
-            double size_ratio = static_cast<double>(constants::SIZE_RATIO);
-
-            log_debug("Distributing " + std::to_string(data_size_mb) + "MB of data across levels");
+        // Publish the strategies in one version
+        std::vector<int> changed_levels;
+        bool strategies_changed = false;
+        for (size_t i = 1; i < level_count; ++i)
+        {
+            strategies_changed = strategies_changed || strategies[i] != version->levels[i]->get_strategy();
+        }
+        if (strategies_changed)
+        {
+            install_version([&](Version &next)
+                            {
+                                for (size_t i = 1; i < level_count && i < next.levels.size(); ++i)
+                                {
+                                    if (next.levels[i]->get_strategy() != strategies[i])
+                                    {
+                                        next.edit_level(i).set_strategy(strategies[i]);
+                                        changed_levels.push_back(static_cast<int>(i));
+                                    }
+                                }
+                            });
+        }
 
-            // Calculate capacity for each level in MB
-            std::vector<double> level_capacities_mb;
-            for (int level = 1; level <= max_level; level++)
+        if (budget > 0.0)
+        {
             {
-                double capacity = default_buffer_mb * std::pow(size_ratio, level - 1);
-                level_capacities_mb.push_back(capacity);
-                log_debug("Level " + std::to_string(level) + " capacity: " +
-                          std::to_string(capacity) + "MB");
+                std::lock_guard<std::mutex> lock(tuning_mutex);
+                tuned_fprs = fprs;
             }
+            rebuild_filters();
+        }
 
-            // Find the lowest level that can hold all the data
-            int target_level = 1;
-            while (target_level <= max_level && level_capacities_mb[target_level - 1] < data_size_mb)
+        std::string summary = "Tuned for " + std::to_string(reads) + " reads and " +
+                              std::to_string(writes) + " writes:";
+        for (size_t i = 1; i < level_count; ++i)
+        {
+            summary += " L" + std::to_string(i) + "=" + get_strategy_name(strategies[i]);
+            if (fprs[i] > 0.0)
             {
-                target_level++;
+                summary += " (FPR " + std::to_string(fprs[i]) + ")";
             }
+        }
+        log_debug(summary);
 
-            // If we couldn't find a level with enough capacity, use the highest level
-            if (target_level > max_level)
-            {
-                target_level = max_level;
-            }
+        for (int level : changed_levels)
+        {
+            schedule_compaction(level);
+        }
+    }
 
-            log_debug("Lowest level that can hold all data: " + std::to_string(target_level));
+    bool LSMTree::is_auto_tuning_enabled() const
+    {
+        return constants::AUTO_TUNING_ENABLED.load();
+    }
 
-            // Calculate level distribution working backwards from target_level
-            std::vector<double> level_data_mb(max_level, 0.0);
-            double remaining_data_mb = data_size_mb;
+    void LSMTree::set_auto_tuning(bool enabled)
+    {
+        log_debug(std::string("Auto tuning ") + (enabled ? "enabled" : "disabled"));
+        constants::AUTO_TUNING_ENABLED.store(enabled);
+        flushes_since_tuning = 0;
+    }
 
-            for (int level = target_level; level > 0 && remaining_data_mb > 0; level--)
-            {
-                // Get capacity of the previous level (for flushing calculation)
-                double prev_level_capacity = (level > 1) ? level_capacities_mb[level - 2] : default_buffer_mb;
+    bool LSMTree::is_parallel_lookup_enabled() const
+    {
+        return parallel_lookup.load(std::memory_order_acquire);
+    }
 
-                // Calculate how many times we would have flushed from the previous level
-                int flush_count = static_cast<int>(remaining_data_mb / prev_level_capacity);
-                double data_for_level = flush_count * prev_level_capacity;
+    void LSMTree::set_parallel_lookup(bool enabled)
+    {
+        log_debug(std::string("Parallel lookups ") + (enabled ? "enabled" : "disabled"));
+        if (enabled)
+        {
+            std::call_once(lookup_pool_once, [this]
+                           { lookup_pool = std::make_unique<ThreadPool>(constants::PARALLEL_LOOKUP_THREADS); });
+        }
 
-                // Don't allocate more than the remaining data
-                data_for_level = std::min(data_for_level, remaining_data_mb);
+        // The pool exists before any lookup can see the mode on; the global setting is
+        // only the default for trees created later
+        parallel_lookup.store(enabled, std::memory_order_release);
+        constants::PARALLEL_LOOKUP_ENABLED.store(enabled);
+    }
 
-                // Store the allocation
-                level_data_mb[level - 1] = data_for_level;
-                remaining_data_mb -= data_for_level;
+    size_t LSMTree::get_range_filter_prefix_bits() const
+    {
+        return constants::RANGE_FILTER_PREFIX_BITS.load();
+    }
 
-                log_debug("Level " + std::to_string(level) + " gets " +
-                          std::to_string(data_for_level) + "MB (" +
-                          std::to_string(flush_count) + " flushes from level " +
-                          std::to_string(level - 1) + ")");
-            }
+    void LSMTree::set_range_filter_prefix_bits(size_t bits)
+    {
+        if (bits > 63)
+        {
+            throw std::runtime_error("Range filter prefix bits must be at most 63");
+        }
+        log_debug("Range filter prefix bits set to " + std::to_string(bits));
+        constants::RANGE_FILTER_PREFIX_BITS.store(bits);
+    }
 
-            // Distribute any remaining data to level 1
-            if (remaining_data_mb > 0)
-            {
-                level_data_mb[0] += remaining_data_mb;
-                log_debug("Level 1 gets additional " + std::to_string(remaining_data_mb) +
-                          "MB of remaining data");
-            }
+    size_t LSMTree::immutable_buffer_count() const
+    {
+        std::lock_guard<std::mutex> lock(buffer_mutex);
+        return immutable_buffers.size();
+    }
+
+    void LSMTree::wait_for_background_work()
+    {
+        scheduler->wait_idle();
+    }
 
-            // Distribute the actual pairs according to the calculated allocations
-            size_t pairs_per_mb = all_pairs.size() / data_size_mb;
-            size_t start_idx = 0;
+    // Optimized bulk loading
+    void LSMTree::bulk_load_file(const std::string &filepath)
+    {
+        // Map the input; its size gives the pair count without a counting pass
+        log_debug("Starting bulk load from file: " + filepath);
+        MappedPairFile input(filepath);
+        bulk_load_pairs(input.pairs(), input.size());
+    }
 
-            for (int level = 1; level <= max_level; level++)
-            {
-                if (level_data_mb[level - 1] <= 0)
-                {
-                    continue; // Skip levels with no allocation
-                }
+    void LSMTree::bulk_load_pairs(FilePair *pairs, size_t total_pairs)
+    {
+        // Create a unique_lock instead of lock_guard so we can manually unlock it
+        std::unique_lock<std::shared_mutex> lock(tree_mutex);
+
+        // Hand off the buffer and let background jobs drain so none of them races the load
+        flush_buffer();
+        scheduler->wait_idle();
 
-                // Calculate number of pairs for this level
-                size_t pair_count = static_cast<size_t>(level_data_mb[level - 1] * pairs_per_mb);
+        // Hold this tree's compactions back until every loaded run is installed. The
+        // pairs never pass through the buffer, so its size is left alone.
+        bulk_loading.store(true);
+        try
+        {
+            log_debug("Bulk loading " + std::to_string(total_pairs) + " pairs");
 
-                // Ensure we don't exceed available pairs
-                pair_count = std::min(pair_count, all_pairs.size() - start_idx);
+            // 1. Sort and deduplicate chunks of the input in place, in parallel
+            size_t chunk_count = (total_pairs + constants::BULK_LOAD_CHUNK_PAIRS - 1) / constants::BULK_LOAD_CHUNK_PAIRS;
+            std::vector<FilePair *> chunk_ends(chunk_count);
+            std::atomic<size_t> next_chunk{0};
 
-                if (pair_count > 0)
+            auto sort_chunks = [&]
+            {
+                for (size_t chunk = next_chunk++; chunk < chunk_count; chunk = next_chunk++)
                 {
-                    // Create a vector slice for this level
-                    std::vector<KeyValuePair> level_pairs(
-                        all_pairs.begin() + start_idx,
-                        all_pairs.begin() + start_idx + pair_count);
+                    FilePair *begin = pairs + chunk * constants::BULK_LOAD_CHUNK_PAIRS;
+                    FilePair *end = pairs + std::min(total_pairs, (chunk + 1) * constants::BULK_LOAD_CHUNK_PAIRS);
+                    chunk_ends[chunk] = sort_and_deduplicate(begin, end);
+                }
+            };
 
-                    // Create run for this level
-                    size_t run_id = levels[level]->run_count();
-                    double fpr = calculate_fpr_for_level(level);
+            size_t thread_count = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), chunk_count);
+            log_debug("Sorting " + std::to_string(chunk_count) + " chunks on " + std::to_string(thread_count) + " threads");
 
-                    log_debug("Creating run with " + std::to_string(level_pairs.size()) +
-                              " pairs in level " + std::to_string(level) +
-                              " (" + std::to_string(level_data_mb[level - 1]) + "MB)");
+            std::vector<std::thread> sorters;
+            for (size_t i = 1; i < thread_count; ++i)
+            {
+                sorters.emplace_back(sort_chunks);
+            }
+            sort_chunks();
+            for (auto &sorter : sorters)
+            {
+                sorter.join();
+            }
 
-                    auto new_run = std::make_unique<Run>(level_pairs, level, run_id, fpr);
-                    levels[level]->add_run(std::move(new_run));
+            // 2. Merge the chunks; later chunks hold newer pairs, so they go first
+            std::vector<std::unique_ptr<PairIterator>> sources;
+            size_t unique_pairs = 0;
+            for (size_t chunk = chunk_count; chunk-- > 0;)
+            {
+                FilePair *begin = pairs + chunk * constants::BULK_LOAD_CHUNK_PAIRS;
+                sources.push_back(std::make_unique<PairSpanIterator>(begin, chunk_ends[chunk]));
+                unique_pairs += chunk_ends[chunk] - begin;
+            }
+            MergeIterator merged(std::move(sources), true);
 
-                    // Update start index for next level
-                    start_idx += pair_count;
+            // 3. Stream the merged pairs into one run per level; the builders write the
+            // bloom filters and fence pointers as the data goes out
+            std::vector<size_t> level_pairs = plan_bulk_load_levels(unique_pairs);
+            int last_level = 0;
+            for (size_t level = 1; level < level_pairs.size(); ++level)
+            {
+                if (level_pairs[level] > 0)
+                {
+                    last_level = static_cast<int>(level);
                 }
             }
 
-            if (start_idx < all_pairs.size())
+            for (int level = 1; level <= last_level && merged.valid(); ++level)
             {
-                size_t remaining_pairs = all_pairs.size() - start_idx;
-                log_debug("Warning: " + std::to_string(remaining_pairs) +
-                          " pairs weren't distributed to any level");
-
-                // Put remaining pairs in the highest level that received data
-                int highest_used_level = max_level;
-                while (highest_used_level > 0 && level_data_mb[highest_used_level - 1] <= 0)
+                if (level_pairs[level] == 0)
                 {
-                    highest_used_level--;
+                    continue;
                 }
 
-                if (highest_used_level > 0)
-                {
-                    std::vector<KeyValuePair> remaining_level_pairs(
-                        all_pairs.begin() + start_idx,
-                        all_pairs.end());
+                RunBuilder builder(data_directory, level, next_run_id++, calculate_fpr_for_level(level), level_pairs[level],
+                                   &io_counters, RunWriteOptions{constants::RUN_WRITE_DROP_CACHE.load(), nullptr});
 
-                    size_t run_id = levels[highest_used_level]->run_count();
-                    double fpr = calculate_fpr_for_level(highest_used_level);
+                // Cross-chunk duplicates only shrink the total, so the last level takes the rest
+                for (; merged.valid() && (builder.size() < level_pairs[level] || level == last_level); merged.next())
+                {
+                    const KeyValuePair &pair = merged.current();
+                    builder.add(pair.key, pair.value);
+                }
 
-                    log_debug("Adding remaining " + std::to_string(remaining_level_pairs.size()) +
-                              " pairs to level " + std::to_string(highest_used_level));
+                log_debug("Creating run with " + std::to_string(builder.size()) +
+                          " pairs in level " + std::to_string(level));
 
-                    auto new_run = std::make_unique<Run>(remaining_level_pairs, highest_used_level, run_id, fpr);
-                    levels[highest_used_level]->add_run(std::move(new_run));
+                std::shared_ptr<Run> new_run = builder.finish();
+                if (new_run)
+                {
+                    install_version([&](Version &version)
+                                    { version.edit_level(level).add_run(new_run); });
                 }
             }
 
+            // The loaded runs are newer than everything cached
+            row_cache->clear();
             log_debug("Bulk load completed successfully");
 
             // Unlock the mutex before starting compaction
             // This ensures other threads can access the tree while compaction runs
+            bulk_loading.store(false);
             lock.unlock();
 
-            // 9. Perform a full compaction after load is complete
-            set_compaction_enabled(true);
+            // 4. Perform a full compaction after load is complete
             compact();
         }
         catch (const std::exception &e)
         {
-            // Restore original settings before propagating the exception
-            set_buffer_size(original_buffer_size);
-            set_compaction_enabled(original_compaction_state);
+            bulk_loading.store(false);
 
             // Make sure to unlock if we're still holding the lock
             if (lock.owns_lock())
@@ -1309,55 +2742,147 @@ namespace lsm
             throw;
         }
 
-        // 10. Restore original settings
-        set_buffer_size(original_buffer_size);
+        log_debug("Bulk load fully completed, ready for normal operations");
+    }
+
+
+    std::vector<size_t> LSMTree::plan_bulk_load_levels(size_t total_pairs) const
+    {
+        std::vector<size_t> level_pairs(max_level + 1, 0);
+        if (total_pairs == 0)
+        {
+            return level_pairs;
+        }
+
+        double data_mb = total_pairs * sizeof(FilePair) / (1024.0 * 1024.0);
+        double default_buffer_mb = constants::DEFAULT_BUFFER_SIZE_BYTES / (1024.0 * 1024.0);
+        double size_ratio = static_cast<double>(constants::SIZE_RATIO.load());
 
-        // No need to unlock here - either we've already unlocked above
-        // or the exception handler did it
+        log_debug("Distributing " + std::to_string(data_mb) + "MB of data across levels");
 
-        log_debug("Bulk load fully completed, ready for normal operations");
+        // Calculate capacity for each level in MB
+        std::vector<double> level_capacities_mb;
+        for (int level = 1; level <= max_level; level++)
+        {
+            double capacity = default_buffer_mb * std::pow(size_ratio, level - 1);
+            level_capacities_mb.push_back(capacity);
+        }
+
+        // Find the lowest level that can hold all the data, or use the highest level
+        int target_level = 1;
+        while (target_level < max_level && level_capacities_mb[target_level - 1] < data_mb)
+        {
+            target_level++;
+        }
+
+        log_debug("Lowest level that can hold all data: " + std::to_string(target_level));
+
+        // Work backwards from the target level: each level gets as many whole flushes of
+        // the level above it as fit in the remaining data
+        std::vector<double> level_data_mb(max_level + 1, 0.0);
+        double remaining_data_mb = data_mb;
+        for (int level = target_level; level > 1 && remaining_data_mb > 0; level--)
+        {
+            double prev_level_capacity = level_capacities_mb[level - 2];
+            double data_for_level = std::floor(remaining_data_mb / prev_level_capacity) * prev_level_capacity;
+            level_data_mb[level] = data_for_level;
+            remaining_data_mb -= data_for_level;
+        }
+
+        // Level 1 gets whatever is left
+        level_data_mb[1] += remaining_data_mb;
+
+        // Convert the allocations to pair counts; rounding error goes to level 1
+        size_t assigned = 0;
+        for (int level = 2; level <= max_level; level++)
+        {
+            level_pairs[level] = static_cast<size_t>(level_data_mb[level] / data_mb * total_pairs);
+            assigned += level_pairs[level];
+        }
+        level_pairs[1] = total_pairs - std::min(assigned, total_pairs);
+
+        for (int level = 1; level <= max_level; level++)
+        {
+            if (level_pairs[level] > 0)
+            {
+                log_debug("Level " + std::to_string(level) + " gets " + std::to_string(level_pairs[level]) +
+                          " pairs (" + std::to_string(level_data_mb[level]) + "MB)");
+            }
+        }
+
+        return level_pairs;
     }
 
     // I/O statistics tracking
-    void LSMTree::increment_read_io() { read_io_count++; }
-    void LSMTree::increment_write_io() { write_io_count++; }
-    size_t LSMTree::get_read_io_count() const { return read_io_count.load(); }
-    size_t LSMTree::get_write_io_count() const { return write_io_count.load(); }
+    void LSMTree::increment_read_io() { io_counters.reads.add(); }
+    void LSMTree::increment_write_io() { io_counters.writes.add(); }
+    size_t LSMTree::get_read_io_count() const { return io_counters.reads.value(); }
+    size_t LSMTree::get_write_io_count() const { return io_counters.writes.value(); }
     void LSMTree::reset_io_stats()
     {
-        read_io_count.store(0);
-        write_io_count.store(0);
+        io_counters.reads.reset();
+        io_counters.writes.reset();
+        BlockCache::get_instance().reset_stats();
+        row_cache->reset_stats();
     }
 
     // Operation timing metrics implementation
     double LSMTree::get_avg_read_time_ms() const
     {
-        size_t count = read_count.load();
-        return count > 0 ? total_read_time_ms.load() / count : 0.0;
+        size_t count = read_count.value();
+        uint64_t total_ns = metrics.latency(Metrics::Operation::GET).snapshot().sum_ns +
+                            metrics.latency(Metrics::Operation::MULTI_GET).snapshot().sum_ns;
+        return count > 0 ? total_ns / 1e6 / count : 0.0;
     }
 
     double LSMTree::get_avg_write_time_ms() const
     {
-        size_t count = write_count.load();
-        return count > 0 ? total_write_time_ms.load() / count : 0.0;
+        size_t count = write_count.value();
+        uint64_t total_ns = metrics.latency(Metrics::Operation::PUT).snapshot().sum_ns +
+                            metrics.latency(Metrics::Operation::DELETE).snapshot().sum_ns +
+                            metrics.latency(Metrics::Operation::MULTI_PUT).snapshot().sum_ns;
+        return count > 0 ? total_ns / 1e6 / count : 0.0;
     }
 
     size_t LSMTree::get_read_count() const
     {
-        return read_count.load();
+        return read_count.value();
     }
 
     size_t LSMTree::get_write_count() const
     {
-        return write_count.load();
+        return write_count.value();
     }
 
     void LSMTree::reset_timing_stats()
     {
-        read_count.store(0);
-        write_count.store(0);
-        total_read_time_ms.store(0.0);
-        total_write_time_ms.store(0.0);
+        read_count.reset();
+        write_count.reset();
+        metrics.reset();
+    }
+
+    const Metrics &LSMTree::get_metrics() const
+    {
+        return metrics;
+    }
+
+    void LSMTree::write_metrics_json(std::ostream &out) const
+    {
+        const BlockCache &cache = BlockCache::get_instance();
+        out << "{\"reads\": " << read_count.value()
+            << ", \"writes\": " << write_count.value()
+            << ", \"read_ios\": " << io_counters.reads.value()
+            << ", \"write_ios\": " << io_counters.writes.value()
+            << ", \"block_cache\": {\"hits\": " << cache.get_hit_count()
+            << ", \"misses\": " << cache.get_miss_count()
+            << ", \"usage\": " << cache.usage()
+            << ", \"capacity\": " << cache.capacity() << "}"
+            << ", \"row_cache\": {\"hits\": " << row_cache->get_hit_count()
+            << ", \"misses\": " << row_cache->get_miss_count()
+            << ", \"size\": " << row_cache->size()
+            << ", \"capacity\": " << row_cache->capacity() << "}, ";
+        metrics.write_json(out);
+        out << "}";
     }
 
 } // namespace lsm
\ No newline at end of file
@@ -76,6 +76,9 @@ int main(int argc, char *argv[])
         }
     }
 
+    // Optional third argument switches the connection to the binary protocol
+    bool binary_protocol = argc > 3 && std::string(argv[3]) == "--binary";
+
     // Setup signal handling
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
@@ -88,7 +91,7 @@ int main(int argc, char *argv[])
 
         // Connect to server
         std::cout << "Connecting to LSM-Tree server at " << host << ":" << port << std::endl;
-        if (!client.connect())
+        if (!client.connect(binary_protocol))
         {
             std::cerr << "Failed to connect to server" << std::endl;
             return 1;
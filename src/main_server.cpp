@@ -9,6 +9,7 @@
 #include <cstdlib>
 #include <chrono>
 #include <thread>
+#include <algorithm>
 
 // Global server instance for signal handling
 lsm::Server *g_server = nullptr;
@@ -83,19 +84,73 @@ int main(int argc, char *argv[])
 
     try
     {
+        // The shard layout must be known before the adapter opens the tree
+        size_t shard_count = std::max<size_t>(get_env_var<size_t>("LSMTREE_SHARDS", lsm::constants::SHARD_COUNT.load()), 1);
+        bool pin_threads = get_env_var<int>("LSMTREE_PIN_THREADS", 0) != 0;
+        lsm::constants::SHARD_COUNT.store(shard_count);
+        lsm::constants::PIN_THREADS.store(pin_threads);
+
+        // So are the run file write options, which the tree uses as it opens
+        bool direct_io = get_env_var<int>("LSMTREE_DIRECT_IO", 0) != 0;
+        bool drop_cache = get_env_var<int>("LSMTREE_DROP_COMPACTION_CACHE", 1) != 0;
+        lsm::constants::RUN_WRITE_DIRECT_IO.store(direct_io);
+        lsm::constants::RUN_WRITE_DROP_CACHE.store(drop_cache);
+        lsm::constants::COMPACTION_WRITE_BYTES_PER_SECOND.store(
+            get_env_var<size_t>("LSMTREE_COMPACTION_RATE", lsm::constants::COMPACTION_WRITE_BYTES_PER_SECOND.load()));
+
         // Pre-initialize the LSM adapter to ensure it's ready before accepting connections
         std::cout << "Initializing LSM tree adapter..." << std::endl;
         auto &adapter = lsm::LSMAdapter::get_instance();
 
         // Display current configuration
         size_t buffer_size = get_env_var<size_t>("LSMTREE_BUFFER_SIZE", lsm::constants::BUFFER_SIZE_BYTES);
-        int size_ratio = get_env_var<int>("LSMTREE_SIZE_RATIO", lsm::constants::SIZE_RATIO);
+        size_t size_ratio = get_env_var<size_t>("LSMTREE_SIZE_RATIO", lsm::constants::SIZE_RATIO.load());
         int thread_count = get_env_var<int>("LSMTREE_THREAD_COUNT", lsm::constants::default_thread_count());
+        size_t block_cache_size = get_env_var<size_t>("LSMTREE_BLOCK_CACHE_SIZE", lsm::constants::BLOCK_CACHE_SIZE_BYTES);
+        bool auto_tune = get_env_var<int>("LSMTREE_AUTO_TUNE", 0) != 0;
+        bool parallel_lookup = get_env_var<int>("LSMTREE_PARALLEL_GET", 0) != 0;
+        size_t range_filter_bits = get_env_var<size_t>("LSMTREE_RANGE_FILTER_BITS", lsm::constants::RANGE_FILTER_PREFIX_BITS);
+        size_t row_cache_entries = get_env_var<size_t>("LSMTREE_ROW_CACHE_ENTRIES", lsm::constants::ROW_CACHE_ENTRIES);
+        // The block cache and range filter width are shared by all shards
+        adapter.get_tree()->shard(0).set_block_cache_size(block_cache_size);
+        adapter.get_tree()->shard(0).set_range_filter_prefix_bits(range_filter_bits);
+        adapter.get_tree()->set_size_ratio(size_ratio);
+        adapter.get_tree()->set_auto_tuning(auto_tune);
+        adapter.get_tree()->set_parallel_lookup(parallel_lookup);
+        adapter.get_tree()->set_row_cache_capacity(row_cache_entries);
+
+        // Default durability of writes: none, async or sync
+        std::string durability = get_env_var<std::string>("LSMTREE_DURABILITY", "async");
+        if (durability == "none")
+        {
+            adapter.set_write_durability(lsm::Durability::NONE);
+        }
+        else if (durability == "sync")
+        {
+            adapter.set_write_durability(lsm::Durability::SYNC);
+        }
+        else if (durability != "async")
+        {
+            std::cerr << "Warning: Unknown LSMTREE_DURABILITY '" << durability << "', using async" << std::endl;
+            durability = "async";
+        }
 
         std::cout << "LSM Tree Configuration:" << std::endl;
         std::cout << "  Buffer Size: " << buffer_size << " bytes" << std::endl;
         std::cout << "  Size Ratio: " << size_ratio << std::endl;
         std::cout << "  Thread Count: " << thread_count << std::endl;
+        std::cout << "  Block Cache Size: " << block_cache_size << " bytes" << std::endl;
+        std::cout << "  Auto Tuning: " << (auto_tune ? "on" : "off") << std::endl;
+        std::cout << "  Parallel Lookups: " << (parallel_lookup ? "on" : "off") << std::endl;
+        std::cout << "  Range Filter Prefix Bits: " << range_filter_bits << std::endl;
+        std::cout << "  Row Cache Entries: " << row_cache_entries << std::endl;
+        std::cout << "  Write Durability: " << durability << std::endl;
+        std::cout << "  Compaction Write Rate: " << adapter.get_tree()->shard(0).get_compaction_write_rate()
+                  << " bytes/s" << std::endl;
+        std::cout << "  Direct I/O: " << (direct_io ? "on" : "off") << std::endl;
+        std::cout << "  Drop Compaction Output From Page Cache: " << (drop_cache ? "on" : "off") << std::endl;
+        std::cout << "  Shards: " << shard_count << std::endl;
+        std::cout << "  Thread Pinning: " << (pin_threads ? "on" : "off") << std::endl;
 
         // Create and start server
         lsm::Server server(port);
@@ -0,0 +1,180 @@
+#include "../include/manifest.h"
+#include "../include/block_codec.h"
+#include "../include/constants.h"
+
+#include <fstream>
+#include <stdexcept>
+#include <filesystem>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace lsm
+{
+
+    namespace
+    {
+        // First bytes of a manifest, followed by count records and a checksum of their words
+        struct ManifestFileHeader
+        {
+            uint64_t magic;
+            uint32_t version;
+            uint32_t reserved;
+            uint64_t next_run_id;
+            uint64_t count;
+        };
+
+        // A run as saved
+        struct ManifestRecord
+        {
+            uint32_t level;
+            uint32_t reserved;
+            uint64_t run_id;
+            uint64_t num_pairs;
+            uint64_t file_bytes;
+            int64_t min_key;
+            int64_t max_key;
+            double bloom_fpr;
+        };
+        static_assert(sizeof(ManifestRecord) % sizeof(uint64_t) == 0, "records must be whole words");
+
+        // Write a whole buffer, retrying short writes
+        bool write_fully(int fd, const char *data, size_t size)
+        {
+            while (size > 0)
+            {
+                ssize_t written = ::write(fd, data, size);
+                if (written < 0)
+                {
+                    if (errno == EINTR)
+                    {
+                        continue;
+                    }
+                    return false;
+                }
+                data += written;
+                size -= static_cast<size_t>(written);
+            }
+            return true;
+        }
+    }
+
+    Manifest::Manifest(std::vector<ManifestRun> runs, size_t next_run_id)
+        : runs(std::move(runs)), next_run_id(next_run_id)
+    {
+    }
+
+    std::optional<Manifest> Manifest::load(const std::string &directory)
+    {
+        std::string filename = make_filename(directory);
+        std::ifstream file(filename, std::ios::binary);
+        if (!file)
+        {
+            if (fs::exists(filename))
+            {
+                throw std::runtime_error("Failed to open manifest: " + filename);
+            }
+            return std::nullopt;
+        }
+
+        ManifestFileHeader header{};
+        file.read(reinterpret_cast<char *>(&header), sizeof(header));
+        if (!file || header.magic != constants::MANIFEST_FILE_MAGIC)
+        {
+            throw std::runtime_error("Not a manifest: " + filename);
+        }
+        if (header.version != constants::MANIFEST_FILE_VERSION)
+        {
+            throw std::runtime_error("Unsupported manifest version " + std::to_string(header.version) + " in " +
+                                     filename);
+        }
+
+        std::vector<ManifestRecord> records(header.count);
+        uint64_t checksum = 0;
+        file.read(reinterpret_cast<char *>(records.data()),
+                  static_cast<std::streamsize>(records.size() * sizeof(ManifestRecord)));
+        file.read(reinterpret_cast<char *>(&checksum), sizeof(checksum));
+        if (!file || checksum != BlockCodec::checksum(reinterpret_cast<const uint64_t *>(records.data()),
+                                                      records.size() * sizeof(ManifestRecord) / sizeof(uint64_t)))
+        {
+            throw std::runtime_error("Corrupt manifest: " + filename);
+        }
+
+        std::vector<ManifestRun> runs;
+        runs.reserve(records.size());
+        for (const auto &record : records)
+        {
+            runs.push_back(ManifestRun{static_cast<int>(record.level), record.run_id, record.num_pairs,
+                                       record.file_bytes, record.min_key, record.max_key, record.bloom_fpr});
+        }
+        return Manifest(std::move(runs), header.next_run_id);
+    }
+
+    void Manifest::save(const std::string &directory) const
+    {
+        std::vector<ManifestRecord> records;
+        records.reserve(runs.size());
+        for (const auto &run : runs)
+        {
+            records.push_back(ManifestRecord{static_cast<uint32_t>(run.level), 0, run.run_id, run.num_pairs,
+                                             run.file_bytes, run.min_key, run.max_key, run.bloom_fpr});
+        }
+
+        ManifestFileHeader header{constants::MANIFEST_FILE_MAGIC, constants::MANIFEST_FILE_VERSION, 0,
+                                  next_run_id, records.size()};
+        uint64_t checksum = BlockCodec::checksum(reinterpret_cast<const uint64_t *>(records.data()),
+                                                 records.size() * sizeof(ManifestRecord) / sizeof(uint64_t));
+
+        std::string contents(reinterpret_cast<const char *>(&header), sizeof(header));
+        contents.append(reinterpret_cast<const char *>(records.data()), records.size() * sizeof(ManifestRecord));
+        contents.append(reinterpret_cast<const char *>(&checksum), sizeof(checksum));
+
+        // Write a new file next to the old one, make it durable, then rename it over the old one
+        std::string filename = make_filename(directory);
+        std::string temp_filename = filename + ".tmp";
+        int fd = ::open(temp_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0)
+        {
+            throw std::runtime_error("Failed to create manifest: " + temp_filename + ": " + std::strerror(errno));
+        }
+        bool written = write_fully(fd, contents.data(), contents.size()) && ::fsync(fd) == 0;
+        int error = errno;
+        ::close(fd);
+        if (!written)
+        {
+            throw std::runtime_error("Failed to write manifest: " + temp_filename + ": " + std::strerror(error));
+        }
+
+        if (::rename(temp_filename.c_str(), filename.c_str()) != 0)
+        {
+            throw std::runtime_error("Failed to replace manifest: " + filename + ": " + std::strerror(errno));
+        }
+
+        // Make the rename itself durable
+        int dir_fd = ::open(directory.c_str(), O_RDONLY | O_CLOEXEC);
+        if (dir_fd >= 0)
+        {
+            ::fsync(dir_fd);
+            ::close(dir_fd);
+        }
+    }
+
+    const std::vector<ManifestRun> &Manifest::get_runs() const
+    {
+        return runs;
+    }
+
+    size_t Manifest::get_next_run_id() const
+    {
+        return next_run_id;
+    }
+
+    std::string Manifest::make_filename(const std::string &directory)
+    {
+        return directory + "/" + constants::MANIFEST_FILENAME;
+    }
+
+}
@@ -0,0 +1,65 @@
+#include "../include/mapped_file.h"
+
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace lsm
+{
+
+    MappedFile::MappedFile(const std::string &filename) : mapping(nullptr), bytes(0)
+    {
+        int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            throw std::runtime_error("Failed to open file: " + filename + ": " + std::strerror(errno));
+        }
+
+        struct stat info;
+        if (::fstat(fd, &info) < 0)
+        {
+            int error = errno;
+            ::close(fd);
+            throw std::runtime_error("Failed to stat file: " + filename + ": " + std::strerror(error));
+        }
+
+        bytes = static_cast<size_t>(info.st_size);
+        if (bytes > 0)
+        {
+            mapping = ::mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+            if (mapping == MAP_FAILED)
+            {
+                int error = errno;
+                mapping = nullptr;
+                ::close(fd);
+                throw std::runtime_error("Failed to map file: " + filename + ": " + std::strerror(error));
+            }
+        }
+
+        // The mapping holds its own reference to the file
+        ::close(fd);
+    }
+
+    MappedFile::~MappedFile()
+    {
+        if (mapping)
+        {
+            ::munmap(mapping, bytes);
+        }
+    }
+
+    const char *MappedFile::data() const
+    {
+        return static_cast<const char *>(mapping);
+    }
+
+    size_t MappedFile::size() const
+    {
+        return bytes;
+    }
+
+}
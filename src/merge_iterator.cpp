@@ -0,0 +1,191 @@
+#include "../include/merge_iterator.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace lsm
+{
+
+    MergeIterator::MergeIterator(std::vector<std::unique_ptr<PairIterator>> sources, bool drop_tombstones)
+        : sources(std::move(sources)), next_fragment(0), drop_tombstones(drop_tombstones), current_pair(0, 0),
+          has_current(false)
+    {
+        build_fragments();
+        heap.reserve(this->sources.size());
+
+        for (size_t i = 0; i < this->sources.size(); ++i)
+        {
+            if (this->sources[i]->valid())
+            {
+                heap.push_back({this->sources[i]->current().key, i});
+            }
+        }
+        std::make_heap(heap.begin(), heap.end(), heap_compare);
+
+        advance();
+    }
+
+    bool MergeIterator::valid() const
+    {
+        return has_current;
+    }
+
+    const KeyValuePair &MergeIterator::current() const
+    {
+        if (!has_current)
+        {
+            throw std::out_of_range("MergeIterator is exhausted");
+        }
+        return current_pair;
+    }
+
+    void MergeIterator::next()
+    {
+        advance();
+    }
+
+    bool MergeIterator::heap_compare(const HeapEntry &a, const HeapEntry &b)
+    {
+        // std heap functions build a max-heap, so invert the ordering
+        if (a.key != b.key)
+        {
+            return a.key > b.key;
+        }
+        return a.source > b.source;
+    }
+
+    void MergeIterator::advance_source(size_t source)
+    {
+        sources[source]->next();
+        if (sources[source]->valid())
+        {
+            heap.push_back({sources[source]->current().key, source});
+            std::push_heap(heap.begin(), heap.end(), heap_compare);
+        }
+    }
+
+    void MergeIterator::advance()
+    {
+        while (!heap.empty())
+        {
+            // The top of the heap is the smallest key from the newest source holding it
+            std::pop_heap(heap.begin(), heap.end(), heap_compare);
+            HeapEntry top = heap.back();
+            heap.pop_back();
+
+            current_pair = sources[top.source]->current();
+            advance_source(top.source);
+
+            // Older versions of the same key are shadowed
+            while (!heap.empty() && heap.front().key == top.key)
+            {
+                std::pop_heap(heap.begin(), heap.end(), heap_compare);
+                size_t shadowed = heap.back().source;
+                heap.pop_back();
+                advance_source(shadowed);
+            }
+
+            if (skip_covered(top.key, top.source))
+            {
+                continue;
+            }
+
+            if (drop_tombstones && current_pair.type != EntryType::VALUE)
+            {
+                continue;
+            }
+
+            has_current = true;
+            return;
+        }
+
+        has_current = false;
+    }
+
+    void MergeIterator::build_fragments()
+    {
+        // Every tombstone boundary starts a new fragment
+        std::vector<int64_t> bounds;
+        for (const auto &source : sources)
+        {
+            if (const RangeTombstoneSet *tombstones = source->range_tombstones())
+            {
+                for (const auto &tombstone : tombstones->get_tombstones())
+                {
+                    bounds.push_back(tombstone.start_key);
+                    bounds.push_back(tombstone.end_key);
+                }
+            }
+        }
+        std::sort(bounds.begin(), bounds.end());
+        bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+
+        // The newest source covering a fragment decides it; neighbours decided by the same
+        // source are joined
+        for (size_t i = 0; i + 1 < bounds.size(); ++i)
+        {
+            for (size_t source = 0; source < sources.size(); ++source)
+            {
+                const RangeTombstoneSet *tombstones = sources[source]->range_tombstones();
+                if (tombstones && tombstones->covers(bounds[i]))
+                {
+                    if (!fragments.empty() && fragments.back().end_key == bounds[i] &&
+                        fragments.back().source == source)
+                    {
+                        fragments.back().end_key = bounds[i + 1];
+                    }
+                    else
+                    {
+                        fragments.push_back({bounds[i], bounds[i + 1], source});
+                    }
+                    break;
+                }
+            }
+        }
+    }
+
+    bool MergeIterator::skip_covered(int64_t key, size_t source)
+    {
+        // Keys come out in ascending order, so fragments behind the key are done with
+        while (next_fragment < fragments.size() && fragments[next_fragment].end_key <= key)
+        {
+            next_fragment++;
+        }
+        if (next_fragment == fragments.size())
+        {
+            return false;
+        }
+
+        const Fragment &fragment = fragments[next_fragment];
+        if (key < fragment.start_key || source <= fragment.source)
+        {
+            return false;
+        }
+
+        // Everything older than the tombstone is deleted up to its end
+        bool moved = false;
+        for (size_t older = fragment.source + 1; older < sources.size(); ++older)
+        {
+            if (sources[older]->valid() && sources[older]->current().key < fragment.end_key)
+            {
+                sources[older]->seek(fragment.end_key);
+                moved = true;
+            }
+        }
+
+        if (moved)
+        {
+            heap.clear();
+            for (size_t i = 0; i < sources.size(); ++i)
+            {
+                if (sources[i]->valid())
+                {
+                    heap.push_back({sources[i]->current().key, i});
+                }
+            }
+            std::make_heap(heap.begin(), heap.end(), heap_compare);
+        }
+        return true;
+    }
+
+}
@@ -0,0 +1,348 @@
+#include "../include/metrics.h"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+namespace lsm
+{
+
+    namespace
+    {
+        // Shard of the calling thread; threads are spread over the shards as they first
+        // touch a metric
+        size_t this_thread_shard()
+        {
+            static std::atomic<size_t> next_shard{0};
+            thread_local const size_t shard = next_shard++ % constants::METRICS_SHARDS;
+            return shard;
+        }
+
+        // Write one histogram as a JSON object
+        void write_histogram_json(std::ostream &out, const LatencyHistogram::Snapshot &snapshot)
+        {
+            out << "{\"count\": " << snapshot.count
+                << ", \"mean\": " << static_cast<uint64_t>(snapshot.mean_ns())
+                << ", \"p50\": " << snapshot.percentile_ns(0.5)
+                << ", \"p99\": " << snapshot.percentile_ns(0.99)
+                << ", \"p999\": " << snapshot.percentile_ns(0.999)
+                << ", \"max\": " << snapshot.max_ns << "}";
+        }
+
+        // Write one histogram as count and percentiles in microseconds
+        void write_histogram_text(std::ostream &out, const LatencyHistogram::Snapshot &snapshot)
+        {
+            out << "count=" << snapshot.count << std::fixed << std::setprecision(1)
+                << ", mean=" << snapshot.mean_ns() / 1000.0
+                << "us, p50=" << snapshot.percentile_ns(0.5) / 1000.0
+                << "us, p99=" << snapshot.percentile_ns(0.99) / 1000.0
+                << "us, p999=" << snapshot.percentile_ns(0.999) / 1000.0
+                << "us, max=" << snapshot.max_ns / 1000.0 << "us";
+        }
+    }
+
+    // ShardedCounter implementation
+
+    ShardedCounter::ShardedCounter()
+    {
+        reset();
+    }
+
+    void ShardedCounter::add(uint64_t amount)
+    {
+        shards[this_thread_shard()].value.fetch_add(amount, std::memory_order_relaxed);
+    }
+
+    uint64_t ShardedCounter::value() const
+    {
+        uint64_t total = 0;
+        for (const auto &shard : shards)
+        {
+            total += shard.value.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+    void ShardedCounter::reset()
+    {
+        for (auto &shard : shards)
+        {
+            shard.value.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // LatencyHistogram implementation
+
+    LatencyHistogram::LatencyHistogram()
+    {
+        reset();
+    }
+
+    size_t LatencyHistogram::bucket_index(uint64_t nanoseconds)
+    {
+        // The first power-of-two group is linear: one bucket per nanosecond
+        if (nanoseconds < constants::METRICS_SUB_BUCKETS)
+        {
+            return static_cast<size_t>(nanoseconds);
+        }
+
+        size_t exponent = 63 - static_cast<size_t>(__builtin_clzll(nanoseconds));
+        if (exponent > constants::METRICS_MAX_LATENCY_BITS)
+        {
+            return BUCKET_COUNT - 1;
+        }
+
+        size_t shift = exponent - constants::METRICS_SUB_BUCKET_BITS;
+        size_t sub_bucket = static_cast<size_t>(nanoseconds >> shift) & (constants::METRICS_SUB_BUCKETS - 1);
+        return (shift + 1) * constants::METRICS_SUB_BUCKETS + sub_bucket;
+    }
+
+    uint64_t LatencyHistogram::bucket_lower(size_t index)
+    {
+        size_t group = index / constants::METRICS_SUB_BUCKETS;
+        uint64_t sub_bucket = index % constants::METRICS_SUB_BUCKETS;
+        if (group == 0)
+        {
+            return sub_bucket;
+        }
+        return (constants::METRICS_SUB_BUCKETS + sub_bucket) << (group - 1);
+    }
+
+    uint64_t LatencyHistogram::bucket_upper(size_t index)
+    {
+        if (index + 1 >= BUCKET_COUNT)
+        {
+            return UINT64_MAX;
+        }
+        return bucket_lower(index + 1) - 1;
+    }
+
+    void LatencyHistogram::record(uint64_t nanoseconds)
+    {
+        Shard &shard = shards[this_thread_shard()];
+        shard.buckets[bucket_index(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+        shard.sum_ns.fetch_add(nanoseconds, std::memory_order_relaxed);
+
+        uint64_t max = shard.max_ns.load(std::memory_order_relaxed);
+        while (nanoseconds > max && !shard.max_ns.compare_exchange_weak(max, nanoseconds, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    LatencyHistogram::Snapshot LatencyHistogram::snapshot() const
+    {
+        Snapshot snapshot;
+        snapshot.buckets.assign(BUCKET_COUNT, 0);
+        for (const auto &shard : shards)
+        {
+            for (size_t i = 0; i < BUCKET_COUNT; ++i)
+            {
+                uint64_t count = shard.buckets[i].load(std::memory_order_relaxed);
+                snapshot.buckets[i] += count;
+                snapshot.count += count;
+            }
+            snapshot.sum_ns += shard.sum_ns.load(std::memory_order_relaxed);
+            snapshot.max_ns = std::max(snapshot.max_ns, shard.max_ns.load(std::memory_order_relaxed));
+        }
+        return snapshot;
+    }
+
+    void LatencyHistogram::reset()
+    {
+        for (auto &shard : shards)
+        {
+            for (auto &bucket : shard.buckets)
+            {
+                bucket.store(0, std::memory_order_relaxed);
+            }
+            shard.sum_ns.store(0, std::memory_order_relaxed);
+            shard.max_ns.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    double LatencyHistogram::Snapshot::mean_ns() const
+    {
+        return count > 0 ? static_cast<double>(sum_ns) / static_cast<double>(count) : 0.0;
+    }
+
+    uint64_t LatencyHistogram::Snapshot::percentile_ns(double q) const
+    {
+        if (count == 0)
+        {
+            return 0;
+        }
+
+        // The bucket holding the sample of rank ceil(q * count), reported by its upper
+        // bound, but never above the largest sample seen
+        uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(q * static_cast<double>(count))));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < buckets.size(); ++i)
+        {
+            seen += buckets[i];
+            if (seen >= rank)
+            {
+                return std::min(bucket_upper(i), max_ns);
+            }
+        }
+        return max_ns;
+    }
+
+    // Metrics implementation
+
+    uint64_t Metrics::elapsed_ns(Clock::time_point start)
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+    }
+
+    const char *Metrics::operation_name(Operation operation)
+    {
+        switch (operation)
+        {
+        case Operation::PUT:
+            return "put";
+        case Operation::DELETE:
+            return "delete";
+        case Operation::GET:
+            return "get";
+        case Operation::MULTI_GET:
+            return "multi_get";
+        case Operation::MULTI_PUT:
+            return "multi_put";
+        case Operation::RANGE:
+            return "range";
+        case Operation::DELETE_RANGE:
+            return "delete_range";
+        default:
+            return "unknown";
+        }
+    }
+
+    size_t Metrics::level_slot(int level)
+    {
+        return std::min<size_t>(static_cast<size_t>(std::max(level, 0)), constants::METRICS_MAX_LEVELS - 1);
+    }
+
+    void Metrics::record(Operation operation, uint64_t nanoseconds)
+    {
+        operations[static_cast<size_t>(operation)].record(nanoseconds);
+    }
+
+    void Metrics::record_probe(int level, uint64_t nanoseconds, bool found)
+    {
+        size_t slot = level_slot(level);
+        probe_latency[slot].record(nanoseconds);
+        (found ? filter_true_positives : filter_false_positives)[slot].add();
+    }
+
+    void Metrics::record_filter_negative(int level)
+    {
+        filter_negatives[level_slot(level)].add();
+    }
+
+    void Metrics::record_range_run(int level, bool scanned)
+    {
+        (scanned ? range_runs_scanned : range_runs_skipped)[level_slot(level)].add();
+    }
+
+    const LatencyHistogram &Metrics::latency(Operation operation) const
+    {
+        return operations[static_cast<size_t>(operation)];
+    }
+
+    void Metrics::write_text(std::ostream &out) const
+    {
+        out << "Operations:" << std::endl;
+        for (size_t i = 0; i < OPERATION_COUNT; ++i)
+        {
+            auto snapshot = operations[i].snapshot();
+            if (snapshot.count == 0)
+            {
+                continue;
+            }
+            out << "  " << operation_name(static_cast<Operation>(i)) << ": ";
+            write_histogram_text(out, snapshot);
+            out << std::endl;
+        }
+
+        out << "Level Probes:" << std::endl;
+        for (size_t level = 1; level < constants::METRICS_MAX_LEVELS; ++level)
+        {
+            uint64_t negatives = filter_negatives[level].value();
+            uint64_t true_positives = filter_true_positives[level].value();
+            uint64_t false_positives = filter_false_positives[level].value();
+            uint64_t range_scanned = range_runs_scanned[level].value();
+            uint64_t range_skipped = range_runs_skipped[level].value();
+            if (negatives + true_positives + false_positives + range_scanned + range_skipped == 0)
+            {
+                continue;
+            }
+
+            // Keys absent from a run are either ruled out or false positives
+            uint64_t absent = negatives + false_positives;
+            double observed_fpr = absent > 0 ? static_cast<double>(false_positives) / static_cast<double>(absent) : 0.0;
+
+            out << "  Level " << level << ": filter negatives=" << negatives
+                << ", true positives=" << true_positives
+                << ", false positives=" << false_positives
+                << ", observed FPR=" << std::setprecision(6) << observed_fpr
+                << ", range runs scanned=" << range_scanned << ", range runs skipped=" << range_skipped
+                << ", probes ";
+            write_histogram_text(out, probe_latency[level].snapshot());
+            out << std::endl;
+        }
+    }
+
+    void Metrics::write_json(std::ostream &out) const
+    {
+        out << "\"latency_ns\": {";
+        for (size_t i = 0; i < OPERATION_COUNT; ++i)
+        {
+            out << (i > 0 ? ", " : "") << "\"" << operation_name(static_cast<Operation>(i)) << "\": ";
+            write_histogram_json(out, operations[i].snapshot());
+        }
+        out << "}, \"levels\": [";
+
+        bool first = true;
+        for (size_t level = 1; level < constants::METRICS_MAX_LEVELS; ++level)
+        {
+            uint64_t negatives = filter_negatives[level].value();
+            uint64_t true_positives = filter_true_positives[level].value();
+            uint64_t false_positives = filter_false_positives[level].value();
+            uint64_t range_scanned = range_runs_scanned[level].value();
+            uint64_t range_skipped = range_runs_skipped[level].value();
+            if (negatives + true_positives + false_positives + range_scanned + range_skipped == 0)
+            {
+                continue;
+            }
+
+            out << (first ? "" : ", ") << "{\"level\": " << level
+                << ", \"filter_negatives\": " << negatives
+                << ", \"filter_true_positives\": " << true_positives
+                << ", \"filter_false_positives\": " << false_positives
+                << ", \"range_runs_scanned\": " << range_scanned
+                << ", \"range_runs_skipped\": " << range_skipped
+                << ", \"probe_latency_ns\": ";
+            write_histogram_json(out, probe_latency[level].snapshot());
+            out << "}";
+            first = false;
+        }
+        out << "]";
+    }
+
+    void Metrics::reset()
+    {
+        for (auto &histogram : operations)
+        {
+            histogram.reset();
+        }
+        for (size_t level = 0; level < constants::METRICS_MAX_LEVELS; ++level)
+        {
+            probe_latency[level].reset();
+            filter_negatives[level].reset();
+            filter_true_positives[level].reset();
+            filter_false_positives[level].reset();
+            range_runs_scanned[level].reset();
+            range_runs_skipped[level].reset();
+        }
+    }
+
+}
@@ -0,0 +1,340 @@
+#include "../include/skip_list.h"
+#include "../include/bloom_filter.h"
+#include "../include/fence_pointers.h"
+#include "../include/run.h"
+#include "../include/constants.h"
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <filesystem>
+
+// Microbenchmarks of the tree's building blocks, each measured in isolation
+
+struct BenchmarkResult
+{
+    std::string name;
+    size_t operations;
+    double seconds;
+    std::string note; // Extra measurement, such as an observed FPR
+};
+
+// Results are consumed here so the compiler cannot drop the benchmarked calls
+static volatile int64_t benchmark_sink = 0;
+
+void print_usage()
+{
+    std::cerr << "Usage: microbenchmark [OPTIONS]\n"
+              << "Benchmark SkipList, BloomFilter, FencePointers and Run in isolation\n\n"
+              << "Options:\n"
+              << "  --ops COUNT              Operations per benchmark (default: 1000000)\n"
+              << "  --suite NAME             Only run one suite: skip_list, bloom_filter, fence_pointers,\n"
+              << "                           run or compact_run\n"
+              << "  --format FORMAT          Output format: 'text' or 'json' (default: text)\n"
+              << "  --help                   Display this help message\n";
+}
+
+// Distinct non-negative keys in random order
+std::vector<int64_t> make_keys(size_t count, uint64_t seed)
+{
+    std::mt19937_64 gen(seed);
+    std::vector<int64_t> keys(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        // Even keys only, so odd keys are known to be absent
+        keys[i] = static_cast<int64_t>(i) * 2;
+    }
+    std::shuffle(keys.begin(), keys.end(), gen);
+    return keys;
+}
+
+// Time `operations` calls of body(i)
+BenchmarkResult measure(const std::string &name, size_t operations, const std::function<void(size_t)> &body)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < operations; i++)
+    {
+        body(i);
+    }
+    auto end = std::chrono::steady_clock::now();
+    return BenchmarkResult{name, operations, std::chrono::duration<double>(end - start).count(), ""};
+}
+
+void benchmark_skip_list(size_t operations, std::vector<BenchmarkResult> &results)
+{
+    auto keys = make_keys(operations, 1);
+    lsm::SkipList list;
+
+    results.push_back(measure("skip_list.insert", operations, [&](size_t i)
+                              { list.insert(keys[i], static_cast<int64_t>(i)); }));
+    results.push_back(measure("skip_list.get_hit", operations, [&](size_t i)
+                              { benchmark_sink = benchmark_sink + list.get(keys[i]).value_or(lsm::KeyValuePair(0, 0)).value; }));
+    results.push_back(measure("skip_list.get_miss", operations, [&](size_t i)
+                              { benchmark_sink = benchmark_sink + list.get(keys[i] + 1).value_or(lsm::KeyValuePair(0, 0)).value; }));
+
+    size_t ranges = std::max<size_t>(operations / 100, 1);
+    results.push_back(measure("skip_list.range_100", ranges, [&](size_t i)
+                              { benchmark_sink = benchmark_sink + static_cast<int64_t>(list.range(keys[i], keys[i] + 200).size()); }));
+}
+
+void benchmark_bloom_filter(size_t operations, std::vector<BenchmarkResult> &results)
+{
+    auto keys = make_keys(operations, 2);
+    lsm::BloomFilter filter(0.01, operations);
+
+    results.push_back(measure("bloom_filter.insert", operations, [&](size_t i)
+                              { filter.insert(keys[i]); }));
+    results.push_back(measure("bloom_filter.probe_hit", operations, [&](size_t i)
+                              { benchmark_sink = benchmark_sink + filter.might_contain(keys[i]); }));
+
+    size_t false_positives = 0;
+    results.push_back(measure("bloom_filter.probe_miss", operations, [&](size_t i)
+                              { false_positives += filter.might_contain(keys[i] + 1); }));
+
+    std::ostringstream note;
+    note << "fpr=" << std::setprecision(4) << static_cast<double>(false_positives) / static_cast<double>(operations)
+         << " target=0.01";
+    results.back().note = note.str();
+}
+
+void benchmark_fence_pointers(size_t operations, std::vector<BenchmarkResult> &results)
+{
+    // One fence pointer per page of a run holding `operations` pairs
+    size_t pages = std::max<size_t>(operations / lsm::constants::RUN_BLOCK_PAIRS, 1);
+    std::vector<int64_t> page_keys(pages);
+    for (size_t i = 0; i < pages; i++)
+    {
+        page_keys[i] = static_cast<int64_t>(i * lsm::constants::RUN_BLOCK_PAIRS * 2);
+    }
+    lsm::FencePointers fences(page_keys);
+
+    auto keys = make_keys(operations, 3);
+    results.push_back(measure("fence_pointers.find_offset", operations, [&](size_t i)
+                              { benchmark_sink = benchmark_sink + static_cast<int64_t>(fences.find_offset(keys[i])); }));
+}
+
+void benchmark_run(size_t operations, std::vector<BenchmarkResult> &results)
+{
+    std::filesystem::create_directories(lsm::constants::DATA_DIRECTORY);
+
+    std::vector<lsm::KeyValuePair> pairs;
+    pairs.reserve(operations);
+    for (size_t i = 0; i < operations; i++)
+    {
+        pairs.emplace_back(static_cast<int64_t>(i) * 2, static_cast<int64_t>(i));
+    }
+
+    // A level and run ID no tree uses, so the files cannot clash with real runs
+    std::unique_ptr<lsm::Run> run;
+    results.push_back(measure("run.write", 1, [&](size_t)
+                              {
+        lsm::RunBuilder builder(lsm::constants::DATA_DIRECTORY, 99, 0, 0.01, pairs.size());
+        for (const auto &pair : pairs)
+        {
+            builder.add(pair.key, pair.value);
+        }
+        run = builder.finish(); }));
+    results.back().operations = operations;
+
+    auto keys = make_keys(operations, 4);
+    results.push_back(measure("run.get_hit", operations, [&](size_t i)
+                              { benchmark_sink = benchmark_sink + run->get(keys[i]).value_or(lsm::KeyValuePair(0, 0)).value; }));
+    results.push_back(measure("run.get_miss", operations, [&](size_t i)
+                              { benchmark_sink = benchmark_sink + run->get(keys[i] + 1).value_or(lsm::KeyValuePair(0, 0)).value; }));
+
+    size_t scanned = 0;
+    results.push_back(measure("run.scan", 1, [&](size_t)
+                              {
+        for (lsm::RunIterator it(*run); it.valid(); it.next())
+        {
+            benchmark_sink = benchmark_sink + it.current().value;
+            ++scanned;
+        } }));
+    results.back().operations = scanned;
+
+    run->delete_files_from_disk();
+}
+
+// The run suite over CompactKeyTraits: 32-bit keys with 32-byte values
+void benchmark_compact_run(size_t operations, std::vector<BenchmarkResult> &results)
+{
+    using Traits = lsm::CompactKeyTraits;
+    using Value = Traits::value_type;
+
+    std::filesystem::create_directories(lsm::constants::DATA_DIRECTORY);
+
+    // Every byte of a value derives from its key, so reads can be checked
+    auto value_of = [](int32_t key)
+    {
+        Value value;
+        for (size_t b = 0; b < value.bytes.size(); b++)
+        {
+            value.bytes[b] = static_cast<uint8_t>(key * 31 + static_cast<int32_t>(b));
+        }
+        return value;
+    };
+
+    size_t count = std::min<size_t>(operations, std::numeric_limits<int32_t>::max() / 2);
+    std::unique_ptr<lsm::BasicRun<Traits>> run;
+    results.push_back(measure("compact_run.write", 1, [&](size_t)
+                              {
+        lsm::BasicRunBuilder<Traits> builder(lsm::constants::DATA_DIRECTORY, 99, 1, 0.01, count);
+        for (size_t i = 0; i < count; i++)
+        {
+            int32_t key = static_cast<int32_t>(i) * 2;
+            builder.add(key, value_of(key));
+        }
+        run = builder.finish(); }));
+    results.back().operations = count;
+
+    auto keys = make_keys(count, 5);
+    size_t mismatches = 0;
+    results.push_back(measure("compact_run.get_hit", count, [&](size_t i)
+                              {
+        int32_t key = static_cast<int32_t>(keys[i]);
+        auto pair = run->get(key);
+        if (!pair || pair->value != value_of(key))
+        {
+            ++mismatches;
+        } }));
+    results.push_back(measure("compact_run.get_miss", count, [&](size_t i)
+                              {
+        if (run->get(static_cast<int32_t>(keys[i] + 1)))
+        {
+            ++mismatches;
+        } }));
+
+    size_t scanned = 0;
+    results.push_back(measure("compact_run.scan", 1, [&](size_t)
+                              {
+        for (lsm::BasicRunIterator<Traits> it(*run); it.valid(); it.next())
+        {
+            if (it.current().key != static_cast<int32_t>(scanned) * 2 || it.current().value != value_of(it.current().key))
+            {
+                ++mismatches;
+            }
+            ++scanned;
+        } }));
+    mismatches += scanned == count ? 0 : 1;
+    results.back().operations = scanned;
+    results.back().note = "mismatches=" + std::to_string(mismatches);
+
+    run->delete_files_from_disk();
+}
+
+void print_text(std::ostream &out, const std::vector<BenchmarkResult> &results)
+{
+    out << std::left << std::setw(30) << "benchmark" << std::right << std::setw(12) << "ops"
+              << std::setw(14) << "ns/op" << std::setw(16) << "ops/s" << "  note" << std::endl;
+    for (const auto &result : results)
+    {
+        double ns_per_op = result.seconds * 1e9 / static_cast<double>(result.operations);
+        out << std::left << std::setw(30) << result.name << std::right << std::setw(12) << result.operations
+                  << std::fixed << std::setprecision(1) << std::setw(14) << ns_per_op
+                  << std::setprecision(0) << std::setw(16) << static_cast<double>(result.operations) / result.seconds
+                  << "  " << result.note << std::endl;
+    }
+}
+
+void print_json(std::ostream &out, const std::vector<BenchmarkResult> &results)
+{
+    out << "{\"benchmarks\": [";
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const auto &result = results[i];
+        out << (i > 0 ? ", " : "") << "{\"name\": \"" << result.name << "\""
+                  << ", \"operations\": " << result.operations
+                  << std::fixed << std::setprecision(3)
+                  << ", \"seconds\": " << result.seconds
+                  << ", \"ns_per_op\": " << result.seconds * 1e9 / static_cast<double>(result.operations)
+                  << ", \"ops_per_sec\": " << static_cast<double>(result.operations) / result.seconds
+                  << ", \"note\": \"" << result.note << "\"}";
+    }
+    out << "]}" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t operations = 1000000;
+    std::string only_suite;
+    std::string format = "text";
+
+    // Parse command line arguments
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--ops") == 0 && i + 1 < argc)
+        {
+            operations = std::max<size_t>(std::stoul(argv[++i]), 1);
+        }
+        else if (strcmp(argv[i], "--suite") == 0 && i + 1 < argc)
+        {
+            only_suite = argv[++i];
+        }
+        else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc)
+        {
+            format = argv[++i];
+        }
+        else if (strcmp(argv[i], "--help") == 0)
+        {
+            print_usage();
+            return 0;
+        }
+        else
+        {
+            std::cerr << "Unknown option: " << argv[i] << "\n";
+            print_usage();
+            return 1;
+        }
+    }
+
+    if (format != "text" && format != "json")
+    {
+        std::cerr << "Error: format must be 'text' or 'json'\n";
+        return 1;
+    }
+
+    std::vector<std::pair<std::string, std::function<void(size_t, std::vector<BenchmarkResult> &)>>> suites = {
+        {"skip_list", benchmark_skip_list},
+        {"bloom_filter", benchmark_bloom_filter},
+        {"fence_pointers", benchmark_fence_pointers},
+        {"run", benchmark_run},
+        {"compact_run", benchmark_compact_run},
+    };
+
+    // Runs log to stdout; send that to stderr so stdout holds only the results
+    std::ostream out(std::cout.rdbuf());
+    std::cout.rdbuf(std::cerr.rdbuf());
+
+    std::vector<BenchmarkResult> results;
+    for (const auto &suite : suites)
+    {
+        if (only_suite.empty() || suite.first == only_suite)
+        {
+            suite.second(operations, results);
+        }
+    }
+
+    if (results.empty())
+    {
+        std::cerr << "Error: unknown suite '" << only_suite << "'\n";
+        return 1;
+    }
+
+    if (format == "json")
+    {
+        print_json(out, results);
+    }
+    else
+    {
+        print_text(out, results);
+    }
+    return 0;
+}
@@ -0,0 +1,395 @@
+#include "../include/protocol.h"
+#include "../include/constants.h"
+
+#include <stdexcept>
+
+namespace lsm
+{
+    namespace protocol
+    {
+
+        namespace
+        {
+            // Little-endian field writers
+            void put_u8(std::string &out, uint8_t value)
+            {
+                out.push_back(static_cast<char>(value));
+            }
+
+            void put_u32(std::string &out, uint32_t value)
+            {
+                for (int i = 0; i < 4; ++i)
+                {
+                    out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+                }
+            }
+
+            void put_u64(std::string &out, uint64_t value)
+            {
+                for (int i = 0; i < 8; ++i)
+                {
+                    out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+                }
+            }
+
+            void put_i64(std::string &out, int64_t value)
+            {
+                put_u64(out, static_cast<uint64_t>(value));
+            }
+
+            uint32_t read_u32(const char *data)
+            {
+                uint32_t value = 0;
+                for (int i = 0; i < 4; ++i)
+                {
+                    value |= static_cast<uint32_t>(static_cast<uint8_t>(data[i])) << (8 * i);
+                }
+                return value;
+            }
+
+            uint64_t read_u64(const char *data)
+            {
+                uint64_t value = 0;
+                for (int i = 0; i < 8; ++i)
+                {
+                    value |= static_cast<uint64_t>(static_cast<uint8_t>(data[i])) << (8 * i);
+                }
+                return value;
+            }
+
+            // Bounds-checked reader over the body of one frame
+            class FrameReader
+            {
+            public:
+                FrameReader(const char *data, size_t size) : data(data), size(size), offset(0) {}
+
+                uint8_t u8()
+                {
+                    require(1);
+                    return static_cast<uint8_t>(data[offset++]);
+                }
+
+                uint32_t u32()
+                {
+                    require(4);
+                    uint32_t value = read_u32(data + offset);
+                    offset += 4;
+                    return value;
+                }
+
+                uint64_t u64()
+                {
+                    require(8);
+                    uint64_t value = read_u64(data + offset);
+                    offset += 8;
+                    return value;
+                }
+
+                int64_t i64()
+                {
+                    return static_cast<int64_t>(u64());
+                }
+
+                std::string rest()
+                {
+                    std::string value(data + offset, size - offset);
+                    offset = size;
+                    return value;
+                }
+
+                size_t remaining() const
+                {
+                    return size - offset;
+                }
+
+            private:
+                void require(size_t bytes) const
+                {
+                    if (size - offset < bytes)
+                    {
+                        throw std::runtime_error("Truncated protocol frame");
+                    }
+                }
+
+                const char *data;
+                size_t size;
+                size_t offset;
+            };
+
+            // Reserve room for the length prefix; returns its position
+            size_t begin_frame(std::string &out)
+            {
+                size_t start = out.size();
+                put_u32(out, 0);
+                return start;
+            }
+
+            // Fill in the length prefix once the body is written
+            void end_frame(std::string &out, size_t start)
+            {
+                uint32_t length = static_cast<uint32_t>(out.size() - start - 4);
+                for (int i = 0; i < 4; ++i)
+                {
+                    out[start + i] = static_cast<char>((length >> (8 * i)) & 0xFF);
+                }
+            }
+
+            // Get the body of the frame at the front of a buffer, if complete
+            bool frame_body(const char *data, size_t size, const char *&body, size_t &body_size)
+            {
+                if (size < 4)
+                {
+                    return false;
+                }
+
+                body_size = read_u32(data);
+                if (body_size > constants::PROTOCOL_MAX_FRAME_SIZE)
+                {
+                    throw std::runtime_error("Protocol frame of " + std::to_string(body_size) + " bytes exceeds limit");
+                }
+
+                if (size - 4 < body_size)
+                {
+                    return false;
+                }
+
+                body = data + 4;
+                return true;
+            }
+
+            // Counted list of key-value pairs
+            void put_pairs(std::string &out, const std::vector<std::pair<int64_t, int64_t>> &pairs)
+            {
+                put_u32(out, static_cast<uint32_t>(pairs.size()));
+                for (const auto &pair : pairs)
+                {
+                    put_i64(out, pair.first);
+                    put_i64(out, pair.second);
+                }
+            }
+
+            void read_pairs(FrameReader &reader, std::vector<std::pair<int64_t, int64_t>> &pairs)
+            {
+                uint32_t count = reader.u32();
+                if (reader.remaining() < static_cast<size_t>(count) * 16)
+                {
+                    throw std::runtime_error("Truncated protocol frame");
+                }
+                pairs.reserve(count);
+                for (uint32_t i = 0; i < count; ++i)
+                {
+                    int64_t key = reader.i64();
+                    int64_t value = reader.i64();
+                    pairs.emplace_back(key, value);
+                }
+            }
+
+            // Requests that change the tree, and so may carry SYNC_FLAG
+            bool is_write(Opcode opcode)
+            {
+                return opcode == Opcode::PUT || opcode == Opcode::DELETE || opcode == Opcode::MPUT ||
+                       opcode == Opcode::DELETE_RANGE;
+            }
+
+            Opcode to_opcode(uint8_t value)
+            {
+                if (value < static_cast<uint8_t>(Opcode::PUT) || value > static_cast<uint8_t>(Opcode::DELETE_RANGE))
+                {
+                    throw std::runtime_error("Unknown protocol opcode " + std::to_string(value));
+                }
+                return static_cast<Opcode>(value);
+            }
+        }
+
+        void encode_request(const Request &request, std::string &out)
+        {
+            size_t start = begin_frame(out);
+            put_u64(out, request.id);
+            put_u8(out, static_cast<uint8_t>(static_cast<uint8_t>(request.opcode) | (request.sync ? SYNC_FLAG : 0)));
+
+            switch (request.opcode)
+            {
+            case Opcode::PUT:
+            case Opcode::RANGE:
+            case Opcode::DELETE_RANGE:
+                put_i64(out, request.key);
+                put_i64(out, request.value);
+                break;
+
+            case Opcode::GET:
+            case Opcode::DELETE:
+                put_i64(out, request.key);
+                break;
+
+            case Opcode::TEXT:
+                out.append(request.text);
+                break;
+
+            case Opcode::MGET:
+                put_u32(out, static_cast<uint32_t>(request.keys.size()));
+                for (int64_t key : request.keys)
+                {
+                    put_i64(out, key);
+                }
+                break;
+
+            case Opcode::MPUT:
+                put_pairs(out, request.pairs);
+                break;
+            }
+
+            end_frame(out, start);
+        }
+
+        void encode_response(const Response &response, std::string &out)
+        {
+            size_t start = begin_frame(out);
+            put_u64(out, response.id);
+            put_u8(out, static_cast<uint8_t>(response.opcode));
+            put_u8(out, static_cast<uint8_t>(response.status));
+
+            if (response.status == Status::ERROR)
+            {
+                out.append(response.text);
+            }
+            else if (response.status == Status::OK || response.status == Status::PARTIAL)
+            {
+                switch (response.opcode)
+                {
+                case Opcode::GET:
+                    put_i64(out, response.value);
+                    break;
+
+                case Opcode::RANGE:
+                case Opcode::MGET:
+                    put_pairs(out, response.pairs);
+                    break;
+
+                case Opcode::TEXT:
+                    out.append(response.text);
+                    break;
+
+                case Opcode::PUT:
+                case Opcode::DELETE:
+                case Opcode::MPUT:
+                case Opcode::DELETE_RANGE:
+                    break;
+                }
+            }
+
+            end_frame(out, start);
+        }
+
+        size_t decode_request(const char *data, size_t size, Request &request)
+        {
+            const char *body;
+            size_t body_size;
+            if (!frame_body(data, size, body, body_size))
+            {
+                return 0;
+            }
+
+            FrameReader reader(body, body_size);
+            request = Request();
+            request.id = reader.u64();
+            uint8_t opcode = reader.u8();
+            request.opcode = to_opcode(opcode & ~SYNC_FLAG);
+            request.sync = (opcode & SYNC_FLAG) != 0;
+            if (request.sync && !is_write(request.opcode))
+            {
+                throw std::runtime_error("Sync flag on a request that does not write");
+            }
+
+            switch (request.opcode)
+            {
+            case Opcode::PUT:
+            case Opcode::RANGE:
+            case Opcode::DELETE_RANGE:
+                request.key = reader.i64();
+                request.value = reader.i64();
+                break;
+
+            case Opcode::GET:
+            case Opcode::DELETE:
+                request.key = reader.i64();
+                break;
+
+            case Opcode::TEXT:
+                request.text = reader.rest();
+                break;
+
+            case Opcode::MGET:
+            {
+                uint32_t count = reader.u32();
+                if (reader.remaining() < static_cast<size_t>(count) * 8)
+                {
+                    throw std::runtime_error("Truncated protocol frame");
+                }
+                request.keys.reserve(count);
+                for (uint32_t i = 0; i < count; ++i)
+                {
+                    request.keys.push_back(reader.i64());
+                }
+                break;
+            }
+
+            case Opcode::MPUT:
+                read_pairs(reader, request.pairs);
+                break;
+            }
+
+            return 4 + body_size;
+        }
+
+        size_t decode_response(const char *data, size_t size, Response &response)
+        {
+            const char *body;
+            size_t body_size;
+            if (!frame_body(data, size, body, body_size))
+            {
+                return 0;
+            }
+
+            // Reset the fields in place so a reused response keeps its buffers
+            FrameReader reader(body, body_size);
+            response.value = 0;
+            response.pairs.clear();
+            response.text.clear();
+            response.id = reader.u64();
+            response.opcode = to_opcode(reader.u8());
+            response.status = static_cast<Status>(reader.u8());
+
+            if (response.status == Status::ERROR)
+            {
+                response.text = reader.rest();
+            }
+            else if (response.status == Status::OK || response.status == Status::PARTIAL)
+            {
+                switch (response.opcode)
+                {
+                case Opcode::GET:
+                    response.value = reader.i64();
+                    break;
+
+                case Opcode::RANGE:
+                case Opcode::MGET:
+                    read_pairs(reader, response.pairs);
+                    break;
+
+                case Opcode::TEXT:
+                    response.text = reader.rest();
+                    break;
+
+                case Opcode::PUT:
+                case Opcode::DELETE:
+                case Opcode::MPUT:
+                case Opcode::DELETE_RANGE:
+                    break;
+                }
+            }
+
+            return 4 + body_size;
+        }
+
+    } // namespace protocol
+} // namespace lsm
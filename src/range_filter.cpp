@@ -0,0 +1,194 @@
+#include "../include/range_filter.h"
+#include "../include/constants.h"
+#include "../include/key_value_traits.h"
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+
+namespace lsm
+{
+
+    namespace
+    {
+        // First bytes of a range filter sidecar, followed by the prefix bloom filter if
+        // has_prefix_filter is set
+        struct RangeFilterFileHeader
+        {
+            uint64_t magic;
+            uint32_t version;
+            uint32_t prefix_bits;
+            int64_t min_key;
+            int64_t max_key;
+            uint32_t has_prefix_filter;
+            uint32_t reserved;
+        };
+    }
+
+    RangeFilter::RangeFilter(size_t prefix_bits)
+        : prefix_bits(std::min<size_t>(prefix_bits, 63)),
+          min_key(DefaultTraits::max_key()),
+          max_key(DefaultTraits::min_key())
+    {
+    }
+
+    RangeFilter::RangeFilter(const std::string &filename)
+    {
+        std::ifstream file(filename, std::ios::binary);
+        if (!file)
+        {
+            throw std::runtime_error("Failed to open range filter file: " + filename);
+        }
+        read(file, filename);
+    }
+
+    RangeFilter::RangeFilter(std::istream &in, const std::string &name)
+    {
+        read(in, name);
+    }
+
+    void RangeFilter::read(std::istream &in, const std::string &name)
+    {
+        RangeFilterFileHeader header{};
+        in.read(reinterpret_cast<char *>(&header), sizeof(header));
+        if (!in || header.magic != constants::RANGE_FILTER_FILE_MAGIC)
+        {
+            throw std::runtime_error("Not a range filter file: " + name);
+        }
+        if (header.version != constants::RANGE_FILTER_FILE_VERSION || header.prefix_bits > 63)
+        {
+            throw std::runtime_error("Unsupported range filter file version " + std::to_string(header.version) +
+                                     " in " + name);
+        }
+
+        prefix_bits = header.prefix_bits;
+        min_key = header.min_key;
+        max_key = header.max_key;
+        if (header.has_prefix_filter)
+        {
+            prefix_filter = std::make_unique<BloomFilter>(in, name);
+        }
+    }
+
+    void RangeFilter::add(int64_t key)
+    {
+        min_key = std::min(min_key, key);
+        max_key = std::max(max_key, key);
+
+        if (prefix_bits == 0 || too_many_prefixes)
+        {
+            return;
+        }
+
+        // Keys arrive in order, so a repeated prefix is always the last one
+        int64_t prefix = prefix_of(key);
+        if (prefixes.empty() || prefixes.back() != prefix)
+        {
+            if (prefixes.size() >= constants::RANGE_FILTER_MAX_PREFIXES)
+            {
+                too_many_prefixes = true;
+                std::vector<int64_t>().swap(prefixes);
+                return;
+            }
+            prefixes.push_back(prefix);
+        }
+    }
+
+    void RangeFilter::seal()
+    {
+        if (!prefixes.empty())
+        {
+            prefix_filter = std::make_unique<BloomFilter>(constants::RANGE_FILTER_FPR, prefixes.size());
+            for (int64_t prefix : prefixes)
+            {
+                prefix_filter->insert(prefix);
+            }
+        }
+        std::vector<int64_t>().swap(prefixes);
+    }
+
+    void RangeFilter::save(const std::string &filename) const
+    {
+        std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+        if (!file)
+        {
+            throw std::runtime_error("Failed to create range filter file: " + filename);
+        }
+
+        write(file);
+
+        if (!file)
+        {
+            throw std::runtime_error("Failed to write range filter file: " + filename);
+        }
+    }
+
+    void RangeFilter::write(std::ostream &out) const
+    {
+        RangeFilterFileHeader header{constants::RANGE_FILTER_FILE_MAGIC, constants::RANGE_FILTER_FILE_VERSION,
+                                     static_cast<uint32_t>(prefix_bits), min_key, max_key,
+                                     prefix_filter ? 1u : 0u, 0};
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        if (prefix_filter)
+        {
+            prefix_filter->write(out);
+        }
+    }
+
+    bool RangeFilter::may_overlap(int64_t start_key, int64_t end_key) const
+    {
+        // Clip the query to the key span; end_key is exclusive
+        int64_t first = std::max(start_key, min_key);
+        if (start_key >= end_key || first > max_key || end_key <= first)
+        {
+            return false;
+        }
+        int64_t last = std::min(end_key - 1, max_key);
+
+        if (!prefix_filter)
+        {
+            return true;
+        }
+
+        // Probe every bucket the clipped query touches, unless there are too many
+        int64_t first_prefix = prefix_of(first);
+        int64_t last_prefix = prefix_of(last);
+        if (static_cast<uint64_t>(last_prefix) - static_cast<uint64_t>(first_prefix) >= constants::RANGE_FILTER_MAX_PROBES)
+        {
+            return true;
+        }
+        for (int64_t prefix = first_prefix;; ++prefix)
+        {
+            if (prefix_filter->might_contain(prefix))
+            {
+                return true;
+            }
+            if (prefix == last_prefix)
+            {
+                return false;
+            }
+        }
+    }
+
+    int64_t RangeFilter::get_min_key() const
+    {
+        return min_key;
+    }
+
+    int64_t RangeFilter::get_max_key() const
+    {
+        return max_key;
+    }
+
+    bool RangeFilter::has_prefix_filter() const
+    {
+        return prefix_filter != nullptr;
+    }
+
+    int64_t RangeFilter::prefix_of(int64_t key) const
+    {
+        // Arithmetic shift: buckets stay in key order for negative keys too
+        return key >> prefix_bits;
+    }
+
+}
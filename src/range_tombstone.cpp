@@ -0,0 +1,194 @@
+#include "../include/range_tombstone.h"
+#include "../include/block_codec.h"
+#include "../include/constants.h"
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+
+namespace lsm
+{
+
+    namespace
+    {
+        // First bytes of a tombstone sidecar, followed by count (start, end) pairs and a
+        // checksum of their words
+        struct TombstoneFileHeader
+        {
+            uint64_t magic;
+            uint32_t version;
+            uint32_t reserved;
+            uint64_t count;
+        };
+        static_assert(sizeof(RangeTombstone) == 2 * sizeof(int64_t), "tombstones are saved as raw words");
+    }
+
+    RangeTombstoneSet::RangeTombstoneSet(std::vector<RangeTombstone> tombstones)
+        : tombstones(std::move(tombstones))
+    {
+        normalize();
+    }
+
+    RangeTombstoneSet RangeTombstoneSet::load(const std::string &filename)
+    {
+        std::ifstream file(filename, std::ios::binary);
+        if (!file)
+        {
+            throw std::runtime_error("Failed to open range tombstone file: " + filename);
+        }
+        return read(file, filename);
+    }
+
+    RangeTombstoneSet RangeTombstoneSet::read(std::istream &in, const std::string &name)
+    {
+        TombstoneFileHeader header{};
+        in.read(reinterpret_cast<char *>(&header), sizeof(header));
+        if (!in || header.magic != constants::TOMBSTONE_FILE_MAGIC)
+        {
+            throw std::runtime_error("Not a range tombstone file: " + name);
+        }
+        if (header.version != constants::TOMBSTONE_FILE_VERSION)
+        {
+            throw std::runtime_error("Unsupported range tombstone file version " + std::to_string(header.version) +
+                                     " in " + name);
+        }
+
+        std::vector<uint64_t> words(header.count * 2);
+        uint64_t checksum = 0;
+        in.read(reinterpret_cast<char *>(words.data()), static_cast<std::streamsize>(words.size() * sizeof(uint64_t)));
+        in.read(reinterpret_cast<char *>(&checksum), sizeof(checksum));
+        if (!in || checksum != BlockCodec::checksum(words.data(), words.size()))
+        {
+            throw std::runtime_error("Corrupt range tombstone file: " + name);
+        }
+
+        RangeTombstoneSet set;
+        set.tombstones.reserve(header.count);
+        for (size_t i = 0; i < header.count; ++i)
+        {
+            set.tombstones.emplace_back(static_cast<int64_t>(words[i * 2]), static_cast<int64_t>(words[i * 2 + 1]));
+        }
+        set.normalize();
+        return set;
+    }
+
+    void RangeTombstoneSet::save(const std::string &filename) const
+    {
+        std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+        if (!file)
+        {
+            throw std::runtime_error("Failed to create range tombstone file: " + filename);
+        }
+
+        write(file);
+
+        if (!file)
+        {
+            throw std::runtime_error("Failed to write range tombstone file: " + filename);
+        }
+    }
+
+    void RangeTombstoneSet::write(std::ostream &out) const
+    {
+        std::vector<uint64_t> words;
+        words.reserve(tombstones.size() * 2);
+        for (const auto &tombstone : tombstones)
+        {
+            words.push_back(static_cast<uint64_t>(tombstone.start_key));
+            words.push_back(static_cast<uint64_t>(tombstone.end_key));
+        }
+        uint64_t checksum = BlockCodec::checksum(words.data(), words.size());
+
+        TombstoneFileHeader header{constants::TOMBSTONE_FILE_MAGIC, constants::TOMBSTONE_FILE_VERSION, 0,
+                                   tombstones.size()};
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char *>(words.data()), static_cast<std::streamsize>(words.size() * sizeof(uint64_t)));
+        out.write(reinterpret_cast<const char *>(&checksum), sizeof(checksum));
+    }
+
+    void RangeTombstoneSet::add(const RangeTombstone &tombstone)
+    {
+        tombstones.push_back(tombstone);
+        normalize();
+    }
+
+    void RangeTombstoneSet::merge(const RangeTombstoneSet &other)
+    {
+        tombstones.insert(tombstones.end(), other.tombstones.begin(), other.tombstones.end());
+        normalize();
+    }
+
+    RangeTombstoneSet RangeTombstoneSet::clip(int64_t start_key, int64_t end_key) const
+    {
+        RangeTombstoneSet clipped;
+        for (const auto &tombstone : tombstones)
+        {
+            int64_t start = std::max(tombstone.start_key, start_key);
+            int64_t end = std::min(tombstone.end_key, end_key);
+            if (start < end)
+            {
+                clipped.tombstones.emplace_back(start, end);
+            }
+        }
+        return clipped;
+    }
+
+    bool RangeTombstoneSet::covers(int64_t key) const
+    {
+        // The last tombstone starting at or before the key is the only one that can cover it
+        auto it = std::upper_bound(tombstones.begin(), tombstones.end(), key,
+                                   [](int64_t k, const RangeTombstone &tombstone)
+                                   { return k < tombstone.start_key; });
+        return it != tombstones.begin() && std::prev(it)->covers(key);
+    }
+
+    bool RangeTombstoneSet::overlaps(int64_t start_key, int64_t end_key) const
+    {
+        // First tombstone ending after start_key
+        auto it = std::upper_bound(tombstones.begin(), tombstones.end(), start_key,
+                                   [](int64_t k, const RangeTombstone &tombstone)
+                                   { return k < tombstone.end_key; });
+        return it != tombstones.end() && it->start_key < end_key && start_key < end_key;
+    }
+
+    const std::vector<RangeTombstone> &RangeTombstoneSet::get_tombstones() const
+    {
+        return tombstones;
+    }
+
+    size_t RangeTombstoneSet::size() const
+    {
+        return tombstones.size();
+    }
+
+    bool RangeTombstoneSet::empty() const
+    {
+        return tombstones.empty();
+    }
+
+    void RangeTombstoneSet::normalize()
+    {
+        tombstones.erase(std::remove_if(tombstones.begin(), tombstones.end(),
+                                        [](const RangeTombstone &tombstone)
+                                        { return tombstone.start_key >= tombstone.end_key; }),
+                         tombstones.end());
+        std::sort(tombstones.begin(), tombstones.end(),
+                  [](const RangeTombstone &a, const RangeTombstone &b)
+                  { return a.start_key < b.start_key; });
+
+        size_t out = 0;
+        for (size_t i = 0; i < tombstones.size(); ++i)
+        {
+            if (out > 0 && tombstones[i].start_key <= tombstones[out - 1].end_key)
+            {
+                tombstones[out - 1].end_key = std::max(tombstones[out - 1].end_key, tombstones[i].end_key);
+            }
+            else
+            {
+                tombstones[out++] = tombstones[i];
+            }
+        }
+        tombstones.erase(tombstones.begin() + static_cast<std::ptrdiff_t>(out), tombstones.end());
+    }
+
+}
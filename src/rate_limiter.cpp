@@ -0,0 +1,56 @@
+#include "../include/rate_limiter.h"
+#include "../include/constants.h"
+
+#include <algorithm>
+#include <thread>
+
+namespace lsm
+{
+
+    RateLimiter::RateLimiter(size_t bytes_per_second)
+        : rate(bytes_per_second), next_free(Clock::now())
+    {
+    }
+
+    RateLimiter &RateLimiter::get_compaction_limiter()
+    {
+        static RateLimiter instance(constants::COMPACTION_WRITE_BYTES_PER_SECOND.load());
+        return instance;
+    }
+
+    void RateLimiter::request(size_t bytes)
+    {
+        size_t bytes_per_second = rate.load();
+        if (bytes_per_second == 0 || bytes == 0)
+        {
+            return;
+        }
+
+        auto cost = std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(static_cast<double>(bytes) / static_cast<double>(bytes_per_second)));
+
+        Clock::time_point start;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            // Bandwidth left unused for longer than the burst window is gone
+            auto now = Clock::now();
+            next_free = std::max(next_free, now - std::chrono::milliseconds(constants::RATE_LIMITER_BURST_MS));
+            start = next_free;
+            next_free += cost;
+        }
+
+        std::this_thread::sleep_until(start);
+    }
+
+    void RateLimiter::set_rate(size_t bytes_per_second)
+    {
+        rate.store(bytes_per_second);
+    }
+
+    size_t RateLimiter::get_rate() const
+    {
+        return rate.load();
+    }
+
+}
@@ -0,0 +1,336 @@
+#include "../include/row_cache.h"
+#include "../include/constants.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace lsm
+{
+
+    namespace
+    {
+        // Spread a key over 64 bits (the murmur3 finalizer)
+        uint64_t mix(uint64_t h)
+        {
+            h ^= h >> 33;
+            h *= 0xFF51AFD7ED558CCDULL;
+            h ^= h >> 33;
+            h *= 0xC4CEB9FE1A85EC53ULL;
+            h ^= h >> 33;
+            return h;
+        }
+    }
+
+    // FrequencySketch implementation
+
+    void RowCache::FrequencySketch::resize(size_t capacity_entries)
+    {
+        width = 16;
+        while (width < capacity_entries)
+        {
+            width <<= 1;
+        }
+        counters.assign(ROWS * width, 0);
+        additions = 0;
+        reset_threshold = std::max<size_t>(capacity_entries, 1) * constants::ROW_CACHE_SKETCH_RESET_MULTIPLIER;
+    }
+
+    size_t RowCache::FrequencySketch::index(int64_t key, size_t row) const
+    {
+        uint64_t h = mix(static_cast<uint64_t>(key) + (row + 1) * 0x9E3779B97F4A7C15ULL);
+        return row * width + (h & (width - 1));
+    }
+
+    void RowCache::FrequencySketch::increment(int64_t key)
+    {
+        if (counters.empty())
+        {
+            return;
+        }
+
+        for (size_t row = 0; row < ROWS; ++row)
+        {
+            uint8_t &counter = counters[index(key, row)];
+            if (counter < 15)
+            {
+                ++counter;
+            }
+        }
+
+        // Age every count so keys that were hot long ago lose their advantage
+        if (++additions >= reset_threshold)
+        {
+            for (auto &counter : counters)
+            {
+                counter >>= 1;
+            }
+            additions /= 2;
+        }
+    }
+
+    uint8_t RowCache::FrequencySketch::frequency(int64_t key) const
+    {
+        if (counters.empty())
+        {
+            return 0;
+        }
+
+        uint8_t estimate = 15;
+        for (size_t row = 0; row < ROWS; ++row)
+        {
+            estimate = std::min(estimate, counters[index(key, row)]);
+        }
+        return estimate;
+    }
+
+    // Shard implementation
+
+    void RowCache::Shard::reset(size_t capacity_entries)
+    {
+        window.clear();
+        probation.clear();
+        protected_entries.clear();
+        index.clear();
+
+        window_capacity = capacity_entries == 0
+                              ? 0
+                              : std::max<size_t>(capacity_entries * constants::ROW_CACHE_WINDOW_PERCENT / 100, 1);
+        main_capacity = capacity_entries - window_capacity;
+        protected_capacity = main_capacity * constants::ROW_CACHE_PROTECTED_PERCENT / 100;
+        sketch.resize(capacity_entries);
+        generation++;
+    }
+
+    RowCache::EntryList &RowCache::Shard::list_for(Segment segment)
+    {
+        switch (segment)
+        {
+        case Segment::WINDOW:
+            return window;
+        case Segment::PROBATION:
+            return probation;
+        default:
+            return protected_entries;
+        }
+    }
+
+    void RowCache::Shard::touch(EntryList::iterator entry)
+    {
+        if (entry->segment != Segment::PROBATION)
+        {
+            EntryList &list = list_for(entry->segment);
+            list.splice(list.begin(), list, entry);
+            return;
+        }
+
+        // A second hit earns a protected place; the protected segment's least recently
+        // used entry goes back on probation to make room
+        entry->segment = Segment::PROTECTED;
+        protected_entries.splice(protected_entries.begin(), probation, entry);
+        if (protected_entries.size() > protected_capacity)
+        {
+            auto demoted = std::prev(protected_entries.end());
+            demoted->segment = Segment::PROBATION;
+            probation.splice(probation.begin(), protected_entries, demoted);
+        }
+    }
+
+    void RowCache::Shard::admit_from_window()
+    {
+        auto candidate = std::prev(window.end());
+        if (probation.size() + protected_entries.size() < main_capacity)
+        {
+            candidate->segment = Segment::PROBATION;
+            probation.splice(probation.begin(), window, candidate);
+            return;
+        }
+
+        // The main segment is full: the candidate replaces the probation entry that would
+        // be evicted next only if its key is accessed more often
+        if (probation.empty() || sketch.frequency(candidate->key) <= sketch.frequency(probation.back().key))
+        {
+            remove(candidate);
+            return;
+        }
+
+        remove(std::prev(probation.end()));
+        candidate->segment = Segment::PROBATION;
+        probation.splice(probation.begin(), window, candidate);
+    }
+
+    void RowCache::Shard::remove(EntryList::iterator entry)
+    {
+        index.erase(entry->key);
+        list_for(entry->segment).erase(entry);
+    }
+
+    // RowCache implementation
+
+    RowCache::RowCache(size_t capacity_entries, size_t num_shards)
+        : total_capacity(0)
+    {
+        for (size_t i = 0; i < std::max<size_t>(num_shards, 1); ++i)
+        {
+            shards.push_back(std::make_unique<Shard>());
+        }
+        set_capacity(capacity_entries);
+    }
+
+    RowCache::Shard &RowCache::shard_for(int64_t key) const
+    {
+        return *shards[mix(static_cast<uint64_t>(key)) % shards.size()];
+    }
+
+    uint64_t RowCache::ticket(int64_t key) const
+    {
+        if (total_capacity.load(std::memory_order_relaxed) == 0)
+        {
+            return 0;
+        }
+        return shard_for(key).generation.load(std::memory_order_acquire);
+    }
+
+    std::optional<RowCache::Value> RowCache::lookup(int64_t key)
+    {
+        if (total_capacity.load(std::memory_order_relaxed) == 0)
+        {
+            return std::nullopt;
+        }
+
+        Shard &shard = shard_for(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.sketch.increment(key);
+
+        auto it = shard.index.find(key);
+        if (it == shard.index.end())
+        {
+            shard.misses++;
+            return std::nullopt;
+        }
+
+        shard.hits++;
+        shard.touch(it->second);
+        return it->second->value;
+    }
+
+    void RowCache::insert(int64_t key, Value value, uint64_t ticket)
+    {
+        if (total_capacity.load(std::memory_order_relaxed) == 0)
+        {
+            return;
+        }
+
+        Shard &shard = shard_for(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (shard.window_capacity == 0 || shard.generation.load() != ticket)
+        {
+            return;
+        }
+
+        auto it = shard.index.find(key);
+        if (it != shard.index.end())
+        {
+            it->second->value = value;
+            return;
+        }
+
+        shard.window.push_front(Entry{key, value, Segment::WINDOW});
+        shard.index[key] = shard.window.begin();
+        if (shard.window.size() > shard.window_capacity)
+        {
+            shard.admit_from_window();
+        }
+    }
+
+    void RowCache::erase(int64_t key)
+    {
+        if (total_capacity.load(std::memory_order_relaxed) == 0)
+        {
+            return;
+        }
+
+        Shard &shard = shard_for(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.generation++;
+
+        auto it = shard.index.find(key);
+        if (it != shard.index.end())
+        {
+            shard.remove(it->second);
+        }
+    }
+
+    void RowCache::clear()
+    {
+        for (auto &shard : shards)
+        {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            shard->generation++;
+            shard->window.clear();
+            shard->probation.clear();
+            shard->protected_entries.clear();
+            shard->index.clear();
+        }
+    }
+
+    void RowCache::set_capacity(size_t capacity_entries)
+    {
+        total_capacity.store(capacity_entries);
+
+        size_t per_shard = (capacity_entries + shards.size() - 1) / shards.size();
+        for (auto &shard : shards)
+        {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            shard->reset(per_shard);
+        }
+    }
+
+    size_t RowCache::capacity() const
+    {
+        return total_capacity.load();
+    }
+
+    size_t RowCache::size() const
+    {
+        size_t total = 0;
+        for (const auto &shard : shards)
+        {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            total += shard->index.size();
+        }
+        return total;
+    }
+
+    size_t RowCache::get_hit_count() const
+    {
+        size_t total = 0;
+        for (const auto &shard : shards)
+        {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            total += shard->hits;
+        }
+        return total;
+    }
+
+    size_t RowCache::get_miss_count() const
+    {
+        size_t total = 0;
+        for (const auto &shard : shards)
+        {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            total += shard->misses;
+        }
+        return total;
+    }
+
+    void RowCache::reset_stats()
+    {
+        for (auto &shard : shards)
+        {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            shard->hits = 0;
+            shard->misses = 0;
+        }
+    }
+
+}
@@ -1,58 +1,104 @@
 #include "../include/run.h"
 #include "../include/constants.h"
+#include "../include/block_codec.h"
 #include <fstream>
 #include <stdexcept>
 #include <algorithm>
 #include <filesystem>
 #include <iostream>
-#include "../include/lsm_adapter.h"
+#include <sstream>
+#include <tuple>
+#include <cstring>
+#include <cstddef>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 namespace fs = std::filesystem;
 
 namespace lsm
 {
 
-    Run::Run(const std::vector<KeyValuePair> &data, int level, size_t run_id, double fpr)
-        : level(level), run_id(run_id), num_pairs(data.size()), bytes(0)
+    namespace
     {
-
-        // Create filename
-        filename = constants::DATA_DIRECTORY + "/" +
-                   constants::RUN_FILENAME_PREFIX +
-                   std::to_string(level) + "_" +
-                   std::to_string(run_id) + ".data";
-
-        // Write data to disk
-        write_to_disk(data);
-
-        // Create metadata (bloom filter and fence pointers)
-        create_metadata(data, fpr);
-    }
-
-    Run::Run(const std::string &filename, int level, size_t run_id)
-        : level(level), run_id(run_id), filename(filename)
-    {
-
-        // Open the file to count pairs and calculate size
-        std::ifstream file(filename, std::ios::binary | std::ios::ate);
-        if (!file)
+        // Last bytes of a run file, after the block index
+        struct RunFileFooter
         {
-            throw std::runtime_error("Failed to open run file: " + filename);
+            uint64_t index_offset;
+            uint64_t num_pairs;
+            uint64_t num_blocks;
+            uint32_t version;
+            uint32_t index_checksum;
+            uint64_t magic;
+        };
+        static_assert(sizeof(RunFileFooter) % sizeof(uint64_t) == 0, "footer must be whole words");
+
+        // Offset and size of every metadata section of a run file, just before the footer
+        struct RunFileSectionTable
+        {
+            uint64_t bloom_offset;
+            uint64_t bloom_bytes;
+            uint64_t fence_offset;
+            uint64_t fence_bytes;
+            uint64_t range_filter_offset;
+            uint64_t range_filter_bytes;
+            uint64_t range_tombstones_offset;
+            uint64_t range_tombstones_bytes;
+            uint64_t keys_offset;
+            uint64_t keys_bytes;
+            uint64_t checksum;
+        };
+        static_assert(sizeof(RunFileSectionTable) % sizeof(uint64_t) == 0, "table must be whole words");
+
+        // Footer version of a run of Traits. Runs of other record layouts carry the layout
+        // above the version byte, so they fail as an unsupported version elsewhere.
+        template <typename Traits>
+        constexpr uint32_t run_file_version()
+        {
+            return constants::RUN_FILE_VERSION | Traits::LAYOUT_ID << 8;
         }
 
-        // Get file size
-        bytes = file.tellg();
+        // Checksum of a section table's entries
+        uint64_t section_table_checksum(const RunFileSectionTable &table)
+        {
+            return BlockCodec::checksum(reinterpret_cast<const uint64_t *>(&table),
+                                        offsetof(RunFileSectionTable, checksum) / sizeof(uint64_t));
+        }
 
-        // Calculate number of pairs (each pair is 2 int64_t values)
-        num_pairs = bytes / (sizeof(int64_t) * 2);
+        // Make the creation or renaming of files in a directory durable
+        void sync_directory(const std::string &directory)
+        {
+            int fd = ::open(directory.empty() ? "." : directory.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0)
+            {
+                throw std::runtime_error("Failed to open directory " + directory + ": " + std::strerror(errno));
+            }
+            int synced = ::fsync(fd);
+            int error = errno;
+            ::close(fd);
+            if (synced != 0)
+            {
+                throw std::runtime_error("Failed to sync directory " + directory + ": " + std::strerror(error));
+            }
+        }
 
-        // Validate file size - must be a multiple of the pair size
-        if (bytes % (sizeof(int64_t) * 2) != 0)
+        // Create the directory of a file, returning the filename for use in an initializer
+        const std::string &with_parent_directory(const std::string &filename)
         {
-            throw std::runtime_error("Invalid run file size for " + filename +
-                                     ". Size: " + std::to_string(bytes) +
-                                     " is not a multiple of " + std::to_string(sizeof(int64_t) * 2));
+            fs::create_directories(fs::path(filename).parent_path());
+            return filename;
         }
+    }
+
+    template <typename Traits>
+    BasicRun<Traits>::BasicRun(const std::string &filename, int level, size_t run_id, IoCounters *io)
+        : level(level), run_id(run_id), filename(filename), io(io)
+    {
+
+        // The footer records the number of pairs and where each block starts
+        num_pairs = load_block_index();
+        bytes = num_pairs * Traits::RECORD_BYTES;
 
         // Verify the file contains at least one key-value pair
         if (num_pairs == 0)
@@ -62,17 +108,63 @@ namespace lsm
 
         // Load metadata
         load_metadata();
+        set_bounds();
+    }
+
+    template <typename Traits>
+    BasicRun<Traits>::BasicRun(const std::string &filename, int level, size_t run_id, size_t num_pairs,
+                               std::unique_ptr<BloomFilter> bloom_filter, std::unique_ptr<FencePointers> fence_pointers,
+                               std::unique_ptr<RangeFilter> range_filter, RangeTombstoneSet range_tombstones,
+                               IoCounters *io)
+        : level(level), run_id(run_id), filename(filename), num_pairs(num_pairs),
+          bytes(num_pairs * Traits::RECORD_BYTES), bloom_filter(std::move(bloom_filter)),
+          fence_pointers(std::move(fence_pointers)), range_filter(std::move(range_filter)),
+          range_tombstones(std::move(range_tombstones)), io(io)
+    {
+        size_t pairs_on_disk = load_block_index();
+        if (pairs_on_disk != num_pairs)
+        {
+            throw std::runtime_error("Run file " + filename + " holds " + std::to_string(pairs_on_disk) +
+                                     " pairs, expected " + std::to_string(num_pairs));
+        }
+        set_bounds();
+    }
+
+    template <typename Traits>
+    BasicRun<Traits>::BasicRun(const std::string &filename, const ManifestRun &record, IoCounters *io)
+        : level(record.level), run_id(record.run_id), filename(filename), num_pairs(record.num_pairs),
+          bytes(record.num_pairs * Traits::RECORD_BYTES), file_bytes(record.file_bytes),
+          min_bound(record.min_key), max_bound(record.max_key), recorded_fpr(record.bloom_fpr),
+          metadata_loaded(false), io(io)
+    {
+    }
+
+    template <typename Traits>
+    std::string BasicRun<Traits>::make_filename(const std::string &directory, int level, size_t run_id)
+    {
+        return directory + "/" +
+               constants::RUN_FILENAME_PREFIX +
+               std::to_string(level) + "_" +
+               std::to_string(run_id) + ".data";
     }
 
-    std::optional<int64_t> Run::get(int64_t key) const
+    template <typename Traits>
+    std::optional<typename BasicRun<Traits>::Pair> BasicRun<Traits>::get(key_type key) const
     {
+        if (!in_bounds(key))
+        {
+            return std::nullopt;
+        }
+        ensure_metadata();
+
         // If bloom filter is available, check it first
-        if (bloom_filter && !bloom_filter->might_contain(key))
+        auto filter = get_bloom_filter();
+        if (filter && !filter->might_contain_hash(Traits::hash(key)))
         {
             return std::nullopt;
         }
 
-        // Use fence pointers to find the approximate position
+        // Use fence pointers to find the page the key would be on
         size_t start_pos = 0;
         if (fence_pointers)
         {
@@ -80,29 +172,30 @@ namespace lsm
             start_pos = pos;
         }
 
-        // Binary search within the block to find the exact position
-        std::ifstream file(get_data_filename(), std::ios::binary);
-        if (!file)
+        // With fence pointers the first page decides; without them, scan forward page by page
+        for (size_t page = start_pos / constants::PAGE_SIZE; page < page_count(); ++page)
         {
-            throw std::runtime_error("Failed to open run file: " + get_data_filename());
-        }
-
-        // Track disk read I/O
-        LSMAdapter::get_instance().increment_read_io();
+            auto block = read_page(page);
+            size_t pairs = block->size();
+            if (pairs == 0)
+            {
+                break;
+            }
 
-        // Set file position to the estimated start based on fence pointers
-        file.seekg(start_pos);
+            // Binary search the sorted keys within the page
+            size_t left = lower_bound_in_page(*block, key);
 
-        // Read pairs until we find the key or reach the end
-        int64_t file_key, value;
-        while (file.read(reinterpret_cast<char *>(&file_key), sizeof(file_key)) &&
-               file.read(reinterpret_cast<char *>(&value), sizeof(value)))
-        {
-            if (file_key == key)
+            if (left < pairs)
             {
-                return value;
+                if (page_key(*block, left) == key)
+                {
+                    return page_pair(*block, left);
+                }
+                break;
             }
-            if (file_key > key)
+
+            // Fence pointers guarantee the key cannot be on a later page
+            if (fence_pointers)
             {
                 break;
             }
@@ -111,364 +204,861 @@ namespace lsm
         return std::nullopt;
     }
 
-    std::vector<KeyValuePair> Run::range(int64_t start_key, int64_t end_key) const
+    template <typename Traits>
+    std::vector<std::pair<size_t, typename BasicRun<Traits>::Pair>> BasicRun<Traits>::multi_get(
+        const std::vector<key_type> &keys) const
     {
-        if (start_key >= end_key)
+        std::vector<std::pair<size_t, Pair>> found;
+        if (keys.empty() || keys.back() < min_bound || keys.front() > max_bound)
         {
-            return {};
+            return found;
         }
+        ensure_metadata();
 
-        std::vector<KeyValuePair> results;
-
-        // Use fence pointers to find the range to scan
-        std::pair<size_t, size_t> offsets;
-        if (fence_pointers)
+        // Probe the bloom filter for the whole batch first
+        auto filter = get_bloom_filter();
+        std::vector<size_t> candidates;
+        candidates.reserve(keys.size());
+        for (size_t i = 0; i < keys.size(); ++i)
         {
-            offsets = fence_pointers->find_range_offsets(start_key, end_key);
-        }
-        else
-        {
-            offsets = std::pair<size_t, size_t>(0, std::numeric_limits<size_t>::max());
+            if (!filter || filter->might_contain_hash(Traits::hash(keys[i])))
+            {
+                candidates.push_back(i);
+            }
         }
 
-        // Open the file
-        std::ifstream file(get_data_filename(), std::ios::binary);
-        if (!file)
+        // Without fence pointers there is no page to share, so look keys up one by one
+        if (!fence_pointers)
         {
-            throw std::runtime_error("Failed to open run file: " + get_data_filename());
+            for (size_t i : candidates)
+            {
+                auto entry = get(keys[i]);
+                if (entry.has_value())
+                {
+                    found.emplace_back(i, *entry);
+                }
+            }
+            return found;
         }
 
-        // Track disk read I/O
-        LSMAdapter::get_instance().increment_read_io();
-
-        // Seek to the start offset
-        file.seekg(offsets.first);
-
-        // Read pairs until we find the range or reach the end
-        int64_t file_key, value;
-        while (file.read(reinterpret_cast<char *>(&file_key), sizeof(file_key)) &&
-               file.read(reinterpret_cast<char *>(&value), sizeof(value)))
+        // Sorted keys map to non-decreasing pages, so each page is read once
+        BlockCache::BlockHandle block;
+        size_t block_page = 0;
+        size_t pages = page_count();
+        for (size_t i : candidates)
         {
-
-            // Check if we've passed the end offset
-            if (static_cast<size_t>(file.tellg()) > offsets.second && offsets.second != std::numeric_limits<size_t>::max())
+            size_t page = fence_pointers->find_offset(keys[i]) / constants::PAGE_SIZE;
+            if (page >= pages)
             {
-                break;
+                continue;
             }
 
-            // Check if key is in range
-            if (file_key >= start_key && file_key < end_key)
+            if (!block || page != block_page)
             {
-                results.emplace_back(file_key, value);
+                block = read_page(page);
+                block_page = page;
             }
 
-            // If we've passed the end key, we can stop
-            if (file_key >= end_key)
+            size_t position = lower_bound_in_page(*block, keys[i]);
+            if (position < block->size() && page_key(*block, position) == keys[i])
             {
-                break;
+                found.emplace_back(i, page_pair(*block, position));
             }
         }
 
-        return results;
+        return found;
     }
 
-    size_t Run::size() const
+    template <typename Traits>
+    const RangeTombstoneSet &BasicRun<Traits>::get_range_tombstones() const
     {
-        return num_pairs;
+        ensure_metadata();
+        return range_tombstones;
     }
 
-    size_t Run::size_bytes() const
+    template <typename Traits>
+    bool BasicRun<Traits>::range_deleted(key_type key) const
     {
-        return bytes;
+        if (!in_bounds(key))
+        {
+            return false;
+        }
+        ensure_metadata();
+        return !range_tombstones.empty() && range_tombstones.covers(key);
     }
 
-    int Run::get_level() const
+    template <typename Traits>
+    std::vector<typename BasicRun<Traits>::Pair> BasicRun<Traits>::range(key_type start_key, key_type end_key) const
     {
-        return level;
+        std::vector<Pair> results;
+        for (BasicRunRangeIterator<Traits> it(*this, start_key, end_key); it.valid(); it.next())
+        {
+            results.push_back(it.current());
+        }
+        return results;
     }
 
-    size_t Run::get_run_id() const
+    template <typename Traits>
+    bool BasicRun<Traits>::may_overlap(key_type start_key, key_type end_key) const
     {
-        return run_id;
+        if (start_key >= end_key || end_key <= min_bound || start_key > max_bound)
+        {
+            return false;
+        }
+        ensure_metadata();
+
+        // Tombstones delete keys of older runs, so they matter even where the run has no keys
+        if (range_tombstones.overlaps(start_key, end_key))
+        {
+            return true;
+        }
+        return !range_filter || range_filter->may_overlap(start_key, end_key);
     }
 
-    std::string Run::get_filename() const
+    template <typename Traits>
+    int BasicRun<Traits>::get_data_fd() const
     {
-        return filename;
+        std::call_once(data_fd_once, [this]
+                       {
+            data_fd = ::open(get_data_filename().c_str(), O_RDONLY | O_CLOEXEC);
+            if (data_fd < 0)
+            {
+                throw std::runtime_error("Failed to open run file: " + get_data_filename() +
+                                         ": " + std::strerror(errno));
+            } });
+        return data_fd;
     }
 
-    size_t Run::get_bloom_filter_bits_per_element() const
+    template <typename Traits>
+    BlockCache::BlockHandle BasicRun<Traits>::read_page(size_t page) const
     {
-        if (bloom_filter)
+        BlockCache &cache = BlockCache::get_instance();
+        if (auto block = cache.lookup(cache_id, page))
         {
-            return bloom_filter->bit_count() / num_pairs;
+            return block;
         }
-        return 0;
-    }
-
-    void Run::rebuild_bloom_filter(double new_fpr)
-    {
-        // Read all data to rebuild the bloom filter
-        auto all_pairs = get_all_pairs();
 
-        // Create a new bloom filter
-        bloom_filter = std::make_unique<BloomFilter>(new_fpr, all_pairs.size());
+        auto block = std::make_shared<BlockCache::Block>();
 
-        // Insert all keys
-        for (const auto &pair : all_pairs)
+        // Track disk read I/O
+        if (io)
         {
-            bloom_filter->insert(pair.key);
+            io->reads.add();
         }
 
-        // Save the bloom filter
-        bloom_filter->save(get_bloom_filter_filename());
-    }
+        if (block_offsets.empty())
+        {
+            // Raw pairs: a page is PAGE_SIZE bytes of the file
+            size_t offset = page * constants::PAGE_SIZE;
+            size_t length = offset < bytes ? std::min(constants::PAGE_SIZE, bytes - offset) : 0;
+            block->words.resize(length / sizeof(int64_t));
+            read_at(offset, length, block->words.data());
+            block->types.assign(block->words.size() / Traits::RECORD_WORDS, EntryType::VALUE);
+        }
+        else if (page < page_count())
+        {
+            size_t offset = block_offsets[page];
+            size_t length = block_offsets[page + 1] - offset;
+            std::vector<uint64_t> words(length / sizeof(uint64_t));
+            read_at(offset, length, words.data());
 
-    void Run::save() const
-    {
-        // The data file is already written in the constructor or loaded
+            try
+            {
+                BasicBlockCodec<Traits>::decode(words.data(), words.size(), block->words, block->types);
+            }
+            catch (const std::runtime_error &e)
+            {
+                throw std::runtime_error(std::string(e.what()) + ": page " + std::to_string(page) +
+                                         " of run file: " + get_data_filename());
+            }
+        }
 
-        // Save bloom filter and fence pointers if they exist
-        if (bloom_filter)
+        if (legacy_tombstones)
         {
-            bloom_filter->save(get_bloom_filter_filename());
+            convert_legacy_tombstones(block->words, block->types);
         }
 
-        if (fence_pointers)
+        cache.insert(cache_id, page, block);
+        return block;
+    }
+
+    template <typename Traits>
+    void BasicRun<Traits>::read_at(size_t offset, size_t length, void *dest) const
+    {
+        char *out = static_cast<char *>(dest);
+        size_t done = 0;
+        while (done < length)
         {
-            fence_pointers->save(get_fence_pointers_filename());
+            ssize_t n = ::pread(get_data_fd(), out + done, length - done, offset + done);
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n <= 0)
+            {
+                throw std::runtime_error("Failed to read " + std::to_string(length) + " bytes at offset " +
+                                         std::to_string(offset) + " of run file: " + get_data_filename());
+            }
+            done += static_cast<size_t>(n);
         }
     }
 
-    std::vector<KeyValuePair> Run::get_all_pairs() const
+    template <typename Traits>
+    size_t BasicRun<Traits>::load_block_index()
     {
-        std::vector<KeyValuePair> pairs;
-        pairs.reserve(num_pairs);
-
-        // Open the file
-        std::ifstream file(get_data_filename(), std::ios::binary);
-        if (!file)
+        struct stat info;
+        if (::fstat(get_data_fd(), &info) != 0)
         {
-            throw std::runtime_error("Failed to open run file: " + get_data_filename());
+            throw std::runtime_error("Failed to stat run file: " + get_data_filename() +
+                                     ": " + std::strerror(errno));
         }
+        file_bytes = static_cast<size_t>(info.st_size);
+        block_offsets.clear();
 
-        // Read all pairs
-        int64_t key, value;
-        size_t count = 0;
-        while (file.read(reinterpret_cast<char *>(&key), sizeof(key)) &&
-               file.read(reinterpret_cast<char *>(&value), sizeof(value)))
+        RunFileFooter footer{};
+        bool has_footer = file_bytes >= sizeof(footer);
+        if (has_footer)
         {
-            pairs.emplace_back(key, value);
-            count++;
+            read_at(file_bytes - sizeof(footer), sizeof(footer), &footer);
+            has_footer = footer.magic == constants::RUN_FILE_MAGIC;
+        }
 
-            // Safety check to avoid reading past the expected number of pairs
-            if (count >= num_pairs)
+        // Files older than the current version only ever held int64_t keys and values
+        constexpr bool legacy_formats = Traits::LAYOUT_ID == 0;
+        if (!has_footer && legacy_formats)
+        {
+            // Raw pairs, as written before the block format; the size gives the count
+            if (file_bytes % Traits::RECORD_BYTES != 0)
             {
-                break;
+                throw std::runtime_error("Invalid run file size for " + get_data_filename() +
+                                         ". Size: " + std::to_string(file_bytes) +
+                                         " is not a multiple of " + std::to_string(Traits::RECORD_BYTES));
             }
+            legacy_tombstones = true;
+            return file_bytes / Traits::RECORD_BYTES;
         }
-
-        if (count != num_pairs)
+        if (!has_footer)
         {
-            std::cerr << "Warning: Expected " << num_pairs << " pairs but read " << count
-                      << " from file " << get_data_filename() << std::endl;
+            throw std::runtime_error("Missing footer in run file: " + get_data_filename());
         }
 
-        return pairs;
-    }
-
-    KeyValuePair Run::read_pair_at(std::ifstream &file, size_t offset) const
-    {
-        // Seek to the offset
-        file.seekg(offset);
-
-        // Read the key and value
-        int64_t key, value;
-        if (file.read(reinterpret_cast<char *>(&key), sizeof(key)) &&
-            file.read(reinterpret_cast<char *>(&value), sizeof(value)))
+        legacy_tombstones = legacy_formats && footer.version == constants::RUN_FILE_LEGACY_TOMBSTONE_VERSION;
+        has_sections = footer.version == run_file_version<Traits>();
+        bool has_sidecars = legacy_formats && footer.version == constants::RUN_FILE_SIDECAR_VERSION;
+        if (!has_sections && !has_sidecars && !legacy_tombstones)
         {
-            return {key, value};
+            throw std::runtime_error("Unsupported run file version " + std::to_string(footer.version) +
+                                     " in " + get_data_filename());
         }
 
-        throw std::runtime_error("Failed to read pair at offset: " + std::to_string(offset));
-    }
-
-    void Run::write_to_disk(const std::vector<KeyValuePair> &data) const
-    {
-        // Skip if no data to write
-        if (data.empty())
+        // The sections and their table lie between the index and the footer
+        size_t index_bytes = footer.num_blocks * sizeof(uint64_t);
+        size_t index_end = footer.index_offset + index_bytes;
+        size_t trailer_bytes = sizeof(footer) + (has_sections ? sizeof(RunFileSectionTable) : 0);
+        if (file_bytes < trailer_bytes || index_end > file_bytes - trailer_bytes ||
+            (!has_sections && index_end != file_bytes - trailer_bytes) ||
+            footer.num_pairs > footer.num_blocks * constants::RUN_BLOCK_PAIRS)
         {
-            std::cerr << "Warning: Attempting to write empty run to disk: "
-                      << get_data_filename() << std::endl;
-            return;
+            throw std::runtime_error("Corrupt footer in run file: " + get_data_filename());
         }
 
-        // Create parent directories if they don't exist
-        fs::path path(get_data_filename());
-        fs::create_directories(path.parent_path());
-
-        // Open the file
-        std::ofstream file(get_data_filename(), std::ios::binary);
-        if (!file)
+        if (has_sections)
         {
-            throw std::runtime_error("Failed to create run file: " + get_data_filename());
-        }
+            RunFileSectionTable table{};
+            size_t table_offset = file_bytes - trailer_bytes;
+            read_at(table_offset, sizeof(table), &table);
+            if (table.checksum != section_table_checksum(table))
+            {
+                throw std::runtime_error("Corrupt section table in run file: " + get_data_filename());
+            }
 
-        // Track disk write I/O
-        LSMAdapter::get_instance().increment_write_io();
+            bloom_section = Section{table.bloom_offset, table.bloom_bytes};
+            fence_section = Section{table.fence_offset, table.fence_bytes};
+            range_filter_section = Section{table.range_filter_offset, table.range_filter_bytes};
+            range_tombstones_section = Section{table.range_tombstones_offset, table.range_tombstones_bytes};
+            keys_section = Section{table.keys_offset, table.keys_bytes};
+            for (const Section &section :
+                 {bloom_section, fence_section, range_filter_section, range_tombstones_section, keys_section})
+            {
+                if (section.bytes > 0 &&
+                    (section.offset < index_end || section.bytes > table_offset - section.offset))
+                {
+                    throw std::runtime_error("Corrupt section table in run file: " + get_data_filename());
+                }
+            }
+            if (keys_section.bytes % sizeof(uint64_t) != 0)
+            {
+                throw std::runtime_error("Corrupt section table in run file: " + get_data_filename());
+            }
+        }
 
-        // Write all pairs
-        for (const auto &pair : data)
+        block_offsets.resize(footer.num_blocks);
+        read_at(footer.index_offset, index_bytes, block_offsets.data());
+        if (BlockCodec::checksum(block_offsets.data(), block_offsets.size()) != footer.index_checksum)
         {
-            file.write(reinterpret_cast<const char *>(&pair.key), sizeof(pair.key));
-            file.write(reinterpret_cast<const char *>(&pair.value), sizeof(pair.value));
+            throw std::runtime_error("Corrupt block index in run file: " + get_data_filename());
         }
+        block_offsets.push_back(footer.index_offset);
 
-        if (!file)
+        // Blocks are whole words, in order, and start at the beginning of the file
+        for (size_t i = 0; i < block_offsets.size(); ++i)
         {
-            throw std::runtime_error("Failed to write data to run file: " + get_data_filename());
+            uint64_t previous = i == 0 ? 0 : block_offsets[i - 1];
+            if (block_offsets[i] < previous || block_offsets[i] % sizeof(uint64_t) != 0 ||
+                (i == 0 && block_offsets[i] != 0))
+            {
+                throw std::runtime_error("Corrupt block index in run file: " + get_data_filename());
+            }
         }
 
-        // Ensure all data is flushed to disk
-        file.flush();
+        return footer.num_pairs;
     }
 
-    void Run::create_metadata(const std::vector<KeyValuePair> &data, double fpr)
+    template <typename Traits>
+    void BasicRun<Traits>::ensure_metadata() const
     {
-        // Create bloom filter
-        bloom_filter = std::make_unique<BloomFilter>(fpr, data.size());
-
-        // Insert all keys into the bloom filter
-        for (const auto &pair : data)
+        if (metadata_loaded.load(std::memory_order_acquire))
         {
-            bloom_filter->insert(pair.key);
+            return;
         }
 
-        // Create fence pointers
-        std::vector<std::pair<int64_t, size_t>> key_offsets;
-        key_offsets.reserve(data.size());
+        // Readers wait for the first one to load; a failed load is retried by the next reader.
+        // The run is only ever created non-const, so the members can be filled in here.
+        std::call_once(metadata_once, [this]()
+                       {
+                           BasicRun &self = const_cast<BasicRun &>(*this);
+                           size_t pairs_on_disk = self.load_block_index();
+                           if (pairs_on_disk != num_pairs)
+                           {
+                               throw std::runtime_error("Run file " + filename + " holds " +
+                                                        std::to_string(pairs_on_disk) + " pairs, the manifest " +
+                                                        std::to_string(num_pairs));
+                           }
+                           self.load_metadata();
+                           metadata_loaded.store(true, std::memory_order_release);
+                       });
+    }
+
+    template <typename Traits>
+    bool BasicRun<Traits>::in_bounds(int64_t key) const
+    {
+        return key >= min_bound && key <= max_bound;
+    }
+
+    template <typename Traits>
+    void BasicRun<Traits>::set_bounds()
+    {
+        // Without a range filter the keys of the run are unknown
+        min_bound = range_filter ? range_filter->get_min_key() : DefaultTraits::min_key();
+        max_bound = range_filter ? range_filter->get_max_key() : DefaultTraits::max_key();
 
-        size_t offset = 0;
-        for (const auto &pair : data)
+        const auto &tombstones = range_tombstones.get_tombstones();
+        if (!tombstones.empty())
         {
-            key_offsets.emplace_back(pair.key, offset);
-            offset += sizeof(int64_t) * 2;
+            min_bound = std::min(min_bound, tombstones.front().start_key);
+            max_bound = std::max(max_bound, tombstones.back().end_key - 1);
         }
+    }
 
-        fence_pointers = std::make_unique<FencePointers>(get_data_filename(), key_offsets);
+    template <typename Traits>
+    int64_t BasicRun<Traits>::page_key(const BlockCache::Block &block, size_t i)
+    {
+        return block.template key<Traits>(i);
+    }
 
-        // Save metadata
-        bloom_filter->save(get_bloom_filter_filename());
-        fence_pointers->save(get_fence_pointers_filename());
+    template <typename Traits>
+    typename BasicRun<Traits>::Pair BasicRun<Traits>::page_pair(const BlockCache::Block &block, size_t i)
+    {
+        return block.template pair<Traits>(i);
     }
 
-    void Run::load_metadata()
+    template <typename Traits>
+    size_t BasicRun<Traits>::lower_bound_in_page(const BlockCache::Block &block, int64_t key)
     {
-        // Try to load bloom filter
-        try
-        {
-            bloom_filter = std::make_unique<BloomFilter>(get_bloom_filter_filename());
-        }
-        catch (const std::exception &e)
+        size_t left = 0;
+        size_t right = block.size();
+        while (left < right)
         {
-            std::cerr << "Warning: Failed to load bloom filter: " << e.what() << std::endl;
-            bloom_filter = nullptr;
+            size_t mid = left + (right - left) / 2;
+            if (page_key(block, mid) < key)
+            {
+                left = mid + 1;
+            }
+            else
+            {
+                right = mid;
+            }
         }
+        return left;
+    }
 
-        // Try to load fence pointers
-        try
+    template <typename Traits>
+    void BasicRun<Traits>::convert_legacy_tombstones(const std::vector<int64_t> &words, std::vector<EntryType> &types) const
+    {
+        for (size_t i = 0; i < types.size(); ++i)
         {
-            fence_pointers = std::make_unique<FencePointers>(get_fence_pointers_filename());
+            if (words[i * Traits::RECORD_WORDS + 1] == INT64_MIN)
+            {
+                types[i] = EntryType::DELETION;
+            }
         }
-        catch (const std::exception &e)
+    }
+
+    template <typename Traits>
+    size_t BasicRun<Traits>::page_count() const
+    {
+        if (!block_offsets.empty())
         {
-            std::cerr << "Warning: Failed to load fence pointers: " << e.what() << std::endl;
-            fence_pointers = nullptr;
+            return block_offsets.size() - 1;
         }
+        return (bytes + constants::PAGE_SIZE - 1) / constants::PAGE_SIZE;
     }
 
-    std::string Run::get_data_filename() const
+    template <typename Traits>
+    size_t BasicRun<Traits>::size() const
     {
-        return filename;
+        return num_pairs;
     }
 
-    std::string Run::get_bloom_filter_filename() const
+    template <typename Traits>
+    size_t BasicRun<Traits>::size_bytes() const
     {
-        return get_data_filename() + ".bloom";
+        return bytes;
     }
 
-    std::string Run::get_fence_pointers_filename() const
+    template <typename Traits>
+    size_t BasicRun<Traits>::size_on_disk() const
     {
-        return get_data_filename() + ".fence";
+        return file_bytes;
+    }
+
+    template <typename Traits>
+    int BasicRun<Traits>::get_level() const
+    {
+        return level;
+    }
+
+    template <typename Traits>
+    size_t BasicRun<Traits>::get_run_id() const
+    {
+        return run_id;
     }
 
-    bool Run::has_bloom_filter() const
+    template <typename Traits>
+    std::string BasicRun<Traits>::get_filename() const
     {
-        return bloom_filter != nullptr;
+        return filename;
     }
 
-    bool Run::might_contain(int64_t key) const
+    template <typename Traits>
+    size_t BasicRun<Traits>::get_bloom_filter_bits_per_element() const
     {
-        if (!bloom_filter)
+        ensure_metadata();
+        if (auto filter = get_bloom_filter())
         {
-            return true;
+            return filter->bit_count() / num_pairs;
         }
-        return bloom_filter->might_contain(key);
+        return 0;
     }
 
-    std::vector<KeyValuePair> Run::get_sample_pairs(size_t max_count) const
+    template <typename Traits>
+    double BasicRun<Traits>::get_bloom_filter_fpr() const
     {
-        // If max_count is zero or greater than num_pairs, limit to a smaller number
-        size_t limit = std::min(max_count, num_pairs);
-        if (limit == 0)
+        // Rebuilding stale filters checks every run; that must not read them all
+        if (!metadata_loaded.load(std::memory_order_acquire))
         {
-            return {};
+            return recorded_fpr;
         }
+        auto filter = get_bloom_filter();
+        return filter ? filter->get_fpr() : 1.0;
+    }
 
-        std::vector<KeyValuePair> sample_pairs;
-        sample_pairs.reserve(limit);
+    template <typename Traits>
+    void BasicRun<Traits>::rebuild_bloom_filter(double new_fpr)
+    {
+        ensure_metadata();
+
+        // Keys come from the key section, which is a fraction of the data
+        auto filter = std::make_shared<BloomFilter>(new_fpr, num_pairs);
+        bool from_keys = scan_keys([&filter](const int64_t *keys, size_t count)
+                                      {
+                                          for (size_t i = 0; i < count; ++i)
+                                          {
+                                              filter->insert_hash(Traits::hash(static_cast<key_type>(keys[i])));
+                                          }
+                                      });
+
+        if (!from_keys)
+        {
+            // Start over from the data file
+            filter = std::make_shared<BloomFilter>(new_fpr, num_pairs);
+            for (BasicRunIterator<Traits> it(*this); it.valid(); it.next())
+            {
+                filter->insert_hash(Traits::hash(it.current().key));
+            }
+        }
 
-        // Open the file
-        std::ifstream file(get_data_filename(), std::ios::binary);
-        if (!file)
+        // Replace the saved filter in one rename of a synced file and make the rename
+        // durable, then swap it in; readers holding the old one keep using it
+        std::string temp_filename = get_bloom_filter_filename() + ".tmp";
         {
-            throw std::runtime_error("Failed to open run file: " + get_data_filename());
+            std::ostringstream out;
+            filter->write(out);
+            std::string bytes = out.str();
+            RunFileWriter temp(temp_filename);
+            temp.append(bytes.data(), bytes.size());
+            temp.finish();
         }
+        fs::rename(temp_filename, get_bloom_filter_filename());
+        sync_directory(fs::path(get_bloom_filter_filename()).parent_path().string());
+        std::atomic_store(&bloom_filter, std::shared_ptr<const BloomFilter>(std::move(filter)));
+    }
 
-        // Read the limited number of pairs from the beginning of the file
-        int64_t key, value;
-        size_t count = 0;
-        while (count < limit &&
-               file.read(reinterpret_cast<char *>(&key), sizeof(key)) &&
-               file.read(reinterpret_cast<char *>(&value), sizeof(value)))
+    template <typename Traits>
+    bool BasicRun<Traits>::scan_keys(const std::function<void(const int64_t *, size_t)> &visit) const
+    {
+        if (keys_section.bytes == 0)
         {
-            sample_pairs.emplace_back(key, value);
-            count++;
+            return false;
         }
 
-        return sample_pairs;
+        std::vector<uint64_t> words(constants::MERGE_BUFFER_SIZE / sizeof(uint64_t));
+        std::vector<int64_t> keys;
+        keys.reserve(constants::RUN_BLOCK_PAIRS);
+        size_t section_words = keys_section.bytes / sizeof(uint64_t);
+        size_t words_read = 0;
+        size_t buffered = 0;
+        size_t keys_seen = 0;
+
+        try
+        {
+            while (words_read < section_words)
+            {
+                size_t count = std::min(words.size() - buffered, section_words - words_read);
+                read_at(keys_section.offset + words_read * sizeof(uint64_t), count * sizeof(uint64_t),
+                        words.data() + buffered);
+                words_read += count;
+                buffered += count;
+
+                // Decode every whole block in the buffer
+                size_t position = 0;
+                while (position < buffered)
+                {
+                    size_t block_words = BlockCodec::key_block_words(words[position]);
+                    if (position + block_words > buffered)
+                    {
+                        break;
+                    }
+
+                    BlockCodec::decode_keys(&words[position], block_words, keys);
+                    visit(keys.data(), keys.size());
+                    keys_seen += keys.size();
+                    keys.clear();
+                    position += block_words;
+                }
+
+                // Keep the partial block at the end for the next read
+                std::copy(words.begin() + position, words.begin() + buffered, words.begin());
+                buffered -= position;
+                if (buffered == words.size())
+                {
+                    return false;
+                }
+            }
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Warning: Ignoring key section of " << get_data_filename() << ": " << e.what() << std::endl;
+            return false;
+        }
+
+        return buffered == 0 && keys_seen == num_pairs;
     }
 
-    Run::~Run()
+    template <typename Traits>
+    std::vector<typename BasicRun<Traits>::Pair> BasicRun<Traits>::get_all_pairs() const
     {
+        std::vector<Pair> pairs;
+        pairs.reserve(num_pairs);
+
+        // Read all pairs; the iterator warns if the file ends early
+        for (BasicRunIterator<Traits> it(*this); it.valid(); it.next())
+        {
+            pairs.push_back(it.current());
+        }
+
+        return pairs;
     }
 
-    void Run::delete_files_from_disk()
+    template <typename Traits>
+    void BasicRun<Traits>::load_metadata()
     {
+        if (has_sections)
+        {
+            load_sections();
+            return;
+        }
+
+        // Try to load bloom filter
         try
         {
-            // Delete the main data file
-            if (fs::exists(get_data_filename()))
+            bloom_filter = std::make_unique<BloomFilter>(get_bloom_filter_filename());
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Warning: Failed to load bloom filter: " << e.what() << std::endl;
+            bloom_filter = nullptr;
+        }
+
+        // Try to load fence pointers
+        try
+        {
+            fence_pointers = std::make_unique<FencePointers>(get_fence_pointers_filename());
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Warning: Failed to load fence pointers: " << e.what() << std::endl;
+            fence_pointers = nullptr;
+        }
+
+        // Runs written before range filters have none and are never skipped
+        if (fs::exists(get_range_filter_filename()))
+        {
+            try
             {
-                fs::remove(get_data_filename());
-                std::cout << "Deleted run file: " << get_data_filename() << std::endl;
+                range_filter = std::make_unique<RangeFilter>(get_range_filter_filename());
             }
-
-            // Delete the bloom filter file
-            if (fs::exists(get_bloom_filter_filename()))
+            catch (const std::exception &e)
             {
-                fs::remove(get_bloom_filter_filename());
-                std::cout << "Deleted bloom filter file: " << get_bloom_filter_filename() << std::endl;
+                std::cerr << "Warning: Failed to load range filter: " << e.what() << std::endl;
+                range_filter = nullptr;
+            }
+        }
+
+        // Range tombstones cannot be rebuilt from the data file, so a damaged sidecar fails the load
+        if (fs::exists(get_range_tombstones_filename()))
+        {
+            range_tombstones = RangeTombstoneSet::load(get_range_tombstones_filename());
+        }
+    }
+
+    template <typename Traits>
+    void BasicRun<Traits>::load_sections()
+    {
+        auto mapping = std::make_shared<const MappedFile>(get_data_filename());
+
+        // A rebuilt filter is saved next to the data file and replaces the one written with it
+        if (fs::exists(get_bloom_filter_filename()))
+        {
+            try
+            {
+                bloom_filter = std::make_shared<BloomFilter>(get_bloom_filter_filename());
+            }
+            catch (const std::exception &e)
+            {
+                std::cerr << "Warning: Failed to load rebuilt bloom filter: " << e.what() << std::endl;
+            }
+        }
+        if (!bloom_filter && bloom_section.bytes > 0)
+        {
+            try
+            {
+                bloom_filter = std::make_shared<BloomFilter>(mapping, bloom_section.offset, bloom_section.bytes,
+                                                             get_data_filename());
+            }
+            catch (const std::exception &e)
+            {
+                std::cerr << "Warning: Failed to load bloom filter: " << e.what() << std::endl;
+            }
+        }
+
+        if (fence_section.bytes > 0)
+        {
+            try
+            {
+                fence_pointers = std::make_unique<FencePointers>(mapping, fence_section.offset, fence_section.bytes,
+                                                                 get_data_filename());
+            }
+            catch (const std::exception &e)
+            {
+                std::cerr << "Warning: Failed to load fence pointers: " << e.what() << std::endl;
+                fence_pointers = nullptr;
+            }
+        }
+
+        // The range filter and tombstones are small and parsed into memory
+        if (range_filter_section.bytes > 0)
+        {
+            std::istringstream in(std::string(mapping->data() + range_filter_section.offset,
+                                              range_filter_section.bytes));
+            try
+            {
+                range_filter = std::make_unique<RangeFilter>(in, get_data_filename());
+            }
+            catch (const std::exception &e)
+            {
+                std::cerr << "Warning: Failed to load range filter: " << e.what() << std::endl;
+                range_filter = nullptr;
+            }
+        }
+
+        // Range tombstones cannot be rebuilt from the data, so a damaged section fails the load
+        if (range_tombstones_section.bytes > 0)
+        {
+            std::istringstream in(std::string(mapping->data() + range_tombstones_section.offset,
+                                              range_tombstones_section.bytes));
+            range_tombstones = RangeTombstoneSet::read(in, get_data_filename());
+        }
+    }
+
+    template <typename Traits>
+    std::string BasicRun<Traits>::get_data_filename() const
+    {
+        return filename;
+    }
+
+    template <typename Traits>
+    std::string BasicRun<Traits>::get_bloom_filter_filename() const
+    {
+        return get_data_filename() + ".bloom";
+    }
+
+    template <typename Traits>
+    std::string BasicRun<Traits>::get_fence_pointers_filename() const
+    {
+        return get_data_filename() + ".fence";
+    }
+
+    template <typename Traits>
+    std::string BasicRun<Traits>::get_range_tombstones_filename() const
+    {
+        return get_data_filename() + ".tombstones";
+    }
+
+    template <typename Traits>
+    std::string BasicRun<Traits>::get_range_filter_filename() const
+    {
+        return get_data_filename() + ".range";
+    }
+
+    template <typename Traits>
+    int64_t BasicRun<Traits>::get_min_bound() const
+    {
+        return min_bound;
+    }
+
+    template <typename Traits>
+    int64_t BasicRun<Traits>::get_max_bound() const
+    {
+        return max_bound;
+    }
+
+    template <typename Traits>
+    bool BasicRun<Traits>::has_bloom_filter() const
+    {
+        if (!metadata_loaded.load(std::memory_order_acquire))
+        {
+            return recorded_fpr < 1.0;
+        }
+        return get_bloom_filter() != nullptr;
+    }
+
+    template <typename Traits>
+    bool BasicRun<Traits>::might_contain(key_type key) const
+    {
+        if (!in_bounds(key))
+        {
+            return false;
+        }
+        ensure_metadata();
+
+        auto filter = get_bloom_filter();
+        if (!filter)
+        {
+            return true;
+        }
+        return filter->might_contain_hash(Traits::hash(key));
+    }
+
+    template <typename Traits>
+    std::shared_ptr<const BloomFilter> BasicRun<Traits>::get_bloom_filter() const
+    {
+        return std::atomic_load(&bloom_filter);
+    }
+
+    template <typename Traits>
+    void BasicRun<Traits>::mark_obsolete()
+    {
+        obsolete.store(true);
+    }
+
+    template <typename Traits>
+    bool BasicRun<Traits>::is_obsolete() const
+    {
+        return obsolete.load();
+    }
+
+    template <typename Traits>
+    ManifestRun BasicRun<Traits>::get_manifest_record() const
+    {
+        return ManifestRun{level, run_id, num_pairs, file_bytes, min_bound, max_bound, get_bloom_filter_fpr()};
+    }
+
+    template <typename Traits>
+    std::vector<typename BasicRun<Traits>::Pair> BasicRun<Traits>::get_sample_pairs(size_t max_count) const
+    {
+        // If max_count is zero or greater than num_pairs, limit to a smaller number
+        size_t limit = std::min(max_count, num_pairs);
+        if (limit == 0)
+        {
+            return {};
+        }
+
+        std::vector<Pair> sample_pairs;
+        sample_pairs.reserve(limit);
+
+        // Read the limited number of pairs from the beginning of the file
+        for (BasicRunIterator<Traits> it(*this, constants::PAGE_SIZE); it.valid() && sample_pairs.size() < limit;
+             it.next())
+        {
+            sample_pairs.push_back(it.current());
+        }
+
+        return sample_pairs;
+    }
+
+    template <typename Traits>
+    BasicRun<Traits>::~BasicRun()
+    {
+        if (data_fd >= 0)
+        {
+            ::close(data_fd);
+        }
+
+        // The last version holding a compacted run has let go of it
+        if (obsolete.load())
+        {
+            delete_files_from_disk();
+        }
+    }
+
+    template <typename Traits>
+    void BasicRun<Traits>::delete_files_from_disk()
+    {
+        try
+        {
+            // Delete the main data file
+            if (fs::exists(get_data_filename()))
+            {
+                fs::remove(get_data_filename());
+                std::cout << "Deleted run file: " << get_data_filename() << std::endl;
+            }
+
+            // Delete the bloom filter file
+            if (fs::exists(get_bloom_filter_filename()))
+            {
+                fs::remove(get_bloom_filter_filename());
+                std::cout << "Deleted bloom filter file: " << get_bloom_filter_filename() << std::endl;
             }
 
             // Delete the fence pointers file
@@ -477,6 +1067,18 @@ namespace lsm
                 fs::remove(get_fence_pointers_filename());
                 std::cout << "Deleted fence pointers file: " << get_fence_pointers_filename() << std::endl;
             }
+
+            // Delete the range tombstones
+            if (fs::exists(get_range_tombstones_filename()))
+            {
+                fs::remove(get_range_tombstones_filename());
+            }
+
+            // Delete the range filter
+            if (fs::exists(get_range_filter_filename()))
+            {
+                fs::remove(get_range_filter_filename());
+            }
         }
         catch (const std::exception &e)
         {
@@ -484,4 +1086,498 @@ namespace lsm
         }
     }
 
-}
\ No newline at end of file
+    // RunIterator implementation
+
+    template <typename Traits>
+    BasicRunIterator<Traits>::BasicRunIterator(const BasicRun<Traits> &run, size_t buffer_bytes)
+        : run(run),
+          filename(run.get_filename()),
+          buffer(std::max<size_t>(buffer_bytes / sizeof(int64_t) / Traits::RECORD_WORDS, 1) * Traits::RECORD_WORDS),
+          buffered_pairs(0),
+          position(0),
+          remaining_pairs(run.size()),
+          blocks_per_refill(std::max<size_t>(buffer_bytes / constants::PAGE_SIZE, 1)),
+          next_block(0),
+          current_pair(key_type{}, typename Traits::value_type{}),
+          has_current(false)
+    {
+        run.ensure_metadata();
+        file.open(filename, std::ios::binary);
+        if (!file)
+        {
+            throw std::runtime_error("Failed to open run file: " + filename);
+        }
+
+        next();
+    }
+
+    template <typename Traits>
+    bool BasicRunIterator<Traits>::valid() const
+    {
+        return has_current;
+    }
+
+    template <typename Traits>
+    const typename BasicRunIterator<Traits>::Pair &BasicRunIterator<Traits>::current() const
+    {
+        if (!has_current)
+        {
+            throw std::out_of_range("RunIterator is exhausted: " + filename);
+        }
+        return current_pair;
+    }
+
+    template <typename Traits>
+    void BasicRunIterator<Traits>::next()
+    {
+        if (position == buffered_pairs)
+        {
+            refill();
+        }
+
+        if (position == buffered_pairs)
+        {
+            has_current = false;
+            return;
+        }
+
+        const int64_t *record = &buffer[position * Traits::RECORD_WORDS];
+        current_pair = Pair(Traits::key_traits::from_words(record), Traits::value_traits::from_words(record + 1),
+                            types[position]);
+        position++;
+        has_current = true;
+    }
+
+    template <typename Traits>
+    void BasicRunIterator<Traits>::seek(key_type key)
+    {
+        if (!has_current || current_pair.key >= key)
+        {
+            return;
+        }
+
+        // A key past the buffered pairs starts on its fence pointer page or the next
+        // unread block, whichever comes later; the blocks in between are never read
+        if (!run.block_offsets.empty() && run.fence_pointers &&
+            buffer[(buffered_pairs - 1) * Traits::RECORD_WORDS] < key)
+        {
+            size_t block = std::max(next_block, run.fence_pointers->find_offset(key) / constants::PAGE_SIZE);
+            if (block < run.page_count())
+            {
+                // Every block but the last is full
+                next_block = block;
+                remaining_pairs = run.size() - std::min(run.size(), block * constants::RUN_BLOCK_PAIRS);
+                file.clear();
+                file.seekg(static_cast<std::streamoff>(run.block_offsets[block]));
+            }
+            else
+            {
+                next_block = run.page_count();
+                remaining_pairs = 0;
+            }
+            position = buffered_pairs = 0;
+            next();
+        }
+
+        while (has_current && current_pair.key < key)
+        {
+            next();
+        }
+    }
+
+    template <typename Traits>
+    const RangeTombstoneSet *BasicRunIterator<Traits>::range_tombstones() const
+    {
+        return &run.range_tombstones;
+    }
+
+    template <typename Traits>
+    void BasicRunIterator<Traits>::refill()
+    {
+        position = 0;
+        buffered_pairs = 0;
+
+        if (!run.block_offsets.empty())
+        {
+            refill_blocks();
+            return;
+        }
+
+        size_t pairs = std::min(buffer.size() / Traits::RECORD_WORDS, remaining_pairs);
+        if (pairs == 0)
+        {
+            return;
+        }
+
+        file.read(reinterpret_cast<char *>(buffer.data()), pairs * Traits::RECORD_BYTES);
+        buffered_pairs = static_cast<size_t>(file.gcount()) / Traits::RECORD_BYTES;
+        remaining_pairs -= pairs;
+
+        // Files of raw pairs always mark deletions with INT64_MIN
+        types.assign(buffered_pairs, EntryType::VALUE);
+        run.convert_legacy_tombstones(buffer, types);
+
+        if (buffered_pairs != pairs)
+        {
+            std::cerr << "Warning: Expected " << pairs << " more pairs but read " << buffered_pairs
+                      << " from file " << filename << std::endl;
+            remaining_pairs = 0;
+        }
+    }
+
+    template <typename Traits>
+    void BasicRunIterator<Traits>::refill_blocks()
+    {
+        size_t blocks = run.page_count();
+        if (remaining_pairs == 0 || next_block >= blocks)
+        {
+            return;
+        }
+
+        // Blocks are stored back to back, so a run of them is read in one go
+        size_t last = std::min(blocks, next_block + blocks_per_refill);
+        uint64_t begin = run.block_offsets[next_block];
+        uint64_t end = run.block_offsets[last];
+        encoded.resize((end - begin) / sizeof(uint64_t));
+
+        file.read(reinterpret_cast<char *>(encoded.data()), end - begin);
+        if (static_cast<uint64_t>(file.gcount()) != end - begin)
+        {
+            std::cerr << "Warning: Expected " << remaining_pairs << " more pairs but the file ended"
+                      << " in " << filename << std::endl;
+            remaining_pairs = 0;
+            return;
+        }
+
+        buffer.clear();
+        types.clear();
+        for (size_t block = next_block; block < last; ++block)
+        {
+            size_t offset = (run.block_offsets[block] - begin) / sizeof(uint64_t);
+            size_t words = (run.block_offsets[block + 1] - run.block_offsets[block]) / sizeof(uint64_t);
+            BasicBlockCodec<Traits>::decode(encoded.data() + offset, words, buffer, types);
+        }
+        next_block = last;
+
+        if (run.legacy_tombstones)
+        {
+            run.convert_legacy_tombstones(buffer, types);
+        }
+
+        buffered_pairs = std::min(buffer.size() / Traits::RECORD_WORDS, remaining_pairs);
+        remaining_pairs -= buffered_pairs;
+    }
+
+    // RunRangeIterator implementation
+
+    template <typename Traits>
+    BasicRunRangeIterator<Traits>::BasicRunRangeIterator(const BasicRun<Traits> &run, key_type start_key,
+                                                         key_type end_key)
+        : run(run), end_key(end_key), page(0), position(0), current_pair(key_type{}, typename Traits::value_type{}),
+          has_current(false)
+    {
+        if (start_key >= end_key)
+        {
+            return;
+        }
+        run.ensure_metadata();
+
+        // Use fence pointers to find the first page to scan
+        if (run.fence_pointers)
+        {
+            page = run.fence_pointers->find_range_offsets(start_key, end_key).first / constants::PAGE_SIZE;
+        }
+
+        if (page < run.page_count())
+        {
+            block = run.read_page(page);
+            position = BasicRun<Traits>::lower_bound_in_page(*block, start_key);
+        }
+
+        load();
+    }
+
+    template <typename Traits>
+    bool BasicRunRangeIterator<Traits>::valid() const
+    {
+        return has_current;
+    }
+
+    template <typename Traits>
+    const typename BasicRunRangeIterator<Traits>::Pair &BasicRunRangeIterator<Traits>::current() const
+    {
+        if (!has_current)
+        {
+            throw std::out_of_range("RunRangeIterator is exhausted: " + run.get_filename());
+        }
+        return current_pair;
+    }
+
+    template <typename Traits>
+    void BasicRunRangeIterator<Traits>::next()
+    {
+        if (has_current)
+        {
+            position++;
+            load();
+        }
+    }
+
+    template <typename Traits>
+    void BasicRunRangeIterator<Traits>::seek(key_type key)
+    {
+        if (!has_current || current_pair.key >= key)
+        {
+            return;
+        }
+
+        // The key's fence pointer page is the first that can hold it
+        if (run.fence_pointers)
+        {
+            size_t target = run.fence_pointers->find_offset(key) / constants::PAGE_SIZE;
+            if (target > page && target < run.page_count())
+            {
+                page = target;
+                block = run.read_page(page);
+            }
+        }
+        position = BasicRun<Traits>::lower_bound_in_page(*block, key);
+        load();
+    }
+
+    template <typename Traits>
+    const RangeTombstoneSet *BasicRunRangeIterator<Traits>::range_tombstones() const
+    {
+        return &run.range_tombstones;
+    }
+
+    template <typename Traits>
+    void BasicRunRangeIterator<Traits>::load()
+    {
+        has_current = false;
+        if (!block)
+        {
+            return;
+        }
+
+        // Move on to the next page once this one is used up
+        while (position >= block->size())
+        {
+            if (++page >= run.page_count())
+            {
+                block.reset();
+                return;
+            }
+            block = run.read_page(page);
+            position = 0;
+        }
+
+        if (BasicRun<Traits>::page_key(*block, position) >= end_key)
+        {
+            block.reset();
+            return;
+        }
+
+        current_pair = BasicRun<Traits>::page_pair(*block, position);
+        has_current = true;
+    }
+
+    // RunBuilder implementation
+
+    template <typename Traits>
+    BasicRunBuilder<Traits>::BasicRunBuilder(const std::string &directory, int level, size_t run_id, double fpr,
+                                             size_t expected_pairs, IoCounters *io, const RunWriteOptions &options,
+                                             size_t buffer_bytes)
+        : level(level),
+          run_id(run_id),
+          filename(BasicRun<Traits>::make_filename(directory, level, run_id)),
+          file(with_parent_directory(filename), options),
+          buffer_capacity_words(std::max<size_t>(buffer_bytes / sizeof(uint64_t), 1)),
+          file_offset(0),
+          num_pairs(0),
+          finished(false),
+          io(io),
+          bloom_filter(std::make_unique<BloomFilter>(fpr, std::max<size_t>(expected_pairs, 1))),
+          range_filter(std::make_unique<RangeFilter>(constants::RANGE_FILTER_PREFIX_BITS.load()))
+    {
+        // Sidecars left behind by an older run of the same name would be taken for this one's
+        std::error_code ec;
+        fs::remove(filename + ".bloom", ec);
+        fs::remove(filename + ".fence", ec);
+        fs::remove(filename + ".tombstones", ec);
+        fs::remove(filename + ".range", ec);
+
+        // Track disk write I/O
+        if (io)
+        {
+            io->writes.add();
+        }
+
+        block.reserve(constants::RUN_BLOCK_PAIRS);
+        buffer.reserve(buffer_capacity_words);
+    }
+
+    template <typename Traits>
+    BasicRunBuilder<Traits>::~BasicRunBuilder()
+    {
+        if (!finished)
+        {
+            std::error_code ec;
+            fs::remove(filename, ec);
+        }
+    }
+
+    template <typename Traits>
+    void BasicRunBuilder<Traits>::add(key_type key, const value_type &value, EntryType type)
+    {
+        // Every block is a fence pointer page
+        if (block.empty())
+        {
+            page_keys.push_back(key);
+        }
+
+        bloom_filter->insert_hash(Traits::hash(key));
+        range_filter->add(key);
+
+        block.emplace_back(key, value, type);
+        num_pairs++;
+
+        if (block.size() == constants::RUN_BLOCK_PAIRS)
+        {
+            seal_block();
+        }
+    }
+
+    template <typename Traits>
+    void BasicRunBuilder<Traits>::add_range_tombstones(const RangeTombstoneSet &tombstones)
+    {
+        range_tombstones.merge(tombstones);
+    }
+
+    template <typename Traits>
+    size_t BasicRunBuilder<Traits>::size() const
+    {
+        return num_pairs;
+    }
+
+    template <typename Traits>
+    std::unique_ptr<BasicRun<Traits>> BasicRunBuilder<Traits>::finish()
+    {
+        // A run holding only tombstones still needs a pair; a deletion under the first
+        // tombstone changes nothing
+        if (num_pairs == 0 && !range_tombstones.empty())
+        {
+            add(static_cast<key_type>(range_tombstones.get_tombstones().front().start_key), value_type{},
+                EntryType::DELETION);
+        }
+
+        if (num_pairs == 0)
+        {
+            // Nothing was written; the destructor removes the empty file
+            return nullptr;
+        }
+
+        // The block index follows the last block
+        seal_block();
+        uint64_t index_offset = file_offset;
+        buffer.insert(buffer.end(), block_offsets.begin(), block_offsets.end());
+        flush();
+
+        // Then the metadata sections, their table and the footer
+        auto fence_pointers = std::make_unique<FencePointers>(page_keys);
+        range_filter->seal();
+
+        RunFileSectionTable table{};
+        std::ostringstream section;
+        bloom_filter->write(section);
+        std::tie(table.bloom_offset, table.bloom_bytes) = append_section(section.str());
+
+        section.str("");
+        fence_pointers->write(section);
+        std::tie(table.fence_offset, table.fence_bytes) = append_section(section.str());
+
+        section.str("");
+        range_filter->write(section);
+        std::tie(table.range_filter_offset, table.range_filter_bytes) = append_section(section.str());
+
+        if (!range_tombstones.empty())
+        {
+            section.str("");
+            range_tombstones.write(section);
+            std::tie(table.range_tombstones_offset, table.range_tombstones_bytes) = append_section(section.str());
+        }
+
+        std::tie(table.keys_offset, table.keys_bytes) =
+            append_section(std::string(reinterpret_cast<const char *>(keys_blocks.data()),
+                                       keys_blocks.size() * sizeof(uint64_t)));
+        keys_blocks = {};
+
+        table.checksum = section_table_checksum(table);
+        file.append(&table, sizeof(table));
+
+        RunFileFooter footer{index_offset, num_pairs, block_offsets.size(), run_file_version<Traits>(),
+                             BlockCodec::checksum(block_offsets.data(), block_offsets.size()),
+                             constants::RUN_FILE_MAGIC};
+        file.append(&footer, sizeof(footer));
+
+        // One sync makes the whole run durable
+        file.finish();
+
+        auto run = std::make_unique<BasicRun<Traits>>(filename, level, run_id, num_pairs, std::move(bloom_filter),
+                                                      std::move(fence_pointers), std::move(range_filter),
+                                                      std::move(range_tombstones), io);
+        finished = true;
+        return run;
+    }
+
+    template <typename Traits>
+    std::pair<uint64_t, uint64_t> BasicRunBuilder<Traits>::append_section(const std::string &bytes)
+    {
+        file.pad_to(constants::RUN_FILE_SECTION_ALIGNMENT);
+        uint64_t offset = file.offset();
+        file.append(bytes.data(), bytes.size());
+        return {offset, bytes.size()};
+    }
+
+    template <typename Traits>
+    void BasicRunBuilder<Traits>::seal_block()
+    {
+        if (block.empty())
+        {
+            return;
+        }
+
+        block_offsets.push_back(file_offset);
+        size_t words = buffer.size();
+        BasicBlockCodec<Traits>::encode(block.data(), block.size(), buffer);
+        BasicBlockCodec<Traits>::encode_keys(block.data(), block.size(), keys_blocks);
+        file_offset += (buffer.size() - words) * sizeof(uint64_t);
+        block.clear();
+
+        if (buffer.size() >= buffer_capacity_words)
+        {
+            flush();
+        }
+    }
+
+    template <typename Traits>
+    void BasicRunBuilder<Traits>::flush()
+    {
+        if (!buffer.empty())
+        {
+            file.append(buffer.data(), buffer.size() * sizeof(uint64_t));
+            buffer.clear();
+        }
+    }
+
+    template class BasicRun<DefaultTraits>;
+    template class BasicRunIterator<DefaultTraits>;
+    template class BasicRunRangeIterator<DefaultTraits>;
+    template class BasicRunBuilder<DefaultTraits>;
+
+    template class BasicRun<CompactKeyTraits>;
+    template class BasicRunIterator<CompactKeyTraits>;
+    template class BasicRunRangeIterator<CompactKeyTraits>;
+    template class BasicRunBuilder<CompactKeyTraits>;
+
+}
@@ -0,0 +1,154 @@
+#include "../include/run_file_writer.h"
+#include "../include/constants.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace lsm
+{
+
+    RunFileWriter::RunFileWriter(const std::string &filename, const RunWriteOptions &options)
+        : filename(filename), options(options), fd(-1), direct(false), buffered(0), written(0)
+    {
+        void *memory = nullptr;
+        if (::posix_memalign(&memory, constants::RUN_WRITE_ALIGNMENT, constants::RUN_WRITE_BUFFER_BYTES) != 0)
+        {
+            throw std::runtime_error("Failed to allocate write buffer for run file: " + filename);
+        }
+        buffer.reset(static_cast<char *>(memory));
+
+        int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+#ifdef O_DIRECT
+        if (constants::RUN_WRITE_DIRECT_IO.load())
+        {
+            // File systems without direct I/O (tmpfs, some network mounts) refuse the flag
+            fd = ::open(filename.c_str(), flags | O_DIRECT, 0644);
+            direct = fd >= 0;
+        }
+#endif
+        if (fd < 0)
+        {
+            fd = ::open(filename.c_str(), flags, 0644);
+        }
+        if (fd < 0)
+        {
+            throw std::runtime_error("Failed to create run file: " + filename + ": " + std::strerror(errno));
+        }
+    }
+
+    RunFileWriter::~RunFileWriter()
+    {
+        if (fd >= 0)
+        {
+            ::close(fd);
+        }
+    }
+
+    void RunFileWriter::append(const void *data, size_t size)
+    {
+        const char *bytes = static_cast<const char *>(data);
+        while (size > 0)
+        {
+            size_t chunk = std::min(size, constants::RUN_WRITE_BUFFER_BYTES - buffered);
+            std::memcpy(buffer.get() + buffered, bytes, chunk);
+            buffered += chunk;
+            bytes += chunk;
+            size -= chunk;
+
+            if (buffered == constants::RUN_WRITE_BUFFER_BYTES)
+            {
+                write_buffer(buffered);
+                buffered = 0;
+            }
+        }
+    }
+
+    void RunFileWriter::pad_to(size_t alignment)
+    {
+        static const char zeros[64] = {};
+        size_t padding = (alignment - offset() % alignment) % alignment;
+        while (padding > 0)
+        {
+            size_t chunk = std::min(padding, sizeof(zeros));
+            append(zeros, chunk);
+            padding -= chunk;
+        }
+    }
+
+    uint64_t RunFileWriter::offset() const
+    {
+        return written + buffered;
+    }
+
+    void RunFileWriter::finish()
+    {
+        // Direct writes must be whole aligned blocks; the tail goes through the page cache
+#ifdef O_DIRECT
+        if (direct && buffered % constants::RUN_WRITE_ALIGNMENT != 0)
+        {
+            int flags = ::fcntl(fd, F_GETFL);
+            if (flags < 0 || ::fcntl(fd, F_SETFL, flags & ~O_DIRECT) < 0)
+            {
+                throw std::runtime_error("Failed to finish run file: " + filename + ": " + std::strerror(errno));
+            }
+            direct = false;
+        }
+#endif
+        write_buffer(buffered);
+        buffered = 0;
+
+#if defined(__APPLE__)
+        int synced = ::fsync(fd);
+#else
+        int synced = ::fdatasync(fd);
+#endif
+        if (synced != 0)
+        {
+            throw std::runtime_error("Failed to sync run file: " + filename + ": " + std::strerror(errno));
+        }
+
+#ifdef POSIX_FADV_DONTNEED
+        if (options.drop_cache)
+        {
+            // Clean pages only, which they all are once synced
+            ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        }
+#endif
+
+        int result = ::close(fd);
+        fd = -1;
+        if (result != 0)
+        {
+            throw std::runtime_error("Failed to close run file: " + filename + ": " + std::strerror(errno));
+        }
+    }
+
+    void RunFileWriter::write_buffer(size_t size)
+    {
+        if (options.rate_limiter)
+        {
+            options.rate_limiter->request(size);
+        }
+
+        size_t done = 0;
+        while (done < size)
+        {
+            ssize_t n = ::pwrite(fd, buffer.get() + done, size - done, static_cast<off_t>(written + done));
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                throw std::runtime_error("Failed to write run file: " + filename + ": " + std::strerror(errno));
+            }
+            done += static_cast<size_t>(n);
+        }
+        written += size;
+    }
+
+}
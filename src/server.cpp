@@ -1,11 +1,14 @@
 #include "../include/server.h"
 #include "../include/lsm_adapter.h"
+#include "../include/protocol.h"
 
 #include <iostream>
 #include <string>
 #include <cstring>
 #include <unistd.h>
+#include <fcntl.h>
 #include <arpa/inet.h>
+#include <netinet/tcp.h>
 #include <sstream>
 #include <vector>
 #include <thread>
@@ -14,12 +17,23 @@
 namespace lsm
 {
 
+    namespace
+    {
+        // Switch a descriptor to non-blocking mode
+        void set_non_blocking(int fd)
+        {
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+        }
+    }
+
+    std::vector<std::string> split_string(const std::string &str);
+
     Server::Server(int port)
         : server_socket(-1),
           port(port),
           running(false)
     {
-        thread_pool = std::make_unique<ThreadPool>(constants::default_thread_count());
+        thread_pool = std::make_unique<ThreadPool>(constants::default_thread_count(), constants::PIN_THREADS.load());
     }
 
     Server::~Server()
@@ -70,17 +84,36 @@ namespace lsm
             close(server_socket);
             throw std::runtime_error("Failed to listen on socket");
         }
+        set_non_blocking(server_socket);
 
         // Initialize the LSM tree adapter before accepting connections
         std::cout << "Pre-initializing LSM tree..." << std::endl;
         LSMAdapter::get_instance(); // This will trigger the adapter's constructor and initialize the tree
         std::cout << "LSM tree ready" << std::endl;
 
+        if (!thread_pool)
+        {
+            thread_pool = std::make_unique<ThreadPool>(constants::default_thread_count(), constants::PIN_THREADS.load());
+        }
+
+        // Set up the I/O threads; the first one watches the listening socket
+        for (size_t i = 0; i < std::max<size_t>(constants::IO_THREAD_COUNT, 1); ++i)
+        {
+            auto io = std::make_unique<IOThread>();
+            io->loop = std::make_unique<EventLoop>();
+            io_threads.push_back(std::move(io));
+        }
+        io_threads[0]->loop->add(server_socket);
+
         running.store(true);
-        std::cout << "Server started on port " << port << std::endl;
+        std::cout << "Server started on port " << port << " with " << io_threads.size() << " I/O threads" << std::endl;
 
-        // Start connection handling thread
-        connection_thread = std::make_unique<std::thread>(&Server::handle_connections, this);
+        for (auto &io : io_threads)
+        {
+            IOThread *thread_state = io.get();
+            io->thread = std::thread([this, thread_state]
+                                     { run_io_thread(*thread_state); });
+        }
     }
 
     void Server::stop()
@@ -93,64 +126,125 @@ namespace lsm
         std::cout << "Stopping server..." << std::endl;
         running.store(false);
 
-        // Close the server socket to unblock the accept() call
+        // Wake the I/O threads so they notice and exit
+        for (auto &io : io_threads)
+        {
+            io->loop->wake();
+        }
+        for (auto &io : io_threads)
+        {
+            if (io->thread.joinable())
+            {
+                io->thread.join();
+            }
+        }
+
+        // Close the server socket
         if (server_socket != -1)
         {
             close(server_socket);
             server_socket = -1;
         }
 
-        // First, close all client sockets to unblock recv() calls
+        // Close every connection, including ones not yet adopted by their thread
+        for (auto &io : io_threads)
         {
-            std::lock_guard<std::mutex> lock(clients_mutex);
-            for (auto &client : clients)
+            for (auto &connection : io->incoming)
+            {
+                io->connections[connection->fd] = connection;
+            }
+            io->incoming.clear();
+
+            std::vector<std::shared_ptr<Connection>> connections;
+            for (auto &entry : io->connections)
+            {
+                connections.push_back(entry.second);
+            }
+            for (auto &connection : connections)
             {
-                std::cout << "Closing client socket: " << client.first << std::endl;
-                shutdown(client.first, SHUT_RDWR); // Properly shutdown the socket
-                close(client.first);
+                close_connection(*io, connection);
             }
         }
 
-        // Wait for the connection handling thread to finish with a short timeout
-        if (connection_thread && connection_thread->joinable())
-        {
-            std::cout << "Waiting for connection thread to finish..." << std::endl;
+        // Let running commands finish before the tree goes away
+        thread_pool.reset();
+        io_threads.clear();
 
-            // Use a detached thread to join with timeout
-            std::thread join_thread([this]()
-                                    {
-                if (connection_thread->joinable()) {
-                    connection_thread->join();
-                } });
+        // Make sure the LSM tree is properly shut down
+        std::cout << "Shutting down LSM adapter..." << std::endl;
+        LSMAdapter::get_instance().shutdown();
 
-            // Wait briefly and detach
-            join_thread.detach();
-            std::this_thread::sleep_for(std::chrono::seconds(1));
-        }
+        std::cout << "Server stopped" << std::endl;
+    }
 
-        // IMPORTANT: Detach client threads instead of joining them
-        // This prevents the server from hanging if clients are stuck
+    void Server::run_io_thread(IOThread &io)
+    {
+        std::vector<EventLoop::Event> events;
+
+        while (running.load())
         {
-            std::lock_guard<std::mutex> lock(clients_mutex);
-            for (auto &client : clients)
+            try
+            {
+                io.loop->wait(events, constants::EVENT_LOOP_TIMEOUT_MS);
+            }
+            catch (const std::exception &e)
+            {
+                std::cerr << e.what() << std::endl;
+                continue;
+            }
+
+            // Pick up connections and pending writes handed over by other threads
+            std::vector<std::shared_ptr<Connection>> incoming;
+            std::vector<std::shared_ptr<Connection>> write_requests;
             {
-                std::cout << "Detaching client thread for socket: " << client.first << std::endl;
-                if (client.second && client.second->joinable())
+                std::lock_guard<std::mutex> lock(io.mutex);
+                incoming.swap(io.incoming);
+                write_requests.swap(io.write_requests);
+            }
+
+            for (auto &connection : incoming)
+            {
+                io.connections[connection->fd] = connection;
+                io.loop->add(connection->fd);
+            }
+
+            for (auto &connection : write_requests)
+            {
+                std::lock_guard<std::mutex> lock(connection->mutex);
+                if (!connection->closed)
                 {
-                    client.second->detach();
+                    io.loop->set_writable(connection->fd, true);
                 }
             }
-            clients.clear();
-        }
 
-        // Make sure the LSM tree is properly shut down
-        std::cout << "Shutting down LSM adapter..." << std::endl;
-        LSMAdapter::get_instance().shutdown();
+            for (const auto &event : events)
+            {
+                if (event.fd == server_socket)
+                {
+                    accept_connections();
+                    continue;
+                }
 
-        std::cout << "Server stopped" << std::endl;
+                auto it = io.connections.find(event.fd);
+                if (it == io.connections.end())
+                {
+                    continue;
+                }
+                std::shared_ptr<Connection> connection = it->second;
+
+                if (event.writable)
+                {
+                    handle_writable(io, connection);
+                }
+                if (event.readable || event.error)
+                {
+                    handle_readable(io, connection);
+                }
+            }
+        }
     }
 
-    void Server::handle_connections()
+    void Server::accept_connections()
     {
         while (running.load())
         {
@@ -161,273 +255,663 @@ namespace lsm
             int client_socket = accept(server_socket, (struct sockaddr *)&client_addr, &client_addr_len);
             if (client_socket < 0)
             {
-                if (running.load())
+                if (errno == EINTR)
                 {
-                    std::cerr << "Failed to accept connection: " << strerror(errno) << std::endl;
+                    continue;
                 }
-                continue;
-            }
-
-            // Check if we've reached the maximum number of clients
-            {
-                std::lock_guard<std::mutex> lock(clients_mutex);
-                if (clients.size() >= constants::MAX_CLIENTS)
+                if (errno != EAGAIN && errno != EWOULDBLOCK)
                 {
-                    std::string error_msg = "Server is full, try again later\r\n";
-                    send(client_socket, error_msg.c_str(), error_msg.length(), 0);
-                    close(client_socket);
-                    continue;
+                    std::cerr << "Failed to accept connection: " << strerror(errno) << std::endl;
                 }
+                return;
             }
 
+            set_non_blocking(client_socket);
+            int no_delay = 1;
+            setsockopt(client_socket, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+
             // Log new connection
             char client_ip[INET_ADDRSTRLEN];
             inet_ntop(AF_INET, &client_addr.sin_addr, client_ip, INET_ADDRSTRLEN);
             std::cout << "New connection from: " << client_ip << ":" << ntohs(client_addr.sin_port)
                       << " (socket: " << client_socket << ")" << std::endl;
 
-            // Create a thread to handle this client
+            // Spread connections over the I/O threads round-robin
+            auto connection = std::make_shared<Connection>();
+            connection->fd = client_socket;
+            connection->owner = io_threads[next_io_thread++ % io_threads.size()].get();
+
+            // Send a welcome message confirming the LSM tree is ready
+            queue_output(connection, "LSM-Tree ready and waiting for commands" + std::string(constants::CMD_DELIMITER));
+
             {
-                std::lock_guard<std::mutex> lock(clients_mutex);
-                clients[client_socket] = std::make_unique<std::thread>(&Server::handle_client, this, client_socket);
+                std::lock_guard<std::mutex> lock(connection->owner->mutex);
+                connection->owner->incoming.push_back(connection);
             }
+            connection->owner->loop->wake();
         }
     }
 
-    void Server::handle_client(int client_socket)
+    void Server::handle_readable(IOThread &io, const std::shared_ptr<Connection> &connection)
     {
-        char buffer[constants::BUFFER_SIZE];
-        std::string command_buffer;
-
-        // Send a welcome message confirming the LSM tree is ready
-        std::string welcome_msg = "LSM-Tree ready and waiting for commands" + std::string(constants::CMD_DELIMITER);
-        ssize_t welcome_sent = send(client_socket, welcome_msg.c_str(), welcome_msg.length(), 0);
-        if (welcome_sent < 0)
         {
-            std::cerr << "Error sending welcome message: " << strerror(errno) << std::endl;
-            goto cleanup;
+            std::lock_guard<std::mutex> lock(connection->mutex);
+            if (connection->closed)
+            {
+                return;
+            }
         }
 
-        std::cout << "Sent welcome message to client " << client_socket << " (" << welcome_sent << " bytes)" << std::endl;
+        char buffer[constants::PROTOCOL_READ_BUFFER_SIZE];
 
-        while (running.load())
+        // Drain the socket; level triggering brings us back if more arrives later
+        while (true)
         {
-            std::cout << "Waiting for command from client " << client_socket << "..." << std::endl;
-            std::memset(buffer, 0, constants::BUFFER_SIZE);
-            ssize_t bytes_read = recv(client_socket, buffer, constants::BUFFER_SIZE - 1, 0);
-
-            if (bytes_read < 0)
+            ssize_t bytes_read = recv(connection->fd, buffer, sizeof(buffer), 0);
+            if (bytes_read > 0)
             {
-                if (errno == EINTR && running.load())
+                connection->input.append(buffer, bytes_read);
+                if (static_cast<size_t>(bytes_read) < sizeof(buffer))
                 {
-                    // Interrupted system call, try again if still running
-                    continue;
+                    break;
                 }
-                std::cerr << "Error receiving from client " << client_socket << ": " << strerror(errno) << std::endl;
+                continue;
+            }
+
+            if (bytes_read < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (bytes_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
                 break;
             }
 
-            if (bytes_read == 0)
+            if (bytes_read < 0)
+            {
+                std::cerr << "Error receiving from client " << connection->fd << ": " << strerror(errno) << std::endl;
+            }
+            else
+            {
+                std::cout << "Client " << connection->fd << " closed connection" << std::endl;
+            }
+            close_connection(io, connection);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(connection->mutex);
+            if (connection->close_after_write)
+            {
+                // Ignore anything sent after the client asked to disconnect
+                connection->input.clear();
+                return;
+            }
+        }
+
+        if (!connection->binary)
+        {
+            parse_text_commands(connection);
+        }
+
+        if (connection->binary && !parse_binary_requests(connection))
+        {
+            close_connection(io, connection);
+        }
+    }
+
+    void Server::handle_writable(IOThread &io, const std::shared_ptr<Connection> &connection)
+    {
+        bool close_now = false;
+        {
+            std::lock_guard<std::mutex> lock(connection->mutex);
+            if (connection->closed)
+            {
+                return;
+            }
+
+            if (!flush_output(*connection))
+            {
+                close_now = true;
+            }
+            else if (connection->output.empty())
+            {
+                // Everything is written; stop watching for writability
+                connection->write_pending = false;
+                io.loop->set_writable(connection->fd, false);
+                close_now = connection->close_after_write;
+            }
+        }
+
+        if (close_now)
+        {
+            close_connection(io, connection);
+        }
+    }
+
+    void Server::close_connection(IOThread &io, const std::shared_ptr<Connection> &connection)
+    {
+        {
+            std::lock_guard<std::mutex> lock(connection->mutex);
+            if (connection->closed)
             {
-                std::cout << "Client " << client_socket << " closed connection" << std::endl;
+                return;
+            }
+
+            // Workers check `closed` under the same mutex, so none can write to a reused descriptor
+            connection->closed = true;
+            connection->output.clear();
+            io.loop->remove(connection->fd);
+            close(connection->fd);
+        }
+
+        io.connections.erase(connection->fd);
+        std::cout << "Client " << connection->fd << " disconnected" << std::endl;
+    }
+
+    void Server::parse_text_commands(const std::shared_ptr<Connection> &connection)
+    {
+        std::vector<std::string> commands;
+
+        // Extract complete commands (delimited by \r\n)
+        size_t start = 0;
+        size_t delimiter_pos;
+        const size_t delimiter_length = strlen(constants::CMD_DELIMITER);
+        while ((delimiter_pos = connection->input.find(constants::CMD_DELIMITER, start)) != std::string::npos)
+        {
+            commands.push_back(connection->input.substr(start, delimiter_pos - start));
+            start = delimiter_pos + delimiter_length;
+
+            // Everything after a switch to binary is binary frames
+            if (commands.back() == constants::CMD_BINARY)
+            {
+                connection->binary = true;
                 break;
             }
+        }
+        connection->input.erase(0, start);
+
+        if (commands.empty())
+        {
+            return;
+        }
+
+        // Bulk loads run behind the requests of other clients
+        bool has_load = false;
+        for (const auto &command : commands)
+        {
+            has_load = has_load || (!command.empty() && command[0] == constants::CMD_LOAD);
+        }
+
+        bool start_worker = false;
+        {
+            std::lock_guard<std::mutex> lock(connection->mutex);
+            for (auto &command : commands)
+            {
+                connection->text_commands.push_back(std::move(command));
+            }
+            if (!connection->text_worker_active)
+            {
+                connection->text_worker_active = true;
+                start_worker = true;
+            }
+        }
+
+        if (start_worker)
+        {
+            thread_pool->submit([this, connection]
+                                { run_text_commands(connection); },
+                                has_load ? ThreadPool::Priority::BACKGROUND : ThreadPool::Priority::FOREGROUND);
+        }
+    }
+
+    bool Server::parse_binary_requests(const std::shared_ptr<Connection> &connection)
+    {
+        std::vector<protocol::Request> requests;
+        size_t offset = 0;
+        try
+        {
+            protocol::Request request;
+            while (size_t consumed = protocol::decode_request(connection->input.data() + offset,
+                                                              connection->input.size() - offset, request))
+            {
+                offset += consumed;
+                requests.push_back(std::move(request));
+            }
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Malformed request from client " << connection->fd << ": " << e.what() << std::endl;
+            return false;
+        }
+        connection->input.erase(0, offset);
+
+        if (requests.empty())
+        {
+            return true;
+        }
+
+        // Bulk loads run behind the requests of other clients
+        bool has_load = false;
+        for (const auto &request : requests)
+        {
+            has_load = has_load || (request.opcode == protocol::Opcode::TEXT && !request.text.empty() &&
+                                    request.text[0] == constants::CMD_LOAD);
+        }
+        auto priority = has_load ? ThreadPool::Priority::BACKGROUND : ThreadPool::Priority::FOREGROUND;
 
-            std::cout << "Read " << bytes_read << " bytes from client " << client_socket << std::endl;
+        bool start_worker = false;
+        {
+            std::lock_guard<std::mutex> lock(connection->mutex);
+            connection->binary_batches.push_back(std::move(requests));
+            start_worker = claim_binary_worker(*connection);
+        }
 
-            // Add received data to the command buffer
-            command_buffer.append(buffer, bytes_read);
+        // Batches of a connection prefer one worker, which keeps its buffers in that cache
+        if (start_worker)
+        {
+            thread_pool->submit([this, connection]
+                                { run_binary_requests(connection); },
+                                priority, static_cast<size_t>(connection->fd));
+        }
+        return true;
+    }
 
-            std::cout << "Command buffer now contains: '" << command_buffer << "'" << std::endl;
+    bool Server::claim_binary_worker(Connection &connection)
+    {
+        if (connection.binary_worker_active || connection.text_worker_active || connection.binary_batches.empty())
+        {
+            return false;
+        }
+        connection.binary_worker_active = true;
+        return true;
+    }
 
-            // Process complete commands (delimited by \r\n)
-            size_t delimiter_pos;
-            while ((delimiter_pos = command_buffer.find(constants::CMD_DELIMITER)) != std::string::npos)
+    void Server::run_binary_requests(const std::shared_ptr<Connection> &connection)
+    {
+        ShardedLSMTree &tree = *LSMAdapter::get_instance().get_tree();
+        std::string out;
+        while (true)
+        {
+            std::vector<protocol::Request> requests;
             {
-                // Extract the command
-                std::string command = command_buffer.substr(0, delimiter_pos);
-                command_buffer.erase(0, delimiter_pos + strlen(constants::CMD_DELIMITER));
+                std::lock_guard<std::mutex> lock(connection->mutex);
+                if (connection->binary_batches.empty() || connection->closed)
+                {
+                    connection->binary_worker_active = false;
+                    return;
+                }
+                requests = std::move(connection->binary_batches.front());
+                connection->binary_batches.pop_front();
+            }
 
-                std::cout << "Extracted command: '" << command << "', remaining buffer: '" << command_buffer << "'" << std::endl;
+            out.clear();
+            for (const auto &request : requests)
+            {
+                process_binary_request(tree, connection, request, out);
+            }
+            queue_output(connection, out);
+        }
+    }
 
-                // Check for exit command
-                if (command == constants::CMD_EXIT)
+    void Server::run_text_commands(const std::shared_ptr<Connection> &connection)
+    {
+        while (true)
+        {
+            std::string command;
+            bool done = false;
+            bool start_binary = false;
+            {
+                std::lock_guard<std::mutex> lock(connection->mutex);
+                if (connection->text_commands.empty() || connection->closed)
+                {
+                    connection->text_worker_active = false;
+                    start_binary = !connection->closed && claim_binary_worker(*connection);
+                    done = true;
+                }
+                else
                 {
-                    std::cout << "Client requested disconnect (socket: " << client_socket << ")" << std::endl;
-                    goto cleanup;
+                    command = std::move(connection->text_commands.front());
+                    connection->text_commands.pop_front();
                 }
+            }
 
-                // Log received command
-                std::cout << "Received command from client " << client_socket << ": " << command << std::endl;
+            // Binary batches that arrived behind the switch run once the text commands are done
+            if (done)
+            {
+                if (start_binary)
+                {
+                    thread_pool->submit([this, connection]
+                                        { run_binary_requests(connection); },
+                                        ThreadPool::Priority::FOREGROUND, static_cast<size_t>(connection->fd));
+                }
+                return;
+            }
 
-                // Special handling for bulk load commands, which can take a long time
-                if (command.length() > 0 && command[0] == constants::CMD_LOAD)
+            // Check for exit command; close once earlier responses are written
+            if (command == constants::CMD_EXIT)
+            {
+                std::cout << "Client requested disconnect (socket: " << connection->fd << ")" << std::endl;
                 {
-                    // Send an initial acknowledgment
-                    std::string ack_msg = "Processing load command, this may take some time..." + std::string(constants::CMD_DELIMITER);
-                    ssize_t ack_sent = send(client_socket, ack_msg.c_str(), ack_msg.length(), 0);
-                    if (ack_sent < 0)
-                    {
-                        std::cerr << "Error sending load acknowledgment: " << strerror(errno) << std::endl;
-                    }
-                    else
-                    {
-                        std::cout << "Sent load acknowledgment to client " << client_socket << " (" << ack_sent << " bytes)" << std::endl;
-                    }
+                    std::lock_guard<std::mutex> lock(connection->mutex);
+                    connection->close_after_write = true;
+                    connection->text_commands.clear();
+                    connection->text_worker_active = false;
+                }
+                request_write(connection);
+                return;
+            }
 
-                    // Process the bulk load command
-                    std::cout << "Processing bulk load command: '" << command << "'" << std::endl;
-                    std::string response = this->process_command(command);
+            // Switch to the binary protocol for the rest of the connection
+            if (command == constants::CMD_BINARY)
+            {
+                std::cout << "Client " << connection->fd << " switched to the binary protocol" << std::endl;
+                queue_output(connection, constants::BINARY_PROTOCOL_READY + std::string(constants::CMD_DELIMITER));
+                continue;
+            }
 
-                    // Format the response carefully for bulk load completion
-                    std::cout << "Command processed, response: '" << response << "'" << std::endl;
+            // Bulk loads can take a long time, so acknowledge them first
+            if (!command.empty() && command[0] == constants::CMD_LOAD)
+            {
+                queue_output(connection, "Processing load command, this may take some time..." +
+                                             std::string(constants::CMD_DELIMITER));
+            }
 
-                    // Ensure we have some response even for empty results
-                    if (response.empty())
-                    {
-                        response = "File loaded successfully";
-                        std::cout << "Empty response replaced with: '" << response << "'" << std::endl;
-                    }
+            // Range results are sent chunk by chunk as they are merged
+            if (!command.empty() && command[0] == constants::CMD_RANGE && stream_text_range(connection, command))
+            {
+                continue;
+            }
 
-                    // Add an additional newline and delimiter for bulk load operations
-                    if (!response.empty() && response.back() != '\n')
-                    {
-                        response += '\n';
-                    }
-                    response += constants::CMD_DELIMITER;
+            queue_output(connection, format_text_response(command, process_command(command)));
+        }
+    }
+
+    bool Server::stream_text_range(const std::shared_ptr<Connection> &connection, const std::string &command)
+    {
+        // Anything malformed is left to the adapter, which reports the error
+        auto tokens = split_string(command);
+        if (tokens.size() != 3 || tokens[0].size() != 1)
+        {
+            return false;
+        }
 
-                    // Send the response with careful error handling
-                    std::cout << "Sending bulk load response to client " << client_socket << std::endl;
-                    std::cout << "Response length: " << response.length() << " bytes" << std::endl;
+        int64_t start_key;
+        int64_t end_key;
+        try
+        {
+            start_key = std::stoll(tokens[1]);
+            end_key = std::stoll(tokens[2]);
+        }
+        catch (const std::exception &)
+        {
+            return false;
+        }
 
-                    // Send in chunks with careful error handling
-                    const size_t CHUNK_SIZE = 4096;
-                    size_t bytes_sent = 0;
-                    size_t total_bytes = response.length();
+        if (start_key >= end_key)
+        {
+            return false;
+        }
 
-                    while (bytes_sent < total_bytes)
-                    {
-                        size_t chunk_size = std::min(CHUNK_SIZE, total_bytes - bytes_sent);
-                        ssize_t sent = send(client_socket, response.c_str() + bytes_sent, chunk_size, 0);
-
-                        if (sent < 0)
-                        {
-                            if (errno == EINTR && running.load())
-                            {
-                                // Interrupted, try again
-                                continue;
-                            }
-                            std::cerr << "Error sending bulk load response to client " << client_socket << ": "
-                                      << strerror(errno) << std::endl;
-                            goto cleanup;
-                        }
-
-                        bytes_sent += sent;
-                        std::cout << "Sent chunk of " << sent << " bytes, total sent: " << bytes_sent << "/" << total_bytes << std::endl;
-                    }
+        bool any_results = false;
+        try
+        {
+            ShardedLSMTree &tree = *LSMAdapter::get_instance().get_tree();
+            tree.scan(start_key, end_key, constants::RANGE_CHUNK_PAIRS,
+                      [&](const std::vector<KeyValuePair> &chunk)
+                      {
+                          std::string out;
+                          for (const auto &pair : chunk)
+                          {
+                              out += std::to_string(pair.key);
+                              out += ':';
+                              out += std::to_string(pair.value);
+                              out += ' ';
+                          }
+                          queue_output(connection, out);
+                          any_results = true;
+                          return true;
+                      });
+        }
+        catch (const std::exception &e)
+        {
+            // Pairs already sent cannot be taken back; end the line with the error
+            queue_output(connection, std::string("Error: ") + e.what() + constants::CMD_DELIMITER);
+            return true;
+        }
 
-                    std::cout << "Bulk load response fully sent (" << bytes_sent << " bytes total)" << std::endl;
+        queue_output(connection, any_results ? constants::CMD_DELIMITER
+                                             : std::string("No results in range") + constants::CMD_DELIMITER);
+        return true;
+    }
 
-                    // Check if client is still connected after bulk loading
-                    struct timeval tv;
-                    tv.tv_sec = 0;
-                    tv.tv_usec = 0;
+    void Server::queue_output(const std::shared_ptr<Connection> &connection, const std::string &data)
+    {
+        bool needs_owner = false;
+        {
+            std::lock_guard<std::mutex> lock(connection->mutex);
+            if (connection->closed)
+            {
+                return;
+            }
 
-                    fd_set read_fds;
-                    FD_ZERO(&read_fds);
-                    FD_SET(client_socket, &read_fds);
+            connection->output.append(data);
 
-                    int select_result = select(client_socket + 1, &read_fds, NULL, NULL, &tv);
-                    if (select_result > 0)
-                    {
-                        // Socket has data or has been closed
-                        char check_buffer[1];
-                        ssize_t check_bytes = recv(client_socket, check_buffer, 1, MSG_PEEK);
-                        if (check_bytes == 0)
-                        {
-                            std::cout << "Client " << client_socket << " disconnected after bulk load" << std::endl;
-                            goto cleanup;
-                        }
-                    }
+            // The owner is already waiting to write the rest
+            if (connection->write_pending)
+            {
+                return;
+            }
+
+            // On failure the owner sees the error when it next reads
+            if (flush_output(*connection) && !connection->output.empty())
+            {
+                connection->write_pending = true;
+                needs_owner = true;
+            }
+        }
+
+        if (needs_owner)
+        {
+            request_write(connection);
+        }
+    }
+
+    bool Server::flush_output(Connection &connection)
+    {
+        size_t bytes_sent = 0;
+        while (bytes_sent < connection.output.size())
+        {
+            ssize_t sent = send(connection.fd, connection.output.data() + bytes_sent,
+                                connection.output.size() - bytes_sent, MSG_NOSIGNAL);
+            if (sent < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    break;
+                }
+                connection.output.clear();
+                return false;
+            }
+            bytes_sent += sent;
+        }
+
+        connection.output.erase(0, bytes_sent);
+        return true;
+    }
+
+    void Server::request_write(const std::shared_ptr<Connection> &connection)
+    {
+        IOThread *owner = connection->owner;
+        {
+            std::lock_guard<std::mutex> lock(owner->mutex);
+            owner->write_requests.push_back(connection);
+        }
+        owner->loop->wake();
+    }
+
+    std::string Server::format_text_response(const std::string &command, std::string response) const
+    {
+        // Ensure we have some response even for empty results
+        if (response.empty())
+        {
+            if (!command.empty() && command[0] == constants::CMD_GET)
+            {
+                response = "Key not found";
+            }
+            else if (!command.empty() && command[0] == constants::CMD_RANGE)
+            {
+                response = "No results in range";
+            }
+            else if (command.compare(0, 2, constants::CMD_MULTI_GET) == 0)
+            {
+                response = "No keys found";
+            }
+            else if (!command.empty() && command[0] == constants::CMD_LOAD)
+            {
+                response = "File loaded successfully";
+            }
+            else
+            {
+                response = "Operation completed";
+            }
+        }
+
+        // Bulk load responses end with an extra newline before the delimiter
+        if (!command.empty() && command[0] == constants::CMD_LOAD && response.back() != '\n')
+        {
+            response += '\n';
+        }
+
+        // Add delimiter to response if it doesn't have one
+        if (response.find(constants::CMD_DELIMITER) == std::string::npos)
+        {
+            response += constants::CMD_DELIMITER;
+        }
+
+        return response;
+    }
+
+    void Server::process_binary_request(ShardedLSMTree &tree, const std::shared_ptr<Connection> &connection,
+                                        const protocol::Request &request, std::string &out)
+    {
+        protocol::Response response;
+        response.id = request.id;
+        response.opcode = request.opcode;
+
+        // Writes sent with the sync flag return only once they are on disk
+        Durability durability = request.sync ? Durability::SYNC : LSMAdapter::get_instance().get_write_durability();
+
+        try
+        {
+            switch (request.opcode)
+            {
+            case protocol::Opcode::PUT:
+                tree.put(request.key, request.value, durability);
+                break;
+
+            case protocol::Opcode::GET:
+            {
+                auto result = tree.get(request.key);
+                if (result)
+                {
+                    response.value = *result;
                 }
                 else
                 {
-                    // Regular (non-bulk-load) command processing
-                    std::cout << "Processing command: '" << command << "'" << std::endl;
-                    std::string response = this->process_command(command);
-                    std::cout << "Command processed, response: '" << response << "'" << std::endl;
+                    response.status = protocol::Status::NOT_FOUND;
+                }
+                break;
+            }
 
-                    // Ensure we have some response even for empty results
-                    if (response.empty())
-                    {
-                        if (command[0] == constants::CMD_GET)
-                        {
-                            response = "Key not found";
-                        }
-                        else if (command[0] == constants::CMD_RANGE)
-                        {
-                            response = "No results in range";
-                        }
-                        else
-                        {
-                            response = "Operation completed";
-                        }
-                        std::cout << "Empty response replaced with: '" << response << "'" << std::endl;
-                    }
+            case protocol::Opcode::DELETE:
+                tree.remove(request.key, durability);
+                break;
 
-                    // Add delimiter to response if it doesn't have one
-                    if (response.find(constants::CMD_DELIMITER) == std::string::npos)
-                    {
-                        response += constants::CMD_DELIMITER;
-                    }
+            case protocol::Opcode::DELETE_RANGE:
+                if (request.key >= request.value)
+                {
+                    response.status = protocol::Status::ERROR;
+                    response.text = "Start key must be less than end key";
+                    break;
+                }
+                tree.delete_range(request.key, request.value, durability);
+                break;
 
-                    // Send the response
-                    std::cout << "Sending response to client " << client_socket << " for command: " << command << std::endl;
-                    std::cout << "Response length: " << response.length() << " bytes, content: '" << response << "'" << std::endl;
+            case protocol::Opcode::RANGE:
+            {
+                if (request.key >= request.value)
+                {
+                    response.status = protocol::Status::ERROR;
+                    response.text = "Start key must be less than end key";
+                    break;
+                }
 
-                    // Send in smaller chunks to prevent issues with large responses
-                    const size_t CHUNK_SIZE = 4096;
-                    size_t bytes_sent = 0;
-                    size_t total_bytes = response.length();
+                // Hold back each chunk until the next one arrives, so the last chunk can go
+                // out in the final OK response
+                tree.scan(request.key, request.value, constants::RANGE_CHUNK_PAIRS,
+                          [&](const std::vector<KeyValuePair> &chunk)
+                          {
+                              if (!response.pairs.empty())
+                              {
+                                  response.status = protocol::Status::PARTIAL;
+                                  protocol::encode_response(response, out);
+                                  queue_output(connection, out);
+                                  out.clear();
+                                  response.status = protocol::Status::OK;
+                                  response.pairs.clear();
+                              }
+
+                              for (const auto &pair : chunk)
+                              {
+                                  response.pairs.emplace_back(pair.key, pair.value);
+                              }
+                              return true;
+                          });
+                break;
+            }
+
+            case protocol::Opcode::TEXT:
+                response.text = process_command(request.text);
+                break;
 
-                    while (bytes_sent < total_bytes)
+            case protocol::Opcode::MGET:
+            {
+                auto results = tree.multi_get(request.keys);
+                for (size_t i = 0; i < results.size(); ++i)
+                {
+                    if (results[i])
                     {
-                        size_t chunk_size = std::min(CHUNK_SIZE, total_bytes - bytes_sent);
-                        ssize_t sent = send(client_socket, response.c_str() + bytes_sent, chunk_size, 0);
-
-                        if (sent < 0)
-                        {
-                            std::cerr << "Error sending response to client " << client_socket << ": "
-                                      << strerror(errno) << std::endl;
-                            goto cleanup;
-                        }
-
-                        bytes_sent += sent;
-                        std::cout << "Sent chunk of " << sent << " bytes, total sent: " << bytes_sent << "/" << total_bytes << std::endl;
+                        response.pairs.emplace_back(request.keys[i], *results[i]);
                     }
-
-                    std::cout << "Response sent successfully (" << bytes_sent << " bytes total)" << std::endl;
                 }
+                break;
             }
-        }
 
-    cleanup:
-        std::cout << "Cleaning up client connection: " << client_socket << std::endl;
-        // Close socket and remove from clients map
-        close(client_socket);
-
-        {
-            std::lock_guard<std::mutex> lock(clients_mutex);
-            auto it = clients.find(client_socket);
-            if (it != clients.end())
+            case protocol::Opcode::MPUT:
             {
-                std::thread *client_thread = it->second.get();
-                // Detach the thread since we're inside it
-                client_thread->detach();
-                clients.erase(it);
+                std::vector<KeyValuePair> pairs;
+                pairs.reserve(request.pairs.size());
+                for (const auto &pair : request.pairs)
+                {
+                    pairs.emplace_back(pair.first, pair.second);
+                }
+                tree.multi_put(pairs, durability);
+                break;
+            }
             }
         }
-        std::cout << "Client " << client_socket << " disconnected" << std::endl;
+        catch (const std::exception &e)
+        {
+            response.status = protocol::Status::ERROR;
+            response.text = e.what();
+        }
+
+        protocol::encode_response(response, out);
     }
 
     // Helper function to split a string into tokens
@@ -447,7 +931,10 @@ namespace lsm
 
     std::string Server::process_command(const std::string &command)
     {
-        std::cout << "Processing command: " << command << std::endl;
+        if constexpr (constants::DEBUG_LOGGING)
+        {
+            std::cout << "Processing command: " << command << std::endl;
+        }
 
         if (command.empty())
         {
@@ -527,6 +1014,12 @@ namespace lsm
 
         case constants::CMD_STATS:
         {
+            // Machine-readable stats go to the client as they are
+            if (split_string(command).size() > 1)
+            {
+                return LSMAdapter::get_instance().process_command(command);
+            }
+
             try
             {
                 // Log that we're getting stats
@@ -537,7 +1030,7 @@ namespace lsm
                 ss << "LSM-Tree Statistics Summary:" << std::endl;
                 ss << "==========================" << std::endl;
                 ss << "Buffer Size: " << constants::BUFFER_SIZE_BYTES << " bytes" << std::endl;
-                ss << "Size Ratio: " << constants::SIZE_RATIO << std::endl;
+                ss << "Size Ratio: " << constants::SIZE_RATIO.load() << std::endl;
                 ss << "Level Count: " << constants::INITIAL_MAX_LEVEL << std::endl;
                 ss << "==========================" << std::endl;
 
@@ -575,9 +1068,15 @@ namespace lsm
             try
             {
                 // Log that we're sending the command to the LSM adapter
-                std::cout << "Forwarding command to LSM adapter: " << command << std::endl;
+                if constexpr (constants::DEBUG_LOGGING)
+                {
+                    std::cout << "Forwarding command to LSM adapter: " << command << std::endl;
+                }
                 std::string result = LSMAdapter::get_instance().process_command(command);
-                std::cout << "LSM adapter processed command, result length: " << result.length() << " bytes" << std::endl;
+                if constexpr (constants::DEBUG_LOGGING)
+                {
+                    std::cout << "LSM adapter processed command, result length: " << result.length() << " bytes" << std::endl;
+                }
                 return result;
             }
             catch (const std::exception &e)
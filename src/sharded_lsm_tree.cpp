@@ -0,0 +1,656 @@
+#include "../include/sharded_lsm_tree.h"
+#include "../include/thread_pool.h"
+#include "../include/mapped_file.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace lsm
+{
+
+    namespace
+    {
+        // File recording the shard count of a data directory
+        const std::string SHARDS_FILENAME = "SHARDS";
+
+        // Spread keys over the shards; nearby keys land on different shards
+        uint64_t mix_key(int64_t key)
+        {
+            uint64_t x = static_cast<uint64_t>(key) + constants::HASH_GOLDEN_RATIO;
+            x = (x ^ (x >> 30)) * constants::HASH_MIX_MULTIPLIER_1;
+            x = (x ^ (x >> 27)) * constants::HASH_MIX_MULTIPLIER_2;
+            return x ^ (x >> 31);
+        }
+
+        // Pages through one shard's part of a scan
+        struct ShardCursor
+        {
+            LSMTree *shard;
+            int64_t next_key;
+            bool fetched_all = false;
+            std::vector<KeyValuePair> buffer;
+            size_t position = 0;
+
+            bool has_pair() const
+            {
+                return position < buffer.size();
+            }
+
+            // Read the shard's next chunk once the buffer is used up
+            void fill(int64_t end_key, size_t chunk_pairs)
+            {
+                if (has_pair() || fetched_all)
+                {
+                    return;
+                }
+
+                buffer.clear();
+                position = 0;
+                shard->scan(next_key, end_key, chunk_pairs, [this](const std::vector<KeyValuePair> &chunk)
+                            {
+                    buffer = chunk;
+                    return false; });
+
+                if (buffer.empty() || buffer.back().key == INT64_MAX || buffer.back().key + 1 >= end_key)
+                {
+                    fetched_all = true;
+                }
+                else
+                {
+                    next_key = buffer.back().key + 1;
+                }
+            }
+        };
+    }
+
+    ShardedLSMTree::ShardedLSMTree(size_t shard_count, const std::string &data_directory, bool pin_threads)
+        : data_directory(data_directory)
+    {
+        shard_count = std::max<size_t>(shard_count, 1);
+        check_layout(shard_count);
+
+        for (size_t i = 0; i < shard_count; ++i)
+        {
+            shards.push_back(std::make_unique<LSMTree>(shard_directory(i, shard_count)));
+            if (pin_threads)
+            {
+                shards.back()->pin_background_threads(i);
+            }
+        }
+    }
+
+    size_t ShardedLSMTree::shard_count() const
+    {
+        return shards.size();
+    }
+
+    LSMTree &ShardedLSMTree::shard(size_t index) const
+    {
+        if (index >= shards.size())
+        {
+            throw std::out_of_range("Shard " + std::to_string(index) + " does not exist");
+        }
+        return *shards[index];
+    }
+
+    size_t ShardedLSMTree::shard_for_key(int64_t key) const
+    {
+        return shards.size() == 1 ? 0 : static_cast<size_t>(mix_key(key) % shards.size());
+    }
+
+    void ShardedLSMTree::for_each_shard(const std::function<void(LSMTree &)> &fn) const
+    {
+        for (const auto &shard : shards)
+        {
+            fn(*shard);
+        }
+    }
+
+    std::string ShardedLSMTree::shard_directory(size_t index, size_t shard_count) const
+    {
+        // A single shard keeps the layout of an unsharded tree
+        if (shard_count == 1)
+        {
+            return data_directory;
+        }
+        return data_directory + "/shard_" + std::to_string(index);
+    }
+
+    void ShardedLSMTree::put(int64_t key, int64_t value, Durability durability)
+    {
+        shards[shard_for_key(key)]->put(key, value, durability);
+    }
+
+    std::optional<int64_t> ShardedLSMTree::get(int64_t key)
+    {
+        return shards[shard_for_key(key)]->get(key);
+    }
+
+    bool ShardedLSMTree::remove(int64_t key, Durability durability)
+    {
+        return shards[shard_for_key(key)]->remove(key, durability);
+    }
+
+    void ShardedLSMTree::delete_range(int64_t start_key, int64_t end_key, Durability durability)
+    {
+        // Keys are hashed, so every shard may hold part of the range
+        for (auto &shard : shards)
+        {
+            shard->delete_range(start_key, end_key, durability);
+        }
+    }
+
+    std::vector<KeyValuePair> ShardedLSMTree::range(int64_t start_key, int64_t end_key)
+    {
+        if (shards.size() == 1)
+        {
+            return shards[0]->range(start_key, end_key);
+        }
+
+        // Every shard's result is sorted and no key is in two shards, so merging the
+        // results one after another gives the sorted union
+        std::vector<KeyValuePair> results;
+        for (const auto &shard : shards)
+        {
+            auto part = shard->range(start_key, end_key);
+            size_t middle = results.size();
+            results.insert(results.end(), part.begin(), part.end());
+            std::inplace_merge(results.begin(), results.begin() + static_cast<std::ptrdiff_t>(middle), results.end());
+        }
+        return results;
+    }
+
+    void ShardedLSMTree::scan(int64_t start_key, int64_t end_key, size_t chunk_pairs,
+                              const std::function<bool(const std::vector<KeyValuePair> &)> &consumer)
+    {
+        if (shards.size() == 1)
+        {
+            shards[0]->scan(start_key, end_key, chunk_pairs, consumer);
+            return;
+        }
+        if (start_key >= end_key)
+        {
+            return;
+        }
+
+        chunk_pairs = std::max<size_t>(chunk_pairs, 1);
+        std::vector<ShardCursor> cursors;
+        for (const auto &shard : shards)
+        {
+            ShardCursor cursor;
+            cursor.shard = shard.get();
+            cursor.next_key = start_key;
+            cursors.push_back(std::move(cursor));
+        }
+
+        std::vector<KeyValuePair> chunk;
+        chunk.reserve(chunk_pairs);
+        while (true)
+        {
+            for (auto &cursor : cursors)
+            {
+                cursor.fill(end_key, chunk_pairs);
+            }
+
+            // Pairs up to the smallest last key of a shard with more to read can be
+            // merged now; no later chunk of any shard comes before them
+            bool any_pair = false;
+            int64_t bound = INT64_MAX;
+            for (const auto &cursor : cursors)
+            {
+                if (cursor.has_pair())
+                {
+                    any_pair = true;
+                    if (!cursor.fetched_all)
+                    {
+                        bound = std::min(bound, cursor.buffer.back().key);
+                    }
+                }
+            }
+            if (!any_pair)
+            {
+                break;
+            }
+
+            while (true)
+            {
+                ShardCursor *smallest = nullptr;
+                for (auto &cursor : cursors)
+                {
+                    if (cursor.has_pair() && cursor.buffer[cursor.position].key <= bound &&
+                        (!smallest || cursor.buffer[cursor.position].key < smallest->buffer[smallest->position].key))
+                    {
+                        smallest = &cursor;
+                    }
+                }
+                if (!smallest)
+                {
+                    break;
+                }
+
+                chunk.push_back(smallest->buffer[smallest->position++]);
+                if (chunk.size() >= chunk_pairs)
+                {
+                    if (!consumer(chunk))
+                    {
+                        return;
+                    }
+                    chunk.clear();
+                }
+            }
+        }
+
+        if (!chunk.empty())
+        {
+            consumer(chunk);
+        }
+    }
+
+    std::vector<std::optional<int64_t>> ShardedLSMTree::multi_get(const std::vector<int64_t> &keys)
+    {
+        if (shards.size() == 1)
+        {
+            return shards[0]->multi_get(keys);
+        }
+
+        // Positions of the keys of every shard
+        std::vector<std::vector<size_t>> positions(shards.size());
+        for (size_t i = 0; i < keys.size(); ++i)
+        {
+            positions[shard_for_key(keys[i])].push_back(i);
+        }
+
+        std::vector<std::optional<int64_t>> results(keys.size());
+        std::vector<int64_t> shard_keys;
+        for (size_t s = 0; s < shards.size(); ++s)
+        {
+            if (positions[s].empty())
+            {
+                continue;
+            }
+
+            shard_keys.clear();
+            for (size_t position : positions[s])
+            {
+                shard_keys.push_back(keys[position]);
+            }
+
+            auto shard_results = shards[s]->multi_get(shard_keys);
+            for (size_t i = 0; i < positions[s].size(); ++i)
+            {
+                results[positions[s][i]] = shard_results[i];
+            }
+        }
+        return results;
+    }
+
+    void ShardedLSMTree::multi_put(const std::vector<KeyValuePair> &pairs, Durability durability)
+    {
+        if (shards.size() == 1)
+        {
+            shards[0]->multi_put(pairs, durability);
+            return;
+        }
+
+        std::vector<std::vector<KeyValuePair>> parts(shards.size());
+        for (const auto &pair : pairs)
+        {
+            parts[shard_for_key(pair.key)].push_back(pair);
+        }
+        for (size_t s = 0; s < shards.size(); ++s)
+        {
+            if (!parts[s].empty())
+            {
+                shards[s]->multi_put(parts[s], durability);
+            }
+        }
+    }
+
+    void ShardedLSMTree::load_file(const std::string &filepath)
+    {
+        if (shards.size() == 1)
+        {
+            shards[0]->load_file(filepath);
+            return;
+        }
+
+        std::ifstream file(filepath, std::ios::binary);
+        if (!file)
+        {
+            throw std::runtime_error("Failed to open file: " + filepath);
+        }
+
+        // Read key-value pairs in chunks and hand each chunk to the shards
+        const size_t CHUNK_SIZE = 1000;
+        std::vector<KeyValuePair> pairs;
+        pairs.reserve(CHUNK_SIZE);
+
+        int64_t key, value;
+        while (file.read(reinterpret_cast<char *>(&key), sizeof(key)) &&
+               file.read(reinterpret_cast<char *>(&value), sizeof(value)))
+        {
+            pairs.emplace_back(key, value);
+            if (pairs.size() >= CHUNK_SIZE)
+            {
+                multi_put(pairs);
+                pairs.clear();
+            }
+        }
+        multi_put(pairs);
+    }
+
+    void ShardedLSMTree::bulk_load_file(const std::string &filepath)
+    {
+        if (shards.size() == 1)
+        {
+            shards[0]->bulk_load_file(filepath);
+            return;
+        }
+
+        // Map the input once and split it by shard, keeping the order of the pairs within
+        // each part so later duplicates still win. The split is counted and then copied in
+        // parallel; every thread takes one contiguous slice of the file.
+        MappedFile input(filepath);
+        const FilePair *pairs = reinterpret_cast<const FilePair *>(input.data());
+        size_t total_pairs = input.size() / sizeof(FilePair);
+
+        size_t thread_count = std::max<size_t>(1, std::min<size_t>(std::thread::hardware_concurrency(),
+                                                                   total_pairs / constants::RANGE_CHUNK_PAIRS + 1));
+        size_t slice_pairs = (total_pairs + thread_count - 1) / thread_count;
+        auto run_slices = [&](const std::function<void(size_t, size_t, size_t)> &work)
+        {
+            std::vector<std::thread> threads;
+            for (size_t t = 0; t < thread_count; ++t)
+            {
+                size_t begin = std::min(total_pairs, t * slice_pairs);
+                size_t end = std::min(total_pairs, begin + slice_pairs);
+                threads.emplace_back(work, t, begin, end);
+            }
+            for (auto &thread : threads)
+            {
+                thread.join();
+            }
+        };
+
+        // counts[t][s]: pairs of slice t that belong to shard s
+        std::vector<std::vector<size_t>> counts(thread_count, std::vector<size_t>(shards.size(), 0));
+        run_slices([&](size_t t, size_t begin, size_t end)
+                   {
+                       for (size_t i = begin; i < end; ++i)
+                       {
+                           counts[t][shard_for_key(pairs[i].key)]++;
+                       }
+                   });
+
+        // Each slice writes its pairs of a shard after those of the slices before it
+        std::vector<std::vector<FilePair>> parts(shards.size());
+        std::vector<std::vector<size_t>> offsets(thread_count, std::vector<size_t>(shards.size(), 0));
+        for (size_t s = 0; s < shards.size(); ++s)
+        {
+            size_t offset = 0;
+            for (size_t t = 0; t < thread_count; ++t)
+            {
+                offsets[t][s] = offset;
+                offset += counts[t][s];
+            }
+            parts[s].resize(offset);
+        }
+        run_slices([&](size_t t, size_t begin, size_t end)
+                   {
+                       std::vector<size_t> &next = offsets[t];
+                       for (size_t i = begin; i < end; ++i)
+                       {
+                           size_t s = shard_for_key(pairs[i].key);
+                           parts[s][next[s]++] = pairs[i];
+                       }
+                   });
+
+        // Load the parts concurrently; the first failure is reported once all are done.
+        // Each shard holds back only its own compactions while it loads.
+        std::vector<std::thread> loaders;
+        std::vector<std::exception_ptr> errors(shards.size());
+        for (size_t s = 0; s < shards.size(); ++s)
+        {
+            loaders.emplace_back([this, s, &parts, &errors]
+                                 {
+                try
+                {
+                    shards[s]->bulk_load_pairs(parts[s].data(), parts[s].size());
+                }
+                catch (...)
+                {
+                    errors[s] = std::current_exception();
+                }
+                std::vector<FilePair>().swap(parts[s]); });
+        }
+        for (auto &loader : loaders)
+        {
+            loader.join();
+        }
+
+        for (const auto &error : errors)
+        {
+            if (error)
+            {
+                std::rethrow_exception(error);
+            }
+        }
+    }
+
+    void ShardedLSMTree::compact()
+    {
+        for_each_shard([](LSMTree &shard)
+                       { shard.compact(); });
+    }
+
+    void ShardedLSMTree::wait_for_background_work()
+    {
+        for_each_shard([](LSMTree &shard)
+                       { shard.wait_for_background_work(); });
+    }
+
+    size_t ShardedLSMTree::size() const
+    {
+        size_t total = 0;
+        for (const auto &shard : shards)
+        {
+            total += shard->size();
+        }
+        return total;
+    }
+
+    void ShardedLSMTree::print_stats(std::ostream &out) const
+    {
+        if (shards.size() == 1)
+        {
+            shards[0]->print_stats(out);
+            return;
+        }
+
+        for (size_t s = 0; s < shards.size(); ++s)
+        {
+            out << "===== Shard " << s << " (" << shards[s]->get_data_directory() << ") =====" << std::endl;
+            shards[s]->print_stats(out);
+        }
+    }
+
+    void ShardedLSMTree::write_metrics_text(std::ostream &out) const
+    {
+        for (size_t s = 0; s < shards.size(); ++s)
+        {
+            if (shards.size() > 1)
+            {
+                out << "Shard " << s << ":" << std::endl;
+            }
+            shards[s]->get_metrics().write_text(out);
+        }
+    }
+
+    void ShardedLSMTree::write_metrics_json(std::ostream &out) const
+    {
+        if (shards.size() == 1)
+        {
+            shards[0]->write_metrics_json(out);
+            return;
+        }
+
+        out << "{\"shard_count\": " << shards.size() << ", \"shards\": [";
+        for (size_t s = 0; s < shards.size(); ++s)
+        {
+            out << (s > 0 ? ", " : "");
+            shards[s]->write_metrics_json(out);
+        }
+        out << "]}";
+    }
+
+    void ShardedLSMTree::set_size_ratio(size_t ratio)
+    {
+        for_each_shard([ratio](LSMTree &shard)
+                       { shard.set_size_ratio(ratio); });
+    }
+
+    void ShardedLSMTree::set_auto_tuning(bool enabled)
+    {
+        for_each_shard([enabled](LSMTree &shard)
+                       { shard.set_auto_tuning(enabled); });
+    }
+
+    void ShardedLSMTree::set_parallel_lookup(bool enabled)
+    {
+        for_each_shard([enabled](LSMTree &shard)
+                       { shard.set_parallel_lookup(enabled); });
+    }
+
+    void ShardedLSMTree::set_row_cache_capacity(size_t entries)
+    {
+        size_t per_shard = (entries + shards.size() - 1) / shards.size();
+        for_each_shard([per_shard](LSMTree &shard)
+                       { shard.set_row_cache_capacity(per_shard); });
+    }
+
+    size_t ShardedLSMTree::get_read_io_count() const
+    {
+        size_t total = 0;
+        for (const auto &shard : shards)
+        {
+            total += shard->get_read_io_count();
+        }
+        return total;
+    }
+
+    size_t ShardedLSMTree::get_write_io_count() const
+    {
+        size_t total = 0;
+        for (const auto &shard : shards)
+        {
+            total += shard->get_write_io_count();
+        }
+        return total;
+    }
+
+    void ShardedLSMTree::reset_io_stats()
+    {
+        for_each_shard([](LSMTree &shard)
+                       { shard.reset_io_stats(); });
+    }
+
+    double ShardedLSMTree::get_avg_read_time_ms() const
+    {
+        // Weighted by each shard's number of reads
+        double total_ms = 0.0;
+        size_t count = 0;
+        for (const auto &shard : shards)
+        {
+            total_ms += shard->get_avg_read_time_ms() * static_cast<double>(shard->get_read_count());
+            count += shard->get_read_count();
+        }
+        return count > 0 ? total_ms / static_cast<double>(count) : 0.0;
+    }
+
+    double ShardedLSMTree::get_avg_write_time_ms() const
+    {
+        double total_ms = 0.0;
+        size_t count = 0;
+        for (const auto &shard : shards)
+        {
+            total_ms += shard->get_avg_write_time_ms() * static_cast<double>(shard->get_write_count());
+            count += shard->get_write_count();
+        }
+        return count > 0 ? total_ms / static_cast<double>(count) : 0.0;
+    }
+
+    size_t ShardedLSMTree::get_read_count() const
+    {
+        size_t total = 0;
+        for (const auto &shard : shards)
+        {
+            total += shard->get_read_count();
+        }
+        return total;
+    }
+
+    size_t ShardedLSMTree::get_write_count() const
+    {
+        size_t total = 0;
+        for (const auto &shard : shards)
+        {
+            total += shard->get_write_count();
+        }
+        return total;
+    }
+
+    void ShardedLSMTree::reset_timing_stats()
+    {
+        for_each_shard([](LSMTree &shard)
+                       { shard.reset_timing_stats(); });
+    }
+
+    void ShardedLSMTree::check_layout(size_t shard_count) const
+    {
+        fs::create_directories(data_directory);
+        std::string layout_path = data_directory + "/" + SHARDS_FILENAME;
+
+        std::ifstream layout(layout_path);
+        if (layout)
+        {
+            size_t recorded = 0;
+            if (!(layout >> recorded) || recorded == 0)
+            {
+                throw std::runtime_error("Damaged shard layout file: " + layout_path);
+            }
+            if (recorded != shard_count)
+            {
+                throw std::runtime_error("Data directory " + data_directory + " holds " + std::to_string(recorded) +
+                                         " shards, not " + std::to_string(shard_count));
+            }
+            return;
+        }
+
+        // A tree written before the layout file existed is a single unsharded tree
+        if (shard_count > 1)
+        {
+            for (const auto &entry : fs::directory_iterator(data_directory))
+            {
+                std::string name = entry.path().filename().string();
+                if (name.rfind(constants::RUN_FILENAME_PREFIX, 0) == 0 || name.rfind(constants::WAL_FILENAME_PREFIX, 0) == 0)
+                {
+                    throw std::runtime_error("Data directory " + data_directory + " holds an unsharded tree");
+                }
+            }
+        }
+
+        std::ofstream out(layout_path, std::ios::trunc);
+        out << shard_count << std::endl;
+        if (!out)
+        {
+            throw std::runtime_error("Failed to write shard layout file: " + layout_path);
+        }
+    }
+
+}
@@ -3,238 +3,324 @@
 #include <limits>
 #include <algorithm>
 #include <optional>
+#include <new>
+#include <stdexcept>
 
 namespace lsm
 {
 
     // SkipListNode implementation
 
-    SkipListNode::SkipListNode(int64_t key, int64_t value, int height)
-        : key(key), value(value), height(height), next_nodes(height, nullptr)
+    template <typename Traits>
+    BasicSkipListNode<Traits>::BasicSkipListNode(Arena &arena, key_type key, const value_type &value, EntryType type,
+                                                 int height)
+        : key(key), value(arena, value), height(height), type(type)
     {
+        for (int i = 0; i < height; ++i)
+        {
+            new (&next_nodes[i]) std::atomic<BasicSkipListNode *>(nullptr);
+        }
     }
 
-    SkipListNode::SkipListNode(int height)
-        : key(0), value(0), height(height), next_nodes(height, nullptr)
+    template <typename Traits>
+    BasicSkipListNode<Traits> *BasicSkipListNode<Traits>::create(Arena &arena, key_type key, const value_type &value,
+                                                                 EntryType type, int height)
     {
+        void *memory = arena.allocate(allocation_size(height), alignof(BasicSkipListNode));
+        return new (memory) BasicSkipListNode(arena, key, value, type, height);
     }
 
-    int64_t SkipListNode::get_key() const
+    template <typename Traits>
+    BasicSkipListNode<Traits> *BasicSkipListNode<Traits>::create_sentinel(Arena &arena, int height)
+    {
+        return create(arena, key_type{}, value_type{}, EntryType::VALUE, height);
+    }
+
+    template <typename Traits>
+    size_t BasicSkipListNode<Traits>::allocation_size(int height)
+    {
+        return sizeof(BasicSkipListNode) + sizeof(std::atomic<BasicSkipListNode *>) * (height - 1);
+    }
+
+    template <typename Traits>
+    typename BasicSkipListNode<Traits>::key_type BasicSkipListNode<Traits>::get_key() const
     {
         return key;
     }
 
-    int64_t SkipListNode::get_value() const
+    template <typename Traits>
+    typename BasicSkipListNode<Traits>::value_type BasicSkipListNode<Traits>::get_value() const
+    {
+        return value.load();
+    }
+
+    template <typename Traits>
+    typename BasicSkipListNode<Traits>::Pair BasicSkipListNode<Traits>::get_entry() const
     {
-        return value;
+        EntryType entry_type = type.load(std::memory_order_acquire);
+        if (entry_type != EntryType::VALUE)
+        {
+            return Pair(key, value_type{}, entry_type);
+        }
+        return Pair(key, value.load());
     }
 
-    void SkipListNode::set_value(int64_t new_value)
+    template <typename Traits>
+    void BasicSkipListNode<Traits>::set_entry(Arena &arena, const value_type &new_value, EntryType new_type)
     {
-        value = new_value;
+        if (new_type == EntryType::VALUE)
+        {
+            value.store(arena, new_value);
+        }
+        type.store(new_type, std::memory_order_release);
     }
 
-    SkipListNode *SkipListNode::next(int level) const
+    template <typename Traits>
+    BasicSkipListNode<Traits> *BasicSkipListNode<Traits>::next(int level) const
     {
         if (level < 0 || level >= height)
         {
             return nullptr;
         }
-        return next_nodes[level];
+        return next_nodes[level].load(std::memory_order_acquire);
     }
 
-    void SkipListNode::set_next(int level, SkipListNode *node)
+    template <typename Traits>
+    void BasicSkipListNode<Traits>::set_next(int level, BasicSkipListNode *node)
     {
         if (level < 0 || level >= height)
         {
             return;
         }
-        next_nodes[level] = node;
+        next_nodes[level].store(node, std::memory_order_release);
     }
 
-    int SkipListNode::get_height() const
+    template <typename Traits>
+    bool BasicSkipListNode<Traits>::cas_next(int level, BasicSkipListNode *expected, BasicSkipListNode *node)
+    {
+        if (level < 0 || level >= height)
+        {
+            return false;
+        }
+        return next_nodes[level].compare_exchange_strong(expected, node, std::memory_order_acq_rel,
+                                                         std::memory_order_acquire);
+    }
+
+    template <typename Traits>
+    int BasicSkipListNode<Traits>::get_height() const
     {
         return height;
     }
 
     // SkipList implementation
 
-    SkipList::SkipList()
-        : current_size(0), num_elements(0), rng(std::random_device()())
+    template <typename Traits>
+    BasicSkipList<Traits>::BasicSkipList()
+        : num_elements(0), max_height(1), range_tombstones(std::make_shared<const RangeTombstoneSet>())
     {
 
-        // Create sentinel nodes
-        head = std::make_unique<SkipListNode>(constants::MAX_SKIP_LIST_HEIGHT);
-        tail = std::make_unique<SkipListNode>(constants::MAX_SKIP_LIST_HEIGHT);
-
-        // Connect head to tail at all levels
-        for (int i = 0; i < constants::MAX_SKIP_LIST_HEIGHT; ++i)
-        {
-            head->set_next(i, tail.get());
-        }
+        // Create the head sentinel; every level starts out empty
+        head = Node::create_sentinel(arena, constants::MAX_SKIP_LIST_HEIGHT);
     }
 
-    SkipList::~SkipList()
+    template <typename Traits>
+    BasicSkipList<Traits>::~BasicSkipList()
     {
-        // No need for explicit cleanup due to unique_ptr usage
+        // Nodes are freed together with the arena
     }
 
-    void SkipList::insert(int64_t key, int64_t value)
+    template <typename Traits>
+    void BasicSkipList<Traits>::insert(key_type key, const value_type &value, EntryType type)
     {
-        std::lock_guard<std::mutex> lock(skip_list_mutex);
+        // Determine height for the new node and publish it before linking
+        int height = random_height();
+        int current_max = max_height.load(std::memory_order_relaxed);
+        while (height > current_max && !max_height.compare_exchange_weak(current_max, height))
+        {
+        }
 
         // Find nodes that would precede the key at each level
-        std::vector<SkipListNode *> predecessors(constants::MAX_SKIP_LIST_HEIGHT);
-        find_predecessors(key, predecessors);
+        Node *predecessors[constants::MAX_SKIP_LIST_HEIGHT];
+        Node *successors[constants::MAX_SKIP_LIST_HEIGHT];
+        find_predecessors(key, predecessors, successors);
 
         // Check if key already exists
-        SkipListNode *next_node = predecessors[0]->next(0);
-        if (next_node != tail.get() && next_node->get_key() == key)
+        if (successors[0] != nullptr && Traits::equal(successors[0]->get_key(), key))
         {
             // Update existing key's value
-            next_node->set_value(value);
+            successors[0]->set_entry(arena, value, type);
             return;
         }
 
-        // Determine height for the new node
-        int height = random_height();
+        // Create new node
+        Node *new_node = Node::create(arena, key, value, type, height);
 
-        // Calculate size of the new pair
-        size_t pair_size = estimate_pair_size(key, value, height);
+        // Link the bottom level first; once that succeeds the key is visible
+        while (true)
+        {
+            new_node->set_next(0, successors[0]);
+            if (predecessors[0]->cas_next(0, successors[0], new_node))
+            {
+                break;
+            }
 
-        // Create new node
-        auto new_node = new SkipListNode(key, value, height);
+            // Another writer changed the neighbourhood; search again
+            find_predecessors(key, predecessors, successors);
+            if (successors[0] != nullptr && Traits::equal(successors[0]->get_key(), key))
+            {
+                // The same key was inserted concurrently, so update it instead; the
+                // unused node stays in the arena and is counted in the size
+                successors[0]->set_entry(arena, value, type);
+                return;
+            }
+        }
 
-        // Insert the node at each level
-        for (int i = 0; i < height; ++i)
+        // Link the upper levels; these only speed up searches
+        for (int i = 1; i < height; ++i)
         {
-            new_node->set_next(i, predecessors[i]->next(i));
-            predecessors[i]->set_next(i, new_node);
+            while (true)
+            {
+                new_node->set_next(i, successors[i]);
+                if (predecessors[i]->cas_next(i, successors[i], new_node))
+                {
+                    break;
+                }
+                find_predecessors(key, predecessors, successors);
+            }
         }
 
-        // Update size and count
-        current_size += pair_size;
-        num_elements++;
+        // Update count; the size is tracked exactly by the arena
+        num_elements.fetch_add(1, std::memory_order_relaxed);
     }
 
-    std::optional<int64_t> SkipList::get(int64_t key) const
+    template <typename Traits>
+    void BasicSkipList<Traits>::delete_range(key_type start_key, key_type end_key)
     {
-        std::lock_guard<std::mutex> lock(skip_list_mutex);
-
-        // Start at the highest level and work down
-        SkipListNode *current = head.get();
+        if (!Traits::less(start_key, end_key))
+        {
+            return;
+        }
 
-        for (int level = constants::MAX_SKIP_LIST_HEIGHT - 1; level >= 0; --level)
+        // Keys already in the list are newer than older sources but older than the
+        // tombstone, so they are marked deleted here rather than covered by it
+        insert(start_key, value_type{}, EntryType::DELETION);
+        for (Node *current = find_greater_or_equal(start_key);
+             current != nullptr && Traits::less(current->get_key(), end_key); current = current->next(0))
         {
-            // Traverse the current level as far as possible
-            while (current->next(level) != tail.get() && current->next(level)->get_key() < key)
-            {
-                current = current->next(level);
-            }
+            current->set_entry(arena, value_type{}, EntryType::DELETION);
         }
 
-        // Move to the next node at level 0
-        current = current->next(0);
+        // Publish a new set; readers holding the old one keep using it
+        std::lock_guard<std::mutex> lock(range_tombstone_mutex);
+        auto tombstones = std::make_shared<RangeTombstoneSet>(*get_range_tombstones());
+        tombstones->add(RangeTombstone(start_key, end_key));
+        std::atomic_store(&range_tombstones, std::shared_ptr<const RangeTombstoneSet>(std::move(tombstones)));
+        has_range_tombstones.store(true, std::memory_order_release);
+    }
+
+    template <typename Traits>
+    std::optional<typename BasicSkipList<Traits>::Pair> BasicSkipList<Traits>::get(key_type key) const
+    {
+        Node *current = find_greater_or_equal(key);
 
         // Check if we found the key
-        if (current != tail.get() && current->get_key() == key)
+        if (current != nullptr && Traits::equal(current->get_key(), key))
         {
-            return current->get_value();
+            return current->get_entry();
         }
 
         // Key not found
         return std::nullopt;
     }
 
-    std::vector<KeyValuePair> SkipList::range(int64_t start_key, int64_t end_key) const
+    template <typename Traits>
+    std::shared_ptr<const RangeTombstoneSet> BasicSkipList<Traits>::get_range_tombstones() const
     {
-        std::lock_guard<std::mutex> lock(skip_list_mutex);
-
-        std::vector<KeyValuePair> results;
+        return std::atomic_load(&range_tombstones);
+    }
 
-        // Find the node just before or at start_key
-        SkipListNode *current = head.get();
+    template <typename Traits>
+    bool BasicSkipList<Traits>::range_deleted(key_type key) const
+    {
+        return has_range_tombstones.load(std::memory_order_acquire) && get_range_tombstones()->covers(key);
+    }
 
-        for (int level = constants::MAX_SKIP_LIST_HEIGHT - 1; level >= 0; --level)
-        {
-            while (current->next(level) != tail.get() && current->next(level)->get_key() < start_key)
-            {
-                current = current->next(level);
-            }
-        }
+    template <typename Traits>
+    std::vector<typename BasicSkipList<Traits>::Pair> BasicSkipList<Traits>::range(key_type start_key,
+                                                                                key_type end_key) const
+    {
+        std::vector<Pair> results;
 
-        // Move to the next node, which is >= start_key
-        current = current->next(0);
+        // Find the first node >= start_key
+        Node *current = find_greater_or_equal(start_key);
 
         // Collect all nodes until we reach end_key or the end of the list
-        while (current != tail.get() && current->get_key() < end_key)
+        while (current != nullptr && Traits::less(current->get_key(), end_key))
         {
-            results.emplace_back(current->get_key(), current->get_value());
+            results.push_back(current->get_entry());
             current = current->next(0);
         }
 
         return results;
     }
 
-    bool SkipList::is_full() const
+    template <typename Traits>
+    bool BasicSkipList<Traits>::is_full() const
     {
-        std::lock_guard<std::mutex> lock(skip_list_mutex);
-        return current_size >= constants::BUFFER_SIZE_BYTES;
+        return arena.allocated_bytes() >= constants::BUFFER_SIZE_BYTES;
     }
 
-    size_t SkipList::size_bytes() const
+    template <typename Traits>
+    size_t BasicSkipList<Traits>::size_bytes() const
     {
-        std::lock_guard<std::mutex> lock(skip_list_mutex);
-        return current_size;
+        return arena.allocated_bytes();
     }
 
-    size_t SkipList::element_count() const
+    template <typename Traits>
+    size_t BasicSkipList<Traits>::element_count() const
     {
-        std::lock_guard<std::mutex> lock(skip_list_mutex);
-        return num_elements;
+        return num_elements.load(std::memory_order_relaxed);
     }
 
-    void SkipList::clear()
+    template <typename Traits>
+    void BasicSkipList<Traits>::clear()
     {
-        std::lock_guard<std::mutex> lock(skip_list_mutex);
+        // Drop every node at once and start over with a fresh head sentinel
+        arena.reset();
+        head = Node::create_sentinel(arena, constants::MAX_SKIP_LIST_HEIGHT);
 
-        // Create new sentinel nodes
-        head = std::make_unique<SkipListNode>(constants::MAX_SKIP_LIST_HEIGHT);
-        tail = std::make_unique<SkipListNode>(constants::MAX_SKIP_LIST_HEIGHT);
-
-        // Connect head to tail at all levels
-        for (int i = 0; i < constants::MAX_SKIP_LIST_HEIGHT; ++i)
-        {
-            head->set_next(i, tail.get());
-        }
-
-        // Reset size and count
-        current_size = 0;
+        // Reset count
         num_elements = 0;
+        max_height = 1;
+        std::atomic_store(&range_tombstones, std::make_shared<const RangeTombstoneSet>());
+        has_range_tombstones = false;
     }
 
-    std::vector<KeyValuePair> SkipList::get_all_sorted() const
+    template <typename Traits>
+    std::vector<typename BasicSkipList<Traits>::Pair> BasicSkipList<Traits>::get_all_sorted() const
     {
-        std::lock_guard<std::mutex> lock(skip_list_mutex);
-
-        std::vector<KeyValuePair> results;
-        results.reserve(num_elements);
+        std::vector<Pair> results;
+        results.reserve(element_count());
 
         // Start after the head sentinel
-        SkipListNode *current = head->next(0);
+        Node *current = head->next(0);
 
-        // Collect all nodes until we reach the tail sentinel
-        while (current != tail.get())
+        // Collect all nodes until we reach the end of the list
+        while (current != nullptr)
         {
-            results.emplace_back(current->get_key(), current->get_value());
+            results.push_back(current->get_entry());
             current = current->next(0);
         }
 
         return results;
     }
 
-    int SkipList::random_height()
+    template <typename Traits>
+    int BasicSkipList<Traits>::random_height()
     {
+        // Each writer thread draws heights from its own generator
+        thread_local std::mt19937 rng(std::random_device{}());
+
         // Probability distribution based on p = 1/4
         std::geometric_distribution<int> dist(0.75);
 
@@ -242,25 +328,116 @@ namespace lsm
         return std::min(dist(rng) + 1, constants::MAX_SKIP_LIST_HEIGHT);
     }
 
-    void SkipList::find_predecessors(int64_t key, std::vector<SkipListNode *> &predecessors) const
+    template <typename Traits>
+    typename BasicSkipList<Traits>::Node *BasicSkipList<Traits>::find_greater_or_equal(key_type key) const
     {
-        SkipListNode *current = head.get();
+        // Start at the highest level in use and work down
+        Node *current = head;
 
-        for (int level = constants::MAX_SKIP_LIST_HEIGHT - 1; level >= 0; --level)
+        for (int level = max_height.load(std::memory_order_acquire) - 1; level >= 0; --level)
         {
-            while (current->next(level) != tail.get() && current->next(level)->get_key() < key)
+            // Traverse the current level as far as possible
+            Node *next = current->next(level);
+            while (next != nullptr && Traits::less(next->get_key(), key))
             {
-                current = current->next(level);
+                current = next;
+                next = current->next(level);
+            }
+        }
+
+        // The next node at level 0 is the first one >= key
+        return current->next(0);
+    }
+
+    template <typename Traits>
+    void BasicSkipList<Traits>::find_predecessors(key_type key, Node **predecessors, Node **successors) const
+    {
+        Node *current = head;
+
+        for (int level = max_height.load(std::memory_order_acquire) - 1; level >= 0; --level)
+        {
+            Node *next = current->next(level);
+            while (next != nullptr && Traits::less(next->get_key(), key))
+            {
+                current = next;
+                next = current->next(level);
             }
             predecessors[level] = current;
+            successors[level] = next;
+        }
+    }
+
+    // SkipListIterator implementation
+
+    template <typename Traits>
+    BasicSkipListIterator<Traits>::BasicSkipListIterator(std::shared_ptr<const BasicSkipList<Traits>> list,
+                                                         key_type start_key, key_type end_key)
+        : list(std::move(list)), node(nullptr), end_key(end_key),
+          current_pair(key_type{}, typename Traits::value_type{}), has_current(false)
+    {
+        tombstones = this->list->get_range_tombstones();
+        node = this->list->find_greater_or_equal(start_key);
+        load();
+    }
+
+    template <typename Traits>
+    bool BasicSkipListIterator<Traits>::valid() const
+    {
+        return has_current;
+    }
+
+    template <typename Traits>
+    const typename BasicSkipListIterator<Traits>::Pair &BasicSkipListIterator<Traits>::current() const
+    {
+        if (!has_current)
+        {
+            throw std::out_of_range("SkipListIterator is exhausted");
+        }
+        return current_pair;
+    }
+
+    template <typename Traits>
+    void BasicSkipListIterator<Traits>::next()
+    {
+        if (has_current)
+        {
+            node = node->next(0);
+            load();
         }
     }
 
-    size_t SkipList::estimate_pair_size(int64_t key, int64_t value, int height) const
+    template <typename Traits>
+    void BasicSkipListIterator<Traits>::seek(key_type key)
     {
-        // Key + value + next pointers + node overhead
-        return sizeof(key) + sizeof(value) + sizeof(SkipListNode *) * height +
-               sizeof(SkipListNode) - sizeof(std::vector<SkipListNode *>);
+        if (has_current && Traits::less(node->get_key(), key))
+        {
+            node = list->find_greater_or_equal(key);
+            load();
+        }
     }
 
-}
\ No newline at end of file
+    template <typename Traits>
+    const RangeTombstoneSet *BasicSkipListIterator<Traits>::range_tombstones() const
+    {
+        return tombstones.get();
+    }
+
+    template <typename Traits>
+    void BasicSkipListIterator<Traits>::load()
+    {
+        has_current = node != nullptr && Traits::less(node->get_key(), end_key);
+        if (has_current)
+        {
+            current_pair = node->get_entry();
+        }
+    }
+
+    template class BasicSkipListNode<DefaultTraits>;
+    template class BasicSkipList<DefaultTraits>;
+    template class BasicSkipListIterator<DefaultTraits>;
+
+    template class BasicSkipListNode<CompactKeyTraits>;
+    template class BasicSkipList<CompactKeyTraits>;
+    template class BasicSkipListIterator<CompactKeyTraits>;
+
+}
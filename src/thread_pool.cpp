@@ -1,22 +1,66 @@
 #include "../include/thread_pool.h"
 
+#include <algorithm>
+#include <iostream>
+#include <exception>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
 namespace lsm
 {
 
-    ThreadPool::ThreadPool(size_t num_threads)
-        : stop(false)
+    namespace
+    {
+        // Pool and index of the calling worker thread; nullptr on other threads
+        thread_local ThreadPool *current_pool = nullptr;
+        thread_local size_t current_index = 0;
+    }
+
+    bool pin_thread_to_core(std::thread &thread, size_t core)
     {
+#ifdef __linux__
+        size_t cores = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(core % cores, &set);
+        return pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set) == 0;
+#else
+        (void)thread;
+        (void)core;
+        return false;
+#endif
+    }
+
+    ThreadPool::ThreadPool(size_t num_threads, bool pin_workers)
+        : next_worker(0), sleeping(0), stop(false)
+    {
+        num_threads = std::max<size_t>(num_threads, 1);
+        for (auto &count : pending)
+        {
+            count.store(0);
+        }
         for (size_t i = 0; i < num_threads; ++i)
         {
-            workers.emplace_back([this]
-                                 { this->worker_thread(); });
+            queues.push_back(std::make_unique<Worker>());
+        }
+        for (size_t i = 0; i < num_threads; ++i)
+        {
+            workers.emplace_back([this, i]
+                                 { this->worker_thread(i); });
+            if (pin_workers && !pin_thread_to_core(workers.back(), i))
+            {
+                std::cerr << "ThreadPool: could not pin worker " << i << " to a core" << std::endl;
+            }
         }
     }
 
     ThreadPool::~ThreadPool()
     {
         {
-            std::unique_lock<std::mutex> lock(queue_mutex);
+            std::lock_guard<std::mutex> lock(sleep_mutex);
             stop = true;
         }
 
@@ -31,29 +75,150 @@ namespace lsm
         }
     }
 
-    void ThreadPool::worker_thread()
+    size_t ThreadPool::size() const
     {
-        while (true)
+        return workers.size();
+    }
+
+    bool ThreadPool::on_worker_thread() const
+    {
+        return current_pool == this;
+    }
+
+    void ThreadPool::schedule(Task *task, Priority priority, size_t affinity)
+    {
+        size_t level = static_cast<size_t>(priority);
+        bool on_worker = on_worker_thread();
+
+        pending[level].fetch_add(1);
+
+        if (on_worker && (affinity == NO_AFFINITY || affinity % queues.size() == current_index))
+        {
+            // Fast path: the worker's own deque, no lock taken
+            queues[current_index]->local[level].push(task);
+        }
+        else
+        {
+            size_t index = affinity != NO_AFFINITY ? affinity % queues.size()
+                                                   : next_worker.fetch_add(1, std::memory_order_relaxed) % queues.size();
+            Worker &worker = *queues[index];
+            std::lock_guard<std::mutex> lock(worker.inbox_mutex);
+            worker.inbox[level].push_back(task);
+        }
+
+        // A worker increments sleeping before it checks pending, so either it sees this
+        // task or it is seen here and woken
+        if (sleeping.load() > 0)
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            if (affinity != NO_AFFINITY)
+            {
+                // Only the chosen worker is sure to look at its inbox first
+                condition.notify_all();
+            }
+            else
+            {
+                condition.notify_one();
+            }
+        }
+    }
+
+    ThreadPool::Task *ThreadPool::take_from_inbox(Worker &worker, size_t priority)
+    {
+        std::lock_guard<std::mutex> lock(worker.inbox_mutex);
+        auto &inbox = worker.inbox[priority];
+        if (inbox.empty())
+        {
+            return nullptr;
+        }
+        Task *task = inbox.front();
+        inbox.pop_front();
+        return task;
+    }
+
+    ThreadPool::Task *ThreadPool::take(size_t index, size_t priority)
+    {
+        if (pending[priority].load() == 0)
+        {
+            return nullptr;
+        }
+
+        Worker &own = *queues[index];
+        Task *task = own.local[priority].pop();
+        if (!task)
         {
-            std::function<void()> task;
+            task = take_from_inbox(own, priority);
+        }
 
+        // Steal, starting with the next worker so thieves spread over their victims
+        for (size_t i = 1; !task && i < queues.size(); ++i)
+        {
+            Worker &victim = *queues[(index + i) % queues.size()];
+            task = victim.local[priority].steal();
+            if (!task)
             {
-                std::unique_lock<std::mutex> lock(queue_mutex);
+                task = take_from_inbox(victim, priority);
+            }
+        }
 
-                condition.wait(lock, [this]
-                               { return stop || !tasks.empty(); });
+        if (task)
+        {
+            pending[priority].fetch_sub(1);
+        }
+        return task;
+    }
 
-                if (stop && tasks.empty())
+    void ThreadPool::worker_thread(size_t index)
+    {
+        current_pool = this;
+        current_index = index;
+
+        while (true)
+        {
+            Task *task = nullptr;
+            for (size_t priority = 0; priority < PRIORITY_COUNT && !task; ++priority)
+            {
+                task = take(index, priority);
+            }
+
+            if (task)
+            {
+                std::unique_ptr<Task> owned(task);
+                try
                 {
-                    return;
+                    (*owned)();
                 }
+                catch (const std::exception &e)
+                {
+                    std::cerr << "Thread pool task failed: " << e.what() << std::endl;
+                }
+                continue;
+            }
+
+            auto has_work = [this]
+            {
+                return pending[0].load() + pending[1].load() > 0;
+            };
 
-                task = std::move(tasks.front());
-                tasks.pop();
+            // A task counted in pending but not yet queued, or being stolen by another
+            // worker, is found on the next pass
+            if (has_work())
+            {
+                std::this_thread::yield();
+                continue;
             }
 
-            task();
+            std::unique_lock<std::mutex> lock(sleep_mutex);
+            sleeping.fetch_add(1);
+            condition.wait(lock, [this, &has_work]
+                           { return stop || has_work(); });
+            sleeping.fetch_sub(1);
+
+            if (stop && !has_work())
+            {
+                return;
+            }
         }
     }
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,481 @@
+#include "../include/wal.h"
+#include "../include/constants.h"
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+#include <filesystem>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace lsm
+{
+
+    namespace
+    {
+        // Record layout: [key][value][u32 type][u32 checksum], with the key and value as
+        // wide as the traits make them (i64 each by default)
+        template <typename Traits>
+        constexpr size_t RECORD_SIZE = Traits::RECORD_BYTES + 2 * sizeof(uint32_t);
+
+        // Records of LSMWAL01 segments: [i64 key][i64 value][u32 checksum], with INT64_MIN
+        // values for deletions
+        constexpr size_t LEGACY_RECORD_SIZE = 2 * sizeof(int64_t) + sizeof(uint32_t);
+
+        uint32_t record_checksum(int64_t key, int64_t value)
+        {
+            uint64_t hash = static_cast<uint64_t>(key) * constants::HASH_MIX_MULTIPLIER_1;
+            hash ^= static_cast<uint64_t>(value) + constants::HASH_GOLDEN_RATIO + (hash << 6) + (hash >> 2);
+            hash = (hash ^ (hash >> 31)) * constants::HASH_MIX_MULTIPLIER_2;
+            return static_cast<uint32_t>(hash ^ (hash >> 32));
+        }
+
+        uint32_t record_checksum(int64_t key, int64_t value, uint32_t type)
+        {
+            return record_checksum(key, value) ^ (type * static_cast<uint32_t>(constants::HASH_GOLDEN_RATIO));
+        }
+
+        // Checksum of a record of Traits; values wider than a word are hashed down to one
+        template <typename Traits>
+        uint32_t record_checksum(const BasicKeyValuePair<Traits> &pair, uint32_t type)
+        {
+            if constexpr (Traits::INTEGER_VALUES)
+            {
+                return record_checksum(static_cast<int64_t>(pair.key), static_cast<int64_t>(pair.value), type);
+            }
+            else
+            {
+                return record_checksum(static_cast<int64_t>(pair.key),
+                                       static_cast<int64_t>(Traits::value_traits::hash(pair.value)), type);
+            }
+        }
+
+        // Magic that starts a segment of Traits; other record layouts have their own
+        template <typename Traits>
+        constexpr uint64_t segment_magic()
+        {
+            return constants::WAL_FILE_MAGIC ^ (static_cast<uint64_t>(Traits::LAYOUT_ID) << 32);
+        }
+
+        // Write a whole buffer, retrying short writes
+        bool write_fully(int fd, const char *data, size_t size)
+        {
+            while (size > 0)
+            {
+                ssize_t written = ::write(fd, data, size);
+                if (written < 0)
+                {
+                    if (errno == EINTR)
+                    {
+                        continue;
+                    }
+                    return false;
+                }
+                data += written;
+                size -= static_cast<size_t>(written);
+            }
+            return true;
+        }
+
+        // Flush file data to stable storage
+        bool sync_file(int fd)
+        {
+#if defined(__APPLE__)
+            return ::fsync(fd) == 0;
+#else
+            return ::fdatasync(fd) == 0;
+#endif
+        }
+
+        // Make a newly created or deleted directory entry durable
+        void sync_directory(const std::string &directory)
+        {
+            int dir_fd = ::open(directory.c_str(), O_RDONLY | O_CLOEXEC);
+            if (dir_fd >= 0)
+            {
+                ::fsync(dir_fd);
+                ::close(dir_fd);
+            }
+        }
+    }
+
+    template <typename Traits>
+    BasicWriteAheadLog<Traits>::BasicWriteAheadLog(const std::string &directory)
+        : directory(directory),
+          appended_position(0),
+          durable_position(0),
+          commit_in_progress(false),
+          fd(-1),
+          segment_number(0),
+          segment_has_records(false),
+          segment_synced_size(0),
+          stopping(false)
+    {
+    }
+
+    template <typename Traits>
+    BasicWriteAheadLog<Traits>::~BasicWriteAheadLog()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        commit_condition.notify_all();
+        if (committer.joinable())
+        {
+            committer.join();
+        }
+
+        if (fd < 0)
+        {
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        if (failure.empty())
+        {
+            try
+            {
+                commit(lock, appended_position);
+            }
+            catch (const std::exception &e)
+            {
+                std::cerr << "Error: " << e.what() << std::endl;
+            }
+        }
+
+        ::close(fd);
+        if (!segment_has_records)
+        {
+            ::unlink(segment_filename(segment_number).c_str());
+        }
+    }
+
+    template <typename Traits>
+    std::vector<std::vector<typename BasicWriteAheadLog<Traits>::Pair>> BasicWriteAheadLog<Traits>::recover()
+    {
+        std::vector<std::pair<uint64_t, std::string>> segments;
+        for (const auto &entry : fs::directory_iterator(directory))
+        {
+            // Segment files: wal_[number].log
+            std::string filename = entry.path().filename().string();
+            if (filename.find(constants::WAL_FILENAME_PREFIX) == 0 &&
+                filename.size() > constants::WAL_FILENAME_PREFIX.size() + 4 &&
+                filename.substr(filename.size() - 4) == ".log")
+            {
+                std::string number = filename.substr(constants::WAL_FILENAME_PREFIX.size(),
+                                                     filename.size() - constants::WAL_FILENAME_PREFIX.size() - 4);
+                try
+                {
+                    segments.emplace_back(std::stoull(number), entry.path().string());
+                }
+                catch (const std::exception &)
+                {
+                    std::cerr << "Warning: Ignoring unrecognized log file " << filename << std::endl;
+                }
+            }
+        }
+
+        std::sort(segments.begin(), segments.end());
+
+        std::vector<std::vector<Pair>> recovered;
+        uint64_t next_segment = 0;
+        for (const auto &[number, filename] : segments)
+        {
+            next_segment = number + 1;
+
+            // Keep the writes of other configurations sharing the directory
+            auto pairs = read_segment(filename);
+            if (!pairs)
+            {
+                std::cerr << "Warning: Skipping log segment of another record layout: " << filename << std::endl;
+                continue;
+            }
+
+            // Segments without records, such as one whose header was cut short, are dropped
+            if (pairs->empty())
+            {
+                ::unlink(filename.c_str());
+                continue;
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            sealed_segments.push_back(filename);
+            recovered.push_back(std::move(*pairs));
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            open_segment(next_segment);
+        }
+
+        committer = std::thread(&BasicWriteAheadLog::run_committer, this);
+        return recovered;
+    }
+
+    template <typename Traits>
+    uint64_t BasicWriteAheadLog<Traits>::append(const Pair *pairs, size_t count, const std::function<void()> &apply)
+    {
+        constexpr size_t record_size = RECORD_SIZE<Traits>;
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!failure.empty())
+        {
+            throw std::runtime_error(failure);
+        }
+
+        size_t offset = pending.size();
+        pending.resize(offset + count * record_size);
+        char *out = &pending[offset];
+        for (size_t i = 0; i < count; ++i)
+        {
+            uint32_t type = static_cast<uint32_t>(pairs[i].type);
+            uint32_t checksum = record_checksum(pairs[i], type);
+            std::memcpy(out, &pairs[i].key, Traits::KEY_BYTES);
+            std::memcpy(out + Traits::KEY_BYTES, &pairs[i].value, Traits::VALUE_BYTES);
+            std::memcpy(out + Traits::RECORD_BYTES, &type, sizeof(uint32_t));
+            std::memcpy(out + Traits::RECORD_BYTES + sizeof(uint32_t), &checksum, sizeof(uint32_t));
+            out += record_size;
+        }
+
+        appended_position += count * record_size;
+        segment_has_records = segment_has_records || count > 0;
+
+        apply();
+        return appended_position;
+    }
+
+    template <typename Traits>
+    void BasicWriteAheadLog<Traits>::wait_durable(uint64_t position)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        commit(lock, position);
+    }
+
+    template <typename Traits>
+    void BasicWriteAheadLog<Traits>::roll()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (fd < 0)
+        {
+            throw std::runtime_error("Write-ahead log has not been recovered");
+        }
+
+        // The sealed segment must hold everything its memtable received; a failed log is
+        // sealed as it is, so the memtable can still be flushed
+        if (failure.empty())
+        {
+            try
+            {
+                commit(lock, appended_position);
+            }
+            catch (const std::exception &e)
+            {
+                std::cerr << "Error: " << e.what() << std::endl;
+            }
+        }
+        commit_condition.wait(lock, [this]
+                              { return !commit_in_progress; });
+
+        ::close(fd);
+        sealed_segments.push_back(segment_filename(segment_number));
+        open_segment(segment_number + 1);
+    }
+
+    template <typename Traits>
+    void BasicWriteAheadLog<Traits>::release_oldest()
+    {
+        std::string filename;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (sealed_segments.empty())
+            {
+                return;
+            }
+            filename = std::move(sealed_segments.front());
+            sealed_segments.pop_front();
+        }
+
+        ::unlink(filename.c_str());
+    }
+
+    template <typename Traits>
+    void BasicWriteAheadLog<Traits>::commit(std::unique_lock<std::mutex> &lock, uint64_t position)
+    {
+        while (durable_position < position)
+        {
+            if (!failure.empty())
+            {
+                throw std::runtime_error(failure);
+            }
+
+            // Another writer is already syncing; its commit may cover this position too
+            if (commit_in_progress)
+            {
+                commit_condition.wait(lock);
+                continue;
+            }
+
+            // Lead a group commit of everything appended so far
+            commit_in_progress = true;
+            std::string batch;
+            batch.swap(pending);
+            uint64_t target = appended_position;
+            int target_fd = fd;
+            uint64_t synced_size = segment_synced_size;
+
+            lock.unlock();
+            bool ok = write_fully(target_fd, batch.data(), batch.size()) && sync_file(target_fd);
+            int error = errno;
+            if (!ok)
+            {
+                // Drop whatever part of the batch got in, so recovery cannot replay records
+                // their writers were told had failed
+                if (::ftruncate(target_fd, static_cast<off_t>(synced_size)) == 0)
+                {
+                    sync_file(target_fd);
+                }
+            }
+            lock.lock();
+
+            commit_in_progress = false;
+            commit_condition.notify_all();
+
+            if (!ok)
+            {
+                failure = "Failed to commit write-ahead log: " + std::string(std::strerror(error));
+                throw std::runtime_error(failure);
+            }
+            segment_synced_size += batch.size();
+            durable_position = std::max(durable_position, target);
+        }
+    }
+
+    template <typename Traits>
+    void BasicWriteAheadLog<Traits>::run_committer()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!stopping)
+        {
+            commit_condition.wait_for(lock, std::chrono::milliseconds(constants::WAL_SYNC_INTERVAL_MS), [this]
+                                      { return stopping; });
+
+            if (failure.empty() && durable_position < appended_position)
+            {
+                try
+                {
+                    commit(lock, appended_position);
+                }
+                catch (const std::exception &e)
+                {
+                    std::cerr << "Error: " << e.what() << std::endl;
+                }
+            }
+        }
+    }
+
+    template <typename Traits>
+    void BasicWriteAheadLog<Traits>::open_segment(uint64_t number)
+    {
+        std::string filename = segment_filename(number);
+        int new_fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+        if (new_fd < 0)
+        {
+            throw std::runtime_error("Failed to create log segment: " + filename + ": " + std::strerror(errno));
+        }
+
+        uint64_t magic = segment_magic<Traits>();
+        if (!write_fully(new_fd, reinterpret_cast<const char *>(&magic), sizeof(magic)) || !sync_file(new_fd))
+        {
+            int error = errno;
+            ::close(new_fd);
+            throw std::runtime_error("Failed to write log segment: " + filename + ": " + std::strerror(error));
+        }
+        sync_directory(directory);
+
+        fd = new_fd;
+        segment_number = number;
+        segment_has_records = false;
+        segment_synced_size = sizeof(magic);
+    }
+
+    template <typename Traits>
+    std::string BasicWriteAheadLog<Traits>::segment_filename(uint64_t number) const
+    {
+        return directory + "/" + constants::WAL_FILENAME_PREFIX + std::to_string(number) + ".log";
+    }
+
+    template <typename Traits>
+    std::optional<std::vector<typename BasicWriteAheadLog<Traits>::Pair>> BasicWriteAheadLog<Traits>::read_segment(
+        const std::string &filename)
+    {
+        std::vector<Pair> pairs;
+
+        // A crash right after creating a segment can leave it without its magic
+        std::ifstream file(filename, std::ios::binary);
+        uint64_t magic = 0;
+        if (!file.read(reinterpret_cast<char *>(&magic), sizeof(magic)))
+        {
+            return pairs;
+        }
+
+        // Only int64_t keys and values were ever written in the first format
+        constexpr bool legacy_format = Traits::LAYOUT_ID == 0;
+        if (magic != segment_magic<Traits>() && (!legacy_format || magic != constants::WAL_FILE_LEGACY_MAGIC))
+        {
+            return std::nullopt;
+        }
+
+        bool legacy = legacy_format && magic == constants::WAL_FILE_LEGACY_MAGIC;
+        size_t record_size = legacy ? LEGACY_RECORD_SIZE : RECORD_SIZE<Traits>;
+        char record[std::max(RECORD_SIZE<Traits>, LEGACY_RECORD_SIZE)];
+        while (file.read(record, record_size))
+        {
+            Pair pair(typename Traits::key_type{}, typename Traits::value_type{});
+            uint32_t type = static_cast<uint32_t>(EntryType::VALUE);
+            uint32_t checksum;
+            std::memcpy(&pair.key, record, Traits::KEY_BYTES);
+            std::memcpy(&pair.value, record + Traits::KEY_BYTES, Traits::VALUE_BYTES);
+            if (!legacy)
+            {
+                std::memcpy(&type, record + Traits::RECORD_BYTES, sizeof(uint32_t));
+            }
+            std::memcpy(&checksum, record + record_size - sizeof(uint32_t), sizeof(uint32_t));
+
+            // A crash can leave a torn record at the tail; nothing after it was acknowledged
+            bool intact = checksum == record_checksum(pair, type) &&
+                          type <= static_cast<uint32_t>(EntryType::RANGE_DELETION);
+            if constexpr (legacy_format)
+            {
+                if (legacy)
+                {
+                    intact = checksum == record_checksum(pair.key, pair.value);
+                    if (pair.value == INT64_MIN)
+                    {
+                        type = static_cast<uint32_t>(EntryType::DELETION);
+                    }
+                }
+            }
+            if (!intact)
+            {
+                std::cerr << "Warning: Log segment " << filename << " is corrupt after "
+                          << pairs.size() << " records" << std::endl;
+                break;
+            }
+
+            pair.type = static_cast<EntryType>(type);
+            pairs.push_back(pair);
+        }
+
+        return pairs;
+    }
+
+    template class BasicWriteAheadLog<DefaultTraits>;
+    template class BasicWriteAheadLog<CompactKeyTraits>;
+
+}
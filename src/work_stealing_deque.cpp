@@ -0,0 +1,124 @@
+#include "../include/work_stealing_deque.h"
+
+namespace lsm
+{
+
+    WorkStealingDeque::Buffer::Buffer(size_t capacity)
+        : capacity(capacity), mask(capacity - 1), slots(new std::atomic<Task *>[capacity])
+    {
+    }
+
+    WorkStealingDeque::Task *WorkStealingDeque::Buffer::get(int64_t index) const
+    {
+        return slots[static_cast<size_t>(index) & mask].load(std::memory_order_relaxed);
+    }
+
+    void WorkStealingDeque::Buffer::put(int64_t index, Task *task)
+    {
+        slots[static_cast<size_t>(index) & mask].store(task, std::memory_order_relaxed);
+    }
+
+    WorkStealingDeque::WorkStealingDeque(size_t initial_capacity)
+        : top(0), bottom(0)
+    {
+        size_t capacity = 1;
+        while (capacity < initial_capacity)
+        {
+            capacity <<= 1;
+        }
+        buffers.push_back(std::make_unique<Buffer>(capacity));
+        buffer.store(buffers.back().get(), std::memory_order_relaxed);
+    }
+
+    WorkStealingDeque::~WorkStealingDeque()
+    {
+        // Tasks still queued are owned by the deque
+        while (Task *task = pop())
+        {
+            delete task;
+        }
+    }
+
+    void WorkStealingDeque::push(Task *task)
+    {
+        int64_t b = bottom.load(std::memory_order_relaxed);
+        int64_t t = top.load(std::memory_order_acquire);
+        Buffer *current = buffer.load(std::memory_order_relaxed);
+
+        if (b - t > static_cast<int64_t>(current->capacity) - 1)
+        {
+            current = grow(current, t, b);
+        }
+
+        current->put(b, task);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    WorkStealingDeque::Task *WorkStealingDeque::pop()
+    {
+        int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        Buffer *current = buffer.load(std::memory_order_relaxed);
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top.load(std::memory_order_relaxed);
+
+        if (t > b)
+        {
+            // Empty
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        Task *task = current->get(b);
+        if (t == b)
+        {
+            // Last task: race thieves for it
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            {
+                task = nullptr;
+            }
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return task;
+    }
+
+    WorkStealingDeque::Task *WorkStealingDeque::steal()
+    {
+        int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom.load(std::memory_order_acquire);
+
+        if (t >= b)
+        {
+            return nullptr;
+        }
+
+        Task *task = buffer.load(std::memory_order_acquire)->get(t);
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        {
+            return nullptr;
+        }
+        return task;
+    }
+
+    size_t WorkStealingDeque::size() const
+    {
+        int64_t b = bottom.load(std::memory_order_relaxed);
+        int64_t t = top.load(std::memory_order_relaxed);
+        return b > t ? static_cast<size_t>(b - t) : 0;
+    }
+
+    WorkStealingDeque::Buffer *WorkStealingDeque::grow(Buffer *old_buffer, int64_t top_index, int64_t bottom_index)
+    {
+        buffers.push_back(std::make_unique<Buffer>(old_buffer->capacity * 2));
+        Buffer *grown = buffers.back().get();
+        for (int64_t i = top_index; i < bottom_index; ++i)
+        {
+            grown->put(i, old_buffer->get(i));
+        }
+        buffer.store(grown, std::memory_order_release);
+        return grown;
+    }
+
+}
@@ -0,0 +1,540 @@
+#include "../include/sharded_lsm_tree.h"
+#include "../include/metrics.h"
+#include "../include/constants.h"
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+
+// YCSB-style workload driver running against an LSMTree in this process, so the
+// numbers measure the engine without the client, the sockets or the text protocol.
+// The tree lives in ./data, which must not hold a tree that matters.
+
+struct WorkloadConfig
+{
+    size_t records = 1000000;
+    size_t operations = 1000000;
+    size_t threads = 4;
+    size_t shards = 1;
+    std::string distribution = "zipfian";
+    double zipf_theta = 0.99;
+    size_t scan_length = 100;
+    std::string format = "text";
+
+    // Operation mix, as proportions
+    double read = 0.5;
+    double update = 0.5;
+    double insert = 0.0;
+    double scan = 0.0;
+    double read_modify_write = 0.0;
+};
+
+enum OperationType
+{
+    OP_READ,
+    OP_UPDATE,
+    OP_INSERT,
+    OP_SCAN,
+    OP_READ_MODIFY_WRITE,
+    OP_COUNT
+};
+
+const char *operation_names[OP_COUNT] = {"read", "update", "insert", "scan", "read_modify_write"};
+
+void print_usage()
+{
+    std::cerr << "Usage: ycsb_benchmark [OPTIONS]\n"
+              << "Run a YCSB-style workload against an in-process LSM-tree in ./data\n\n"
+              << "Options:\n"
+              << "  --workload NAME          Preset mix: a (50/50 read/update), b (95/5), c (read only),\n"
+              << "                           e (95/5 scan/insert), f (50/50 read/read-modify-write)\n"
+              << "  --records COUNT          Records loaded before the run (default: 1000000)\n"
+              << "  --operations COUNT       Operations in the run phase (default: 1000000)\n"
+              << "  --threads COUNT          Client threads (default: 4)\n"
+              << "  --shards COUNT           Shards the tree is split into (default: 1)\n"
+              << "  --distribution DIST      Key distribution: 'zipfian' or 'uniform' (default: zipfian)\n"
+              << "  --zipf-theta THETA       Zipfian skew (default: 0.99)\n"
+              << "  --read P --update P --insert P --scan P --rmw P\n"
+              << "                           Custom operation mix; proportions are normalized\n"
+              << "  --scan-length COUNT      Keys covered by a scan (default: 100)\n"
+              << "  --format FORMAT          Output format: 'text' or 'json' (default: text)\n"
+              << "  --help                   Display this help message\n";
+}
+
+// Spread record numbers over the key space, so loading in record order is not a sorted load
+int64_t record_key(uint64_t record)
+{
+    uint64_t hash = record * lsm::constants::HASH_GOLDEN_RATIO;
+    hash ^= hash >> 31;
+    // Keep keys non-negative
+    return static_cast<int64_t>(hash >> 1);
+}
+
+// Zipfian record chooser (Gray et al., "Quickly Generating Billion-Record Synthetic
+// Databases"), as in YCSB. Ranks are scrambled so the hot records are spread out.
+class ZipfianGenerator
+{
+public:
+    ZipfianGenerator(uint64_t items, double theta) : items(items), theta(theta)
+    {
+        // zeta(n) costs O(n), once per run
+        zeta_n = zeta(items, theta);
+        double zeta_2 = zeta(2, theta);
+        alpha = 1.0 / (1.0 - theta);
+        eta = (1.0 - std::pow(2.0 / static_cast<double>(items), 1.0 - theta)) / (1.0 - zeta_2 / zeta_n);
+    }
+
+    uint64_t next(std::mt19937_64 &gen) const
+    {
+        double u = std::uniform_real_distribution<double>(0.0, 1.0)(gen);
+        double uz = u * zeta_n;
+        uint64_t rank;
+        if (uz < 1.0)
+        {
+            rank = 0;
+        }
+        else if (uz < 1.0 + std::pow(0.5, theta))
+        {
+            rank = 1;
+        }
+        else
+        {
+            rank = static_cast<uint64_t>(static_cast<double>(items) * std::pow(eta * u - eta + 1.0, alpha));
+        }
+        rank = std::min(rank, items - 1);
+
+        // FNV-1a of the rank
+        uint64_t hash = 0xCBF29CE484222325ULL;
+        for (int i = 0; i < 8; i++)
+        {
+            hash ^= (rank >> (i * 8)) & 0xFF;
+            hash *= 0x100000001B3ULL;
+        }
+        return hash % items;
+    }
+
+private:
+    uint64_t items;
+    double theta;
+    double zeta_n;
+    double alpha;
+    double eta;
+
+    static double zeta(uint64_t n, double theta)
+    {
+        double sum = 0.0;
+        for (uint64_t i = 1; i <= n; i++)
+        {
+            sum += 1.0 / std::pow(static_cast<double>(i), theta);
+        }
+        return sum;
+    }
+};
+
+// Bytes this process read and wrote through system calls, from /proc/self/io
+bool read_process_io(uint64_t &read_bytes, uint64_t &written_bytes)
+{
+    std::ifstream io("/proc/self/io");
+    if (!io)
+    {
+        return false;
+    }
+
+    bool have_read = false;
+    bool have_written = false;
+    std::string name;
+    uint64_t value;
+    while (io >> name >> value)
+    {
+        if (name == "rchar:")
+        {
+            read_bytes = value;
+            have_read = true;
+        }
+        else if (name == "wchar:")
+        {
+            written_bytes = value;
+            have_written = true;
+        }
+    }
+    return have_read && have_written;
+}
+
+bool apply_workload_preset(WorkloadConfig &config, const std::string &name)
+{
+    config.read = config.update = config.insert = config.scan = config.read_modify_write = 0.0;
+    if (name == "a")
+    {
+        config.read = 0.5;
+        config.update = 0.5;
+    }
+    else if (name == "b")
+    {
+        config.read = 0.95;
+        config.update = 0.05;
+    }
+    else if (name == "c")
+    {
+        config.read = 1.0;
+    }
+    else if (name == "e")
+    {
+        config.scan = 0.95;
+        config.insert = 0.05;
+    }
+    else if (name == "f")
+    {
+        config.read = 0.5;
+        config.read_modify_write = 0.5;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+void write_latency_json(std::ostream &out, const lsm::LatencyHistogram::Snapshot &snapshot)
+{
+    out << "{\"count\": " << snapshot.count
+        << ", \"mean_ns\": " << static_cast<uint64_t>(snapshot.mean_ns())
+        << ", \"p50_ns\": " << snapshot.percentile_ns(0.5)
+        << ", \"p95_ns\": " << snapshot.percentile_ns(0.95)
+        << ", \"p99_ns\": " << snapshot.percentile_ns(0.99)
+        << ", \"p999_ns\": " << snapshot.percentile_ns(0.999)
+        << ", \"max_ns\": " << snapshot.max_ns << "}";
+}
+
+int main(int argc, char *argv[])
+{
+    WorkloadConfig config;
+    bool custom_mix = false;
+
+    // Parse command line arguments
+    for (int i = 1; i < argc; i++)
+    {
+        auto next_arg = [&]() -> std::string
+        {
+            if (i + 1 >= argc)
+            {
+                throw std::runtime_error(std::string("Missing value for ") + argv[i]);
+            }
+            return argv[++i];
+        };
+
+        try
+        {
+            if (strcmp(argv[i], "--workload") == 0)
+            {
+                if (!apply_workload_preset(config, next_arg()))
+                {
+                    std::cerr << "Error: unknown workload '" << argv[i] << "'\n";
+                    return 1;
+                }
+            }
+            else if (strcmp(argv[i], "--records") == 0)
+            {
+                config.records = std::max<size_t>(std::stoul(next_arg()), 2);
+            }
+            else if (strcmp(argv[i], "--operations") == 0)
+            {
+                config.operations = std::stoul(next_arg());
+            }
+            else if (strcmp(argv[i], "--threads") == 0)
+            {
+                config.threads = std::max<size_t>(std::stoul(next_arg()), 1);
+            }
+            else if (strcmp(argv[i], "--shards") == 0)
+            {
+                config.shards = std::max<size_t>(std::stoul(next_arg()), 1);
+            }
+            else if (strcmp(argv[i], "--distribution") == 0)
+            {
+                config.distribution = next_arg();
+            }
+            else if (strcmp(argv[i], "--zipf-theta") == 0)
+            {
+                config.zipf_theta = std::stod(next_arg());
+            }
+            else if (strcmp(argv[i], "--scan-length") == 0)
+            {
+                config.scan_length = std::max<size_t>(std::stoul(next_arg()), 1);
+            }
+            else if (strcmp(argv[i], "--format") == 0)
+            {
+                config.format = next_arg();
+            }
+            else if (strcmp(argv[i], "--read") == 0 || strcmp(argv[i], "--update") == 0 ||
+                     strcmp(argv[i], "--insert") == 0 || strcmp(argv[i], "--scan") == 0 ||
+                     strcmp(argv[i], "--rmw") == 0)
+            {
+                // The first custom proportion replaces the default mix
+                if (!custom_mix)
+                {
+                    config.read = config.update = config.insert = config.scan = config.read_modify_write = 0.0;
+                    custom_mix = true;
+                }
+                std::string option = argv[i];
+                double proportion = std::stod(next_arg());
+                (option == "--read" ? config.read : option == "--update" ? config.update
+                                                : option == "--insert"   ? config.insert
+                                                : option == "--scan"     ? config.scan
+                                                                         : config.read_modify_write) = proportion;
+            }
+            else if (strcmp(argv[i], "--help") == 0)
+            {
+                print_usage();
+                return 0;
+            }
+            else
+            {
+                std::cerr << "Unknown option: " << argv[i] << "\n";
+                print_usage();
+                return 1;
+            }
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Error: " << e.what() << "\n";
+            return 1;
+        }
+    }
+
+    double mix[OP_COUNT] = {config.read, config.update, config.insert, config.scan, config.read_modify_write};
+    double mix_total = 0.0;
+    for (double proportion : mix)
+    {
+        mix_total += std::max(proportion, 0.0);
+    }
+    if (mix_total <= 0.0)
+    {
+        std::cerr << "Error: the operation mix is empty\n";
+        return 1;
+    }
+    if (config.distribution != "zipfian" && config.distribution != "uniform")
+    {
+        std::cerr << "Error: distribution must be 'zipfian' or 'uniform'\n";
+        return 1;
+    }
+    if (config.format != "text" && config.format != "json")
+    {
+        std::cerr << "Error: format must be 'text' or 'json'\n";
+        return 1;
+    }
+
+    if (std::filesystem::exists(lsm::constants::DATA_DIRECTORY) &&
+        !std::filesystem::is_empty(lsm::constants::DATA_DIRECTORY))
+    {
+        std::cerr << "Error: ./" << lsm::constants::DATA_DIRECTORY << " is not empty; run the benchmark in a scratch directory\n";
+        return 1;
+    }
+
+    // The tree logs to stdout; send that, and progress, to stderr so stdout holds only the results
+    std::ostream out(std::cout.rdbuf());
+    std::cout.rdbuf(std::cerr.rdbuf());
+
+    std::cerr << "Loading " << config.records << " records..." << std::endl;
+    auto tree = std::make_unique<lsm::ShardedLSMTree>(config.shards);
+
+    // Load phase: the threads insert interleaved slices of the records
+    auto load_start = std::chrono::steady_clock::now();
+    {
+        std::vector<std::thread> loaders;
+        for (size_t t = 0; t < config.threads; t++)
+        {
+            loaders.emplace_back([&, t]
+                                 {
+                for (uint64_t record = t; record < config.records; record += config.threads)
+                {
+                    tree->put(record_key(record), static_cast<int64_t>(record));
+                } });
+        }
+        for (auto &loader : loaders)
+        {
+            loader.join();
+        }
+        tree->wait_for_background_work();
+    }
+    double load_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - load_start).count();
+
+    // Run phase
+    std::cerr << "Running " << config.operations << " operations on " << config.threads << " threads..." << std::endl;
+    std::vector<lsm::LatencyHistogram> latencies(OP_COUNT);
+    std::atomic<uint64_t> next_record{config.records};
+    std::atomic<uint64_t> user_bytes_read{0};
+    std::atomic<uint64_t> user_bytes_written{0};
+    ZipfianGenerator zipfian(config.records, config.zipf_theta);
+    uint64_t io_read_start = 0;
+    uint64_t io_written_start = 0;
+    bool have_io = read_process_io(io_read_start, io_written_start);
+
+    auto run_start = std::chrono::steady_clock::now();
+    {
+        std::vector<std::thread> clients;
+        for (size_t t = 0; t < config.threads; t++)
+        {
+            clients.emplace_back([&, t]
+                                 {
+                std::mt19937_64 gen(0x5EED + t);
+                std::discrete_distribution<int> choose_operation(std::begin(mix), std::end(mix));
+                std::uniform_int_distribution<uint64_t> uniform(0, config.records - 1);
+                uint64_t written = 0;
+                uint64_t read = 0;
+
+                size_t share = config.operations / config.threads + (t < config.operations % config.threads ? 1 : 0);
+                for (size_t i = 0; i < share; i++)
+                {
+                    int operation = choose_operation(gen);
+                    uint64_t record = config.distribution == "zipfian" ? zipfian.next(gen) : uniform(gen);
+                    int64_t key = record_key(record);
+
+                    auto start = lsm::Metrics::Clock::now();
+                    switch (operation)
+                    {
+                    case OP_READ:
+                        read += tree->get(key).has_value() ? sizeof(lsm::KeyValuePair) : 0;
+                        break;
+                    case OP_UPDATE:
+                        tree->put(key, static_cast<int64_t>(i));
+                        written += sizeof(lsm::KeyValuePair);
+                        break;
+                    case OP_INSERT:
+                        tree->put(record_key(next_record++), static_cast<int64_t>(i));
+                        written += sizeof(lsm::KeyValuePair);
+                        break;
+                    case OP_SCAN:
+                    {
+                        // Keys are hashed, so a range of the key space covering scan_length
+                        // records on average
+                        uint64_t width = (static_cast<uint64_t>(INT64_MAX) / config.records) * config.scan_length;
+                        int64_t end = key > INT64_MAX - static_cast<int64_t>(width) ? INT64_MAX : key + static_cast<int64_t>(width);
+                        read += tree->range(key, end).size() * sizeof(lsm::KeyValuePair);
+                        break;
+                    }
+                    case OP_READ_MODIFY_WRITE:
+                    {
+                        auto value = tree->get(key);
+                        read += value.has_value() ? sizeof(lsm::KeyValuePair) : 0;
+                        tree->put(key, value.value_or(0) + 1);
+                        written += sizeof(lsm::KeyValuePair);
+                        break;
+                    }
+                    }
+                    latencies[operation].record(lsm::Metrics::elapsed_ns(start));
+                }
+
+                user_bytes_read += read;
+                user_bytes_written += written; });
+        }
+        for (auto &client : clients)
+        {
+            client.join();
+        }
+    }
+    double run_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - run_start).count();
+
+    // Let the compactions caused by the run finish, so their I/O is counted against it
+    tree->wait_for_background_work();
+    uint64_t io_read_end = 0;
+    uint64_t io_written_end = 0;
+    have_io = have_io && read_process_io(io_read_end, io_written_end);
+
+    uint64_t user_read = user_bytes_read.load();
+    uint64_t user_written = user_bytes_written.load();
+    uint64_t disk_read = have_io ? io_read_end - io_read_start : 0;
+    uint64_t disk_written = have_io ? io_written_end - io_written_start : 0;
+    double read_amplification = have_io && user_read > 0 ? static_cast<double>(disk_read) / static_cast<double>(user_read) : 0.0;
+    double write_amplification = have_io && user_written > 0 ? static_cast<double>(disk_written) / static_cast<double>(user_written) : 0.0;
+
+    if (config.format == "json")
+    {
+        out << std::fixed << std::setprecision(3)
+                  << "{\"config\": {\"records\": " << config.records
+                  << ", \"operations\": " << config.operations
+                  << ", \"threads\": " << config.threads
+                  << ", \"shards\": " << config.shards
+                  << ", \"distribution\": \"" << config.distribution << "\""
+                  << ", \"zipf_theta\": " << config.zipf_theta
+                  << ", \"scan_length\": " << config.scan_length
+                  << ", \"mix\": {";
+        for (int op = 0; op < OP_COUNT; op++)
+        {
+            out << (op > 0 ? ", " : "") << "\"" << operation_names[op] << "\": " << mix[op] / mix_total;
+        }
+        out << "}}, \"load\": {\"seconds\": " << load_seconds
+                  << ", \"ops_per_sec\": " << static_cast<double>(config.records) / load_seconds
+                  << "}, \"run\": {\"seconds\": " << run_seconds
+                  << ", \"ops_per_sec\": " << static_cast<double>(config.operations) / run_seconds
+                  << ", \"latency\": {";
+        bool first = true;
+        for (int op = 0; op < OP_COUNT; op++)
+        {
+            auto snapshot = latencies[op].snapshot();
+            if (snapshot.count == 0)
+            {
+                continue;
+            }
+            out << (first ? "" : ", ") << "\"" << operation_names[op] << "\": ";
+            write_latency_json(out, snapshot);
+            first = false;
+        }
+        out << "}}, \"amplification\": {";
+        if (have_io)
+        {
+            out << "\"user_bytes_read\": " << user_read
+                      << ", \"user_bytes_written\": " << user_written
+                      << ", \"io_bytes_read\": " << disk_read
+                      << ", \"io_bytes_written\": " << disk_written
+                      << ", \"read\": " << read_amplification
+                      << ", \"write\": " << write_amplification;
+        }
+        out << "}, \"tree\": {\"pairs\": " << tree->size() << "}}" << std::endl;
+    }
+    else
+    {
+        out << std::fixed << std::setprecision(1)
+                  << "Load: " << config.records << " records in " << load_seconds << " s ("
+                  << static_cast<double>(config.records) / load_seconds << " ops/s)" << std::endl
+                  << "Run:  " << config.operations << " operations in " << run_seconds << " s ("
+                  << static_cast<double>(config.operations) / run_seconds << " ops/s)" << std::endl;
+        for (int op = 0; op < OP_COUNT; op++)
+        {
+            auto snapshot = latencies[op].snapshot();
+            if (snapshot.count == 0)
+            {
+                continue;
+            }
+            out << "  " << std::left << std::setw(18) << operation_names[op] << std::right
+                      << "count=" << snapshot.count
+                      << ", mean=" << snapshot.mean_ns() / 1000.0
+                      << "us, p50=" << snapshot.percentile_ns(0.5) / 1000.0
+                      << "us, p99=" << snapshot.percentile_ns(0.99) / 1000.0
+                      << "us, p999=" << snapshot.percentile_ns(0.999) / 1000.0
+                      << "us, max=" << snapshot.max_ns / 1000.0 << "us" << std::endl;
+        }
+        if (have_io)
+        {
+            out << std::setprecision(2)
+                      << "Write amplification: " << write_amplification << " (" << disk_written << " bytes written for "
+                      << user_written << ")" << std::endl
+                      << "Read amplification:  " << read_amplification << " (" << disk_read << " bytes read for "
+                      << user_read << ")" << std::endl;
+        }
+        else
+        {
+            out << "Amplification: not available (no /proc/self/io)" << std::endl;
+        }
+    }
+
+    return 0;
+}